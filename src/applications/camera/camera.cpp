@@ -3,6 +3,8 @@
 #include "base/glfw_window.h"
 #include "base/logbook.h"
 #include "omath/mat4.h"
+#include <algorithm>
+#include <cmath>
 #include <sstream>
 #include <iostream>
 #include <string>
@@ -55,6 +57,14 @@ void camera::calculate_fov() {
 	m_frustum.set_fov( m_zoom, width / height, m_nearPlane, m_farPlane );
 }
 
+double camera::get_aspect_ratio() const {
+	return (double)m_window->get_width() / (double)m_window->get_height();
+}
+
+double camera::get_screen_space_factor() const {
+	return (double)m_window->get_height() * 0.5 / std::tan( omath::radians( m_zoom ) * 0.5 );
+}
+
 void camera::calculate_initial_angles() {
 	// Calculate initial yaw and pitch on change of position or target
 	// m_distanceToTarget is float, direction does not need the precision
@@ -108,7 +118,7 @@ void camera::update_camera_vectors() {
 
 // TODO double
 bool camera::on_mouse_move( float x, float y ) {
-	if( !m_window->is_cursor_disabled() )
+	if( !m_input_enabled || !m_window->is_cursor_disabled() )
 		return false;
 	bool handled{ false };
 	// @todo/fixme cursor should center automatically, according to glfw doc, but doesn't
@@ -149,6 +159,13 @@ bool camera::on_mouse_scroll( float xOffset, float yOffset ) {
 // virtual
 bool camera::on_key_pressed( int key, int scancode, int action, int mods ) {
 	bool handled{ false };
+	if( !m_input_enabled ) {
+		if( GLFW_PRESS == action && GLFW_KEY_ESCAPE == key ) {
+			m_window->set_should_close();
+			handled = true;
+		}
+		return handled;
+	}
 	// movement is mirrored between fps and orbiting mode
     if( GLFW_PRESS == action ) {
     	switch( key ) {
@@ -365,6 +382,29 @@ void camera::set_position_and_target( const omath::dvec3 &pos, const omath::dvec
 	calculate_initial_angles();
 }
 
+void camera::set_pose( const omath::dvec3 &pos, const omath::dvec3 &front, const omath::dvec3 &up, const double zoom ) {
+	m_mode = FIRST_PERSON;
+	m_position = pos;
+	m_up = up;
+	// Inverse of the first person branch of update_camera_vectors()
+	m_pitch = omath::degrees( std::asin( std::max( -1.0, std::min( 1.0, front.y ) ) ) );
+	m_yaw = omath::degrees( std::atan2( -front.x, front.z ) );
+	if( zoom != m_zoom ) {
+		m_zoom = zoom;
+		calculate_fov();
+	}
+	update_camera_vectors();
+}
+
+void camera::set_input_enabled( const bool enabled ) {
+	m_input_enabled = enabled;
+	m_isMoving = false;
+}
+
+bool camera::is_input_enabled() const {
+	return m_input_enabled;
+}
+
 const double &camera::get_zoom() const {
 	return m_zoom;
 }
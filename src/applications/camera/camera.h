@@ -67,6 +67,14 @@ public:
 
 	void set_position_and_target( const omath::dvec3 &pos, const omath::dvec3 &target );
 
+	// Places a first person camera, front must be a unit vector. Zoom in degrees. For replays.
+	void set_pose( const omath::dvec3 &pos, const omath::dvec3 &front, const omath::dvec3 &up, const double zoom );
+
+	// Without input, keys and mouse don't move the camera, except escape to close the window.
+	void set_input_enabled( const bool enabled );
+
+	bool is_input_enabled() const;
+
 	void set_mode( const camera_mode mode );
 
 	void set_up( const omath::dvec3 &up );
@@ -86,6 +94,12 @@ public:
 	// Must be called on near/far plane or angle change.
 	void calculate_fov();
 
+	// Width / height of the window.
+	double get_aspect_ratio() const;
+
+	// Pixels covered by one unit of vertical size at distance 1. Projects errors into screen space.
+	double get_screen_space_factor() const;
+
 	// Update camera and movement. Must be called every frame for continous movemnt.
 	void update_moving(const double delta_time);
 
@@ -159,6 +173,8 @@ private:
 	// Switch between wireframe and textured display. Used internally.
 	bool m_wireframe{ false };
 
+	bool m_input_enabled{ true };
+
 	bool on_key_pressed( int key, int scancode, int action, int mods ) override final;
 
 	bool on_mouse_move( float x, float y ) override final;
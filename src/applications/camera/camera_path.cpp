@@ -0,0 +1,118 @@
+
+#include "camera_path.h"
+#include "base/logbook.h"
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+
+namespace orf_n {
+
+static const char CAMERA_PATH_MAGIC[4]{ 'C', 'P', 'T', 'H' };
+static const uint32_t CAMERA_PATH_VERSION{ 1 };
+// Header and pose sizes in the file
+static const uint64_t CAMERA_PATH_HEADER_SIZE{ sizeof( CAMERA_PATH_MAGIC ) + 2 * sizeof( uint32_t ) };
+static const uint64_t CAMERA_PATH_POSE_SIZE{ 4 * sizeof( double ) + 7 * sizeof( float ) };
+
+camera_path::camera_path() {}
+
+camera_path::~camera_path() {}
+
+bool camera_path::load( const std::string &filename ) {
+	m_poses.clear();
+	std::ifstream f{ filename, std::ios::in | std::ios::binary | std::ios::ate };
+	const std::streamoff file_size{ f.is_open() ? static_cast<std::streamoff>( f.tellg() ) : 0 };
+	f.seekg( 0 );
+	char magic[4];
+	uint32_t header[2];
+	f.read( magic, sizeof( magic ) );
+	f.read( reinterpret_cast<char *>( header ), sizeof( header ) );
+	if( !f.good() || !std::equal( magic, magic + 4, CAMERA_PATH_MAGIC ) || header[0] != CAMERA_PATH_VERSION ) {
+		logbook::log_msg( logbook::SCENE, logbook::ERROR, "'" + filename + "' is not a valid camera path." );
+		return false;
+	}
+	// Don't trust the count before allocating
+	if( static_cast<uint64_t>( file_size ) < CAMERA_PATH_HEADER_SIZE + uint64_t( header[1] ) * CAMERA_PATH_POSE_SIZE ) {
+		logbook::log_msg( logbook::SCENE, logbook::ERROR, "Camera path '" + filename + "' is truncated." );
+		return false;
+	}
+	m_poses.resize( header[1] );
+	for( pose &p : m_poses ) {
+		double d[4];
+		float v[7];
+		f.read( reinterpret_cast<char *>( d ), sizeof( d ) );
+		f.read( reinterpret_cast<char *>( v ), sizeof( v ) );
+		p.time = d[0];
+		p.position = omath::dvec3{ d[1], d[2], d[3] };
+		p.front = omath::vec3{ v[0], v[1], v[2] };
+		p.up = omath::vec3{ v[3], v[4], v[5] };
+		p.fov = v[6];
+	}
+	if( !f.good() ) {
+		logbook::log_msg( logbook::SCENE, logbook::ERROR, "Camera path '" + filename + "' is truncated." );
+		m_poses.clear();
+		return false;
+	}
+	logbook::log_msg( logbook::SCENE, logbook::INFO, "Camera path '" + filename + "' with " +
+			std::to_string( m_poses.size() ) + " poses loaded." );
+	return true;
+}
+
+bool camera_path::save( const std::string &filename ) const {
+	std::ofstream f{ filename, std::ios::out | std::ios::binary | std::ios::trunc };
+	const uint32_t header[]{ CAMERA_PATH_VERSION, (uint32_t)m_poses.size() };
+	f.write( CAMERA_PATH_MAGIC, sizeof( CAMERA_PATH_MAGIC ) );
+	f.write( reinterpret_cast<const char *>( header ), sizeof( header ) );
+	for( const pose &p : m_poses ) {
+		const double d[]{ p.time, p.position.x, p.position.y, p.position.z };
+		const float v[]{ p.front.x, p.front.y, p.front.z, p.up.x, p.up.y, p.up.z, p.fov };
+		f.write( reinterpret_cast<const char *>( d ), sizeof( d ) );
+		f.write( reinterpret_cast<const char *>( v ), sizeof( v ) );
+	}
+	if( !f.good() ) {
+		logbook::log_msg( logbook::SCENE, logbook::ERROR, "Error writing camera path '" + filename + "'." );
+		return false;
+	}
+	logbook::log_msg( logbook::SCENE, logbook::INFO, "Camera path '" + filename + "' with " +
+			std::to_string( m_poses.size() ) + " poses written." );
+	return true;
+}
+
+void camera_path::add( const pose &p ) {
+	m_poses.push_back( p );
+}
+
+void camera_path::clear() {
+	m_poses.clear();
+}
+
+const std::vector<camera_path::pose> &camera_path::get_poses() const {
+	return m_poses;
+}
+
+camera_path::pose camera_path::get_pose_at( const double t ) const {
+	if( m_poses.empty() )
+		return pose{};
+	if( t <= m_poses.front().time )
+		return m_poses.front();
+	if( t >= m_poses.back().time )
+		return m_poses.back();
+	const auto next{ std::upper_bound( m_poses.begin(), m_poses.end(), t,
+			[]( const double time, const pose &p ) { return time < p.time; } ) };
+	const pose &b{ *next };
+	const pose &a{ *( next - 1 ) };
+	const double f{ b.time > a.time ? ( t - a.time ) / ( b.time - a.time ) : 0.0 };
+	const float ff{ (float)f };
+	pose p;
+	p.time = t;
+	p.position = a.position + ( b.position - a.position ) * f;
+	p.front = omath::normalize( a.front + ( b.front - a.front ) * ff );
+	p.up = omath::normalize( a.up + ( b.up - a.up ) * ff );
+	p.fov = a.fov + ( b.fov - a.fov ) * ff;
+	return p;
+}
+
+double camera_path::get_duration() const {
+	return m_poses.empty() ? 0.0 : m_poses.back().time - m_poses.front().time;
+}
+
+}
@@ -0,0 +1,42 @@
+
+/* A camera flight path: pose and timestamp per frame, stored in a compact binary file.
+ * Layout: magic "CPTH", uint32 version, uint32 number of poses, then per pose the time and position
+ * as doubles and front, up and the vertical fov in degrees as floats, little endian. */
+
+#pragma once
+
+#include "omath/vec3.h"
+#include <string>
+#include <vector>
+
+namespace orf_n {
+
+class camera_path {
+public:
+	typedef struct pose {
+		// Seconds since the start of the path
+		double time{ 0.0 };
+		omath::dvec3 position{ 0.0 };
+		omath::vec3 front{ 0.0f, 0.0f, -1.0f };
+		omath::vec3 up{ 0.0f, 1.0f, 0.0f };
+		float fov{ 45.0f };
+	} pose;
+
+	camera_path();
+	virtual ~camera_path();
+
+	bool load( const std::string &filename );
+	bool save( const std::string &filename ) const;
+	void add( const pose &p );
+	void clear();
+	const std::vector<pose> &get_poses() const;
+	// Pose at time t, interpolated between the recorded ones and clamped to the ends.
+	pose get_pose_at( const double t ) const;
+	double get_duration() const;
+
+private:
+	std::vector<pose> m_poses;
+
+};
+
+}
@@ -0,0 +1,135 @@
+
+#include "camera_recorder.h"
+#include "camera.h"
+#include "base/logbook.h"
+#include "renderer/profiler.h"
+#include <algorithm>
+#include <fstream>
+
+namespace orf_n {
+
+camera_recorder::camera_recorder() {}
+
+camera_recorder::~camera_recorder() {}
+
+void camera_recorder::start_recording( const std::string &filename ) {
+	m_path.clear();
+	m_filename = filename;
+	m_time = 0.0;
+	m_mode = RECORDING;
+	logbook::log_msg( logbook::SCENE, logbook::INFO, "Recording camera path to '" + filename + "'." );
+}
+
+bool camera_recorder::start_replay( camera *cam, const std::string &filename, const std::string &stats_filename,
+		const double timestep ) {
+	if( !m_path.load( filename ) || m_path.get_poses().empty() ) {
+		m_mode = IDLE;
+		return false;
+	}
+	m_filename = filename;
+	m_stats_filename = stats_filename;
+	m_timestep = timestep > 0.0 ? timestep : 1.0 / 60.0;
+	m_time = m_path.get_poses().front().time;
+	m_finished = false;
+	m_columns.assign( 1, "time" );
+	m_rows.clear();
+	cam->set_input_enabled( false );
+	m_mode = REPLAYING;
+	logbook::log_msg( logbook::SCENE, logbook::INFO, "Replaying camera path '" + filename + "', " +
+			std::to_string( m_path.get_duration() ) + "s with timestep " + std::to_string( m_timestep ) + "s." );
+	return true;
+}
+
+void camera_recorder::stop( camera *cam ) {
+	if( RECORDING == m_mode )
+		m_path.save( m_filename );
+	else if( REPLAYING == m_mode ) {
+		cam->set_input_enabled( true );
+		if( !m_stats_filename.empty() )
+			write_stats();
+	}
+	m_mode = IDLE;
+}
+
+camera_recorder::recorder_mode camera_recorder::get_mode() const {
+	return m_mode;
+}
+
+bool camera_recorder::is_finished() const {
+	return REPLAYING == m_mode && m_finished;
+}
+
+double camera_recorder::get_delta_time( const double measured ) const {
+	return REPLAYING == m_mode ? m_timestep : measured;
+}
+
+void camera_recorder::update( camera *cam, const double delta_time ) {
+	if( REPLAYING == m_mode ) {
+		const camera_path::pose p{ m_path.get_pose_at( m_time ) };
+		cam->set_pose( p.position, omath::dvec3{ p.front }, omath::dvec3{ p.up }, (double)p.fov );
+		m_time += m_timestep;
+		m_finished = m_time > m_path.get_poses().back().time;
+		return;
+	}
+	cam->update_moving( delta_time );
+	if( RECORDING == m_mode ) {
+		if( !m_path.get_poses().empty() )
+			m_time += delta_time;
+		camera_path::pose p;
+		p.time = m_time;
+		p.position = cam->get_position();
+		p.front = omath::vec3{ cam->get_front() };
+		p.up = omath::vec3{ cam->get_up() };
+		p.fov = (float)cam->get_zoom();
+		m_path.add( p );
+	}
+}
+
+void camera_recorder::end_frame() {
+	if( REPLAYING != m_mode )
+		return;
+	profiler::get_instance().get_last_values( m_frame_values );
+	std::vector<std::pair<size_t, double>> row;
+	row.reserve( m_frame_values.size() + 1 );
+	// Time of the pose this frame was drawn with
+	row.emplace_back( 0, m_time - m_timestep );
+	for( const std::pair<std::string, double> &v : m_frame_values ) {
+		const auto c{ std::find( m_columns.begin(), m_columns.end(), v.first ) };
+		row.emplace_back( (size_t)( c - m_columns.begin() ), v.second );
+		if( c == m_columns.end() )
+			m_columns.push_back( v.first );
+	}
+	m_rows.push_back( std::move( row ) );
+}
+
+void camera_recorder::write_stats() const {
+	std::ofstream out{ m_stats_filename, std::ios::out | std::ios::trunc };
+	if( !out.is_open() ) {
+		logbook::log_msg( logbook::SCENE, logbook::ERROR, "Could not write replay stats '" + m_stats_filename + "'." );
+		return;
+	}
+	out << "frame";
+	for( const std::string &c : m_columns )
+		out << ',' << c;
+	out << '\n';
+	std::vector<double> values( m_columns.size() );
+	std::vector<bool> present( m_columns.size() );
+	for( size_t i = 0; i < m_rows.size(); ++i ) {
+		std::fill( present.begin(), present.end(), false );
+		for( const std::pair<size_t, double> &v : m_rows[i] ) {
+			values[v.first] = v.second;
+			present[v.first] = true;
+		}
+		out << i;
+		for( size_t c = 0; c < m_columns.size(); ++c ) {
+			out << ',';
+			if( present[c] )
+				out << values[c];
+		}
+		out << '\n';
+	}
+	logbook::log_msg( logbook::SCENE, logbook::INFO, "Replay stats of " + std::to_string( m_rows.size() ) +
+			" frames written to '" + m_stats_filename + "'." );
+}
+
+}
@@ -0,0 +1,61 @@
+
+/* Records the camera's pose every frame into a camera_path, or replays one with a fixed timestep
+ * and camera input disabled. During a replay the profiler's values of every frame are collected
+ * and written as CSV when it ends, one row per frame and one column per section or counter. */
+
+#pragma once
+
+#include "camera_path.h"
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace orf_n {
+
+class camera;
+
+class camera_recorder {
+public:
+	typedef enum {
+		IDLE = 0, RECORDING, REPLAYING
+	} recorder_mode;
+
+	camera_recorder();
+	virtual ~camera_recorder();
+
+	// The path is written to filename when the recording stops.
+	void start_recording( const std::string &filename );
+	// Stats are written to stats_filename if it isn't empty. Returns false if the path can't be loaded.
+	bool start_replay( camera *cam, const std::string &filename, const std::string &stats_filename,
+			const double timestep );
+	void stop( camera *cam );
+
+	recorder_mode get_mode() const;
+	// Replay has passed the end of the path.
+	bool is_finished() const;
+	// Fixed timestep while replaying, the measured one else.
+	double get_delta_time( const double measured ) const;
+
+	// Instead of camera::update_moving() while replaying, records the camera's pose after it.
+	void update( camera *cam, const double delta_time );
+	// After profiler::end_frame().
+	void end_frame();
+
+private:
+	recorder_mode m_mode{ IDLE };
+	camera_path m_path;
+	std::string m_filename;
+	std::string m_stats_filename;
+	double m_time{ 0.0 };
+	double m_timestep{ 1.0 / 60.0 };
+	bool m_finished{ false };
+	// Column names and per frame values, missing ones are left empty
+	std::vector<std::string> m_columns;
+	std::vector<std::vector<std::pair<size_t, double>>> m_rows;
+	std::vector<std::pair<std::string, double>> m_frame_values;
+
+	void write_stats() const;
+
+};
+
+}
@@ -1,10 +1,11 @@
 
 #include "base/logbook.h"
-#include "renderer/uniform.h"
-#include "omath/mat4.h"
 #include "aabb_drawing.h"
+#include "renderer/gl_state.h"
 #include "settings.h"
 #include "glad/glad.h"
+#include <algorithm>
+#include <cstddef>
 
 using namespace orf_n;
 
@@ -58,6 +59,16 @@ void aabb_drawing::setup() {
 		glVertexArrayAttribFormat( m_vertex_array, VERTEX_ATTRIBUTE_LOCATION, 3, GL_FLOAT, GL_FALSE, 0 );
 		glVertexArrayAttribBinding( m_vertex_array, VERTEX_ATTRIBUTE_LOCATION, vb );
 		glEnableVertexArrayAttrib( m_vertex_array, VERTEX_ATTRIBUTE_LOCATION );
+		// Instance attributes advance once per box. The buffer is created at the first flush.
+		const GLuint ib = terrain::settings::AABB_DRAWING_INSTANCE_BUFFER_BINDING_INDEX;
+		glVertexArrayBindingDivisor( m_vertex_array, ib, 1 );
+		glVertexArrayAttribFormat( m_vertex_array, CENTER_ATTRIBUTE_LOCATION, 3, GL_FLOAT, GL_FALSE, offsetof( instance_t, center ) );
+		glVertexArrayAttribFormat( m_vertex_array, SIZE_ATTRIBUTE_LOCATION, 3, GL_FLOAT, GL_FALSE, offsetof( instance_t, size ) );
+		glVertexArrayAttribFormat( m_vertex_array, COLOR_ATTRIBUTE_LOCATION, 4, GL_FLOAT, GL_FALSE, offsetof( instance_t, color ) );
+		for( const GLuint a : { CENTER_ATTRIBUTE_LOCATION, SIZE_ATTRIBUTE_LOCATION, COLOR_ATTRIBUTE_LOCATION } ) {
+			glVertexArrayAttribBinding( m_vertex_array, a, ib );
+			glEnableVertexArrayAttrib( m_vertex_array, a );
+		}
 		// Box index buffer.
 		const std::vector<GLuint> indices {
 			0, 4, 0, 1, 5, 1, 2, 6, 2, 3, 7, 6, 5, 4, 7, 3
@@ -66,6 +77,8 @@ void aabb_drawing::setup() {
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,m_index_buffer);
 		//glNamedBufferData( m_index_buffer, boxLoopIndices.size()*sizeof(GLuint), boxLoopIndices.data(), GL_STATIC_DRAW );
 		glNamedBufferStorage( m_index_buffer, indices.size()*sizeof(GLuint), indices.data(), 0 );
+		glVertexArrayElementBuffer( m_vertex_array, m_index_buffer );
+		m_memory.set( box_vertices.size()*sizeof(omath::vec3) + indices.size()*sizeof(GLuint) );
 		logbook::log_msg( logbook::RENDERER, logbook::INFO, "Debug drawing set up." );
 		m_set_up = true;
 	}
@@ -75,22 +88,42 @@ void aabb_drawing::cleanup() {
 	if( m_set_up ) {
 		m_shaderDebug.reset();
 		glDeleteVertexArrays(1,&m_vertex_array);
+		gl_state::get_instance().deleted_vertex_array( m_vertex_array );
 		glDeleteBuffers(1,&m_vertex_buffer);
 		glDeleteBuffers(1,&m_index_buffer);
+		if( 0 != m_instance_buffer )
+			glDeleteBuffers(1,&m_instance_buffer);
+		m_instance_buffer = 0;
+		m_instance_capacity = 0;
+		m_instances.clear();
+		m_memory.set( 0 );
 		m_set_up = false;
 	}
 }
 
-void aabb_drawing::draw( const omath::daabb &bb, const color_t &color ) const {
-	const omath::mat4 m = omath::mat4();
-	const omath::vec3 c = bb.get_center();
-	const omath::mat4 modelM{ omath::translate( m, c ) * omath::scale( m, omath::vec3{ bb.get_size() } ) };
-	orf_n::set_uniform( m_shaderDebug->get_program(), "modelMatrix", modelM );
-	orf_n::set_uniform( m_shaderDebug->get_program(), "debugColor", color );
-	glBindVertexArray(m_vertex_array);
-	glBindBuffer(GL_ARRAY_BUFFER,m_vertex_buffer);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,m_index_buffer);
-	glDrawElements( GL_LINE_LOOP, 16, GL_UNSIGNED_INT, NULL );
+void aabb_drawing::add( const omath::daabb &bb, const color_t &color ) {
+	m_instances.push_back( instance_t{ omath::vec3{ bb.get_center() }, omath::vec3{ bb.get_size() }, color } );
+}
+
+void aabb_drawing::flush() {
+	if( m_instances.empty() )
+		return;
+	if( m_instances.size() > m_instance_capacity ) {
+		// Immutable storage, so grow by recreating it.
+		if( 0 != m_instance_buffer )
+			glDeleteBuffers(1,&m_instance_buffer);
+		const size_t capacity{ std::max( m_instances.size(), 2 * m_instance_capacity ) };
+		m_memory.set( m_memory.get() + ( capacity - m_instance_capacity ) * sizeof(instance_t) );
+		m_instance_capacity = capacity;
+		glCreateBuffers(1,&m_instance_buffer);
+		glNamedBufferStorage( m_instance_buffer, m_instance_capacity*sizeof(instance_t), nullptr, GL_DYNAMIC_STORAGE_BIT );
+		glVertexArrayVertexBuffer( m_vertex_array, terrain::settings::AABB_DRAWING_INSTANCE_BUFFER_BINDING_INDEX,
+				m_instance_buffer, 0, sizeof( instance_t ) );
+	}
+	glNamedBufferSubData( m_instance_buffer, 0, m_instances.size()*sizeof(instance_t), m_instances.data() );
+	gl_state::get_instance().bind_vertex_array( m_vertex_array );
+	glDrawElementsInstanced( GL_LINE_LOOP, 16, GL_UNSIGNED_INT, NULL, (GLsizei)m_instances.size() );
+	m_instances.clear();
 }
 
 const program *aabb_drawing::getProgramPtr() const {
@@ -4,6 +4,8 @@
 #include "renderer/program.h"
 #include "omath/aabb.h"
 #include "renderer/color.h"
+#include "base/memory_tracker.h"
+#include <vector>
 
 namespace terrain {
 
@@ -14,12 +16,25 @@ public:
 	void setup();
 	void cleanup();
 	void bind() const;
-	void draw( const omath::daabb &bb, const orf_n::color_t &color ) const;
+	// Queues a box for the next flush().
+	void add( const omath::daabb &bb, const orf_n::color_t &color );
+	// Draws all queued boxes with one instanced call and empties the queue. The program must be in use.
+	void flush();
 	const orf_n::program *getProgramPtr() const;
 
 private:
 
 	const GLuint VERTEX_ATTRIBUTE_LOCATION=0;
+	const GLuint CENTER_ATTRIBUTE_LOCATION=1;
+	const GLuint SIZE_ATTRIBUTE_LOCATION=2;
+	const GLuint COLOR_ATTRIBUTE_LOCATION=3;
+
+	// Per box attributes
+	typedef struct {
+		omath::vec3 center;
+		omath::vec3 size;
+		orf_n::color_t color;
+	} instance_t;
 
 	aabb_drawing() = default;
 	aabb_drawing( const aabb_drawing & ) = delete;
@@ -31,8 +46,13 @@ private:
 	GLuint m_vertex_array;
 	GLuint m_vertex_buffer;
 	GLuint m_index_buffer;
+	// Grows to the largest batch
+	GLuint m_instance_buffer{ 0 };
+	size_t m_instance_capacity{ 0 };
+	std::vector<instance_t> m_instances;
 
 	bool m_set_up{false};
+	orf_n::memory_tracker::tracked_memory m_memory{ orf_n::memory_tracker::RENDERER, orf_n::memory_tracker::GPU };
 
 };
 
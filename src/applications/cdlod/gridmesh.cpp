@@ -1,6 +1,7 @@
 
 #include "gridmesh.h"
 #include "base/logbook.h"
+#include "renderer/gl_state.h"
 #include "omath/vec3.h"
 #include "settings.h"
 #include <vector>
@@ -24,62 +25,59 @@ gridmesh::gridmesh( const unsigned int dimension ) : m_dimension{ dimension } {
 	glVertexArrayAttribBinding( m_vertex_array, 0, settings::GRIDMESH_VERTEX_BUFFER_BINDING_INDEX );
 	glVertexArrayAttribFormat( m_vertex_array, 0, 3, GL_FLOAT, GL_FALSE, 0 );
 	glEnableVertexArrayAttrib( m_vertex_array, 0 );
-	std::vector<GLuint> indices( m_number_of_indices );
-	GLuint index = 0;
 	GLuint halfD = vert_dim / 2;
 	m_numberOfSubmeshIndices = halfD * halfD * 6;
-	//Top Left
-	for( GLuint y = 0; y < halfD; ++y ) {
-		for( GLuint x = 0; x < halfD; ++x ) {
-			indices[index++] = x + vert_dim * y;
-			indices[index++] = x + vert_dim * (y + 1);
-			indices[index++] = (x + 1) + vert_dim * y;
-			indices[index++] = (x + 1) + vert_dim * y;
-			indices[index++] = x + vert_dim * (y + 1);
-			indices[index++] = (x + 1) + vert_dim * (y + 1);
-		}
-	}
-	m_endIndexTopLeft = index;
-	//Top Right
-	for( GLuint y = 0; y < halfD; ++y ) {
-		for( GLuint x = halfD; x < m_dimension; ++x ) {
-			indices[index++] = x + vert_dim * y;
-			indices[index++] = x + vert_dim * (y + 1);
-			indices[index++] = (x + 1) + vert_dim * y;
-			indices[index++] = (x + 1) + vert_dim * y;
-			indices[index++] = x + vert_dim * (y + 1);
-			indices[index++] = (x + 1) + vert_dim * (y + 1);
-		}
-	}
-	m_endIndexTopRight = index;
-	//Bottom Left
-	for( GLuint y = halfD; y < m_dimension; ++y ) {
-		for( GLuint x = 0; x < halfD; ++x ) {
-			indices[index++] = x + vert_dim * y;
-			indices[index++] = x + vert_dim * (y + 1);
-			indices[index++] = (x + 1) + vert_dim * y;
-			indices[index++] = (x + 1) + vert_dim * y;
-			indices[index++] = x + vert_dim * (y + 1);
-			indices[index++] = (x + 1) + vert_dim * (y + 1);
+	// Quadrant order in the index buffer, the first three repeat
+	const unsigned int quadrant_bits[7]{ 1, 2, 8, 4, 1, 2, 8 };
+	std::vector<GLuint> indices( m_numberOfSubmeshIndices * 7 );
+	GLuint index = 0;
+	for( const unsigned int bit : quadrant_bits ) {
+		const GLuint x_start{ ( 2 == bit || 8 == bit ) ? halfD : 0 };
+		const GLuint y_start{ ( 4 == bit || 8 == bit ) ? halfD : 0 };
+		for( GLuint y = y_start; y < y_start + halfD; ++y ) {
+			for( GLuint x = x_start; x < x_start + halfD; ++x ) {
+				indices[index++] = x + vert_dim * y;
+				indices[index++] = x + vert_dim * (y + 1);
+				indices[index++] = (x + 1) + vert_dim * y;
+				indices[index++] = (x + 1) + vert_dim * y;
+				indices[index++] = x + vert_dim * (y + 1);
+				indices[index++] = (x + 1) + vert_dim * (y + 1);
+			}
 		}
 	}
-	m_endIndexBottomLeft = index;
-	//Bottom Right
-	for( GLuint y = halfD; y < m_dimension; ++y ) {
-		for( GLuint x = halfD; x < m_dimension; ++x ) {
-			indices[index++] = x + vert_dim * y;
-			indices[index++] = x + vert_dim * (y + 1);
-			indices[index++] = (x + 1) + vert_dim * y;
-			indices[index++] = (x + 1) + vert_dim * y;
-			indices[index++] = x + vert_dim * (y + 1);
-			indices[index++] = (x + 1) + vert_dim * (y + 1);
+	m_endIndexTopLeft = m_numberOfSubmeshIndices;
+	m_endIndexTopRight = m_numberOfSubmeshIndices * 2;
+	m_endIndexBottomRight = m_numberOfSubmeshIndices * 3;
+	m_endIndexBottomLeft = m_numberOfSubmeshIndices * 4;
+	// A run of neighbours around the node is one range, else every quadrant gets its own.
+	for( unsigned int q = 1; q < 16; ++q ) {
+		index_ranges &r{ m_quadrant_ranges[q] };
+		unsigned int length{ 0 };
+		for( unsigned int i = 0; i < 4; ++i )
+			length += ( q >> i ) & 1;
+		for( unsigned int start = 0; start < 4 && 0 == r.number; ++start ) {
+			unsigned int run{ 0 };
+			for( unsigned int i = start; i < start + length; ++i )
+				run |= quadrant_bits[i];
+			if( run == q ) {
+				r.number = 1;
+				r.counts[0] = (GLsizei)( length * m_numberOfSubmeshIndices );
+				r.offsets[0] = (const void *)( start * m_numberOfSubmeshIndices * sizeof( GLuint ) );
+			}
 		}
+		if( 0 == r.number )
+			for( unsigned int i = 0; i < 4; ++i )
+				if( q & quadrant_bits[i] ) {
+					r.counts[r.number] = (GLsizei)m_numberOfSubmeshIndices;
+					r.offsets[r.number] = (const void *)( i * m_numberOfSubmeshIndices * sizeof( GLuint ) );
+					++r.number;
+				}
 	}
-	m_endIndexBottomRight = index;
 	glCreateBuffers( 1, &m_index_buffer );
 	glNamedBufferData( m_index_buffer, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW );
+	m_memory.set( vertices.size() * sizeof(omath::vec3) + indices.size() * sizeof(GLuint) );
 	glVertexArrayElementBuffer( m_vertex_array, m_index_buffer );
-	if( (GLsizei)indices.size() != m_number_of_indices )
+	if( (GLsizei)m_endIndexBottomLeft != m_number_of_indices )
 		orf_n::logbook::log_msg(
 			orf_n::logbook::TERRAIN, orf_n::logbook::WARNING,"Number of gridmesh indices unequals precalculated number."
 		);
@@ -89,7 +87,16 @@ gridmesh::gridmesh( const unsigned int dimension ) : m_dimension{ dimension } {
 }
 
 void gridmesh::bind() const {
-	glBindVertexArray( m_vertex_array );
+	orf_n::gl_state::get_instance().bind_vertex_array( m_vertex_array );
+}
+
+unsigned int gridmesh::draw_quadrants( const GLenum mode, const unsigned int quadrants ) const {
+	const index_ranges &r{ m_quadrant_ranges[quadrants & 15] };
+	if( 1 == r.number )
+		glDrawElements( mode, r.counts[0], GL_UNSIGNED_INT, r.offsets[0] );
+	else if( r.number > 1 )
+		glMultiDrawElements( mode, r.counts, GL_UNSIGNED_INT, r.offsets, r.number );
+	return (unsigned int)( r.counts[0] + r.counts[1] ) / m_numberOfSubmeshIndices;
 }
 
 gridmesh::~gridmesh() {
@@ -97,6 +104,7 @@ gridmesh::~gridmesh() {
 	glDeleteBuffers( 1, &m_index_buffer );
 	glDeleteBuffers( 1, &m_vertex_buffer );
 	glDeleteVertexArrays( 1, &m_vertex_array );
+	orf_n::gl_state::get_instance().deleted_vertex_array( m_vertex_array );
 	orf_n::logbook::log_msg( orf_n::logbook::TERRAIN, orf_n::logbook::INFO,
 			"Gridmesh dimension " + std::to_string( m_dimension ) + " destroyed." );
 }
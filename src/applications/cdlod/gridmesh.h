@@ -1,11 +1,14 @@
 
 /* A rectangular, [0.0..1.0] clamped regular flat mesh. X and Z are the horizontal dimensions.
  * Y will be extruded by the heightmap. Index- and vertex buffer are built for element drawing.
- * Indices are givven for all 4 quadrants of the mesh. This is needed for the LOD rendering */
+ * Indices are givven for all 4 quadrants of the mesh. This is needed for the LOD rendering.
+ * Quadrants are stored in the order TL, TR, BR, BL, followed by TL, TR, BR again, so every
+ * combination of neighbouring quadrants is one range of indices. Only the diagonal pairs need two. */
 
 #pragma once
 
 #include "glad/glad.h"
+#include "base/memory_tracker.h"
 
 namespace terrain {
 
@@ -19,13 +22,18 @@ public:
 	unsigned int getEndIndexBL() const;
 	unsigned int getEndIndexBR() const;
 	unsigned int getNumberOfSubMeshIndices() const;
+	// Indices of the full mesh
 	GLsizei get_number_indices() const;
 	void bind() const;
+	/* Draws a combination of quadrants, bits as lod_selection::quadrant_bits, with one call. That is
+	 * glMultiDrawElements for the diagonal pairs. Returns the number of quadrants drawn. */
+	unsigned int draw_quadrants( const GLenum mode, const unsigned int quadrants ) const;
 
 private:
 	GLuint m_vertex_array;
 	GLuint m_index_buffer;
 	GLuint m_vertex_buffer;
+	orf_n::memory_tracker::tracked_memory m_memory{ orf_n::memory_tracker::GRIDMESH, orf_n::memory_tracker::GPU };
 	unsigned int m_dimension = 0;
 	unsigned int m_endIndexTopLeft = 0;
 	unsigned int m_endIndexTopRight = 0;
@@ -33,6 +41,13 @@ private:
 	unsigned int m_endIndexBottomRight = 0;
 	unsigned int m_numberOfSubmeshIndices = 0;
 	GLsizei m_number_of_indices = 0;
+	// Per combination of quadrant bits
+	typedef struct index_ranges {
+		GLsizei number{ 0 };
+		GLsizei counts[2]{ 0, 0 };
+		const void *offsets[2]{ nullptr, nullptr };
+	} index_ranges;
+	index_ranges m_quadrant_ranges[16];
 
 };
 
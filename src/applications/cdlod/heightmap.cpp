@@ -1,34 +1,86 @@
 
 #include "heightmap.h"
+#include "min_max_map.h"
+#include "tile_container.h"
 #include "base/logbook.h"
+#include "base/async_reader.h"
 #include "settings.h"
+#include "renderer/gl_state.h"
 #include "renderer/sampler.h"
 #include <iostream>
 #include <sstream>
 #include <fstream>
 #include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <memory>
 #include <stb/stb_image.h>
+#if defined( __AVX2__ )
+#include <immintrin.h>
+#endif
 
 using namespace orf_n;
 
 namespace terrain {
 
 // TODO checks in own function, box making also.
-heightmap::heightmap( const std::string &filename, const bit_depth depth ) :
+heightmap::heightmap( const std::string &filename, const bit_depth depth, async_reader *reader,
+		const bool create_texture ) :
+				m_filename(filename), m_create_texture(create_texture), m_bit_depth(depth) {
+	// Read the file through the async backend instead of stb's blocking FILE* reads, decode from memory.
+	std::unique_ptr<async_reader> own_reader{ nullptr };
+	if( nullptr == reader ) {
+		own_reader = std::make_unique<async_reader>();
+		reader = own_reader.get();
+	}
+	std::vector<unsigned char> file_data;
+	if( !read_file( *reader, get_data_filename( filename ), file_data ) )
+		file_data.clear();
+	load( file_data );
+}
+
+heightmap::heightmap( const std::string &filename, const std::vector<unsigned char> &file_data, const bit_depth depth ) :
 				m_filename(filename), m_bit_depth(depth) {
+	load( file_data );
+}
+
+// static
+std::string heightmap::get_data_filename( const std::string &filename ) {
+	const std::string container{ filename + ".ctile" };
+	return std::ifstream{ container, std::ios::in | std::ios::binary }.is_open() ? container : filename + ".png";
+}
+
+void heightmap::load( const std::vector<unsigned char> &file_data ) {
+	const std::string &filename{ m_filename };
+	const bit_depth depth{ m_bit_depth };
 	uint16_t *values_16{nullptr};
 	uint8_t *values_8{nullptr};
+	// Preprocessed tiles come as container with heights, bounding box and min/max map
+	std::unique_ptr<tile_container> container{ nullptr };
 	//stbi_set_flip_vertically_on_load( true );
-	int w, h, num_channels;
-	const std::string texture_file = filename+".png";
-	if( B16 == depth )
-		// load the data, single channel 16
-		values_16 = stbi_load_16( texture_file.c_str(), &w, &h, &num_channels, 1 );
-	if( B8 == depth ) {
-		// load the data, single channel 8
-		values_8 = stbi_load( texture_file.c_str(), &w, &h, &num_channels, 1 );
+	int w{ 0 }, h{ 0 }, num_channels{ 0 };
+	const bool is_container{ tile_container::is_container( file_data.data(), file_data.size() ) };
+	const std::string texture_file = filename + ( is_container ? ".ctile" : ".png" );
+	if( is_container ) {
+		container = tile_container::decode( file_data.data(), file_data.size() );
+		if( nullptr != container ) {
+			w = static_cast<int>( container->m_extent.x );
+			h = static_cast<int>( container->m_extent.y );
+			num_channels = 1;
+		}
+	} else if( !file_data.empty() ) {
+		const int file_size{ static_cast<int>( file_data.size() ) };
+		if( B16 == depth )
+			// load the data, single channel 16
+			values_16 = stbi_load_16_from_memory( file_data.data(), file_size, &w, &h, &num_channels, 1 );
+		if( B8 == depth ) {
+			// load the data, single channel 8
+			values_8 = stbi_load_from_memory( file_data.data(), file_size, &w, &h, &num_channels, 1 );
+		}
 	}
-	if( nullptr == values_16 && nullptr == values_8 ) {
+	if( nullptr == values_16 && nullptr == values_8 && nullptr == container ) {
 		std::string s = "Error loading heightmap image file '"+texture_file+"'.";
 		logbook::log_msg( logbook::TERRAIN, logbook::ERROR, s );
 		// @todo throw std::runtime_error( s );
@@ -42,51 +94,121 @@ heightmap::heightmap( const std::string &filename, const bit_depth depth ) :
 	unsigned int numPixels{ m_extent.x * m_extent.y };
 	// TODO Check.
 	m_height_values = new uint16_t[numPixels];
-	memcpy(
-			m_height_values,
-			B8==depth ? (void *)values_8 : (void *)values_16,
-			numPixels * (B8==depth ? sizeof(uint8_t) : sizeof(uint16_t))
-	);
+	if( nullptr != container )
+		std::copy( container->m_heights.begin(), container->m_heights.end(), m_height_values );
+	else
+		memcpy(
+				m_height_values,
+				B8==depth ? (void *)values_8 : (void *)values_16,
+				numPixels * (B8==depth ? sizeof(uint8_t) : sizeof(uint16_t))
+		);
 	// There's only float data 0..1 from now on
-	glCreateTextures( GL_TEXTURE_2D, 1, &m_texture );
-	glBindTextureUnit( HEIGHTMAP_TEXTURE_UNIT, m_texture );
-	const GLenum internal_format = settings::USE_HALF_FLOATS ? GL_R16F : GL_R32F;
-	glTextureStorage2D( m_texture, 1, internal_format, m_extent.x, m_extent.y );
-	glTextureSubImage2D(
-			m_texture, 0,					// texture and mip level
-			0, 0, m_extent.x, m_extent.y,	// offset and size
-			GL_RED, GL_UNSIGNED_SHORT, m_height_values
-	);
-	// set the default sampler for the heightmap texture
-	set_default_sampler( m_texture, LINEAR_CLAMP );
+	if( m_create_texture ) {
+		glCreateTextures( GL_TEXTURE_2D, 1, &m_texture );
+		const GLenum internal_format = settings::USE_HALF_FLOATS ? GL_R16F : GL_R32F;
+		glTextureStorage2D( m_texture, 1, internal_format, m_extent.x, m_extent.y );
+		m_gpu_memory.set( memory_tracker::texture_bytes( internal_format, m_extent.x, m_extent.y ) );
+		glTextureSubImage2D(
+				m_texture, 0,					// texture and mip level
+				0, 0, m_extent.x, m_extent.y,	// offset and size
+				GL_RED, GL_UNSIGNED_SHORT, m_height_values
+		);
+		// set the default sampler for the heightmap texture
+		set_default_sampler( m_texture, LINEAR_CLAMP );
+	}
 	// release mem
 	if( nullptr != values_8 )
 		stbi_image_free( values_8 );
 	if( nullptr != values_16 )
 		stbi_image_free( values_16 );
-	// @todo: query texture size !
-	float size_in_kb{
-		float( sizeof(*this) + numPixels * sizeof(uint16_t) ) / 1024.0f
-	};
 	// Bounding boxes
-	std::ifstream bbf( filename+".bb", std::ios::in );
-	if( !bbf.is_open() ) {
+	if( nullptr != container ) {
+		const omath::aabb &b{ container->m_raster_aabb };
+		m_raster_aabb.m_min = omath::vec3{ b.m_min.x, b.m_min.y * settings::HEIGHT_FACTOR, b.m_min.z };
+		m_raster_aabb.m_max = omath::vec3{ b.m_max.x, b.m_max.y * settings::HEIGHT_FACTOR, b.m_max.z };
+	} else if( !read_raster_aabb( filename, m_raster_aabb ) ) {
 		std::ostringstream s;
 		s << "Error opening bounding box file '" << filename << ".bb'. Tile will not be rendered correctly.";
 		logbook::log_msg( logbook::TERRAIN, logbook::WARNING, s.str() );
 	}
-	omath::vec3 min, max;
-	bbf >> min.x >> min.y >> min.z >> max.x >> max.y >> max.z;
-	bbf.close();
-	m_raster_aabb.m_min = omath::vec3{ min.x, min.y * settings::HEIGHT_FACTOR, min.z };
-	m_raster_aabb.m_max = omath::vec3{ max.x, max.y * settings::HEIGHT_FACTOR, max.z };
+	// Min/max pyramid for the quadtree. Prefer the preprocessed one.
+	if( nullptr != container )
+		m_min_max_map = std::move( container->m_min_max_map );
+	else
+		m_min_max_map = min_max_map::load( filename+".mm", m_extent );
+	if( nullptr != m_min_max_map && ( m_min_max_map->get_leaf_size() != settings::LEAF_NODE_SIZE ||
+			m_min_max_map->get_number_of_levels() < settings::NUMBER_OF_LOD_LEVELS ) ) {
+		logbook::log_msg( logbook::TERRAIN, logbook::WARNING,
+				"Min/max map of '" + filename + "' does not match leaf size and lod levels. Rebuilding it." );
+		m_min_max_map.reset();
+	}
+	if( nullptr == m_min_max_map && nullptr != m_height_values )
+		m_min_max_map = std::make_unique<min_max_map>(
+				m_height_values, m_extent, settings::LEAF_NODE_SIZE, settings::NUMBER_OF_LOD_LEVELS
+		);
+	m_cpu_memory.set( sizeof( *this ) + numPixels * sizeof( uint16_t ) +
+			( nullptr != m_min_max_map ? m_min_max_map->get_size_in_bytes() : 0 ) );
 	std::ostringstream s;
 	s << "Heightmap texture '" << texture_file<<"' loaded.\n\tRaster bounding box: " << m_raster_aabb <<
 		".\n\tTexture unit " << HEIGHTMAP_TEXTURE_UNIT <<", " << m_extent.x <<'*'<< m_extent.y << ", " <<
-		num_channels <<" channel(s). Size in memory : " << size_in_kb << "kB.";
+		num_channels <<" channel(s). Size in memory: " << m_cpu_memory.get() / 1024 << "kB, texture: " <<
+		m_gpu_memory.get() / 1024 << "kB.";
 	logbook::log_msg( logbook::TERRAIN, logbook::INFO, s.str() );
 }
 
+// static
+bool heightmap::read_raster_aabb( const std::string &filename, omath::aabb &out_box ) {
+	std::ifstream bbf( filename+".bb", std::ios::in );
+	if( !bbf.is_open() )
+		return false;
+	omath::vec3 min, max;
+	bbf >> min.x >> min.y >> min.z >> max.x >> max.y >> max.z;
+	out_box.m_min = omath::vec3{ min.x, min.y * settings::HEIGHT_FACTOR, min.z };
+	out_box.m_max = omath::vec3{ max.x, max.y * settings::HEIGHT_FACTOR, max.z };
+	return !bbf.fail();
+}
+
+// static
+bool heightmap::read_file( async_reader &reader, const std::string &filename, std::vector<unsigned char> &out ) {
+	// Many small block reads in one batch; lets the backend overlap them.
+	const size_t BLOCK_SIZE{ 1024 * 1024 };
+	const int fd{ reader.open_file( filename ) };
+	if( fd < 0 )
+		return false;
+	const uint64_t size{ reader.get_file_size( fd ) };
+	out.resize( size );
+	const auto start{ std::chrono::steady_clock::now() };
+	bool ok{ true };
+	std::vector<async_reader::read_request> requests;
+	for( uint64_t offset = 0; offset < size; offset += BLOCK_SIZE ) {
+		async_reader::read_request r;
+		r.fd = fd;
+		r.offset = offset;
+		r.size = static_cast<size_t>( std::min<uint64_t>( BLOCK_SIZE, size - offset ) );
+		r.destination = out.data() + offset;
+		r.on_complete = [&ok]( const async_reader::read_request &req, long result ) {
+			if( result != static_cast<long>( req.size ) )
+				ok = false;
+		};
+		requests.push_back( r );
+	}
+	reader.submit( requests );
+	reader.wait_all();
+	reader.close_file( fd );
+	const double seconds{ std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count() };
+	std::ostringstream s;
+	if( ok ) {
+		s << "Read '" << filename << "', " << size / 1024 << "kB in " << requests.size() << " blocks, " <<
+				seconds * 1000.0 << "ms (" << ( seconds > 0.0 ? double( size ) / ( 1024.0 * 1024.0 ) / seconds : 0.0 ) <<
+				"MB/s, " << reader.get_backend_name() << ").";
+		logbook::log_msg( logbook::TERRAIN, logbook::INFO, s.str() );
+	} else {
+		s << "Error reading '" << filename << "'.";
+		logbook::log_msg( logbook::TERRAIN, logbook::ERROR, s.str() );
+	}
+	return ok;
+}
+
 const GLuint &heightmap::get_texture() const {
 	return m_texture;
 }
@@ -99,6 +221,112 @@ float heightmap::get_height_at( const unsigned int x, const unsigned int y ) con
 	return (float)m_height_values[x + y * m_extent.x] * settings::HEIGHT_FACTOR;
 }
 
+float heightmap::get_height( const omath::dvec2 &position, omath::vec3 *normal ) const {
+	// Raster position on the tile, the cell is clamped so that its far posts exist.
+	const float fx{ std::clamp( (float)( position.x / settings::RASTER_TO_WORLD_X - m_raster_aabb.m_min.x ),
+		0.0f, (float)( m_extent.x - 1 ) ) };
+	const float fz{ std::clamp( (float)( position.y / settings::RASTER_TO_WORLD_Z - m_raster_aabb.m_min.z ),
+		0.0f, (float)( m_extent.y - 1 ) ) };
+	const unsigned int x{ std::min( (unsigned int)fx, m_extent.x - 2 ) };
+	const unsigned int z{ std::min( (unsigned int)fz, m_extent.y - 2 ) };
+	const float tx{ fx - (float)x };
+	const float tz{ fz - (float)z };
+	const float h00{ get_height_at( x, z ) };
+	const float h10{ get_height_at( x + 1, z ) };
+	const float h01{ get_height_at( x, z + 1 ) };
+	const float h11{ get_height_at( x + 1, z + 1 ) };
+	const float h0{ h00 + ( h10 - h00 ) * tx };
+	const float h1{ h01 + ( h11 - h01 ) * tx };
+	if( nullptr != normal ) {
+		// Slopes per raster unit, interpolated across the cell
+		const float dx{ ( h10 - h00 ) + ( ( h11 - h01 ) - ( h10 - h00 ) ) * tz };
+		const float dz{ ( h01 - h00 ) + ( ( h11 - h10 ) - ( h01 - h00 ) ) * tx };
+		*normal = omath::normalize( omath::vec3{
+			dx / -(float)settings::RASTER_TO_WORLD_X, 1.0f, dz / -(float)settings::RASTER_TO_WORLD_Z
+		} );
+	}
+	return h0 + ( h1 - h0 ) * tz;
+}
+
+void heightmap::get_heights( const omath::dvec2 *positions, const unsigned int count, float *heights,
+		omath::vec3 *normals ) const {
+	unsigned int i{ 0 };
+#if defined( __AVX2__ )
+	static_assert( sizeof( omath::dvec2 ) == 2 * sizeof( double ), "Positions are read as pairs of doubles." );
+	// Gather indices are signed 32 bit in units of one post.
+	if( m_extent.x > 1 && m_extent.y > 1 && (uint64_t)m_extent.x * m_extent.y < ( 1ull << 31 ) ) {
+		const __m256d world_to_raster_x{ _mm256_set1_pd( settings::RASTER_TO_WORLD_X ) };
+		const __m256d world_to_raster_z{ _mm256_set1_pd( settings::RASTER_TO_WORLD_Z ) };
+		const __m256d min_x{ _mm256_set1_pd( m_raster_aabb.m_min.x ) };
+		const __m256d min_z{ _mm256_set1_pd( m_raster_aabb.m_min.z ) };
+		const __m256 max_x{ _mm256_set1_ps( (float)( m_extent.x - 1 ) ) };
+		const __m256 max_z{ _mm256_set1_ps( (float)( m_extent.y - 1 ) ) };
+		const __m256i last_x{ _mm256_set1_epi32( (int)m_extent.x - 2 ) };
+		const __m256i last_z{ _mm256_set1_epi32( (int)m_extent.y - 2 ) };
+		const __m256i row{ _mm256_set1_epi32( (int)m_extent.x ) };
+		const __m256i low_half{ _mm256_set1_epi32( 0xFFFF ) };
+		const __m256 factor{ _mm256_set1_ps( settings::HEIGHT_FACTOR ) };
+		const __m256 cell_x{ _mm256_set1_ps( -(float)settings::RASTER_TO_WORLD_X ) };
+		const __m256 cell_z{ _mm256_set1_ps( -(float)settings::RASTER_TO_WORLD_Z ) };
+		const __m256 one{ _mm256_set1_ps( 1.0f ) };
+		const int *const posts{ reinterpret_cast<const int *>( m_height_values ) };
+		const double *const xz{ reinterpret_cast<const double *>( positions ) };
+		// Raster x and z of 4 positions each as 4 floats. The order of positions is kept.
+		const auto to_raster = []( const double *p, const __m256d scale_x, const __m256d scale_z,
+				const __m256d offset_x, const __m256d offset_z, __m128 &x, __m128 &z ) {
+			const __m256d a{ _mm256_loadu_pd( p ) };
+			const __m256d b{ _mm256_loadu_pd( p + 4 ) };
+			const __m256d px{ _mm256_permute4x64_pd( _mm256_unpacklo_pd( a, b ), 0xD8 ) };
+			const __m256d pz{ _mm256_permute4x64_pd( _mm256_unpackhi_pd( a, b ), 0xD8 ) };
+			x = _mm256_cvtpd_ps( _mm256_sub_pd( _mm256_div_pd( px, scale_x ), offset_x ) );
+			z = _mm256_cvtpd_ps( _mm256_sub_pd( _mm256_div_pd( pz, scale_z ), offset_z ) );
+		};
+		for( ; i + 8 <= count; i += 8 ) {
+			__m128 x0, z0, x1, z1;
+			to_raster( xz + 2 * i, world_to_raster_x, world_to_raster_z, min_x, min_z, x0, z0 );
+			to_raster( xz + 2 * i + 8, world_to_raster_x, world_to_raster_z, min_x, min_z, x1, z1 );
+			const __m256 fx{ _mm256_min_ps( _mm256_max_ps( _mm256_set_m128( x1, x0 ), _mm256_setzero_ps() ), max_x ) };
+			const __m256 fz{ _mm256_min_ps( _mm256_max_ps( _mm256_set_m128( z1, z0 ), _mm256_setzero_ps() ), max_z ) };
+			const __m256i ix{ _mm256_min_epi32( _mm256_cvttps_epi32( fx ), last_x ) };
+			const __m256i iz{ _mm256_min_epi32( _mm256_cvttps_epi32( fz ), last_z ) };
+			const __m256 tx{ _mm256_sub_ps( fx, _mm256_cvtepi32_ps( ix ) ) };
+			const __m256 tz{ _mm256_sub_ps( fz, _mm256_cvtepi32_ps( iz ) ) };
+			// Posts x and x + 1 of a row come in one 32 bit element, x in the low half.
+			const __m256i index{ _mm256_add_epi32( _mm256_mullo_epi32( iz, row ), ix ) };
+			const __m256i r0{ _mm256_i32gather_epi32( posts, index, 2 ) };
+			const __m256i r1{ _mm256_i32gather_epi32( posts, _mm256_add_epi32( index, row ), 2 ) };
+			const __m256 h00{ _mm256_mul_ps( _mm256_cvtepi32_ps( _mm256_and_si256( r0, low_half ) ), factor ) };
+			const __m256 h10{ _mm256_mul_ps( _mm256_cvtepi32_ps( _mm256_srli_epi32( r0, 16 ) ), factor ) };
+			const __m256 h01{ _mm256_mul_ps( _mm256_cvtepi32_ps( _mm256_and_si256( r1, low_half ) ), factor ) };
+			const __m256 h11{ _mm256_mul_ps( _mm256_cvtepi32_ps( _mm256_srli_epi32( r1, 16 ) ), factor ) };
+			const __m256 d0x{ _mm256_sub_ps( h10, h00 ) };
+			const __m256 d1x{ _mm256_sub_ps( h11, h01 ) };
+			const __m256 h0{ _mm256_add_ps( h00, _mm256_mul_ps( d0x, tx ) ) };
+			const __m256 h1{ _mm256_add_ps( h01, _mm256_mul_ps( d1x, tx ) ) };
+			_mm256_storeu_ps( heights + i, _mm256_add_ps( h0, _mm256_mul_ps( _mm256_sub_ps( h1, h0 ), tz ) ) );
+			if( nullptr == normals )
+				continue;
+			const __m256 d0z{ _mm256_sub_ps( h01, h00 ) };
+			const __m256 d1z{ _mm256_sub_ps( h11, h10 ) };
+			const __m256 dx{ _mm256_add_ps( d0x, _mm256_mul_ps( _mm256_sub_ps( d1x, d0x ), tz ) ) };
+			const __m256 dz{ _mm256_add_ps( d0z, _mm256_mul_ps( _mm256_sub_ps( d1z, d0z ), tx ) ) };
+			const __m256 nx{ _mm256_div_ps( dx, cell_x ) };
+			const __m256 nz{ _mm256_div_ps( dz, cell_z ) };
+			const __m256 length{ _mm256_sqrt_ps(
+				_mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( nx, nx ), one ), _mm256_mul_ps( nz, nz ) ) ) };
+			alignas( 32 ) float n[3][8];
+			_mm256_store_ps( n[0], _mm256_div_ps( nx, length ) );
+			_mm256_store_ps( n[1], _mm256_div_ps( one, length ) );
+			_mm256_store_ps( n[2], _mm256_div_ps( nz, length ) );
+			for( unsigned int j = 0; j < 8; ++j )
+				normals[i + j] = omath::vec3{ n[0][j], n[1][j], n[2][j] };
+		}
+	}
+#endif
+	for( ; i < count; ++i )
+		heights[i] = get_height( positions[i], nullptr != normals ? &normals[i] : nullptr );
+}
+
 omath::vec2 heightmap::get_min_max_height_area(
 		const unsigned int x, const unsigned int z, const unsigned int w, const unsigned int h ) const {
 	omath::vec2 values{ std::numeric_limits<float>::max(), std::numeric_limits<float>::min() };
@@ -113,6 +341,99 @@ omath::vec2 heightmap::get_min_max_height_area(
 	return omath::vec2{ values };
 }
 
+namespace {
+
+// Moeller-Trumbore, returns the ray parameter or -1 for a miss.
+double intersect_triangle( const omath::dvec3 &origin, const omath::dvec3 &direction,
+		const omath::dvec3 &a, const omath::dvec3 &b, const omath::dvec3 &c ) {
+	const omath::dvec3 e1{ b - a };
+	const omath::dvec3 e2{ c - a };
+	const omath::dvec3 p{ omath::cross( direction, e2 ) };
+	const double det{ omath::dot( e1, p ) };
+	if( std::abs( det ) < 1e-12 )
+		return -1.0;
+	const double inv_det{ 1.0 / det };
+	const omath::dvec3 s{ origin - a };
+	const double u{ omath::dot( s, p ) * inv_det };
+	if( u < 0.0 || u > 1.0 )
+		return -1.0;
+	const omath::dvec3 q{ omath::cross( s, e1 ) };
+	const double v{ omath::dot( direction, q ) * inv_det };
+	if( v < 0.0 || u + v > 1.0 )
+		return -1.0;
+	return omath::dot( e2, q ) * inv_det;
+}
+
+}
+
+bool heightmap::raycast( const omath::dvec3 &origin, const omath::dvec3 &direction,
+		const unsigned int x0, const unsigned int z0, unsigned int x1, unsigned int z1,
+		const double t_min, const double t_max, double &t ) const {
+	// A cell needs its far posts
+	x1 = std::min( x1, m_extent.x - 1 );
+	z1 = std::min( z1, m_extent.y - 1 );
+	if( x0 >= x1 || z0 >= z1 || t_min > t_max )
+		return false;
+	// Post coordinates
+	const omath::dvec3 o{ origin.x - m_raster_aabb.m_min.x, origin.y, origin.z - m_raster_aabb.m_min.z };
+	const double inf{ std::numeric_limits<double>::infinity() };
+	int cell_x{ std::clamp( (int)std::floor( o.x + direction.x * t_min ), (int)x0, (int)x1 - 1 ) };
+	int cell_z{ std::clamp( (int)std::floor( o.z + direction.z * t_min ), (int)z0, (int)z1 - 1 ) };
+	const int step_x{ direction.x > 0.0 ? 1 : -1 };
+	const int step_z{ direction.z > 0.0 ? 1 : -1 };
+	const double delta_x{ 0.0 != direction.x ? std::abs( 1.0 / direction.x ) : inf };
+	const double delta_z{ 0.0 != direction.z ? std::abs( 1.0 / direction.z ) : inf };
+	// Ray parameters of the next cell borders
+	double next_x{ 0.0 != direction.x ? ( cell_x + ( step_x > 0 ? 1 : 0 ) - o.x ) / direction.x : inf };
+	double next_z{ 0.0 != direction.z ? ( cell_z + ( step_z > 0 ? 1 : 0 ) - o.z ) / direction.z : inf };
+	double t_cell{ t_min };
+	while( t_cell <= t_max ) {
+		const double t_exit{ std::min( { next_x, next_z, t_max } ) };
+		const double h00{ get_height_at( cell_x, cell_z ) };
+		const double h10{ get_height_at( cell_x + 1, cell_z ) };
+		const double h01{ get_height_at( cell_x, cell_z + 1 ) };
+		const double h11{ get_height_at( cell_x + 1, cell_z + 1 ) };
+		// Only test the triangles if the ray's heights in the cell overlap the posts'
+		const double y_enter{ o.y + direction.y * t_cell };
+		const double y_exit{ o.y + direction.y * t_exit };
+		if( std::min( y_enter, y_exit ) <= std::max( { h00, h10, h01, h11 } ) &&
+				std::max( y_enter, y_exit ) >= std::min( { h00, h10, h01, h11 } ) ) {
+			const omath::dvec3 p00{ (double)cell_x, h00, (double)cell_z };
+			const omath::dvec3 p10{ cell_x + 1.0, h10, (double)cell_z };
+			const omath::dvec3 p01{ (double)cell_x, h01, cell_z + 1.0 };
+			const omath::dvec3 p11{ cell_x + 1.0, h11, cell_z + 1.0 };
+			// Hits in a cell are behind those of the cells before, so the first cell with one has the nearest.
+			double nearest{ inf };
+			for( const double ti : { intersect_triangle( o, direction, p00, p01, p10 ),
+					intersect_triangle( o, direction, p10, p01, p11 ) } )
+				if( ti >= t_min && ti <= t_max && ti < nearest )
+					nearest = ti;
+			if( nearest < inf ) {
+				t = nearest;
+				return true;
+			}
+		}
+		if( next_x < next_z ) {
+			cell_x += step_x;
+			if( cell_x < (int)x0 || cell_x >= (int)x1 )
+				break;
+			t_cell = next_x;
+			next_x += delta_x;
+		} else {
+			cell_z += step_z;
+			if( cell_z < (int)z0 || cell_z >= (int)z1 )
+				break;
+			t_cell = next_z;
+			next_z += delta_z;
+		}
+	}
+	return false;
+}
+
+const min_max_map *heightmap::get_min_max_map() const {
+	return m_min_max_map.get();
+}
+
 const heightmap::bit_depth &heightmap::get_depth() const {
 	return m_bit_depth;
 }
@@ -132,19 +453,22 @@ omath::daabb &heightmap::get_world_aabb(omath::daabb &out_box) const {
 }
 
 heightmap::~heightmap() {
-	unbind();
-	glDeleteTextures( 1, &m_texture );
+	if( 0 != m_texture ) {
+		unbind();
+		glDeleteTextures( 1, &m_texture );
+		gl_state::get_instance().deleted_texture( m_texture );
+	}
 	delete [] m_height_values;
 	logbook::log_msg( logbook::TERRAIN, logbook::INFO,
 			"Heightmap '" + m_filename + "' destroyed." );
 }
 
 void heightmap::bind() const {
-	glBindTextureUnit( HEIGHTMAP_TEXTURE_UNIT, m_texture );
+	gl_state::get_instance().bind_texture_unit( HEIGHTMAP_TEXTURE_UNIT, m_texture );
 }
 
 void heightmap::unbind() const {
-	glBindTextureUnit( HEIGHTMAP_TEXTURE_UNIT, 0 );
+	gl_state::get_instance().bind_texture_unit( HEIGHTMAP_TEXTURE_UNIT, 0 );
 }
 
 }
@@ -3,18 +3,34 @@
 
 #include "omath/vec2.h"
 #include "omath/aabb.h"
+#include "base/memory_tracker.h"
 #include "glad/glad.h"
+#include <memory>
 #include <string>
+#include <vector>
+
+namespace orf_n {
+class async_reader;
+}
 
 namespace terrain {
 
+class min_max_map;
+
 class heightmap {
 public:
 	static constexpr GLuint HEIGHTMAP_TEXTURE_UNIT{0};
 	typedef enum : unsigned int {
 		B8, B16
 	} bit_depth;
-	heightmap( const std::string &filename, const bit_depth depth = B16 );
+	/* Image data is read through the given asynchronous reader. If none is passed,
+	 * a temporary one is created for the load. Without a texture, no GL context is needed,
+	 * e.g. for headless tools that only select. */
+	heightmap( const std::string &filename, const bit_depth depth = B16, orf_n::async_reader *reader = nullptr,
+			const bool create_texture = true );
+	/* Decodes png or tile container data that was already read, e.g. by an asynchronous tile load.
+	 * Must be called on the GL thread. */
+	heightmap( const std::string &filename, const std::vector<unsigned char> &file_data, const bit_depth depth = B16 );
 	virtual ~heightmap();
 	void bind() const;
 	void unbind() const;
@@ -22,17 +38,37 @@ public:
 	const GLuint &get_texture() const;
 	// Returns the real world height value at coords (normalized * 65535.0f).
 	float get_height_at( const unsigned int x, const unsigned int y ) const;
+	/* Bilinear height at a world space xz position, clamped to the tile. With normal, also the normal of the
+	 * bilinear patch there. */
+	float get_height( const omath::dvec2 &position, omath::vec3 *normal = nullptr ) const;
+	/* Same for count positions, e.g. to place objects or clamp vehicles to the ground. Normals are only written
+	 * if given. Built for AVX2, 8 positions at a time fetch their posts with gathers, 2 per row. */
+	void get_heights( const omath::dvec2 *positions, const unsigned int count, float *heights,
+			omath::vec3 *normals = nullptr ) const;
 	// Returns min/max values in the world range of 0.0f..65535.0f
 	omath::vec2 get_min_max_height_area(
 			const unsigned int x, const unsigned int z, const unsigned int w, const unsigned int h
 	) const;
+	/* First hit of a ray with the surface over the cells [x0,x1)*[z0,z1) between t_min and t_max. The ray is in
+	 * raster coordinates like get_raster_aabb(), t is its parameter at the hit. Cells are walked along the ray
+	 * (2D DDA) and split into two triangles along the same diagonal as the gridmesh. */
+	bool raycast( const omath::dvec3 &origin, const omath::dvec3 &direction,
+			const unsigned int x0, const unsigned int z0, unsigned int x1, unsigned int z1,
+			const double t_min, const double t_max, double &t ) const;
 	const omath::aabb &get_raster_aabb() const;
 	omath::daabb &get_world_aabb(omath::daabb &out_box) const;
+	// Exact min/max heights per quadtree node. Loaded from the container or '<filename>.mm', or built on load.
+	const min_max_map *get_min_max_map() const;
+	// Reads the raster bounding box from '<filename>.bb' without loading the heightmap.
+	static bool read_raster_aabb( const std::string &filename, omath::aabb &out_box );
+	// File the heights are loaded from, '<filename>.ctile' if the preprocessor wrote one, else '<filename>.png'.
+	static std::string get_data_filename( const std::string &filename );
 
 private:
 	std::string m_filename{ "" };
 	uint16_t *m_height_values=nullptr;
 	GLuint m_texture{ 0 };
+	bool m_create_texture{ true };
 	/* Height/width of texture file in pixels.
 	 * Integer because opengl expects integer in texture addressing and for loops compare to <=0 ... */
 	omath::uvec2 m_extent{ 0, 0 };
@@ -40,7 +76,15 @@ private:
 	bit_depth m_bit_depth{ B16 };
 	// Raster bounding box of tile.
 	omath::aabb m_raster_aabb;
+	std::unique_ptr<min_max_map> m_min_max_map{ nullptr };
+	// Height values and min/max map, and the texture
+	orf_n::memory_tracker::tracked_memory m_cpu_memory{ orf_n::memory_tracker::HEIGHTMAP, orf_n::memory_tracker::CPU };
+	orf_n::memory_tracker::tracked_memory m_gpu_memory{ orf_n::memory_tracker::HEIGHTMAP, orf_n::memory_tracker::GPU };
 	const bit_depth &get_depth() const;
+	// Decodes the image or container, uploads the texture and reads bounding box and min/max map.
+	void load( const std::vector<unsigned char> &file_data );
+	// Reads the whole file in blocks through the reader and waits for the result.
+	static bool read_file( orf_n::async_reader &reader, const std::string &filename, std::vector<unsigned char> &out );
 
 };
 
@@ -0,0 +1,295 @@
+
+#include "hiz_culling.h"
+#include "settings.h"
+#include "base/logbook.h"
+#include "renderer/gl_state.h"
+#include "renderer/sampler.h"
+#include "renderer/uniform.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace orf_n;
+
+namespace terrain {
+
+namespace {
+
+// Depth blits need the same format on both sides.
+GLenum get_depth_format( const GLuint framebuffer ) {
+	GLint bits{ 0 }, type{ GL_NONE }, stencil_bits{ 0 };
+	const GLenum attachment{ 0 == framebuffer ? (GLenum)GL_DEPTH : GL_DEPTH_ATTACHMENT };
+	glGetNamedFramebufferAttachmentParameteriv( framebuffer, attachment, GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE, &bits );
+	glGetNamedFramebufferAttachmentParameteriv( framebuffer, attachment, GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE, &type );
+	// Sizes of a missing attachment can't be asked for
+	const GLenum stencil_attachment{ 0 == framebuffer ? (GLenum)GL_STENCIL : attachment };
+	GLint stencil_type{ GL_NONE };
+	glGetNamedFramebufferAttachmentParameteriv( framebuffer, stencil_attachment, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &stencil_type );
+	if( GL_NONE != stencil_type )
+		glGetNamedFramebufferAttachmentParameteriv( framebuffer, stencil_attachment, GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE, &stencil_bits );
+	if( GL_FLOAT == type )
+		return stencil_bits > 0 ? GL_DEPTH32F_STENCIL8 : GL_DEPTH_COMPONENT32F;
+	if( bits <= 16 )
+		return GL_DEPTH_COMPONENT16;
+	if( bits <= 24 )
+		return stencil_bits > 0 ? GL_DEPTH24_STENCIL8 : GL_DEPTH_COMPONENT24;
+	return GL_DEPTH_COMPONENT32;
+}
+
+}
+
+hiz_culling::hiz_culling() {}
+
+hiz_culling::~hiz_culling() {
+	cleanup();
+}
+
+void hiz_culling::setup() {
+	if( m_set_up ) {
+		logbook::log_msg( logbook::RENDERER, logbook::WARNING, "Hierarchical z culling already set up." );
+		return;
+	}
+	std::vector<std::shared_ptr<module>> modules;
+	modules.push_back( std::make_shared<module>( GL_COMPUTE_SHADER, "src/applications/cdlod/hiz_reduce.comp.glsl" ) );
+	m_reduce_program = std::make_unique<program>( modules );
+	modules.clear();
+	modules.push_back( std::make_shared<module>( GL_COMPUTE_SHADER, "src/applications/cdlod/hiz_test.comp.glsl" ) );
+	m_test_program = std::make_unique<program>( modules );
+	glCreateFramebuffers( 1, &m_depth_framebuffer );
+	m_set_up = true;
+	logbook::log_msg( logbook::RENDERER, logbook::INFO, "Hierarchical z culling set up." );
+}
+
+void hiz_culling::cleanup() {
+	if( !m_set_up )
+		return;
+	delete_textures();
+	delete_buffers();
+	glDeleteFramebuffers( 1, &m_depth_framebuffer );
+	m_depth_framebuffer = 0;
+	m_reduce_program.reset();
+	m_test_program.reset();
+	m_valid = m_set_up = false;
+}
+
+void hiz_culling::build( const unsigned int width, const unsigned int height, const omath::mat4 &view_projection ) {
+	if( !m_set_up || 0 == width || 0 == height )
+		return;
+	GLint draw_framebuffer{ 0 };
+	glGetIntegerv( GL_DRAW_FRAMEBUFFER_BINDING, &draw_framebuffer );
+	const GLenum depth_format{ get_depth_format( (GLuint)draw_framebuffer ) };
+	if( width != m_size.x || height != m_size.y || depth_format != m_depth_format )
+		resize( width, height, depth_format );
+	glBlitNamedFramebuffer(
+			(GLuint)draw_framebuffer, m_depth_framebuffer,
+			0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST
+	);
+	m_reduce_program->use();
+	const GLuint p{ m_reduce_program->get_program() };
+	gl_state::get_instance().bind_texture_unit( settings::HIZ_DEPTH_TEXTURE_UNIT, m_depth_texture );
+	for( unsigned int level = 0; level < m_levels; ++level ) {
+		const unsigned int w{ std::max( width >> level, 1u ) };
+		const unsigned int h{ std::max( height >> level, 1u ) };
+		set_uniform( p, "u_copy_depth", 0 == level );
+		glBindImageTexture( 0, m_pyramid, level > 0 ? level - 1 : 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F );
+		glBindImageTexture( 1, m_pyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F );
+		glDispatchCompute( ( w + 7 ) / 8, ( h + 7 ) / 8, 1 );
+		glMemoryBarrier( GL_SHADER_IMAGE_ACCESS_BARRIER_BIT );
+	}
+	glMemoryBarrier( GL_TEXTURE_FETCH_BARRIER_BIT );
+	m_reduce_program->un_use();
+	m_view_projection = view_projection;
+	m_valid = true;
+}
+
+void hiz_culling::invalidate() {
+	m_valid = false;
+	// Results of an old pyramid
+	for( unsigned int i = 0; i < SLOTS; ++i )
+		release_slot( i );
+}
+
+bool hiz_culling::is_valid() const {
+	return m_valid;
+}
+
+void hiz_culling::cull( lod_selection *selection, const unsigned int triangles_per_node ) {
+	m_culled_nodes = m_culled_triangles = 0;
+	if( !m_set_up )
+		return;
+	collect_results();
+	// All quadrants are tested, also those about to be removed, or they would come back next time.
+	if( m_valid )
+		test( selection );
+	if( m_hidden_nodes.empty() )
+		return;
+	m_hidden.assign( selection->m_selection_count, 0 );
+	bool any_hidden{ false };
+	for( unsigned int i = 0; i < selection->m_selection_count; ++i ) {
+		const lod_selection::selected_node &n{ selection->m_selected_nodes[i] };
+		const auto h{ m_hidden_nodes.find( n.p_node ) };
+		if( m_hidden_nodes.end() != h && h->second.tile_index == n.tile_index ) {
+			m_hidden[i] = h->second.quadrants;
+			any_hidden = true;
+		}
+	}
+	if( any_hidden )
+		selection->remove_quadrants( m_hidden, triangles_per_node, m_culled_nodes, m_culled_triangles );
+}
+
+void hiz_culling::collect_results() {
+	m_hidden_nodes.clear();
+	// Newest first, older results are superseded
+	for( unsigned int i = 0; i < SLOTS; ++i ) {
+		const unsigned int index{ ( m_slot + SLOTS - i ) % SLOTS };
+		const slot &s{ m_slots[index] };
+		if( nullptr == s.fence )
+			continue;
+		const GLenum status{ glClientWaitSync( s.fence, 0, 0 ) };
+		if( GL_ALREADY_SIGNALED != status && GL_CONDITION_SATISFIED != status )
+			continue;
+		const GLuint *const results{ m_result_mapping + index * m_buffer_capacity };
+		for( size_t b = 0; b < s.boxes.size(); ++b )
+			if( 0 == results[b] ) {
+				hidden_quadrants &h{ m_hidden_nodes[s.boxes[b].p_node] };
+				h.tile_index = s.boxes[b].tile_index;
+				h.quadrants |= s.boxes[b].quadrants;
+			}
+		for( unsigned int j = i; j < SLOTS; ++j )
+			release_slot( ( m_slot + SLOTS - j ) % SLOTS );
+		return;
+	}
+}
+
+void hiz_culling::test( const lod_selection *selection ) {
+	const unsigned int next{ ( m_slot + 1 ) % SLOTS };
+	// Still unfinished, the GPU is that far behind. Skip instead of waiting.
+	if( nullptr != m_slots[next].fence )
+		return;
+	selection->get_quadrant_boxes( m_boxes );
+	const unsigned int n{ (unsigned int)m_boxes.size() };
+	if( 0 == n )
+		return;
+	reserve_buffers( n );
+	if( nullptr == m_box_mapping || nullptr == m_result_mapping )
+		return;
+	slot &s{ m_slots[next] };
+	s.boxes.resize( n );
+	omath::vec4 *const box_data{ m_box_mapping + 2 * next * m_buffer_capacity };
+	for( unsigned int i = 0; i < n; ++i ) {
+		const omath::daabb &b{ m_boxes[i].box };
+		box_data[2*i] = omath::vec4{ (float)b.m_min.x, (float)b.m_min.y, (float)b.m_min.z, 1.0f };
+		box_data[2*i+1] = omath::vec4{ (float)b.m_max.x, (float)b.m_max.y, (float)b.m_max.z, 1.0f };
+		const lod_selection::selected_node &selected{ selection->m_selected_nodes[m_boxes[i].selected_index] };
+		s.boxes[i] = tested_box{ selected.p_node, selected.tile_index, m_boxes[i].quadrants };
+	}
+	m_test_program->use();
+	const GLuint p{ m_test_program->get_program() };
+	set_uniform( p, "u_view_projection", m_view_projection );
+	set_uniform( p, "u_number_of_boxes", (GLuint)n );
+	glBindBufferRange( GL_SHADER_STORAGE_BUFFER, settings::HIZ_BOX_BUFFER_BINDING, m_box_buffer,
+			(GLintptr)( 2 * next * m_buffer_capacity * sizeof( omath::vec4 ) ), 2 * n * sizeof( omath::vec4 ) );
+	glBindBufferRange( GL_SHADER_STORAGE_BUFFER, settings::HIZ_RESULT_BUFFER_BINDING, m_result_buffer,
+			(GLintptr)( next * m_buffer_capacity * sizeof( GLuint ) ), n * sizeof( GLuint ) );
+	gl_state::get_instance().bind_texture_unit( settings::HIZ_PYRAMID_TEXTURE_UNIT, m_pyramid );
+	glDispatchCompute( ( n + 63 ) / 64, 1, 1 );
+	glMemoryBarrier( GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT );
+	m_test_program->un_use();
+	s.fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+	m_slot = next;
+}
+
+void hiz_culling::release_slot( const unsigned int index ) {
+	slot &s{ m_slots[index] };
+	if( nullptr != s.fence )
+		glDeleteSync( s.fence );
+	s.fence = nullptr;
+	s.boxes.clear();
+}
+
+unsigned int hiz_culling::get_culled_nodes() const {
+	return m_culled_nodes;
+}
+
+unsigned int hiz_culling::get_culled_triangles() const {
+	return m_culled_triangles;
+}
+
+void hiz_culling::resize( const unsigned int width, const unsigned int height, const GLenum depth_format ) {
+	delete_textures();
+	m_size = omath::uvec2{ width, height };
+	m_depth_format = depth_format;
+	m_levels = 1 + (unsigned int)std::floor( std::log2( (double)std::max( width, height ) ) );
+	glCreateTextures( GL_TEXTURE_2D, 1, &m_depth_texture );
+	glTextureStorage2D( m_depth_texture, 1, depth_format, width, height );
+	set_default_sampler( m_depth_texture, NEAREST_CLAMP );
+	glNamedFramebufferTexture( m_depth_framebuffer, GL_DEPTH_ATTACHMENT, m_depth_texture, 0 );
+	glCreateTextures( GL_TEXTURE_2D, 1, &m_pyramid );
+	glTextureStorage2D( m_pyramid, m_levels, GL_R32F, width, height );
+	set_default_sampler( m_pyramid, NEAREST_CLAMP );
+	// texelFetch() needs a mipmap filter to reach levels above 0
+	glTextureParameteri( m_pyramid, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST );
+	m_texture_memory.set( memory_tracker::texture_bytes( depth_format, width, height ) +
+			memory_tracker::texture_bytes( GL_R32F, width, height, m_levels ) );
+	if( GL_FRAMEBUFFER_COMPLETE != glCheckNamedFramebufferStatus( m_depth_framebuffer, GL_DRAW_FRAMEBUFFER ) )
+		logbook::log_msg( logbook::RENDERER, logbook::ERROR, "Hierarchical z depth framebuffer incomplete." );
+	logbook::log_msg( logbook::RENDERER, logbook::INFO, "Hierarchical z pyramid " + std::to_string( width ) +
+			'x' + std::to_string( height ) + " with " + std::to_string( m_levels ) + " levels created." );
+}
+
+void hiz_culling::reserve_buffers( const unsigned int number_of_boxes ) {
+	if( number_of_boxes <= m_buffer_capacity )
+		return;
+	// Multiples of 64 keep the slots' regions 256 byte aligned for storage buffer bindings
+	const unsigned int capacity{ ( std::max( number_of_boxes, 2 * m_buffer_capacity ) + 63 ) & ~63u };
+	delete_buffers();
+	m_buffer_capacity = capacity;
+	const GLbitfield write_flags{ GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT };
+	const GLsizeiptr box_bytes{ (GLsizeiptr)( SLOTS * 2 * m_buffer_capacity * sizeof( omath::vec4 ) ) };
+	glCreateBuffers( 1, &m_box_buffer );
+	glNamedBufferStorage( m_box_buffer, box_bytes, nullptr, write_flags );
+	m_box_mapping = static_cast<omath::vec4 *>( glMapNamedBufferRange( m_box_buffer, 0, box_bytes, write_flags ) );
+	const GLbitfield read_flags{ GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT };
+	const GLsizeiptr result_bytes{ (GLsizeiptr)( SLOTS * m_buffer_capacity * sizeof( GLuint ) ) };
+	glCreateBuffers( 1, &m_result_buffer );
+	glNamedBufferStorage( m_result_buffer, result_bytes, nullptr, read_flags | GL_CLIENT_STORAGE_BIT );
+	m_result_mapping = static_cast<const GLuint *>( glMapNamedBufferRange( m_result_buffer, 0, result_bytes, read_flags ) );
+	if( nullptr == m_box_mapping || nullptr == m_result_mapping )
+		logbook::log_msg( logbook::RENDERER, logbook::ERROR, "Could not map hierarchical z buffers." );
+	m_buffer_memory.set( (size_t)( box_bytes + result_bytes ) );
+}
+
+void hiz_culling::delete_textures() {
+	if( 0 != m_depth_texture ) {
+		glDeleteTextures( 1, &m_depth_texture );
+		gl_state::get_instance().deleted_texture( m_depth_texture );
+	}
+	if( 0 != m_pyramid ) {
+		glDeleteTextures( 1, &m_pyramid );
+		gl_state::get_instance().deleted_texture( m_pyramid );
+	}
+	m_depth_texture = m_pyramid = 0;
+	m_size = omath::uvec2{ 0, 0 };
+	m_valid = false;
+	m_texture_memory.set( 0 );
+}
+
+void hiz_culling::delete_buffers() {
+	// Pending results are in the old buffers
+	for( unsigned int i = 0; i < SLOTS; ++i )
+		release_slot( i );
+	if( 0 != m_box_buffer ) {
+		glUnmapNamedBuffer( m_box_buffer );
+		glDeleteBuffers( 1, &m_box_buffer );
+	}
+	if( 0 != m_result_buffer ) {
+		glUnmapNamedBuffer( m_result_buffer );
+		glDeleteBuffers( 1, &m_result_buffer );
+	}
+	m_box_buffer = m_result_buffer = 0;
+	m_box_mapping = nullptr;
+	m_result_mapping = nullptr;
+	m_buffer_capacity = 0;
+	m_buffer_memory.set( 0 );
+}
+
+}
@@ -0,0 +1,108 @@
+
+/* Hierarchical z occlusion culling of a selection on the GPU. After the terrain is drawn, its
+ * depth is copied and reduced to a pyramid of farthest depths. The next frame's selection is
+ * tested against it in a compute shader: boxes whose nearest depth is behind the farthest depth
+ * of their screen rectangle were hidden in the last frame. The CPU doesn't wait for the test.
+ * Results go to a ring of persistently mapped regions, each fenced, and the newest finished one
+ * is applied to a later selection by node and quadrant. Nodes that weren't tested are kept.
+ * Results are a frame or more older than the selection, so hidden nodes may be kept for a few
+ * frames after the camera moves, and nodes that just came into view may be dropped for as long. */
+
+#pragma once
+
+#include "lod_selection.h"
+#include "renderer/program.h"
+#include "base/memory_tracker.h"
+#include "omath/mat4.h"
+#include "omath/vec2.h"
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace terrain {
+
+class hiz_culling {
+public:
+	hiz_culling();
+	virtual ~hiz_culling();
+	hiz_culling( const hiz_culling &other ) = delete;
+	hiz_culling &operator=( const hiz_culling &other ) = delete;
+
+	// Load shaders. Textures are created with the first build().
+	void setup();
+	void cleanup();
+	/* Copies the depth of the bound draw framebuffer, offscreen or the window's, and builds the pyramid.
+	 * Call after the terrain is drawn, with the framebuffer size and the view projection used for drawing. */
+	void build( const unsigned int width, const unsigned int height, const omath::mat4 &view_projection );
+	// Forget the pyramid, e.g. if the terrain wasn't drawn.
+	void invalidate();
+	bool is_valid() const;
+	/* Tests the selection against the pyramid of the last build(), if there is one, and removes
+	 * the quadrants the newest finished earlier test found hidden. */
+	void cull( lod_selection *selection, const unsigned int triangles_per_node );
+	// Removed nodes and triangles of the last call.
+	unsigned int get_culled_nodes() const;
+	unsigned int get_culled_triangles() const;
+
+private:
+	// Tests in flight. The GPU is rarely more frames behind.
+	static const unsigned int SLOTS{ 3 };
+
+	typedef struct tested_box {
+		const node *p_node;
+		unsigned int tile_index;
+		unsigned int quadrants;
+	} tested_box;
+
+	typedef struct hidden_quadrants {
+		unsigned int tile_index;
+		unsigned int quadrants;
+	} hidden_quadrants;
+
+	typedef struct slot {
+		GLsync fence{ nullptr };
+		std::vector<tested_box> boxes;
+	} slot;
+
+	std::unique_ptr<orf_n::program> m_reduce_program{ nullptr };
+	std::unique_ptr<orf_n::program> m_test_program{ nullptr };
+	GLuint m_depth_framebuffer{ 0 };
+	GLuint m_depth_texture{ 0 };
+	GLuint m_pyramid{ 0 };
+	GLuint m_box_buffer{ 0 };
+	GLuint m_result_buffer{ 0 };
+	// Per slot
+	unsigned int m_buffer_capacity{ 0 };
+	omath::vec4 *m_box_mapping{ nullptr };
+	const GLuint *m_result_mapping{ nullptr };
+	slot m_slots[SLOTS];
+	// Of the newest test
+	unsigned int m_slot{ 0 };
+	omath::uvec2 m_size{ 0, 0 };
+	// Of the framebuffer depth is copied from
+	GLenum m_depth_format{ GL_NONE };
+	unsigned int m_levels{ 0 };
+	orf_n::memory_tracker::tracked_memory m_texture_memory{ orf_n::memory_tracker::RENDERER, orf_n::memory_tracker::GPU };
+	orf_n::memory_tracker::tracked_memory m_buffer_memory{ orf_n::memory_tracker::RENDERER, orf_n::memory_tracker::GPU };
+	omath::mat4 m_view_projection{ 1.0f };
+	bool m_valid{ false };
+	bool m_set_up{ false };
+
+	std::vector<lod_selection::quadrant_box> m_boxes;
+	std::unordered_map<const node *, hidden_quadrants> m_hidden_nodes;
+	std::vector<unsigned int> m_hidden;
+	unsigned int m_culled_nodes{ 0 };
+	unsigned int m_culled_triangles{ 0 };
+
+	// Hidden quadrants of the newest finished test, releases it and older ones.
+	void collect_results();
+	void test( const lod_selection *selection );
+	void release_slot( const unsigned int index );
+	void resize( const unsigned int width, const unsigned int height, const GLenum depth_format );
+	void reserve_buffers( const unsigned int number_of_boxes );
+	void delete_textures();
+	void delete_buffers();
+
+};
+
+}
@@ -0,0 +1,38 @@
+
+/* Builds one level of the depth pyramid. Level 0 is a copy of the depth buffer, every further
+ * level holds the farthest depth of the texels it covers in the level above. Odd sizes take
+ * the extra row and column along, so no texel is lost. */
+
+#version 450 core
+
+layout( local_size_x = 8, local_size_y = 8 ) in;
+
+layout( binding = 1 ) uniform sampler2D u_depth;
+layout( binding = 0, r32f ) uniform readonly image2D u_source;
+layout( binding = 1, r32f ) uniform writeonly image2D u_destination;
+
+// Copy depth to level 0 instead of reducing
+uniform bool u_copy_depth = false;
+
+void main() {
+	ivec2 dst = ivec2( gl_GlobalInvocationID.xy );
+	ivec2 dst_size = imageSize( u_destination );
+	if( any( greaterThanEqual( dst, dst_size ) ) )
+		return;
+	if( u_copy_depth ) {
+		imageStore( u_destination, dst, vec4( texelFetch( u_depth, dst, 0 ).r ) );
+		return;
+	}
+	ivec2 src_size = imageSize( u_source );
+	ivec2 src = dst * 2;
+	// Last destination texel of an odd source takes 3 texels
+	ivec2 extent = ivec2(
+		dst.x == dst_size.x - 1 && ( src_size.x & 1 ) == 1 ? 3 : 2,
+		dst.y == dst_size.y - 1 && ( src_size.y & 1 ) == 1 ? 3 : 2
+	);
+	float depth = 0.0f;
+	for( int y = 0; y < extent.y; ++y )
+		for( int x = 0; x < extent.x; ++x )
+			depth = max( depth, imageLoad( u_source, min( src + ivec2( x, y ), src_size - 1 ) ).r );
+	imageStore( u_destination, dst, vec4( depth ) );
+}
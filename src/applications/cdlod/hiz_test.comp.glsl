@@ -0,0 +1,69 @@
+
+/* Tests boxes against the depth pyramid. A box is hidden if its nearest depth is behind the
+ * farthest depth in its screen rectangle. The pyramid level is chosen so the rectangle covers
+ * at most 2x2 texels there. Boxes behind the camera or off screen are kept. */
+
+#version 450 core
+
+layout( local_size_x = 64 ) in;
+
+struct box_t {
+	vec4 min;
+	vec4 max;
+};
+
+layout( std430, binding = 0 ) readonly buffer boxes {
+	box_t b[];
+};
+
+layout( std430, binding = 1 ) writeonly buffer results {
+	uint visible[];
+};
+
+layout( binding = 2 ) uniform sampler2D u_pyramid;
+
+// View projection the pyramid was made with
+uniform mat4 u_view_projection;
+uniform uint u_number_of_boxes;
+
+void main() {
+	uint i = gl_GlobalInvocationID.x;
+	if( i >= u_number_of_boxes )
+		return;
+	vec2 rect_min = vec2( 1.0f );
+	vec2 rect_max = vec2( 0.0f );
+	float nearest = 1.0f;
+	for( int c = 0; c < 8; ++c ) {
+		vec3 corner = vec3(
+			( c & 1 ) == 0 ? b[i].min.x : b[i].max.x,
+			( c & 2 ) == 0 ? b[i].min.y : b[i].max.y,
+			( c & 4 ) == 0 ? b[i].min.z : b[i].max.z
+		);
+		vec4 clip = u_view_projection * vec4( corner, 1.0f );
+		if( clip.w <= 0.0f ) {
+			visible[i] = 1;
+			return;
+		}
+		vec3 ndc = clip.xyz / clip.w;
+		rect_min = min( rect_min, ndc.xy * 0.5f + 0.5f );
+		rect_max = max( rect_max, ndc.xy * 0.5f + 0.5f );
+		nearest = min( nearest, ndc.z * 0.5f + 0.5f );
+	}
+	// Outside of the last frame's view nothing is known
+	if( any( lessThan( rect_min, vec2( 0.0f ) ) ) || any( greaterThan( rect_max, vec2( 1.0f ) ) ) ) {
+		visible[i] = 1;
+		return;
+	}
+	vec2 size = vec2( textureSize( u_pyramid, 0 ) );
+	vec2 extent = ( rect_max - rect_min ) * size;
+	int max_level = textureQueryLevels( u_pyramid ) - 1;
+	int level = clamp( int( ceil( log2( max( max( extent.x, extent.y ), 1.0f ) ) ) ), 0, max_level );
+	ivec2 level_size = textureSize( u_pyramid, level );
+	ivec2 t0 = clamp( ivec2( rect_min * vec2( level_size ) ), ivec2( 0 ), level_size - 1 );
+	ivec2 t1 = clamp( ivec2( rect_max * vec2( level_size ) ), ivec2( 0 ), level_size - 1 );
+	float farthest = 0.0f;
+	for( int y = t0.y; y <= t1.y; ++y )
+		for( int x = t0.x; x <= t1.x; ++x )
+			farthest = max( farthest, texelFetch( u_pyramid, ivec2( x, y ), level ).r );
+	visible[i] = nearest <= farthest ? 1 : 0;
+}
@@ -0,0 +1,113 @@
+
+#include "horizon_culling.h"
+#include "omath/common.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace terrain {
+
+horizon_culling::horizon_culling( const unsigned int number_of_bins ) :
+		m_horizon( std::max( number_of_bins, 4u ) ),
+		m_bin_width{ omath::TWO_PI / (double)std::max( number_of_bins, 4u ) } {}
+
+horizon_culling::~horizon_culling() {}
+
+void horizon_culling::cull( lod_selection *selection, const unsigned int triangles_per_node, const omath::dvec3 &pos ) {
+	m_culled_nodes = m_culled_triangles = 0;
+	std::fill( m_horizon.begin(), m_horizon.end(), std::numeric_limits<double>::lowest() );
+	m_items.clear();
+	m_pending.clear();
+	const auto further_than = []( const occluder &a, const occluder &b ) { return a.far_distance > b.far_distance; };
+	selection->get_quadrant_boxes( m_boxes );
+	for( const lod_selection::quadrant_box &b : m_boxes )
+		add_item( b, pos );
+	std::sort( m_items.begin(), m_items.end(), []( const item &a, const item &b ) { return a.near_distance < b.near_distance; } );
+
+	m_hidden.assign( selection->m_selection_count, 0 );
+	for( const item &it : m_items ) {
+		while( !m_pending.empty() && m_pending.front().far_distance <= it.near_distance ) {
+			std::pop_heap( m_pending.begin(), m_pending.end(), further_than );
+			add_occluder( m_pending.back() );
+			m_pending.pop_back();
+		}
+		double start, width;
+		// Never cull what the viewer stands on
+		if( !get_azimuth_range( it.quadrant.box, pos, start, width ) )
+			continue;
+		// Highest slope from the view position to the box
+		const double dy_max{ it.quadrant.box.m_max.y - pos.y };
+		if( is_below_horizon( start, width, dy_max / ( dy_max > 0.0 ? it.near_distance : it.far_distance ) ) ) {
+			m_hidden[it.quadrant.selected_index] |= it.quadrant.quadrants;
+			continue;
+		}
+		// Lowest slope of the terrain surface over the footprint
+		const double dy_min{ it.quadrant.box.m_min.y - pos.y };
+		m_pending.push_back( occluder{ it.far_distance, dy_min / ( dy_min > 0.0 ? it.far_distance : it.near_distance ), start, width } );
+		std::push_heap( m_pending.begin(), m_pending.end(), further_than );
+	}
+
+	selection->remove_quadrants( m_hidden, triangles_per_node, m_culled_nodes, m_culled_triangles );
+}
+
+unsigned int horizon_culling::get_culled_nodes() const {
+	return m_culled_nodes;
+}
+
+unsigned int horizon_culling::get_culled_triangles() const {
+	return m_culled_triangles;
+}
+
+void horizon_culling::add_item( const lod_selection::quadrant_box &b, const omath::dvec3 &pos ) {
+	const omath::daabb &box{ b.box };
+	const double dx{ std::max( { box.m_min.x - pos.x, 0.0, pos.x - box.m_max.x } ) };
+	const double dz{ std::max( { box.m_min.z - pos.z, 0.0, pos.z - box.m_max.z } ) };
+	const double fx{ std::max( std::abs( box.m_min.x - pos.x ), std::abs( box.m_max.x - pos.x ) ) };
+	const double fz{ std::max( std::abs( box.m_min.z - pos.z ), std::abs( box.m_max.z - pos.z ) ) };
+	m_items.push_back( item{ b, std::sqrt( dx * dx + dz * dz ), std::sqrt( fx * fx + fz * fz ) } );
+}
+
+// static
+bool horizon_culling::get_azimuth_range( const omath::daabb &box, const omath::dvec3 &pos, double &start, double &width ) {
+	if( pos.x >= box.m_min.x && pos.x <= box.m_max.x && pos.z >= box.m_min.z && pos.z <= box.m_max.z )
+		return false;
+	// Corner angles relative to the direction to the center, the footprint spans less than pi
+	const double center{ std::atan2( ( box.m_min.z + box.m_max.z ) * 0.5 - pos.z, ( box.m_min.x + box.m_max.x ) * 0.5 - pos.x ) };
+	double lo{ 0.0 }, hi{ 0.0 };
+	for( unsigned int c = 0; c < 4; ++c ) {
+		const double x{ ( c & 1 ? box.m_max.x : box.m_min.x ) - pos.x };
+		const double z{ ( c & 2 ? box.m_max.z : box.m_min.z ) - pos.z };
+		const double a{ std::remainder( std::atan2( z, x ) - center, omath::TWO_PI ) };
+		lo = std::min( lo, a );
+		hi = std::max( hi, a );
+	}
+	start = center + lo;
+	if( start < 0.0 )
+		start += omath::TWO_PI;
+	width = hi - lo;
+	return true;
+}
+
+// Only bins completely inside the azimuth range are blocked.
+void horizon_culling::add_occluder( const occluder &o ) {
+	const unsigned int n{ (unsigned int)m_horizon.size() };
+	const long first{ (long)std::ceil( o.start / m_bin_width ) };
+	const long last{ (long)std::floor( ( o.start + o.width ) / m_bin_width ) - 1 };
+	for( long b = first; b <= last; ++b ) {
+		double &h{ m_horizon[(unsigned long)b % n] };
+		h = std::max( h, o.elevation );
+	}
+}
+
+// Every bin touched by the azimuth range must be above the elevation.
+bool horizon_culling::is_below_horizon( const double start, const double width, const double elevation ) const {
+	const unsigned int n{ (unsigned int)m_horizon.size() };
+	const long first{ (long)std::floor( start / m_bin_width ) };
+	const long last{ (long)std::floor( ( start + width ) / m_bin_width ) };
+	for( long b = first; b <= last; ++b )
+		if( m_horizon[(unsigned long)b % n] <= elevation )
+			return false;
+	return true;
+}
+
+}
@@ -0,0 +1,66 @@
+
+/* Occlusion culling of a selection against the terrain's horizon. Selected nodes are split into
+ * their quadrants and processed front to back. A buffer of azimuth bins around the view position
+ * holds the highest elevation (slope) hidden so far. A quadrant whose max height lies below the
+ * horizon over its whole azimuth range can't be seen and is removed from the selection.
+ * Occluders must be conservative: the terrain is at least as high as a box's min height over
+ * its footprint, so a visible quadrant blocks everything below the slope of its min height
+ * behind it, but only in bins completely covered by the footprint. An occluder is added to the
+ * horizon when the front has passed its far distance, before that it could hide nodes in front of it. */
+
+#pragma once
+
+#include "lod_selection.h"
+#include "settings.h"
+#include <vector>
+
+namespace terrain {
+
+class horizon_culling {
+public:
+	horizon_culling( const unsigned int number_of_bins = settings::HORIZON_CULLING_BINS );
+	virtual ~horizon_culling();
+
+	/* Removes quadrants hidden from the view position, and nodes with all quadrants hidden, from the selection.
+	 * Usually the selection's view position, but a selection made ahead for a predicted one is culled with
+	 * where the camera really is. */
+	void cull( lod_selection *selection, const unsigned int triangles_per_node, const omath::dvec3 &position );
+	// Removed nodes and triangles of the last call.
+	unsigned int get_culled_nodes() const;
+	unsigned int get_culled_triangles() const;
+
+private:
+	typedef struct item {
+		lod_selection::quadrant_box quadrant;
+		// Horizontal distances of the box footprint from the view position
+		double near_distance;
+		double far_distance;
+	} item;
+
+	typedef struct occluder {
+		double far_distance;
+		double elevation;
+		double start;
+		double width;
+	} occluder;
+
+	std::vector<double> m_horizon;
+	double m_bin_width;
+	std::vector<lod_selection::quadrant_box> m_boxes;
+	std::vector<item> m_items;
+	// Hidden quadrant bits per selected node
+	std::vector<unsigned int> m_hidden;
+	// Min heap by far distance
+	std::vector<occluder> m_pending;
+	unsigned int m_culled_nodes{ 0 };
+	unsigned int m_culled_triangles{ 0 };
+
+	void add_item( const lod_selection::quadrant_box &box, const omath::dvec3 &pos );
+	// Azimuth range of the box footprint seen from pos, start in [0, 2pi). False if pos is above the footprint.
+	static bool get_azimuth_range( const omath::daabb &box, const omath::dvec3 &pos, double &start, double &width );
+	void add_occluder( const occluder &o );
+	bool is_below_horizon( const double start, const double width, const double elevation ) const;
+
+};
+
+}
@@ -0,0 +1,65 @@
+
+#include "lod_budget.h"
+#include "settings.h"
+#include <algorithm>
+#include <cstdlib>
+
+namespace terrain {
+
+lod_budget::lod_budget( const double initial_ratio ) :
+		m_target_triangles{ settings::LOD_BUDGET_TARGET_TRIANGLES },
+		m_target_frame_ms{ settings::LOD_BUDGET_TARGET_FRAME_MS },
+		m_ratio{ initial_ratio } {}
+
+lod_budget::~lod_budget() {}
+
+bool lod_budget::update( const unsigned int triangles, const double frame_seconds, const unsigned int selection_count ) {
+	/* m_mode is set from the ui. The smoothed value and counters of another mode, or of before it was off,
+	 * don't apply. */
+	if( m_mode != m_last_mode ) {
+		m_last_mode = m_mode;
+		m_measured = 0.0;
+		m_frames_outside = 0;
+		m_cooldown = 0;
+	}
+	if( OFF == m_mode )
+		return false;
+	const double sample{ TRIANGLES == m_mode ? (double)triangles : frame_seconds * 1000.0 };
+	const double target{ TRIANGLES == m_mode ? (double)m_target_triangles : (double)m_target_frame_ms };
+	// Exponential moving average against noisy frame times
+	m_measured = m_measured <= 0.0 ? sample : m_measured + ( sample - m_measured ) * 0.2;
+	if( m_cooldown > 0 ) {
+		--m_cooldown;
+		return false;
+	}
+	double load{ target > 0.0 ? m_measured / target : 1.0 };
+	if( selection_count >= settings::MAX_NUMBER_SELECTED_NODES )
+		load = std::max( load, 1.0 + 2.0 * settings::LOD_BUDGET_HYSTERESIS );
+	if( load > 1.0 + settings::LOD_BUDGET_HYSTERESIS )
+		m_frames_outside = std::max( m_frames_outside, 0 ) + 1;
+	else if( load < 1.0 - settings::LOD_BUDGET_HYSTERESIS )
+		m_frames_outside = std::min( m_frames_outside, 0 ) - 1;
+	else
+		m_frames_outside = 0;
+	if( std::abs( m_frames_outside ) < (int)settings::LOD_BUDGET_REACTION_FRAMES )
+		return false;
+	// Step proportional to the deviation, limited to keep it stable
+	const double step{ 1.0 + settings::LOD_BUDGET_GAIN * std::min( std::abs( load - 1.0 ), 1.0 ) };
+	const double old_ratio{ m_ratio };
+	m_ratio = std::clamp( m_frames_outside > 0 ? m_ratio * step : m_ratio / step,
+			settings::LOD_BUDGET_MIN_DISTANCE_RATIO, settings::LOD_BUDGET_MAX_DISTANCE_RATIO );
+	m_frames_outside = 0;
+	// Give the measurement time to follow
+	m_cooldown = settings::LOD_BUDGET_REACTION_FRAMES;
+	return m_ratio != old_ratio;
+}
+
+double lod_budget::get_distance_ratio() const {
+	return m_ratio;
+}
+
+double lod_budget::get_measured() const {
+	return m_measured;
+}
+
+}
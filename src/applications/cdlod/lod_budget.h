@@ -0,0 +1,42 @@
+
+/* Keeps triangle count or frame time near a target by adjusting the lod level distance ratio.
+ * Higher ratios put fewer triangles into the view range. Measurements are smoothed and only
+ * acted upon if they leave a band around the target for some frames (hysteresis), so the
+ * ranges don't change every frame. An overflowing selection counts as over budget. */
+
+#pragma once
+
+namespace terrain {
+
+class lod_budget {
+public:
+	typedef enum : int {
+		OFF = 0, TRIANGLES, FRAME_TIME
+	} budget_mode;
+
+	lod_budget( const double initial_ratio );
+	virtual ~lod_budget();
+
+	/* Feed last frame's numbers. Returns true if the distance ratio has changed
+	 * and the lod ranges must be recalculated. */
+	bool update( const unsigned int triangles, const double frame_seconds, const unsigned int selection_count );
+	double get_distance_ratio() const;
+	// Smoothed measurement of the current mode, triangles or milliseconds.
+	double get_measured() const;
+
+	budget_mode m_mode{ OFF };
+	int m_target_triangles;
+	float m_target_frame_ms;
+
+private:
+	double m_ratio;
+	double m_measured{ 0.0 };
+	// Frames in a row outside the band, negative below.
+	int m_frames_outside{ 0 };
+	unsigned int m_cooldown{ 0 };
+	// Mode of the last update, the state is reset when it changes.
+	budget_mode m_last_mode{ OFF };
+
+};
+
+}
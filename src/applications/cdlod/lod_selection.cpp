@@ -2,61 +2,153 @@
 #include "lod_selection.h"
 #include "node.h"
 #include "quadtree.h"
+#include "base/frame_arena.h"
 #include "base/logbook.h"
 #include "omath/common.h"	// lerp()
 #include <sstream>
 #include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <tuple>
 
 using namespace orf_n;
 
 namespace terrain {
 
-lod_selection::lod_selection( const camera *cam, bool sort ) :
-		m_camera{ cam }, m_sort_by_distance{ sort } {
+lod_selection::lod_selection( const view_t &view, bool sort ) :
+		m_view{ view }, m_sort_by_distance{ sort } {
 	calculate_ranges();
 }
 
 lod_selection::~lod_selection() {}
 
-void lod_selection::calculate_ranges() {
+// static
+lod_selection::view_t lod_selection::make_view( const camera *cam ) {
+	view_t v;
+	v.frustum = cam->get_view_frustum();
+	v.position = cam->get_position();
+	v.near_plane = cam->get_near_plane();
+	v.far_plane = cam->get_far_plane();
+	v.screen_space_factor = cam->get_screen_space_factor();
+	return v;
+}
+
+void lod_selection::set_view( const view_t &view ) {
+	const bool planes_changed{ view.near_plane != m_view.near_plane || view.far_plane != m_view.far_plane };
+	m_view = view;
+	if( planes_changed )
+		calculate_ranges();
+}
+
+void lod_selection::set_metric( const selection_metric metric, const float pixel_error_threshold,
+		const float *const level_errors ) {
+	m_metric = metric;
+	m_pixel_error_threshold = pixel_error_threshold;
+	if( nullptr != level_errors )
+		std::copy( level_errors, level_errors + settings::NUMBER_OF_LOD_LEVELS, m_level_errors );
+}
+
+void lod_selection::calculate_ranges( const bool debug_output ) {
 	double total=0;
 	double current_detail_balance=1.0;
 	for( unsigned int i=0; i < settings::NUMBER_OF_LOD_LEVELS; ++i ) {
 		total += current_detail_balance;
-		current_detail_balance *= settings::LOD_LEVEL_DISTANCE_RATIO;
+		current_detail_balance *= m_distance_ratio;
 	}
-	double sect{ ( m_camera->get_far_plane() - m_camera->get_near_plane() ) / total };
-	double prev_pos{ m_camera->get_near_plane() };
+	double sect{ ( m_view.far_plane - m_view.near_plane ) / total };
+	double prev_pos{ m_view.near_plane };
 	current_detail_balance = 1.0;
 	for( unsigned int i=0; i < settings::NUMBER_OF_LOD_LEVELS; ++i ) {
 		// @todo why is this inverted ?
 		m_visibility_ranges[settings::NUMBER_OF_LOD_LEVELS - i - 1] = prev_pos + sect * current_detail_balance;
 		prev_pos = m_visibility_ranges[settings::NUMBER_OF_LOD_LEVELS - i - 1];
-		current_detail_balance *= settings::LOD_LEVEL_DISTANCE_RATIO;
+		current_detail_balance *= m_distance_ratio;
 	}
-	prev_pos = m_camera->get_near_plane();
+	prev_pos = m_view.near_plane;
 	for( unsigned int i=0; i < settings::NUMBER_OF_LOD_LEVELS; ++i ) {
 		unsigned int index{ settings::NUMBER_OF_LOD_LEVELS - i - 1 };
 		m_morph_end[i] = m_visibility_ranges[index];
 		m_morph_start[i] = prev_pos + ( m_morph_end[i] - prev_pos ) * settings::MORPH_START_RATIO;
 		prev_pos = m_morph_start[i];
 	}
-	if( settings::DEBUG_OUTPUT_MORPH_LEVELS )
+	if( debug_output )
 		debug_output_morph_levels();
 }
 
 void lod_selection::reset() {
 	m_selection_count = 0;
+	m_current_tile = 0;
+	m_visible_tiles.clear();
 	m_max_selected_lod_level = 0;
 	m_sort_by_distance = settings::SORT_SELECTION;
 	m_min_selected_lod_level = settings::NUMBER_OF_LOD_LEVELS-1;
 	m_stop_at_level = settings::NUMBER_OF_LOD_LEVELS-1;
+	m_max_screen_space_error = 0.0;
+}
+
+double lod_selection::get_screen_space_error( const float geometric_error, const double distance ) const {
+	return (double)geometric_error * m_view.screen_space_factor / std::max( distance, m_view.near_plane );
+}
+
+unsigned int lod_selection::get_triangle_count( const unsigned int triangles_per_node ) const {
+	unsigned int count{ 0 };
+	for( unsigned int i = 0; i < m_selection_count; ++i ) {
+		const selected_node &n{ m_selected_nodes[i] };
+		const unsigned int quadrants{ (unsigned int)n.has_tl + n.has_tr + n.has_bl + n.has_br };
+		count += triangles_per_node / 4 * quadrants;
+	}
+	return count;
+}
+
+void lod_selection::get_quadrant_boxes( std::vector<quadrant_box> &boxes ) const {
+	boxes.clear();
+	omath::daabb box;
+	for( unsigned int i = 0; i < m_selection_count; ++i ) {
+		const selected_node &n{ m_selected_nodes[i] };
+		const bool has[4]{ n.has_tl, n.has_tr, n.has_bl, n.has_br };
+		const node *const children[4]{ n.p_node->get_tl(), n.p_node->get_tr(), n.p_node->get_bl(), n.p_node->get_br() };
+		unsigned int without_child{ 0 };
+		for( unsigned int c = 0; c < 4; ++c ) {
+			if( !has[c] )
+				continue;
+			if( nullptr != children[c] )
+				boxes.push_back( quadrant_box{ i, 1u << c, children[c]->get_world_aabb( box ) } );
+			else
+				without_child |= 1u << c;
+		}
+		if( 0 != without_child )
+			boxes.push_back( quadrant_box{ i, without_child, n.p_node->get_world_aabb( box ) } );
+	}
+}
+
+void lod_selection::remove_quadrants( const std::vector<unsigned int> &hidden, const unsigned int triangles_per_node,
+		unsigned int &removed_nodes, unsigned int &removed_triangles ) {
+	unsigned int count{ 0 };
+	for( unsigned int i = 0; i < m_selection_count; ++i ) {
+		selected_node n{ m_selected_nodes[i] };
+		if( 0 != hidden[i] ) {
+			const unsigned int before{ (unsigned int)n.has_tl + n.has_tr + n.has_bl + n.has_br };
+			n.has_tl = n.has_tl && !( hidden[i] & QUADRANT_TL );
+			n.has_tr = n.has_tr && !( hidden[i] & QUADRANT_TR );
+			n.has_bl = n.has_bl && !( hidden[i] & QUADRANT_BL );
+			n.has_br = n.has_br && !( hidden[i] & QUADRANT_BR );
+			const unsigned int after{ (unsigned int)n.has_tl + n.has_tr + n.has_bl + n.has_br };
+			removed_triangles += ( before - after ) * ( triangles_per_node / 4 );
+			if( 0 == after ) {
+				++removed_nodes;
+				continue;
+			}
+		}
+		m_selected_nodes[count++] = n;
+	}
+	m_selection_count = count;
 }
 
 static inline int compareCloserFirst( const void *arg1, const void *arg2 ) {
 	const lod_selection::selected_node *a = (const lod_selection::selected_node *)arg1;
 	const lod_selection::selected_node *b = (const lod_selection::selected_node *)arg2;
-	return a->min_distance_to_camera > b->min_distance_to_camera;
+	// qsort needs the sign, not just a bool
+	return ( a->min_distance_to_camera > b->min_distance_to_camera ) - ( a->min_distance_to_camera < b->min_distance_to_camera );
 }
 
 // sort by tile index and distance
@@ -65,15 +157,67 @@ void lod_selection::set_distances_and_sort() {
 		std::qsort( m_selected_nodes, m_selection_count, sizeof( *m_selected_nodes ), compareCloserFirst );
 }
 
+/* Drawn quadrants are cells of the next level, keyed by that level and their position in units of its node size
+ * over all tiles. A patch's neighbour across a half edge is drawn at the same level if that cell is there, coarser
+ * if its parent cell is there and finer if one of its child cells is. */
+void lod_selection::calculate_edge_morphs() {
+	for( unsigned int i = 0; i < m_selection_count; ++i )
+		m_selected_nodes[i].edge_morphs = 0;
+	if( SCREEN_SPACE_ERROR != m_metric )
+		return;
+	typedef std::tuple<unsigned int, long long, long long> cell;
+	// Node level and cell of the top left quadrant of the selected nodes
+	orf_n::frame_vector<cell> origins;
+	origins.reserve( m_selection_count );
+	orf_n::frame_vector<cell> cells;
+	cells.reserve( m_selection_count * 4 );
+	for( unsigned int i = 0; i < m_selection_count; ++i ) {
+		const selected_node &n{ m_selected_nodes[i] };
+		const unsigned int level{ n.p_node->get_level() };
+		const double cell_size{ 0.5 * n.p_node->get_size() };
+		const long long x{ (long long)std::floor( n.p_node->get_raster_aabb().m_min.x / cell_size ) };
+		const long long z{ (long long)std::floor( n.p_node->get_raster_aabb().m_min.z / cell_size ) };
+		origins.push_back( cell{ level, x, z } );
+		const bool has[4]{ n.has_tl, n.has_tr, n.has_bl, n.has_br };
+		for( unsigned int q = 0; q < 4; ++q )
+			if( has[q] )
+				cells.push_back( cell{ level + 1, x + q % 2, z + q / 2 } );
+	}
+	std::sort( cells.begin(), cells.end() );
+	const auto drawn = [&cells]( const unsigned int level, const long long x, const long long z ) {
+		return std::binary_search( cells.begin(), cells.end(), cell{ level, x, z } );
+	};
+	// Neighbour cells across the half edges, relative to the top left quadrant, in the order of edge_bits
+	const int offset_x[8]{ 0, 1, 0, 1, -1, -1, 2, 2 };
+	const int offset_z[8]{ -1, -1, 2, 2, 0, 1, 0, 1 };
+	for( unsigned int i = 0; i < m_selection_count; ++i ) {
+		const unsigned int level{ std::get<0>( origins[i] ) };
+		unsigned int coarser{ 0 }, finer{ 0 };
+		for( unsigned int e = 0; e < 8; ++e ) {
+			const long long x{ std::get<1>( origins[i] ) + offset_x[e] };
+			const long long z{ std::get<2>( origins[i] ) + offset_z[e] };
+			if( drawn( level + 1, x, z ) )
+				continue;
+			// Floor division for cells left of or above the raster origin
+			if( level > 0 && drawn( level, x >> 1, z >> 1 ) )
+				coarser |= 1u << e;
+			else if( drawn( level + 2, 2 * x, 2 * z ) || drawn( level + 2, 2 * x + 1, 2 * z ) ||
+					drawn( level + 2, 2 * x, 2 * z + 1 ) || drawn( level + 2, 2 * x + 1, 2 * z + 1 ) )
+				finer |= 1u << e;
+		}
+		m_selected_nodes[i].edge_morphs = coarser | ( finer << 8 );
+	}
+}
+
 void lod_selection::print_selection() const {
-	std::ostringstream s;
+	orf_n::frame_ostringstream s;
 	s << "Selected node #: level / raster bounding box / distance from cam:";
 	for( unsigned int i = 0; i < m_selection_count; ++i ) {
 		const selected_node *n = &m_selected_nodes[i];
 		omath::daabb box; n->p_node->get_world_aabb(box);
 		s << "\n\t" << i << ": " << n->lod_level <<" / " <<	box << " / " << n->min_distance_to_camera;
 	}
-	logbook::log_msg( logbook::TERRAIN, logbook::INFO, s.str() );
+	logbook::log_msg( logbook::TERRAIN, logbook::INFO, s.str().c_str() );
 }
 
 static inline double cdlod_lerp(double const &a, double const &b, double const &f ) {
@@ -93,6 +237,11 @@ bool lod_selection::selected_node::is_vis_dist_too_small() const {
 	return (lod_level & 0x80000000) != 0;
 }
 
+unsigned int lod_selection::selected_node::get_quadrants() const {
+	return ( has_tl ? QUADRANT_TL : 0u ) | ( has_tr ? QUADRANT_TR : 0u ) | ( has_bl ? QUADRANT_BL : 0u ) |
+			( has_br ? QUADRANT_BR : 0u );
+}
+
 void lod_selection::debug_output_morph_levels() const {
 	std::ostringstream s;
 	s << "Lod levels and ranges: lvl: range / morph-start / morph-end ";
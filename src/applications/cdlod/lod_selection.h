@@ -3,8 +3,10 @@
 
 #include "settings.h"
 #include "applications/camera/camera.h"
+#include "omath/aabb.h"
 #include "omath/vec4.h"
 #include <climits>
+#include <vector>
 
 namespace terrain {
 
@@ -13,6 +15,14 @@ class quadtree;
 
 class lod_selection {
 public:
+	/* DISTANCE refines nodes inside the distance range of the next level. SCREEN_SPACE_ERROR additionally
+	 * requires the geometric error around the node to project to more than the pixel threshold, so smooth
+	 * terrain stays coarse, see node::is_error_visible(). Neighbours still differ by one level at most, and
+	 * the edges between them are morphed to match, see calculate_edge_morphs(). */
+	typedef enum : unsigned int {
+		DISTANCE, SCREEN_SPACE_ERROR
+	} selection_metric;
+
 	typedef struct selected_node {
 		node *p_node{ nullptr };
 		// First bit is used to mark too short visibility ranges.
@@ -22,33 +32,100 @@ public:
 		bool has_bl{ false };
 		bool has_br{ false };
 		double min_distance_to_camera{ 0.0 };	// for sorting by distance
+		// Index of the tile in the quadtree forest
+		unsigned int tile_index{ 0 };
+		// Half edges bordering a coarser patch in bits 0-7 and a finer one in bits 8-15, see edge_bits.
+		unsigned int edge_morphs{ 0 };
 		selected_node() {};
 		selected_node( node *n, unsigned int lvl, bool tl, bool tr, bool bl, bool br ) :
 			p_node{n}, lod_level{lvl}, has_tl{tl}, has_tr{tr}, has_bl{bl}, has_br{br} {}
 		bool is_vis_dist_too_small() const;
+		// Drawn quadrants as quadrant_bits
+		unsigned int get_quadrants() const;
 	} selected_node;
 
-	lod_selection( const orf_n::camera *cam, bool sortByDistance = false );
+	/* What the selection is made for. A snapshot, so selections for several views
+	 * (main camera, shadow cascades, reflections) can be made in one traversal. */
+	typedef struct view_t {
+		omath::view_frustum frustum;
+		omath::dvec3 position{ 0.0 };
+		double near_plane{ 1.0 };
+		double far_plane{ 1000.0 };
+		// See camera::get_screen_space_factor()
+		double screen_space_factor{ 1.0 };
+	} view_t;
+
+	// Bits of the quadrants of a selected node.
+	typedef enum : unsigned int {
+		QUADRANT_TL = 1, QUADRANT_TR = 2, QUADRANT_BL = 4, QUADRANT_BR = 8
+	} quadrant_bits;
+
+	/* Half edges of a node, top and bottom edge left half first, then left and right edge top half first.
+	 * The node's grid is fully morphed on edges to coarser patches and not morphed on those to finer ones. */
+	typedef enum : unsigned int {
+		EDGE_TOP_L = 1, EDGE_TOP_R = 2, EDGE_BOTTOM_L = 4, EDGE_BOTTOM_R = 8,
+		EDGE_LEFT_T = 16, EDGE_LEFT_B = 32, EDGE_RIGHT_T = 64, EDGE_RIGHT_B = 128
+	} edge_bits;
+
+	// Box of one or more drawn quadrants of a selected node, for culling after selection.
+	typedef struct quadrant_box {
+		unsigned int selected_index;
+		unsigned int quadrants;
+		omath::daabb box;
+	} quadrant_box;
+
+	lod_selection( const view_t &view, bool sortByDistance = false );
 	virtual ~lod_selection();
-	// Called when camera near or far plane changed to recalc visibility and morph ranges.
-	void calculate_ranges();
+	static view_t make_view( const orf_n::camera *cam );
+	// Call every frame before reset() for a moving view. Recalculates ranges if near or far plane changed.
+	void set_view( const view_t &view );
+	// Called when camera near or far plane or the distance ratio changed to recalc visibility and morph ranges.
+	void calculate_ranges( const bool debug_output = settings::DEBUG_OUTPUT_MORPH_LEVELS );
+	/* For SCREEN_SPACE_ERROR, level_errors bound the geometric errors per node level of neighbouring tiles for
+	 * nodes at tile borders, see quadtree_forest::get_max_geometric_errors(). Not needed for a single tree. */
+	void set_metric( const selection_metric metric, const float pixel_error_threshold = settings::PIXEL_ERROR_THRESHOLD,
+			const float *const level_errors = nullptr );
 	void set_distances_and_sort();
+	// Sets the selected nodes' edge_morphs for SCREEN_SPACE_ERROR after selection. Before culling, so they stay valid.
+	void calculate_edge_morphs();
 	// Here all parameters are set. TODO parametrize sorting and stop level.
 	void reset();
 	void print_selection() const;
 	const omath::vec4 get_morph_consts( const unsigned int lodLevel ) const;
+	// Geometric error projected to pixels at the given distance from the view position.
+	double get_screen_space_error( const float geometric_error, const double distance ) const;
+	// Triangles drawn for the selection, with the given number of triangles for a full node.
+	unsigned int get_triangle_count( const unsigned int triangles_per_node ) const;
+	// Child node boxes of the drawn quadrants, the node's box for quadrants without a child.
+	void get_quadrant_boxes( std::vector<quadrant_box> &boxes ) const;
+	/* Removes the quadrant bits given per selected node, then nodes without quadrants, keeping the order.
+	 * Adds the removed nodes and triangles to the counters. */
+	void remove_quadrants( const std::vector<unsigned int> &hidden, const unsigned int triangles_per_node,
+			unsigned int &removed_nodes, unsigned int &removed_triangles );
 
-	const orf_n::camera *m_camera{ nullptr };
+	view_t m_view;
 	selected_node m_selected_nodes[settings::MAX_NUMBER_SELECTED_NODES];
 
 	double m_visibility_ranges[settings::NUMBER_OF_LOD_LEVELS];
 	bool m_sort_by_distance = false;
+	// Initially settings::LOD_LEVEL_DISTANCE_RATIO, changed by the budget controller.
+	double m_distance_ratio = settings::LOD_LEVEL_DISTANCE_RATIO;
+	// Change these with set_metric().
+	selection_metric m_metric = DISTANCE;
+	float m_pixel_error_threshold = settings::PIXEL_ERROR_THRESHOLD;
+	float m_level_errors[settings::NUMBER_OF_LOD_LEVELS]{};
+	// Largest projected error of the selected nodes.
+	double m_max_screen_space_error = 0.0;
 	bool m_vis_dist_too_small = false;
 	double m_morph_start[settings::NUMBER_OF_LOD_LEVELS];
 	double m_morph_end[settings::NUMBER_OF_LOD_LEVELS];
 	// Stop at this level when selecting nodes. Can accelarate the process for only far away terrain.
 	unsigned int m_stop_at_level = settings::NUMBER_OF_LOD_LEVELS-1;
 	unsigned int m_selection_count = 0;
+	// Tile of the quadtree currently descended, stored with the selected nodes.
+	unsigned int m_current_tile = 0;
+	// Tiles visible in this selection, nearest first.
+	std::vector<unsigned int> m_visible_tiles;
 	unsigned int m_max_selected_lod_level = 0;
 	unsigned int m_min_selected_lod_level = settings::NUMBER_OF_LOD_LEVELS-1;
 
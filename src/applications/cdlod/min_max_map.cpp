@@ -0,0 +1,182 @@
+
+#include "min_max_map.h"
+#include "base/logbook.h"
+#include <algorithm>
+#include <fstream>
+
+namespace terrain {
+
+static const char MIN_MAX_MAP_MAGIC[4]{ 'C', 'D', 'M', 'M' };
+static const uint32_t MIN_MAX_MAP_VERSION{ 1 };
+
+min_max_map::min_max_map( const uint16_t *values, const omath::uvec2 &extent,
+		const unsigned int leaf_size, const unsigned int number_of_levels ) :
+				m_extent{ extent }, m_leaf_size{ leaf_size }, m_number_of_levels{ number_of_levels } {
+	m_level_blocks.resize( m_number_of_levels );
+	m_levels.resize( m_number_of_levels );
+	// Exact min/max of leaf blocks, including the far edge posts
+	omath::uvec2 &blocks{ m_level_blocks[0] };
+	// A raster of n*leaf_size+1 posts (tiles with overlapping edge) has n blocks.
+	blocks = omath::uvec2{
+		m_extent.x > 1 ? ( m_extent.x - 2 ) / m_leaf_size + 1 : 1,
+		m_extent.y > 1 ? ( m_extent.y - 2 ) / m_leaf_size + 1 : 1
+	};
+	std::vector<uint16_t> &leafs{ m_levels[0] };
+	leafs.resize( blocks.x * blocks.y * 2 );
+	for( unsigned int i = 0; i < blocks.x * blocks.y; ++i ) {
+		leafs[i*2] = UINT16_MAX;
+		leafs[i*2+1] = 0;
+	}
+	// Row by row, so the raster is traversed linearly. Edge posts belong to two blocks.
+	for( unsigned int z = 0; z < m_extent.y; ++z ) {
+		const unsigned int bz0{ std::min( z / m_leaf_size, blocks.y - 1 ) };
+		const unsigned int bz1{ std::min( ( z % m_leaf_size == 0 && z > 0 ) ? z / m_leaf_size - 1 : z / m_leaf_size, bz0 ) };
+		const uint16_t *row{ values + size_t( z ) * m_extent.x };
+		for( unsigned int x = 0; x < m_extent.x; ++x ) {
+			const uint16_t v{ row[x] };
+			const unsigned int bx0{ std::min( x / m_leaf_size, blocks.x - 1 ) };
+			const unsigned int bx1{ std::min( ( x % m_leaf_size == 0 && x > 0 ) ? x / m_leaf_size - 1 : x / m_leaf_size, bx0 ) };
+			for( unsigned int bz = bz1; bz <= bz0; ++bz )
+				for( unsigned int bx = bx1; bx <= bx0; ++bx ) {
+					uint16_t *b{ &leafs[( bx + bz * blocks.x ) * 2] };
+					b[0] = std::min( b[0], v );
+					b[1] = std::max( b[1], v );
+				}
+		}
+	}
+	// Coarser levels merge the up to four blocks below
+	for( unsigned int l = 1; l < m_number_of_levels; ++l ) {
+		const omath::uvec2 &below{ m_level_blocks[l-1] };
+		const std::vector<uint16_t> &prev{ m_levels[l-1] };
+		omath::uvec2 &b{ m_level_blocks[l] };
+		b = omath::uvec2{ ( below.x + 1 ) / 2, ( below.y + 1 ) / 2 };
+		std::vector<uint16_t> &cur{ m_levels[l] };
+		cur.resize( b.x * b.y * 2 );
+		for( unsigned int z = 0; z < b.y; ++z )
+			for( unsigned int x = 0; x < b.x; ++x ) {
+				uint16_t mn{ UINT16_MAX }, mx{ 0 };
+				for( unsigned int cz = z * 2; cz < std::min( z * 2 + 2, below.y ); ++cz )
+					for( unsigned int cx = x * 2; cx < std::min( x * 2 + 2, below.x ); ++cx ) {
+						mn = std::min( mn, prev[( cx + cz * below.x ) * 2] );
+						mx = std::max( mx, prev[( cx + cz * below.x ) * 2 + 1] );
+					}
+				cur[( x + z * b.x ) * 2] = mn;
+				cur[( x + z * b.x ) * 2 + 1] = mx;
+			}
+	}
+}
+
+min_max_map::~min_max_map() {}
+
+unsigned int min_max_map::get_level( const unsigned int size ) const {
+	unsigned int level{ 0 };
+	unsigned int s{ m_leaf_size };
+	while( s < size ) {
+		s *= 2;
+		++level;
+	}
+	return level;
+}
+
+bool min_max_map::has_level( const unsigned int size ) const {
+	if( size < m_leaf_size || size % m_leaf_size != 0 )
+		return false;
+	return get_level( size ) < m_number_of_levels;
+}
+
+omath::vec2 min_max_map::get_min_max( const unsigned int x, const unsigned int z, const unsigned int size ) const {
+	const unsigned int level{ get_level( size ) };
+	const omath::uvec2 &b{ m_level_blocks[level] };
+	const unsigned int bx{ std::min( x / size, b.x - 1 ) };
+	const unsigned int bz{ std::min( z / size, b.y - 1 ) };
+	const uint16_t *v{ &m_levels[level][( bx + bz * b.x ) * 2] };
+	return omath::vec2{ (float)v[0], (float)v[1] };
+}
+
+unsigned int min_max_map::get_leaf_size() const {
+	return m_leaf_size;
+}
+
+unsigned int min_max_map::get_number_of_levels() const {
+	return m_number_of_levels;
+}
+
+size_t min_max_map::get_size_in_bytes() const {
+	size_t s{ sizeof( *this ) };
+	for( const std::vector<uint16_t> &l : m_levels )
+		s += l.size() * sizeof( uint16_t );
+	return s;
+}
+
+bool min_max_map::write( std::ostream &out ) const {
+	const uint32_t header[]{ MIN_MAX_MAP_VERSION, m_extent.x, m_extent.y, m_leaf_size, m_number_of_levels };
+	out.write( MIN_MAX_MAP_MAGIC, sizeof( MIN_MAX_MAP_MAGIC ) );
+	out.write( reinterpret_cast<const char *>( header ), sizeof( header ) );
+	for( unsigned int l = 0; l < m_number_of_levels; ++l ) {
+		const uint32_t blocks[]{ m_level_blocks[l].x, m_level_blocks[l].y };
+		out.write( reinterpret_cast<const char *>( blocks ), sizeof( blocks ) );
+		out.write( reinterpret_cast<const char *>( m_levels[l].data() ), m_levels[l].size() * sizeof( uint16_t ) );
+	}
+	return out.good();
+}
+
+bool min_max_map::save( const std::string &filename ) const {
+	std::ofstream f{ filename, std::ios::out | std::ios::binary | std::ios::trunc };
+	if( !f.is_open() || !write( f ) ) {
+		orf_n::logbook::log_msg( orf_n::logbook::TERRAIN, orf_n::logbook::ERROR,
+				"Error writing min/max map '" + filename + "'." );
+		return false;
+	}
+	return true;
+}
+
+// static
+std::unique_ptr<min_max_map> min_max_map::read( std::istream &in, const omath::uvec2 &extent ) {
+	char magic[4];
+	uint32_t header[5];
+	in.read( magic, sizeof( magic ) );
+	in.read( reinterpret_cast<char *>( header ), sizeof( header ) );
+	if( !in.good() || !std::equal( magic, magic + 4, MIN_MAX_MAP_MAGIC ) || header[0] != MIN_MAX_MAP_VERSION )
+		return nullptr;
+	// The map must have been built from a raster of this size, then the block counts are known.
+	if( header[1] != extent.x || header[2] != extent.y || 0 == extent.x || 0 == extent.y ||
+			0 == header[3] || header[4] > 32 )
+		return nullptr;
+	std::unique_ptr<min_max_map> m{ new min_max_map };
+	m->m_extent = extent;
+	m->m_leaf_size = header[3];
+	m->m_number_of_levels = header[4];
+	m->m_level_blocks.resize( m->m_number_of_levels );
+	m->m_levels.resize( m->m_number_of_levels );
+	omath::uvec2 expected{
+		extent.x > 1 ? ( extent.x - 2 ) / m->m_leaf_size + 1 : 1,
+		extent.y > 1 ? ( extent.y - 2 ) / m->m_leaf_size + 1 : 1
+	};
+	for( unsigned int l = 0; l < m->m_number_of_levels; ++l ) {
+		uint32_t blocks[2];
+		in.read( reinterpret_cast<char *>( blocks ), sizeof( blocks ) );
+		if( !in.good() || blocks[0] != expected.x || blocks[1] != expected.y )
+			return nullptr;
+		m->m_level_blocks[l] = expected;
+		m->m_levels[l].resize( size_t( blocks[0] ) * blocks[1] * 2 );
+		in.read( reinterpret_cast<char *>( m->m_levels[l].data() ), m->m_levels[l].size() * sizeof( uint16_t ) );
+		expected = omath::uvec2{ ( expected.x + 1 ) / 2, ( expected.y + 1 ) / 2 };
+	}
+	if( !in.good() )
+		return nullptr;
+	return m;
+}
+
+// static
+std::unique_ptr<min_max_map> min_max_map::load( const std::string &filename, const omath::uvec2 &extent ) {
+	std::ifstream f{ filename, std::ios::in | std::ios::binary };
+	if( !f.is_open() )
+		return nullptr;
+	std::unique_ptr<min_max_map> m{ read( f, extent ) };
+	if( nullptr == m )
+		orf_n::logbook::log_msg( orf_n::logbook::TERRAIN, orf_n::logbook::WARNING,
+				"'" + filename + "' is not a valid min/max map for the heightmap. Ignored." );
+	return m;
+}
+
+}
@@ -0,0 +1,55 @@
+/* Pyramid of min/max heights over square blocks of a heightmap raster.
+ * Level 0 has blocks of leaf node size, every following level doubles the block size,
+ * so there is one level per quadtree lod level and the blocks match the quadtree nodes.
+ * Blocks include their far edge posts, like the gridmesh drawn over a node does.
+ * This is the quadtree cache: written by the preprocessor, read back at startup,
+ * or built from the heightmap values if there's no file. */
+
+#pragma once
+
+#include "omath/vec2.h"
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace terrain {
+
+class min_max_map {
+public:
+	// values is a raster of extent.x * extent.y posts.
+	min_max_map( const uint16_t *values, const omath::uvec2 &extent,
+			const unsigned int leaf_size, const unsigned int number_of_levels );
+	virtual ~min_max_map();
+
+	// Min/max height of the block with origin x/z and size (which is leaf size * 2^n). .x is min, .y max.
+	omath::vec2 get_min_max( const unsigned int x, const unsigned int z, const unsigned int size ) const;
+	// Returns true if there are blocks for nodes of that size.
+	bool has_level( const unsigned int size ) const;
+	unsigned int get_leaf_size() const;
+	unsigned int get_number_of_levels() const;
+	size_t get_size_in_bytes() const;
+
+	bool write( std::ostream &out ) const;
+	bool save( const std::string &filename ) const;
+	/* Return nullptr if the file does not exist or is not a min/max map of a raster with the given extent.
+	 * Block counts are checked against the extent before anything is allocated. */
+	static std::unique_ptr<min_max_map> read( std::istream &in, const omath::uvec2 &extent );
+	static std::unique_ptr<min_max_map> load( const std::string &filename, const omath::uvec2 &extent );
+
+private:
+	min_max_map() = default;
+
+	omath::uvec2 m_extent;
+	unsigned int m_leaf_size{ 0 };
+	unsigned int m_number_of_levels{ 0 };
+	// Per level, number of blocks in x and z, and interleaved min/max values.
+	std::vector<omath::uvec2> m_level_blocks;
+	std::vector<std::vector<uint16_t>> m_levels;
+
+	unsigned int get_level( const unsigned int size ) const;
+
+};
+
+}
@@ -1,6 +1,7 @@
 
 #include "lod_selection.h"
 #include "heightmap.h"
+#include "min_max_map.h"
 #include "node.h"
 #include "quadtree.h"
 #include "base/logbook.h"
@@ -9,6 +10,7 @@
 #include <sstream>
 #include <algorithm>
 #include <cmath>
+#include <limits>
 
 using namespace orf_n;
 
@@ -16,15 +18,55 @@ namespace terrain {
 
 node::node() {}
 
+// Max deviation of heights inside the node from the bilinear surface through its grid posts.
+static float calculate_geometric_error(
+		const heightmap *const h_map, const unsigned int x, const unsigned int z, const unsigned int size ) {
+	const unsigned int step{ size / settings::GRIDMESH_DIMENSION };
+	if( step <= 1 )
+		return 0.0f;
+	const unsigned int last_x{ h_map->get_extent().x - 1 };
+	const unsigned int last_z{ h_map->get_extent().y - 1 };
+	const unsigned int end_x{ std::min( last_x, x + size ) };
+	const unsigned int end_z{ std::min( last_z, z + size ) };
+	float error{ 0.0f };
+	for( unsigned int cz = z; cz < end_z; cz += step ) {
+		const unsigned int cz1{ std::min( cz + step, last_z ) };
+		for( unsigned int cx = x; cx < end_x; cx += step ) {
+			const unsigned int cx1{ std::min( cx + step, last_x ) };
+			const float h00{ h_map->get_height_at( cx, cz ) };
+			const float h10{ h_map->get_height_at( cx1, cz ) };
+			const float h01{ h_map->get_height_at( cx, cz1 ) };
+			const float h11{ h_map->get_height_at( cx1, cz1 ) };
+			for( unsigned int pz = cz; pz <= cz1; ++pz ) {
+				const float fz{ float( pz - cz ) / float( step ) };
+				for( unsigned int px = cx; px <= cx1; ++px ) {
+					const float fx{ float( px - cx ) / float( step ) };
+					const float interpolated{
+						( h00 * ( 1.0f - fx ) + h10 * fx ) * ( 1.0f - fz ) + ( h01 * ( 1.0f - fx ) + h11 * fx ) * fz
+					};
+					error = std::max( error, std::abs( h_map->get_height_at( px, pz ) - interpolated ) );
+				}
+			}
+		}
+	}
+	return error;
+}
+
 void node::create(
 		const unsigned int x, const unsigned int z, const unsigned int size, const unsigned int level,
-		const heightmap *const h_map, node *all_nodes, unsigned int &last_index ) {
+		const heightmap *const h_map, node *all_nodes, unsigned int &last_index,
+		job_system::task_group *group ) {
 	m_x = x;
 	m_z = z;
 	m_level = level;
 	// Find min/max heights at this patch of terrain
 	omath::vec2 min_max_height;
-	if( settings::FAST_TREE_GENERATION ) {
+	const min_max_map *mm{ h_map->get_min_max_map() };
+	if( nullptr != mm && mm->has_level( size ) ) {
+		min_max_height = mm->get_min_max( x, z, size );
+		min_max_height.x *= settings::HEIGHT_FACTOR;
+		min_max_height.y *= settings::HEIGHT_FACTOR;
+	} else if( settings::FAST_TREE_GENERATION ) {
 		const unsigned int limit_x = std::min( h_map->get_extent().x, x + size-1 );
 		const unsigned int limit_z = std::min( h_map->get_extent().y, z + size-1 );
 		const float tl = h_map->get_height_at(x, z);
@@ -48,6 +90,8 @@ void node::create(
 	m_aabb.m_max.x = box.m_min.x + float(m_x + size);
 	m_aabb.m_max.y = min_max_height.y;
 	m_aabb.m_max.z = box.m_min.z + float(m_z + size);
+	if( settings::COMPUTE_GEOMETRIC_ERROR )
+		m_geometric_error = calculate_geometric_error( h_map, x, z, size );
 	// Highest level reached already ?
 	if( size == settings::LEAF_NODE_SIZE ) {
 		if( level != settings::NUMBER_OF_LOD_LEVELS -1 ) {
@@ -58,24 +102,103 @@ void node::create(
 		// Mark leaf node!
 	    m_level |= 0x80000000;
 	} else {
-		unsigned int subSize = size / 2;
-		m_tl = &all_nodes[last_index++];
-		m_tl->create( x, z, subSize, level+1, h_map, all_nodes, last_index );
-		if( ( x + subSize ) < h_map->get_extent().x ) {
-	         m_tr = &all_nodes[last_index++];
-	         m_tr->create( x + subSize, z, subSize, level+1, h_map, all_nodes, last_index );
+		const unsigned int sub_size{ size / 2 };
+		const bool has_right{ x + sub_size < h_map->get_extent().x };
+		const bool has_bottom{ z + sub_size < h_map->get_extent().y };
+		const unsigned int sub_x[4]{ x, x + sub_size, x, x + sub_size };
+		const unsigned int sub_z[4]{ z, z, z + sub_size, z + sub_size };
+		node **const children[4]{ &m_tl, &m_tr, &m_bl, &m_br };
+		const bool exists[4]{ true, has_right, has_bottom, has_right && has_bottom };
+		const bool spawn{ nullptr != group && sub_size >= settings::PARALLEL_TREE_NODE_SIZE };
+		for( unsigned int i = 0; i < 4; ++i ) {
+			if( !exists[i] )
+				continue;
+			node *const child{ &all_nodes[last_index++] };
+			*children[i] = child;
+			if( spawn ) {
+				// The job places the sub tree behind the child, so skip its nodes here.
+				const unsigned int first{ last_index };
+				last_index += count_nodes( sub_x[i], sub_z[i], sub_size, h_map ) - 1;
+				group->run( [=]{
+					unsigned int index{ first };
+					child->create( sub_x[i], sub_z[i], sub_size, level + 1, h_map, all_nodes, index, group );
+				} );
+			} else
+				child->create( sub_x[i], sub_z[i], sub_size, level + 1, h_map, all_nodes, last_index, group );
 		}
-		if( (z + subSize) < h_map->get_extent().y ) {
-			m_bl = &all_nodes[last_index++];
-			m_bl->create( x, z + subSize, subSize, level+1, h_map, all_nodes, last_index );
+	}
+}
+
+// static
+unsigned int node::count_nodes( const unsigned int x, const unsigned int z, const unsigned int size,
+		const heightmap *const h_map ) {
+	if( size <= settings::LEAF_NODE_SIZE )
+		return 1;
+	const unsigned int sub_size{ size / 2 };
+	const bool has_right{ x + sub_size < h_map->get_extent().x };
+	const bool has_bottom{ z + sub_size < h_map->get_extent().y };
+	unsigned int count{ 1 + count_nodes( x, z, sub_size, h_map ) };
+	if( has_right )
+		count += count_nodes( x + sub_size, z, sub_size, h_map );
+	if( has_bottom )
+		count += count_nodes( x, z + sub_size, sub_size, h_map );
+	if( has_right && has_bottom )
+		count += count_nodes( x + sub_size, z + sub_size, sub_size, h_map );
+	return count;
+}
+
+void node::raise_error() {
+	for( const node *n : { m_tl, m_tr, m_bl, m_br } )
+		if( nullptr != n ) {
+			m_geometric_error = std::max( m_geometric_error, n->m_geometric_error );
+			// Fast tree generation only samples the corners
+			m_aabb.m_min.y = std::min( m_aabb.m_min.y, n->m_aabb.m_min.y );
+			m_aabb.m_max.y = std::max( m_aabb.m_max.y, n->m_aabb.m_max.y );
 		}
-		if( ( ( x + subSize ) < h_map->get_extent().x ) && ( ( z + subSize ) < h_map->get_extent().y ) ) {
-			m_br = &all_nodes[last_index++];
-			m_br->create( x + subSize, z + subSize, subSize, level+1, h_map, all_nodes, last_index );
+}
+
+void node::set_neighbourhood( const node *const *neighbours ) {
+	const float size{ m_aabb.m_max.x - m_aabb.m_min.x };
+	m_neighbourhood = m_aabb;
+	m_neighbourhood.m_min.x -= size;
+	m_neighbourhood.m_min.z -= size;
+	m_neighbourhood.m_max.x += size;
+	m_neighbourhood.m_max.z += size;
+	m_neighbourhood_error = m_geometric_error;
+	m_on_tile_border = false;
+	for( unsigned int i = 0; i < 9; ++i ) {
+		const node *const n{ neighbours[i] };
+		if( nullptr == n ) {
+			m_on_tile_border = true;
+			continue;
 		}
+		m_neighbourhood_error = std::max( m_neighbourhood_error, n->m_geometric_error );
+		m_neighbourhood.m_min.y = std::min( m_neighbourhood.m_min.y, n->m_aabb.m_min.y );
+		m_neighbourhood.m_max.y = std::max( m_neighbourhood.m_max.y, n->m_aabb.m_max.y );
+	}
+	// Heights of other tiles aren't known here, so only the horizontal distance counts.
+	if( m_on_tile_border ) {
+		m_neighbourhood.m_min.y = std::numeric_limits<float>::lowest();
+		m_neighbourhood.m_max.y = std::numeric_limits<float>::max();
 	}
 }
 
+/* A node that refines has a larger error or a nearer neighbourhood than the neighbourhoods of its children's
+ * neighbours, so these refine as well. Errors of other tiles are bounded by the selection's level errors. */
+bool node::is_error_visible( const lod_selection *const selection ) const {
+	float error{ m_neighbourhood_error };
+	if( m_on_tile_border )
+		error = std::max( error, selection->m_level_errors[get_level()] );
+	const omath::daabb box{
+		omath::dvec3{ m_neighbourhood.m_min.x * settings::RASTER_TO_WORLD_X, m_neighbourhood.m_min.y,
+			m_neighbourhood.m_min.z * settings::RASTER_TO_WORLD_Z },
+		omath::dvec3{ m_neighbourhood.m_max.x * settings::RASTER_TO_WORLD_X, m_neighbourhood.m_max.y,
+			m_neighbourhood.m_max.z * settings::RASTER_TO_WORLD_Z }
+	};
+	const double distance{ std::sqrt( box.min_distance_from_point_sq( selection->m_view.position ) ) };
+	return selection->get_screen_space_error( error, distance ) > selection->m_pixel_error_threshold;
+}
+
 node::~node() {}
 
 unsigned int node::get_size() const {
@@ -94,6 +217,10 @@ const omath::aabb &node::get_raster_aabb() const {
 	return m_aabb;
 }
 
+float node::get_geometric_error() const {
+	return m_geometric_error;
+}
+
 omath::daabb &node::get_world_aabb(omath::daabb &out_box) const {
 	out_box.m_min.x = m_aabb.m_min.x * settings::RASTER_TO_WORLD_X;
 	out_box.m_min.y = m_aabb.m_min.y;
@@ -124,88 +251,202 @@ bool node::is_leaf() const {
 	return (m_level & 0x80000000) != 0;
 }
 
+void node::get_visible_leaves( const omath::view_frustum &frustum, const bool parent_inside,
+		orf_n::frame_vector<const node *> &leaves ) const {
+	omath::t_intersect intersection{ omath::INSIDE };
+	if( !parent_inside ) {
+		omath::daabb world_aabb; get_world_aabb(world_aabb);
+		intersection = frustum.is_box_in_frustum( world_aabb );
+		if( omath::OUTSIDE == intersection )
+			return;
+	}
+	if( get_level() == settings::NUMBER_OF_LOD_LEVELS - 1 ) {
+		leaves.push_back( this );
+		return;
+	}
+	for( const node *c : { m_tl, m_tr, m_bl, m_br } )
+		if( nullptr != c )
+			c->get_visible_leaves( frustum, omath::INSIDE == intersection, leaves );
+}
+
+// Slab test, the ray parameters where it enters and leaves the box are clipped to [0, t_max].
+static bool intersect_box( const omath::aabb &box, const omath::dvec3 &origin, const omath::dvec3 &inverse_direction,
+		const double t_max, double &t_enter, double &t_exit ) {
+	t_enter = 0.0;
+	t_exit = t_max;
+	for( int i = 0; i < 3; ++i ) {
+		double t0{ ( box.m_min[i] - origin[i] ) * inverse_direction[i] };
+		double t1{ ( box.m_max[i] - origin[i] ) * inverse_direction[i] };
+		if( t0 > t1 )
+			std::swap( t0, t1 );
+		// NaN for a ray parallel to and in a slab's plane, it doesn't narrow the range then.
+		if( t0 > t_enter )
+			t_enter = t0;
+		if( t1 < t_exit )
+			t_exit = t1;
+	}
+	return t_enter <= t_exit;
+}
+
+bool node::raycast( const omath::dvec3 &origin, const omath::dvec3 &direction, const omath::dvec3 &inverse_direction,
+		const heightmap *const h_map, double &t_max, const node *&hit_node ) const {
+	double t_enter, t_exit;
+	if( !intersect_box( m_aabb, origin, inverse_direction, t_max, t_enter, t_exit ) )
+		return false;
+	if( is_leaf() ) {
+		double t;
+		if( !h_map->raycast( origin, direction, m_x, m_z, m_x + settings::LEAF_NODE_SIZE, m_z + settings::LEAF_NODE_SIZE,
+				t_enter, t_exit, t ) )
+			return false;
+		t_max = t;
+		hit_node = this;
+		return true;
+	}
+	// Children the ray passes, sorted by where it enters them
+	const node *children[4];
+	double enter[4];
+	unsigned int count{ 0 };
+	for( const node *c : { m_tl, m_tr, m_bl, m_br } ) {
+		double c_enter, c_exit;
+		if( nullptr == c || !intersect_box( c->m_aabb, origin, inverse_direction, t_max, c_enter, c_exit ) )
+			continue;
+		unsigned int i{ count++ };
+		for( ; i > 0 && enter[i-1] > c_enter; --i ) {
+			children[i] = children[i-1];
+			enter[i] = enter[i-1];
+		}
+		children[i] = c;
+		enter[i] = c_enter;
+	}
+	// A hit ends the descent into children the ray enters behind it.
+	bool hit{ false };
+	for( unsigned int i = 0; i < count && enter[i] <= t_max; ++i )
+		hit = children[i]->raycast( origin, direction, inverse_direction, h_map, t_max, hit_node ) || hit;
+	return hit;
+}
+
 omath::t_intersect node::lod_select( lod_selection *lodSelection, bool parentCompletelyInFrustum ) {
-	// Shortcut
-	const camera *cam{ lodSelection->m_camera };
-	// Test early outs
-	const omath::view_frustum f = cam->get_view_frustum();
+	omath::t_intersect result{ omath::UNDEFINED };
+	lod_select( &lodSelection, 1, 1u, parentCompletelyInFrustum ? 1u : 0u, &result );
+	return result;
+}
+
+void node::lod_select( lod_selection *const *selections, const unsigned int count, const uint32_t active,
+		const uint32_t parent_inside, omath::t_intersect *results ) {
+	// Per node work shared by all views
 	omath::daabb world_aabb; get_world_aabb(world_aabb);
-	omath::t_intersect frustumIntersection = parentCompletelyInFrustum ?
-			omath::INSIDE : cam->get_view_frustum().is_box_in_frustum( world_aabb );
-	if( omath::OUTSIDE == frustumIntersection )
-		return omath::OUTSIDE;
-	const double distanceLimit = lodSelection->m_visibility_ranges[get_level()];
-	if( !world_aabb.intersect_sphere_sq( cam->get_position(), distanceLimit * distanceLimit ) )
-		return omath::OUT_OF_RANGE;
-
-	omath::t_intersect subTLSelRes = omath::UNDEFINED;
-	omath::t_intersect subTRSelRes = omath::UNDEFINED;
-	omath::t_intersect subBLSelRes = omath::UNDEFINED;
-	omath::t_intersect subBRSelRes = omath::UNDEFINED;
-	// Stop at one below number of lod levels
-	if( get_level() != lodSelection->m_stop_at_level ) {
-		const double nextDistanceLimit = lodSelection->m_visibility_ranges[get_level()+1];
-		if( world_aabb.intersect_sphere_sq( cam->get_position(), nextDistanceLimit * nextDistanceLimit ) ) {
-			bool weAreCompletelyInFrustum = frustumIntersection == omath::INSIDE;
-			if( m_tl != nullptr )
-				subTLSelRes = m_tl->lod_select( lodSelection, weAreCompletelyInFrustum );
-			if( m_tr != nullptr )
-				subTRSelRes = m_tr->lod_select( lodSelection, weAreCompletelyInFrustum );
-			if( m_bl != nullptr )
-				subBLSelRes = m_bl->lod_select( lodSelection, weAreCompletelyInFrustum );
-			if( m_br != nullptr )
-				subBRSelRes = m_br->lod_select( lodSelection, weAreCompletelyInFrustum );
+	double distance_sq[settings::MAX_SELECTION_VIEWS];
+	omath::t_intersect frustum_intersection[settings::MAX_SELECTION_VIEWS];
+	uint32_t visible{ 0 }, descend{ 0 }, inside{ 0 };
+	// Test early outs
+	for( unsigned int i = 0; i < count; ++i ) {
+		const uint32_t bit{ 1u << i };
+		if( !( active & bit ) )
+			continue;
+		const lod_selection *s{ selections[i] };
+		// Views at the same position, like shadow cascades, share the distance.
+		distance_sq[i] = -1.0;
+		for( unsigned int j = 0; j < i; ++j )
+			if( ( active & ( 1u << j ) ) && selections[j]->m_view.position == s->m_view.position ) {
+				distance_sq[i] = distance_sq[j];
+				break;
+			}
+		if( distance_sq[i] < 0.0 )
+			distance_sq[i] = world_aabb.min_distance_from_point_sq( s->m_view.position );
+		frustum_intersection[i] = ( parent_inside & bit ) ?
+				omath::INSIDE : s->m_view.frustum.is_box_in_frustum( world_aabb );
+		if( omath::OUTSIDE == frustum_intersection[i] ) {
+			results[i] = omath::OUTSIDE;
+			continue;
+		}
+		const double distanceLimit = s->m_visibility_ranges[get_level()];
+		if( distance_sq[i] > distanceLimit * distanceLimit ) {
+			results[i] = omath::OUT_OF_RANGE;
+			continue;
+		}
+		visible |= bit;
+		if( omath::INSIDE == frustum_intersection[i] )
+			inside |= bit;
+		// Stop at one below number of lod levels
+		if( get_level() != s->m_stop_at_level ) {
+			const double nextDistanceLimit = s->m_visibility_ranges[get_level()+1];
+			// Screen space error metric: additionally, only refine if the error around the node is visible.
+			if( distance_sq[i] <= nextDistanceLimit * nextDistanceLimit &&
+					( lod_selection::SCREEN_SPACE_ERROR != s->m_metric || is_error_visible( s ) ) )
+				descend |= bit;
 		}
 	}
+	if( 0 == visible )
+		return;
 
-	// We don't want to select sub nodes that are invisible (out of frustum) or are selected,
-	// we DO want to select if they are out of range, since we are not.
-	bool removeSubTL = (subTLSelRes == omath::OUTSIDE) || (subTLSelRes == omath::SELECTED);
-	bool removeSubTR = (subTRSelRes == omath::OUTSIDE) || (subTRSelRes == omath::SELECTED);
-	bool removeSubBL = (subBLSelRes == omath::OUTSIDE) || (subBLSelRes == omath::SELECTED);
-	bool removeSubBR = (subBRSelRes == omath::OUTSIDE) || (subBRSelRes == omath::SELECTED);
-
-	if( lodSelection->m_selection_count >= settings::MAX_NUMBER_SELECTED_NODES ) {
-		logbook::log_msg(
-				logbook::TERRAIN, logbook::WARNING,
-				"LOD selected more nodes than the maximum selection count. Some nodes will not be drawn."
-		);
-		return omath::OUTSIDE;
+	omath::t_intersect sub[4][settings::MAX_SELECTION_VIEWS];
+	node *const children[4]{ m_tl, m_tr, m_bl, m_br };
+	for( unsigned int c = 0; c < 4; ++c ) {
+		for( unsigned int i = 0; i < count; ++i )
+			sub[c][i] = omath::UNDEFINED;
+		if( 0 != descend && nullptr != children[c] )
+			children[c]->lod_select( selections, count, descend, inside & descend, sub[c] );
 	}
-	// Add node to selection
-	lod_selection::selected_node *snode = &lodSelection->m_selected_nodes[lodSelection->m_selection_count];
-	if( !( removeSubTL && removeSubTR && removeSubBL && removeSubBR ) &&
-		 ( lodSelection->m_selection_count < settings::MAX_NUMBER_SELECTED_NODES ) ) {
-		unsigned int lodLevel = lodSelection->m_stop_at_level - get_level();
-		*snode = lod_selection::selected_node(
-				this, lodLevel, !removeSubTL, !removeSubTR, !removeSubBL, !removeSubBR
-		);
-		lodSelection->m_min_selected_lod_level = std::min( lodSelection->m_min_selected_lod_level, snode->lod_level );
-		lodSelection->m_max_selected_lod_level = std::max( lodSelection->m_max_selected_lod_level, snode->lod_level );
-		// Check if we get problems with lod distnce ranges.
-		// F.Strugar says: This should be calculated somehow better, but brute force will work for now.
-		if( settings::DEBUG_HIGHLIGHT_SHORT_VISIBILITY_BOXES && !lodSelection->m_vis_dist_too_small && (get_level() != 0) ) {
-			const double maxDistFromCam = std::sqrt( world_aabb.max_distance_from_point_sq( cam->get_position() ) );
-			const double morphStartRange = lodSelection->m_morph_start[lodSelection->m_stop_at_level - get_level()+1];
-			if( maxDistFromCam > morphStartRange ) {
-				lodSelection->m_vis_dist_too_small = true;
-				// TODO mark offending box for drawing.
-				snode->lod_level |= 0x80000000;
+
+	for( unsigned int i = 0; i < count; ++i ) {
+		if( !( visible & ( 1u << i ) ) )
+			continue;
+		lod_selection *lodSelection{ selections[i] };
+		// We don't want to select sub nodes that are invisible (out of frustum) or are selected,
+		// we DO want to select if they are out of range, since we are not.
+		bool removeSubTL = (sub[0][i] == omath::OUTSIDE) || (sub[0][i] == omath::SELECTED);
+		bool removeSubTR = (sub[1][i] == omath::OUTSIDE) || (sub[1][i] == omath::SELECTED);
+		bool removeSubBL = (sub[2][i] == omath::OUTSIDE) || (sub[2][i] == omath::SELECTED);
+		bool removeSubBR = (sub[3][i] == omath::OUTSIDE) || (sub[3][i] == omath::SELECTED);
+
+		if( lodSelection->m_selection_count >= settings::MAX_NUMBER_SELECTED_NODES ) {
+			LOGBOOK_MSG(
+					logbook::TERRAIN, logbook::WARNING,
+					"LOD selected more nodes than the maximum selection count. Some nodes will not be drawn."
+			);
+			results[i] = omath::OUTSIDE;
+			continue;
+		}
+		// Add node to selection
+		lod_selection::selected_node *snode = &lodSelection->m_selected_nodes[lodSelection->m_selection_count];
+		if( !( removeSubTL && removeSubTR && removeSubBL && removeSubBR ) ) {
+			unsigned int lodLevel = lodSelection->m_stop_at_level - get_level();
+			*snode = lod_selection::selected_node(
+					this, lodLevel, !removeSubTL, !removeSubTR, !removeSubBL, !removeSubBR
+			);
+			snode->tile_index = lodSelection->m_current_tile;
+			lodSelection->m_min_selected_lod_level = std::min( lodSelection->m_min_selected_lod_level, snode->lod_level );
+			lodSelection->m_max_selected_lod_level = std::max( lodSelection->m_max_selected_lod_level, snode->lod_level );
+			// Check if we get problems with lod distnce ranges.
+			// F.Strugar says: This should be calculated somehow better, but brute force will work for now.
+			if( settings::DEBUG_HIGHLIGHT_SHORT_VISIBILITY_BOXES && !lodSelection->m_vis_dist_too_small && (get_level() != 0) ) {
+				const double maxDistFromCam = std::sqrt( world_aabb.max_distance_from_point_sq( lodSelection->m_view.position ) );
+				const double morphStartRange = lodSelection->m_morph_start[lodSelection->m_stop_at_level - get_level()+1];
+				if( maxDistFromCam > morphStartRange ) {
+					lodSelection->m_vis_dist_too_small = true;
+					// TODO mark offending box for drawing.
+					snode->lod_level |= 0x80000000;
+				}
 			}
+			const double distance{ std::sqrt( distance_sq[i] ) };
+			lodSelection->m_max_screen_space_error = std::max(
+					lodSelection->m_max_screen_space_error, lodSelection->get_screen_space_error( m_geometric_error, distance )
+			);
+			// Set tile index, min distance and min/max levels for sorting
+			if( lodSelection->m_sort_by_distance )
+				snode->min_distance_to_camera = distance;
+			lodSelection->m_selection_count++;
+			results[i] = omath::SELECTED;
+			continue;
 		}
-		// Set tile index, min distance and min/max levels for sorting
-		if( lodSelection->m_sort_by_distance )
-			snode->min_distance_to_camera = std::sqrt( world_aabb.min_distance_from_point_sq( cam->get_position() ) );
-		lodSelection->m_selection_count++;
-		return omath::SELECTED;
+		// if any of child nodes are selected, then return selected -
+		// otherwise all of them are out of frustum, so we're out of frustum too
+		if( (sub[0][i] == omath::SELECTED) || (sub[1][i] == omath::SELECTED) ||
+			(sub[2][i] == omath::SELECTED) || (sub[3][i] == omath::SELECTED) )
+			results[i] = omath::SELECTED;
+		else
+			results[i] = omath::OUTSIDE;
 	}
-	// if any of child nodes are selected, then return selected -
-	// otherwise all of them are out of frustum, so we're out of frustum too
-	if( (subTLSelRes == omath::SELECTED) || (subTRSelRes == omath::SELECTED) ||
-		(subBLSelRes == omath::SELECTED) || (subBRSelRes == omath::SELECTED) )
-		return omath::SELECTED;
-	else
-		return omath::OUTSIDE;
 }
 
 }
@@ -1,9 +1,12 @@
 
 #pragma once
 
+#include "base/frame_arena.h"
+#include "base/job_system.h"
 #include "omath/aabb.h"
 #include "omath/vec2.h"
 #include "omath/view_frustum.h"
+#include <cstdint>
 #include <memory>
 
 namespace terrain {
@@ -21,16 +24,47 @@ public:
 	unsigned int get_level() const;
 	unsigned int get_size() const;
 	const omath::aabb &get_raster_aabb() const;
+	/* Max height deviation of the terrain inside the node from the surface drawn with the node's grid
+	 * resolution, including the errors of the sub nodes. 0 for leaf nodes. */
+	float get_geometric_error() const;
 	// Get the aabb in world coordinates for selection.
 	omath::daabb &get_world_aabb(omath::daabb &out_box) const;
 	// Set a nodes height when heightmap data becomes available
 	void set_min_max_height();
 	//const omath::vec2 &get_min_max_height() const;
 	// worldPositionCellsize: .x = lower left latitude, .y = longitude, .z = cellsize
+    /* Children are placed from all_nodes[last_index] on, depth first. With a group, sub trees of
+     * at least settings::PARALLEL_TREE_NODE_SIZE are created as jobs of it. Call raise_error() in
+     * reverse order of all nodes afterwards. */
     void create(
     		const unsigned int x, const unsigned int z, const unsigned int size, const unsigned int level,
-    		const heightmap *const h_map, node *all_nodes, unsigned int &last_index );
+    		const heightmap *const h_map, node *all_nodes, unsigned int &last_index,
+    		orf_n::job_system::task_group *group = nullptr );
+    // Number of nodes create() makes for the sub tree, the node included.
+    static unsigned int count_nodes( const unsigned int x, const unsigned int z, const unsigned int size,
+    		const heightmap *const h_map );
+    // Error and height range must not get smaller when refining. Children must be done before.
+    void raise_error();
+    /* Error and box of the node and its 8 same level neighbours for the screen space error test, neighbours
+     * in row order with the node in the middle, nullptr outside the tree. Call after raise_error(). */
+    void set_neighbourhood( const node *const *neighbours );
+    /* Whether refining is needed for the selection's screen space error. The largest error around the node,
+     * projected from the nearest point around it, so neighbours' levels differ by at most one. */
+    bool is_error_visible( const lod_selection *const selection ) const;
     omath::t_intersect lod_select( lod_selection *selection, bool parent_completely_in_frustum = false );
+    /* Selects for count views in one traversal. Bits of active are the views that descended into this node,
+     * bits of parent_inside those whose frustum contains the parent completely. Writes one result per view. */
+    void lod_select( lod_selection *const *selections, const unsigned int count, const uint32_t active,
+    		const uint32_t parent_inside, omath::t_intersect *results );
+    /* Appends the nodes of the last lod level that are at least partly in the frustum. Like in lod_select(),
+     * sub trees outside are skipped and those completely inside aren't tested any more. */
+    void get_visible_leaves( const omath::view_frustum &frustum, const bool parent_inside,
+    		orf_n::frame_vector<const node *> &leaves ) const;
+    /* Nearest hit of a ray in raster coordinates (see heightmap::raycast) before t_max. Children are
+     * descended front to back by where the ray enters their boxes, leaves walk their heightmap cells.
+     * On a hit, t_max becomes its ray parameter and hit_node the leaf. */
+    bool raycast( const omath::dvec3 &origin, const omath::dvec3 &direction, const omath::dvec3 &inverse_direction,
+    		const heightmap *const h_map, double &t_max, const node *&hit_node ) const;
     const node *get_tr() const;
     const node *get_tl() const;
     const node *get_br() const;
@@ -49,6 +83,12 @@ private:
 
     omath::aabb m_aabb;
 
+    float m_geometric_error{ 0.0f };
+    // See set_neighbourhood(). At tile borders the box has no height limits.
+    omath::aabb m_neighbourhood;
+    float m_neighbourhood_error{ 0.0f };
+    bool m_on_tile_border{ false };
+
 };
 
 }
@@ -3,10 +3,10 @@
 
 #pragma debug(on)
 
-uniform vec4 debugColor;
+in vec4 color;
 
 out vec4 fragColor;
 
 void main() {
-	fragColor = debugColor;
+	fragColor = color;
 }
@@ -4,14 +4,20 @@
 #pragma debug(on)
 
 layout( location = 0 ) in vec3 position;
+// Per instance: the box's center, size and color
+layout( location = 1 ) in vec3 box_center;
+layout( location = 2 ) in vec3 box_size;
+layout( location = 3 ) in vec4 box_color;
 
-layout (location = 7) uniform mat4 modelMatrix;
 layout (location = 15) uniform mat4 projViewMatrix;
 // This is just an offset, e.g. for wireframe stuff.
 uniform float y_offset=0.0f;
 
+out vec4 color;
+
 void main() {
-	vec3 pos = position;
+	vec3 pos = box_center + position * box_size;
 	pos.y += y_offset;
-	gl_Position = projViewMatrix * modelMatrix * vec4( pos, 1.0f );
+	color = box_color;
+	gl_Position = projViewMatrix * vec4( pos, 1.0f );
 }
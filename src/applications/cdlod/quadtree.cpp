@@ -4,16 +4,22 @@
 #include "heightmap.h"
 #include "settings.h"
 #include "base/logbook.h"
+#include "omath/aabb.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
 #include <sstream>
+#include <vector>
 
 using namespace orf_n;
 
 namespace terrain {
 
 quadtree::quadtree( const heightmap *const hm ) : m_heightmap{ hm } {
-	// TODO: Checks.
+	// TODO: Checks. Larger terrain must be split into tiles of a quadtree_forest, see terrain_preprocessor.
 	if( m_heightmap->get_extent().x > 65535 || m_heightmap->get_extent().y > 65535 ) {
-		std::string s{ "Heightmap too large (>65535) for the quad tree." };
+		std::string s{ "Heightmap too large (>65535) for one quad tree. Split it into tiles." };
 		logbook::log_msg( logbook::TERRAIN, logbook::ERROR, s );
 		throw std::runtime_error( s );
 	}
@@ -21,8 +27,14 @@ quadtree::quadtree( const heightmap *const hm ) : m_heightmap{ hm } {
 
 bool quadtree::create() {
 	// Determine how many nodes will we use, and the size of the top (root) tree node.
+	// The tree covers its tile's raster bounding box. Tiles without one fall back to the settings.
+	const omath::aabb &r{ m_heightmap->get_raster_aabb() };
 	unsigned int size_x = settings::RASTER_MAX.x - settings::RASTER_MIN.x;
 	unsigned int size_z = settings::RASTER_MAX.z - settings::RASTER_MIN.z;
+	if( r.m_max.x > r.m_min.x && r.m_max.z > r.m_min.z ) {
+		size_x = static_cast<unsigned int>( r.m_max.x - r.m_min.x );
+		size_z = static_cast<unsigned int>( r.m_max.z - r.m_min.z );
+	}
 	unsigned int totalNodeCount = 0;
 	m_topNodeSize = settings::LEAF_NODE_SIZE;
 	for( unsigned int i = 0; i < settings::NUMBER_OF_LOD_LEVELS; ++i ) {
@@ -38,29 +50,45 @@ bool quadtree::create() {
 	m_topNodeCountX = ( size_x - 1 ) / m_topNodeSize + 1;
 	m_topNodeCountZ = ( size_z - 1 ) / m_topNodeSize + 1;
 	m_topLevelNodes = new node**[m_topNodeCountZ];
+	// Top nodes and large sub trees are created in parallel, each into its precounted range of nodes.
+	job_system::task_group group{ job_system::get_instance() };
 	for( unsigned int z=0; z < m_topNodeCountZ; ++z ) {
 		m_topLevelNodes[z] = new node*[m_topNodeCountX];
 		for( unsigned int x{ 0 }; x < m_topNodeCountX; ++x ) {
-			m_topLevelNodes[z][x] = &m_allNodes[nodeCounter];
-			nodeCounter++;
-			m_topLevelNodes[z][x]->create(
-					x * m_topNodeSize, z * m_topNodeSize,m_topNodeSize, 0, m_heightmap, m_allNodes, nodeCounter
-			);
+			node *const top{ &m_allNodes[nodeCounter] };
+			m_topLevelNodes[z][x] = top;
+			const unsigned int first{ nodeCounter + 1 };
+			nodeCounter += node::count_nodes( x * m_topNodeSize, z * m_topNodeSize, m_topNodeSize, m_heightmap );
+			group.run( [this, top, first, x, z, &group] {
+				unsigned int index{ first };
+				top->create( x * m_topNodeSize, z * m_topNodeSize, m_topNodeSize, 0, m_heightmap, m_allNodes, index, &group );
+			} );
 		}
 	}
+	group.wait();
+	// Children come after their parents
+	for( unsigned int i = nodeCounter; i > 0; --i )
+		m_allNodes[i-1].raise_error();
 	m_nodeCount = nodeCounter;
+	for( unsigned int i = 0; i < m_nodeCount; ++i ) {
+		float &e{ m_max_geometric_errors[m_allNodes[i].get_level()] };
+		e = std::max( e, m_allNodes[i].get_geometric_error() );
+	}
+	set_neighbourhoods( size_x, size_z );
 	if( m_nodeCount != totalNodeCount ) {
 		std::ostringstream s;
 		s << "Node counter (" << m_nodeCount << ") does not equal pre-calculated node count ("<<totalNodeCount<< ").";
 		logbook::log_msg( logbook::TERRAIN, logbook::ERROR, s.str() );
 		throw std::runtime_error( s.str() );
 	}
+	// Nodes hold their bounding box, so it isn't counted separately.
+	m_memory.set( sizeof( *this ) + totalNodeCount * sizeof( node ) +
+			m_topNodeCountZ * ( sizeof( node ** ) + m_topNodeCountX * sizeof( node * ) ) );
 	// Debug output
 	std::ostringstream s;
 	// Quad tree summary
-	float sizeInMemory = (float)m_nodeCount * (sizeof(node) + sizeof(omath::aabb) ) / 1024.0f;
-	s << "Quadtree created; " << m_nodeCount << " nodes; size in memory: " << sizeInMemory <<
-		"kB." << m_topNodeCountX << '*' << m_topNodeCountZ << " top nodes.";
+	s << "Quadtree created; " << m_nodeCount << " nodes; size in memory: " << m_memory.get() / 1024 <<
+		"kB. " << m_topNodeCountX << '*' << m_topNodeCountZ << " top nodes.";
 	logbook::log_msg( logbook::TERRAIN, logbook::INFO, s.str() );
 	// Debug: List of all Nodes
 	if( settings::DEBUG_OUTPUT_TREE_NODES )
@@ -68,6 +96,39 @@ bool quadtree::create() {
 	return true;
 }
 
+void quadtree::set_neighbourhoods( const unsigned int size_x, const unsigned int size_z ) {
+	const omath::aabb &r{ m_heightmap->get_raster_aabb() };
+	std::vector<node *> grid;
+	unsigned int size{ m_topNodeSize };
+	for( unsigned int level = 0; level < settings::NUMBER_OF_LOD_LEVELS; ++level, size /= 2 ) {
+		// The nodes of the level by their position in the tile
+		const unsigned int count_x{ ( size_x - 1 ) / size + 1 };
+		const unsigned int count_z{ ( size_z - 1 ) / size + 1 };
+		grid.assign( count_x * count_z, nullptr );
+		for( unsigned int i = 0; i < m_nodeCount; ++i ) {
+			node &n{ m_allNodes[i] };
+			if( n.get_level() != level )
+				continue;
+			const unsigned int x{ static_cast<unsigned int>( n.get_raster_aabb().m_min.x - r.m_min.x ) / size };
+			const unsigned int z{ static_cast<unsigned int>( n.get_raster_aabb().m_min.z - r.m_min.z ) / size };
+			grid[z * count_x + x] = &n;
+		}
+		for( unsigned int z = 0; z < count_z; ++z )
+			for( unsigned int x = 0; x < count_x; ++x ) {
+				if( nullptr == grid[z * count_x + x] )
+					continue;
+				const node *neighbours[9];
+				for( unsigned int i = 0; i < 9; ++i ) {
+					const int nx{ (int)x + (int)( i % 3 ) - 1 };
+					const int nz{ (int)z + (int)( i / 3 ) - 1 };
+					const bool inside{ nx >= 0 && nz >= 0 && nx < (int)count_x && nz < (int)count_z };
+					neighbours[i] = inside ? grid[nz * count_x + nx] : nullptr;
+				}
+				grid[z * count_x + x]->set_neighbourhood( neighbours );
+			}
+	}
+}
+
 void quadtree::cleanup() {
 	if( m_allNodes != nullptr ) {
 		delete[] m_allNodes;
@@ -81,6 +142,7 @@ void quadtree::cleanup() {
 		delete[] m_topLevelNodes;
 		m_topLevelNodes = nullptr;
 	}
+	m_memory.set( 0 );
 }
 
 quadtree::~quadtree() {
@@ -92,6 +154,10 @@ const node *quadtree::getNodes() const {
 	return m_allNodes;
 }
 
+const float *quadtree::get_max_geometric_errors() const {
+	return m_max_geometric_errors;
+}
+
 unsigned int quadtree::getNodeCount() const {
 	return m_nodeCount;
 }
@@ -102,6 +168,98 @@ void quadtree::lodSelect( lod_selection *lodSelection ) const {
 			m_topLevelNodes[z][x]->lod_select( lodSelection, false );
 }
 
+void quadtree::lodSelect( lod_selection *const *selections, const unsigned int count, const uint32_t active ) const {
+	omath::t_intersect results[settings::MAX_SELECTION_VIEWS];
+	for( unsigned int z{ 0 }; z < m_topNodeCountZ; ++z )
+		for( unsigned int x{ 0 }; x < m_topNodeCountX; ++x )
+			m_topLevelNodes[z][x]->lod_select( selections, count, active, 0u, results );
+}
+
+void quadtree::get_visible_leaves( const omath::view_frustum &frustum, orf_n::frame_vector<const node *> &leaves ) const {
+	for( unsigned int z{ 0 }; z < m_topNodeCountZ; ++z )
+		for( unsigned int x{ 0 }; x < m_topNodeCountX; ++x )
+			m_topLevelNodes[z][x]->get_visible_leaves( frustum, false, leaves );
+}
+
+bool quadtree::raycast( const omath::ray_t<double> &ray, raycast_hit &hit ) const {
+	hit.p_node = nullptr;
+	if( nullptr == m_topLevelNodes )
+		return false;
+	// Nodes are in raster coordinates. Scaling the ray keeps its parameter.
+	const omath::dvec3 origin{
+		ray.m_origin.x / settings::RASTER_TO_WORLD_X, ray.m_origin.y, ray.m_origin.z / settings::RASTER_TO_WORLD_Z
+	};
+	const omath::dvec3 direction{
+		ray.m_direction.x / settings::RASTER_TO_WORLD_X, ray.m_direction.y, ray.m_direction.z / settings::RASTER_TO_WORLD_Z
+	};
+	const omath::dvec3 inverse_direction{ 1.0 / direction.x, 1.0 / direction.y, 1.0 / direction.z };
+	// Top nodes are a grid of cells in units of the top node size, from the tile's raster origin.
+	const omath::aabb &r{ m_heightmap->get_raster_aabb() };
+	const double size{ (double)m_topNodeSize };
+	const double gx{ ( origin.x - r.m_min.x ) / size };
+	const double gz{ ( origin.z - r.m_min.z ) / size };
+	const double dx{ direction.x / size };
+	const double dz{ direction.z / size };
+	// Part of the ray over the grid
+	double t_enter{ 0.0 }, t_exit{ ray.m_tmax };
+	const double extent[2]{ (double)m_topNodeCountX, (double)m_topNodeCountZ };
+	const double start[2]{ gx, gz }, dir[2]{ dx, dz };
+	for( int i = 0; i < 2; ++i ) {
+		if( 0.0 == dir[i] ) {
+			if( start[i] < 0.0 || start[i] > extent[i] )
+				return false;
+			continue;
+		}
+		double t0{ -start[i] / dir[i] }, t1{ ( extent[i] - start[i] ) / dir[i] };
+		if( t0 > t1 )
+			std::swap( t0, t1 );
+		t_enter = std::max( t_enter, t0 );
+		t_exit = std::min( t_exit, t1 );
+	}
+	if( t_enter > t_exit )
+		return false;
+	const double inf{ std::numeric_limits<double>::infinity() };
+	int cell_x{ std::clamp( (int)std::floor( gx + dx * t_enter ), 0, (int)m_topNodeCountX - 1 ) };
+	int cell_z{ std::clamp( (int)std::floor( gz + dz * t_enter ), 0, (int)m_topNodeCountZ - 1 ) };
+	const int step_x{ dx > 0.0 ? 1 : -1 };
+	const int step_z{ dz > 0.0 ? 1 : -1 };
+	double next_x{ 0.0 != dx ? ( cell_x + ( step_x > 0 ? 1 : 0 ) - gx ) / dx : inf };
+	double next_z{ 0.0 != dz ? ( cell_z + ( step_z > 0 ? 1 : 0 ) - gz ) / dz : inf };
+	// Top nodes don't overlap, so the first one with a hit has the nearest.
+	double t_max{ ray.m_tmax };
+	const node *hit_node{ nullptr };
+	while( !m_topLevelNodes[cell_z][cell_x]->raycast( origin, direction, inverse_direction, m_heightmap, t_max, hit_node ) ) {
+		if( next_x < next_z ) {
+			cell_x += step_x;
+			if( cell_x < 0 || cell_x >= (int)m_topNodeCountX || next_x > t_exit )
+				return false;
+			next_x += std::abs( 1.0 / dx );
+		} else {
+			cell_z += step_z;
+			if( cell_z < 0 || cell_z >= (int)m_topNodeCountZ || next_z > t_exit )
+				return false;
+			next_z += std::abs( 1.0 / dz );
+		}
+	}
+	hit.distance = t_max;
+	hit.position = ray( t_max );
+	hit.p_node = hit_node;
+	return true;
+}
+
+unsigned int quadtree::raycast( const omath::ray_t<double> *rays, const unsigned int count, raycast_hit *hits ) const {
+	std::atomic<unsigned int> number_of_hits{ 0 };
+	job_system::get_instance().parallel_for( 0, count, settings::RAYCAST_BATCH_GRAIN,
+			[this, rays, hits, &number_of_hits]( size_t begin, size_t end ) {
+		unsigned int n{ 0 };
+		for( size_t i = begin; i < end; ++i )
+			if( raycast( rays[i], hits[i] ) )
+				++n;
+		number_of_hits.fetch_add( n, std::memory_order_relaxed );
+	} );
+	return number_of_hits.load();
+}
+
 void quadtree::debug_output_nodes() const {
 	std::ostringstream s;
 	for( unsigned int i=0; i < m_nodeCount; ++i ) {
@@ -1,6 +1,16 @@
 
 #pragma once
 
+#include "settings.h"
+#include "base/frame_arena.h"
+#include "base/memory_tracker.h"
+#include "omath/ray.h"
+#include <cstdint>
+
+namespace omath {
+class view_frustum;
+}
+
 namespace terrain {
 
 class heightmap;
@@ -9,6 +19,14 @@ class node;
 
 class quadtree {
 public:
+	typedef struct raycast_hit {
+		// Ray parameter of the hit, position = origin + direction * distance
+		double distance{ 0.0 };
+		omath::dvec3 position{ 0.0, 0.0, 0.0 };
+		// Leaf that was hit, nullptr for a miss
+		const node *p_node{ nullptr };
+	} raycast_hit;
+
 	quadtree( const heightmap *const hm );
 	virtual ~quadtree();
 	// Create the tree from settings raster size.
@@ -18,16 +36,33 @@ public:
 	unsigned int getNodeCount() const;
 	// tile index is saved in selection list for sorting by tile and distance
 	void lodSelect( lod_selection *lodSelectlion ) const;
+	// One traversal for several selections. Bits of active are the views that see the tree.
+	void lodSelect( lod_selection *const *selections, const unsigned int count, const uint32_t active ) const;
+	// Largest geometric error of the nodes per level, settings::NUMBER_OF_LOD_LEVELS values.
+	const float *get_max_geometric_errors() const;
+	// Nodes of the last lod level in the frustum, found top down.
+	void get_visible_leaves( const omath::view_frustum &frustum, orf_n::frame_vector<const node *> &leaves ) const;
+	/* Nearest hit of a world space ray with the terrain before ray.m_tmax, e.g. for picking or to keep a camera
+	 * above ground. Top nodes are walked along the ray, nodes descended front to back with their min/max heights
+	 * and the leaves' heightmap cells walked until the first triangle hit. */
+	bool raycast( const omath::ray_t<double> &ray, raycast_hit &hit ) const;
+	// Casts count rays in parallel on the job system, one hit per ray. Returns the number of rays that hit.
+	unsigned int raycast( const omath::ray_t<double> *rays, const unsigned int count, raycast_hit *hits ) const;
 
 private:
 	unsigned int m_topNodeSize = 0;
 	unsigned int m_topNodeCountX = 0;
 	unsigned int m_topNodeCountZ=0;
 	unsigned int m_nodeCount=0;
+	float m_max_geometric_errors[settings::NUMBER_OF_LOD_LEVELS]{};
 	node *m_allNodes=nullptr;
 	node ***m_topLevelNodes=nullptr;
+	// Nodes and top level node pointers
+	orf_n::memory_tracker::tracked_memory m_memory{ orf_n::memory_tracker::QUADTREE, orf_n::memory_tracker::CPU };
 	const heightmap *const m_heightmap=nullptr;
 
+	// Neighbourhood errors and boxes of all nodes, see node::set_neighbourhood(). Size of the tile in posts.
+	void set_neighbourhoods( const unsigned int size_x, const unsigned int size_z );
 	void debug_output_nodes() const;
 
 };
@@ -0,0 +1,306 @@
+
+#include "quadtree_forest.h"
+#include "heightmap.h"
+#include "lod_selection.h"
+#include "quadtree.h"
+#include "settings.h"
+#include "base/logbook.h"
+#include "base/async_reader.h"
+#include "base/frame_arena.h"
+#include "base/memory_tracker.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <tuple>
+
+using namespace orf_n;
+
+namespace terrain {
+
+// Grid cell of a coordinate, clamped to the grid.
+static unsigned int cell_of( const double v, const double origin, const double size, const unsigned int n ) {
+	const double c{ std::floor( ( v - origin ) / size ) };
+	return static_cast<unsigned int>( std::min( std::max( c, 0.0 ), double( n - 1 ) ) );
+}
+
+quadtree_forest::quadtree_forest( const std::vector<std::string> &filenames, async_reader *reader ) :
+		m_reader{ reader } {
+	// Bounding boxes first, they define the grid.
+	omath::dvec2 min{ std::numeric_limits<double>::max() }, max{ std::numeric_limits<double>::lowest() };
+	omath::dvec2 max_tile_size{ 0.0, 0.0 };
+	for( const std::string &f : filenames ) {
+		std::unique_ptr<tile> t{ std::make_unique<tile>() };
+		t->filename = f;
+		if( !heightmap::read_raster_aabb( f, t->raster_aabb ) ) {
+			logbook::log_msg( logbook::TERRAIN, logbook::WARNING,
+					"No bounding box for tile '" + f + "'. Tile ignored." );
+			continue;
+		}
+		const omath::aabb &r{ t->raster_aabb };
+		t->world_aabb = omath::daabb{
+			omath::dvec3{ r.m_min.x * settings::RASTER_TO_WORLD_X, r.m_min.y, r.m_min.z * settings::RASTER_TO_WORLD_Z },
+			omath::dvec3{ r.m_max.x * settings::RASTER_TO_WORLD_X, r.m_max.y, r.m_max.z * settings::RASTER_TO_WORLD_Z }
+		};
+		const omath::daabb &w{ t->world_aabb };
+		min = omath::dvec2{ std::min( min.x, w.m_min.x ), std::min( min.y, w.m_min.z ) };
+		max = omath::dvec2{ std::max( max.x, w.m_max.x ), std::max( max.y, w.m_max.z ) };
+		max_tile_size = omath::dvec2{
+			std::max( max_tile_size.x, w.m_max.x - w.m_min.x ), std::max( max_tile_size.y, w.m_max.z - w.m_min.z )
+		};
+		if( m_tiles.empty() )
+			m_world_aabb = w;
+		else
+			m_world_aabb = omath::daabb{
+				omath::dvec3{ std::min( m_world_aabb.m_min.x, w.m_min.x ), std::min( m_world_aabb.m_min.y, w.m_min.y ),
+							  std::min( m_world_aabb.m_min.z, w.m_min.z ) },
+				omath::dvec3{ std::max( m_world_aabb.m_max.x, w.m_max.x ), std::max( m_world_aabb.m_max.y, w.m_max.y ),
+							  std::max( m_world_aabb.m_max.z, w.m_max.z ) }
+			};
+		m_tiles.push_back( std::move( t ) );
+	}
+	if( m_tiles.empty() ) {
+		std::string s{ "No terrain tiles with bounding boxes found." };
+		logbook::log_msg( logbook::TERRAIN, logbook::ERROR, s );
+		throw std::runtime_error( s );
+	}
+	m_grid_origin = min;
+	m_cell_size = omath::dvec2{ std::max( max_tile_size.x, 1.0 ), std::max( max_tile_size.y, 1.0 ) };
+	m_grid_size = omath::uvec2{
+		std::max( 1u, static_cast<unsigned int>( std::ceil( ( max.x - min.x ) / m_cell_size.x ) ) ),
+		std::max( 1u, static_cast<unsigned int>( std::ceil( ( max.y - min.y ) / m_cell_size.y ) ) )
+	};
+	m_grid.assign( m_grid_size.x * m_grid_size.y, {} );
+	for( unsigned int i = 0; i < m_tiles.size(); ++i ) {
+		// All cells the tile's world box touches
+		const omath::daabb &w{ m_tiles[i]->world_aabb };
+		const unsigned int x0{ cell_of( w.m_min.x, m_grid_origin.x, m_cell_size.x, m_grid_size.x ) };
+		const unsigned int x1{ cell_of( w.m_max.x, m_grid_origin.x, m_cell_size.x, m_grid_size.x ) };
+		const unsigned int z0{ cell_of( w.m_min.z, m_grid_origin.y, m_cell_size.y, m_grid_size.y ) };
+		const unsigned int z1{ cell_of( w.m_max.z, m_grid_origin.y, m_cell_size.y, m_grid_size.y ) };
+		for( unsigned int z = z0; z <= z1; ++z )
+			for( unsigned int x = x0; x <= x1; ++x )
+				m_grid[z * m_grid_size.x + x].push_back( i );
+	}
+	std::ostringstream s;
+	s << "Quadtree forest of " << m_tiles.size() << " tiles on a " << m_grid_size.x << '*' << m_grid_size.y <<
+			" grid. World bounding box " << m_world_aabb << '.';
+	logbook::log_msg( logbook::TERRAIN, logbook::INFO, s.str() );
+}
+
+quadtree_forest::~quadtree_forest() {
+	// Outstanding reads write into the tiles.
+	if( m_loads_in_flight > 0 )
+		m_reader->wait_all();
+	for( unsigned int i = 0; i < m_tiles.size(); ++i )
+		unload( i );
+}
+
+static bool is_over_memory_budget() {
+	using namespace memory_tracker;
+	if( 0 == settings::TILE_MEMORY_BUDGET_MB )
+		return false;
+	const size_t bytes{ get_live_bytes( HEIGHTMAP, CPU ) + get_live_bytes( HEIGHTMAP, GPU ) +
+		get_live_bytes( QUADTREE, CPU ) };
+	return bytes >= settings::TILE_MEMORY_BUDGET_MB * 1024 * 1024;
+}
+
+void quadtree_forest::update( const omath::dvec3 &position, const double range, const bool wait ) {
+	m_reader->poll();
+	const double unload_range{ range * settings::TILE_UNLOAD_RANGE_FACTOR };
+	// Candidates for loading, nearest first
+	orf_n::frame_vector<std::pair<double, unsigned int>> wanted;
+	for( unsigned int i = 0; i < m_tiles.size(); ++i ) {
+		tile &t{ *m_tiles[i] };
+		const double d{ std::sqrt( t.world_aabb.min_distance_from_point_sq( position ) ) };
+		if( UNLOADED == t.state && d <= range )
+			wanted.push_back( { d, i } );
+		else if( RESIDENT == t.state && d > unload_range )
+			unload( i );
+	}
+	std::sort( wanted.begin(), wanted.end() );
+	auto next{ wanted.begin() };
+	bool over_budget{ false };
+	do {
+		while( next != wanted.end() && m_loads_in_flight < settings::MAX_TILE_LOADS_IN_FLIGHT &&
+				!( over_budget = is_over_memory_budget() ) )
+			start_load( (next++)->second );
+		if( wait && m_loads_in_flight > 0 )
+			m_reader->wait_all();
+	} while( wait && next != wanted.end() && !( over_budget = is_over_memory_budget() ) );
+	if( over_budget && next != wanted.end() )
+		LOGBOOK_MSG( logbook::TERRAIN, logbook::WARNING, "Tile memory budget reached, " +
+				std::to_string( wanted.end() - next ) + " tiles in range not loaded." );
+}
+
+void quadtree_forest::start_load( const unsigned int index ) {
+	// Block reads in one batch like the heightmap does; they are decoded when the last one arrived.
+	const size_t BLOCK_SIZE{ 1024 * 1024 };
+	tile &t{ *m_tiles[index] };
+	t.fd = m_reader->open_file( heightmap::get_data_filename( t.filename ) );
+	const uint64_t size{ t.fd >= 0 ? m_reader->get_file_size( t.fd ) : 0 };
+	if( 0 == size ) {
+		m_reader->close_file( t.fd );
+		t.fd = -1;
+		t.state = MISSING;
+		return;
+	}
+	t.state = LOADING;
+	t.read_failed = false;
+	t.file_data.resize( size );
+	std::vector<async_reader::read_request> requests;
+	for( uint64_t offset = 0; offset < size; offset += BLOCK_SIZE ) {
+		async_reader::read_request r;
+		r.fd = t.fd;
+		r.offset = offset;
+		r.size = static_cast<size_t>( std::min<uint64_t>( BLOCK_SIZE, size - offset ) );
+		r.destination = t.file_data.data() + offset;
+		r.on_complete = [this, index]( const async_reader::read_request &req, long result ) {
+			tile &t{ *m_tiles[index] };
+			if( result != static_cast<long>( req.size ) )
+				t.read_failed = true;
+			if( 0 == --t.blocks_pending )
+				finish_load( index );
+		};
+		requests.push_back( r );
+	}
+	t.blocks_pending = static_cast<unsigned int>( requests.size() );
+	++m_loads_in_flight;
+	m_reader->submit( requests );
+}
+
+void quadtree_forest::finish_load( const unsigned int index ) {
+	tile &t{ *m_tiles[index] };
+	m_reader->close_file( t.fd );
+	t.fd = -1;
+	--m_loads_in_flight;
+	if( t.read_failed ) {
+		logbook::log_msg( logbook::TERRAIN, logbook::ERROR, "Error reading tile '" + t.filename + "'." );
+		t.state = MISSING;
+	} else {
+		t.p_heightmap = std::make_unique<heightmap>( t.filename, t.file_data, heightmap::B16 );
+		t.p_quadtree = std::make_unique<quadtree>( t.p_heightmap.get() );
+		t.p_quadtree->create();
+		t.state = RESIDENT;
+	}
+	t.file_data.clear();
+	t.file_data.shrink_to_fit();
+}
+
+void quadtree_forest::unload( const unsigned int index ) {
+	tile &t{ *m_tiles[index] };
+	if( RESIDENT != t.state )
+		return;
+	t.p_quadtree.reset();
+	t.p_heightmap.reset();
+	t.state = UNLOADED;
+	logbook::log_msg( logbook::TERRAIN, logbook::INFO, "Tile '" + t.filename + "' unloaded." );
+}
+
+void quadtree_forest::lod_select( lod_selection *selection ) {
+	lod_select( &selection, 1 );
+}
+
+void quadtree_forest::lod_select( lod_selection *const *selections, unsigned int count ) {
+	if( count > settings::MAX_SELECTION_VIEWS ) {
+		logbook::log_msg( logbook::TERRAIN, logbook::ERROR, "Too many views for one selection traversal." );
+		count = settings::MAX_SELECTION_VIEWS;
+	}
+	// Cells touching the square around any view's range. The coarsest level has the largest range.
+	unsigned int x0{ UINT_MAX }, x1{ 0 }, z0{ UINT_MAX }, z1{ 0 };
+	for( unsigned int i = 0; i < count; ++i ) {
+		const omath::dvec3 &pos{ selections[i]->m_view.position };
+		const double range{ selections[i]->m_visibility_ranges[0] };
+		x0 = std::min( x0, cell_of( pos.x - range, m_grid_origin.x, m_cell_size.x, m_grid_size.x ) );
+		x1 = std::max( x1, cell_of( pos.x + range, m_grid_origin.x, m_cell_size.x, m_grid_size.x ) );
+		z0 = std::min( z0, cell_of( pos.z - range, m_grid_origin.y, m_cell_size.y, m_grid_size.y ) );
+		z1 = std::max( z1, cell_of( pos.z + range, m_grid_origin.y, m_cell_size.y, m_grid_size.y ) );
+	}
+	// Distance to the first view, tile index and mask of views that see the tile
+	orf_n::frame_vector<std::tuple<double, unsigned int, uint32_t>> visible;
+	// Tiles in several cells are tested once
+	orf_n::frame_vector<bool> tested( m_tiles.size(), false );
+	for( unsigned int z = z0; z <= z1 && count > 0; ++z )
+		for( unsigned int x = x0; x <= x1; ++x )
+			for( const unsigned int index : m_grid[z * m_grid_size.x + x] ) {
+				if( tested[index] || RESIDENT != m_tiles[index]->state )
+					continue;
+				tested[index] = true;
+				const tile &t{ *m_tiles[index] };
+				uint32_t mask{ 0 };
+				for( unsigned int i = 0; i < count; ++i ) {
+					const lod_selection::view_t &v{ selections[i]->m_view };
+					const double range{ selections[i]->m_visibility_ranges[0] };
+					if( t.world_aabb.intersect_sphere_sq( v.position, range * range ) &&
+							omath::OUTSIDE != v.frustum.is_box_in_frustum( t.world_aabb ) )
+						mask |= 1u << i;
+				}
+				if( 0 != mask )
+					visible.push_back( std::make_tuple(
+							t.world_aabb.min_distance_from_point_sq( selections[0]->m_view.position ), index, mask ) );
+			}
+	std::sort( visible.begin(), visible.end() );
+	for( const std::tuple<double, unsigned int, uint32_t> &v : visible ) {
+		const unsigned int index{ std::get<1>( v ) };
+		for( unsigned int i = 0; i < count; ++i ) {
+			selections[i]->m_current_tile = index;
+			if( std::get<2>( v ) & ( 1u << i ) )
+				selections[i]->m_visible_tiles.push_back( index );
+		}
+		m_tiles[index]->p_quadtree->lodSelect( selections, count, std::get<2>( v ) );
+	}
+	for( unsigned int i = 0; i < count; ++i )
+		selections[i]->calculate_edge_morphs();
+}
+
+void quadtree_forest::get_max_geometric_errors( float *errors ) const {
+	std::fill( errors, errors + settings::NUMBER_OF_LOD_LEVELS, 0.0f );
+	for( const std::unique_ptr<tile> &t : m_tiles ) {
+		if( RESIDENT != t->state )
+			continue;
+		const float *const e{ t->p_quadtree->get_max_geometric_errors() };
+		for( unsigned int l = 0; l < settings::NUMBER_OF_LOD_LEVELS; ++l )
+			errors[l] = std::max( errors[l], e[l] );
+	}
+}
+
+unsigned int quadtree_forest::get_number_of_tiles() const {
+	return static_cast<unsigned int>( m_tiles.size() );
+}
+
+const quadtree_forest::tile &quadtree_forest::get_tile( const unsigned int index ) const {
+	return *m_tiles[index];
+}
+
+bool quadtree_forest::raycast( const omath::ray_t<double> &ray, quadtree::raycast_hit &hit, unsigned int *tile_index ) const {
+	// Tiles don't overlap, but are few. Every resident one is cast against, each closer hit shortens the ray.
+	omath::ray_t<double> r{ ray };
+	bool found{ false };
+	for( unsigned int i = 0; i < m_tiles.size(); ++i ) {
+		const tile &t{ *m_tiles[i] };
+		quadtree::raycast_hit h;
+		if( RESIDENT != t.state || !t.p_quadtree->raycast( r, h ) )
+			continue;
+		hit = h;
+		r.m_tmax = h.distance;
+		found = true;
+		if( nullptr != tile_index )
+			*tile_index = i;
+	}
+	return found;
+}
+
+unsigned int quadtree_forest::get_number_of_resident_tiles() const {
+	unsigned int n{ 0 };
+	for( const std::unique_ptr<tile> &t : m_tiles )
+		if( RESIDENT == t->state )
+			++n;
+	return n;
+}
+
+const omath::daabb &quadtree_forest::get_world_aabb() const {
+	return m_world_aabb;
+}
+
+}
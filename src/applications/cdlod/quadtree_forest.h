@@ -0,0 +1,95 @@
+
+/* A forest of independent quadtrees, one per terrain tile. Every tile has its own raster
+ * origin (from its .bb file), heightmap and quadtree and is loaded and unloaded on its own
+ * depending on the distance to the camera. Only resident tiles hold height data and nodes,
+ * so memory follows the resident area, not the world size.
+ * A regular grid over the tiles culls whole trees against view range and frustum before
+ * they are descended. Cell size is the largest tile size, a tile is listed in every cell its
+ * world box overlaps, so tiles of mixed sizes and unaligned origins are all found. */
+
+#pragma once
+
+#include "quadtree.h"
+#include "omath/aabb.h"
+#include "omath/vec2.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace orf_n {
+class async_reader;
+}
+
+namespace terrain {
+
+class heightmap;
+class lod_selection;
+
+class quadtree_forest {
+public:
+	typedef enum : unsigned int {
+		UNLOADED, LOADING, RESIDENT, MISSING
+	} tile_state;
+
+	typedef struct tile {
+		std::string filename;
+		omath::aabb raster_aabb;
+		omath::daabb world_aabb;
+		tile_state state{ UNLOADED };
+		std::unique_ptr<heightmap> p_heightmap{ nullptr };
+		std::unique_ptr<quadtree> p_quadtree{ nullptr };
+		// Only used while loading
+		std::vector<unsigned char> file_data;
+		int fd{ -1 };
+		unsigned int blocks_pending{ 0 };
+		bool read_failed{ false };
+	} tile;
+
+	// Only reads the bounding boxes of the tiles. Reads of tile data go through the given reader.
+	quadtree_forest( const std::vector<std::string> &filenames, orf_n::async_reader *reader );
+	virtual ~quadtree_forest();
+	quadtree_forest( const quadtree_forest &other ) = delete;
+	quadtree_forest &operator=( const quadtree_forest &other ) = delete;
+
+	/* Starts loads of tiles closer than range to the position, nearest first, and unloads tiles
+	 * further away than range * TILE_UNLOAD_RANGE_FACTOR. Finished reads become heightmaps and
+	 * quadtrees in here, so call it from the GL thread. With wait, blocks until all tiles in range
+	 * are resident. */
+	void update( const omath::dvec3 &position, const double range, const bool wait = false );
+	/* Culls tiles with the grid, then descends the quadtrees of visible resident tiles. Visible tiles are
+	 * stored with the selection, nearest first. Only reads the forest, may run on another thread than update(). */
+	void lod_select( lod_selection *selection );
+	/* Same for up to settings::MAX_SELECTION_VIEWS selections in one traversal. Tiles are culled per view,
+	 * and descended in the order of their distance to the first view. */
+	void lod_select( lod_selection *const *selections, const unsigned int count );
+
+	/* Nearest hit of a world space ray with the resident tiles, see quadtree::raycast(). The index of the tile
+	 * that was hit goes to tile_index if given. Only reads the forest. */
+	bool raycast( const omath::ray_t<double> &ray, quadtree::raycast_hit &hit, unsigned int *tile_index = nullptr ) const;
+
+	// Largest geometric errors per node level over the resident tiles, settings::NUMBER_OF_LOD_LEVELS values.
+	void get_max_geometric_errors( float *errors ) const;
+
+	unsigned int get_number_of_tiles() const;
+	const tile &get_tile( const unsigned int index ) const;
+	unsigned int get_number_of_resident_tiles() const;
+	const omath::daabb &get_world_aabb() const;
+
+private:
+	orf_n::async_reader *m_reader{ nullptr };
+	std::vector<std::unique_ptr<tile>> m_tiles;
+	// Indices of the tiles overlapping a cell. A tile may be in up to four.
+	std::vector<std::vector<unsigned int>> m_grid;
+	omath::uvec2 m_grid_size{ 0, 0 };
+	omath::dvec2 m_grid_origin{ 0.0, 0.0 };
+	omath::dvec2 m_cell_size{ 1.0, 1.0 };
+	omath::daabb m_world_aabb;
+	unsigned int m_loads_in_flight{ 0 };
+
+	void start_load( const unsigned int index );
+	void finish_load( const unsigned int index );
+	void unload( const unsigned int index );
+
+};
+
+}
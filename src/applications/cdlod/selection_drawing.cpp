@@ -0,0 +1,76 @@
+
+#include "selection_drawing.h"
+#include "node.h"
+#include "renderer/uniform.h"
+#include <climits>
+
+using namespace orf_n;
+
+namespace terrain {
+
+void set_tile_uniforms( const GLuint p, const heightmap &hm, const omath::daabb &world_aabb ) {
+	hm.bind();
+	const float w = (float)hm.get_extent().x;
+	const float h = (float)hm.get_extent().y;
+	// Used to clamp edges to correct terrain size (only max-es needs clamping, min-s are clamped implicitly)
+	set_uniform( p, "g_tileToTexture", omath::vec2{ ( w - 1.0f ) / w, ( h - 1.0f ) / h } );
+	set_uniform( p, "g_heightmapTextureInfo", omath::vec4{ w, h, 1.0f / w, 1.0f / h } );
+	set_uniform( p, "g_tileMax", omath::vec2{ world_aabb.m_max.x, world_aabb.m_max.z } );
+	set_uniform( p, "g_tileScale", omath::vec3{ world_aabb.m_max - world_aabb.m_min } );
+	set_uniform( p, "g_tileOffset", omath::vec3{ world_aabb.m_min } );
+}
+
+void draw_selection( const GLuint p, const GLenum draw_mode, const lod_selection &selection, const gridmesh &mesh,
+		const bool front_to_back, const std::function<void( const unsigned int )> &set_tile, draw_stats &stats ) {
+	const unsigned int triangles_per_quadrant{ mesh.getNumberOfSubMeshIndices() / 3 };
+	unsigned int prevMorphConstLevelSet = UINT_MAX;
+	const auto draw_node = [&]( const lod_selection::selected_node &n ) {
+		// Set LOD level specific consts if they have changed from last node
+		if( prevMorphConstLevelSet != n.lod_level ) {
+			prevMorphConstLevelSet = n.lod_level;
+			set_uniform( p, "g_morphConsts", selection.get_morph_consts( prevMorphConstLevelSet ) );
+		}
+		omath::daabb box; n.p_node->get_world_aabb(box);
+		// .w holds the current lod level
+		omath::vec4 nodeScale{ (float)box.get_size().x, 0.0f, (float)box.get_size().z, float(n.lod_level) };
+		omath::vec3 nodeOffset{ (float)box.m_min.x, float(box.m_min.y+box.m_max.y) * 0.5f, (float)box.m_min.z };
+		set_uniform( p, "g_nodeScale", nodeScale );
+		set_uniform( p, "g_nodeOffset", nodeOffset );
+		set_uniform( p, "g_edgeMorphs", n.edge_morphs );
+		// Partially selected nodes take one call as well
+		const unsigned int quadrants{ mesh.draw_quadrants( draw_mode, n.get_quadrants() ) };
+		if( 0 == quadrants )
+			return;
+		++stats.totalRenderedNodes;
+		++stats.totalDrawCalls;
+		stats.totalRenderedTriangles += quadrants * triangles_per_quadrant;
+		if( quadrants < 4 )
+			stats.savedDrawCalls += quadrants - 1;
+	};
+	if( front_to_back ) {
+		// Selection order, nearest first if sorted. The heightmap is switched when the tile changes.
+		unsigned int bound_tile = UINT_MAX;
+		for( unsigned int i = 0; i < selection.m_selection_count; ++i ) {
+			const lod_selection::selected_node &n = selection.m_selected_nodes[i];
+			if( bound_tile != n.tile_index ) {
+				bound_tile = n.tile_index;
+				set_tile( bound_tile );
+			}
+			draw_node( n );
+		}
+		return;
+	}
+	// Visible tiles nearest first, then the selection's lod levels of each tile.
+	for( const unsigned int tile_index : selection.m_visible_tiles ) {
+		set_tile( tile_index );
+		for( unsigned int level = selection.m_min_selected_lod_level; level <= selection.m_max_selected_lod_level; ++level )
+			for( unsigned int i=0; i < selection.m_selection_count; ++i ) {
+				const lod_selection::selected_node &n = selection.m_selected_nodes[i];
+				// Only draw tiles of the currently bound heightmap; filter out nodes if not of the current level
+				if( level == n.lod_level && tile_index == n.tile_index )
+					draw_node( n );
+			}
+	}
+}
+
+}
@@ -0,0 +1,35 @@
+/* Draw calls of a lod selection, shared by terrain_renderer and terrain_bench so the benchmark
+ * draws what the renderer draws. The program in use is one of the terrain programs, the gridmesh
+ * is bound and view projection and camera uniforms are set. State is left to the caller. */
+
+#pragma once
+
+#include "gridmesh.h"
+#include "heightmap.h"
+#include "lod_selection.h"
+#include "glad/glad.h"
+#include "omath/aabb.h"
+#include <functional>
+
+namespace terrain {
+
+typedef struct draw_stats {
+	int totalRenderedNodes{ 0 };
+	int totalRenderedTriangles{ 0 };
+	int totalDrawCalls{ 0 };
+	// Calls partially selected nodes would need with one per quadrant, minus the ones made
+	int savedDrawCalls{ 0 };
+	void reset() {
+		totalRenderedTriangles = totalRenderedNodes = totalDrawCalls = savedDrawCalls = 0;
+	}
+} draw_stats;
+
+// Binds the tile's heightmap and sets texture size and tile offset/scale uniforms.
+void set_tile_uniforms( const GLuint p, const heightmap &hm, const omath::daabb &world_aabb );
+
+/* Draws the selection tile by tile and level by level, or in the selection's near to far order.
+ * set_tile( tile_index ) is called before the nodes of a tile are drawn. Adds to the stats. */
+void draw_selection( const GLuint p, const GLenum draw_mode, const lod_selection &selection, const gridmesh &mesh,
+		const bool front_to_back, const std::function<void( const unsigned int )> &set_tile, draw_stats &stats );
+
+}
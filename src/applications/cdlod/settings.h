@@ -13,7 +13,13 @@ namespace settings {
 
 const GLuint HEIGHTMAP_TEXTURE_UNIT = 0;
 const GLuint AABB_DRAWING_VERTEX_BUFFER_BINDING_INDEX = 0;
+const GLuint AABB_DRAWING_INSTANCE_BUFFER_BINDING_INDEX = 1;
 const GLuint GRIDMESH_VERTEX_BUFFER_BINDING_INDEX = 11;
+// Depth copy and depth pyramid for hierarchical z culling, and its shader storage buffers.
+const GLuint HIZ_DEPTH_TEXTURE_UNIT = 1;
+const GLuint HIZ_PYRAMID_TEXTURE_UNIT = 2;
+const GLuint HIZ_BOX_BUFFER_BINDING = 0;
+const GLuint HIZ_RESULT_BUFFER_BINDING = 1;
 // Skybox vertex buffer: 12
 // UIOverlay vertex buffer: ??
 // UIOverlay Font texture unit = 20;
@@ -29,13 +35,34 @@ const bool DEBUG_HIGHLIGHT_SHORT_VISIBILITY_BOXES = true;
 
 /* The size of the quadtree in raster units. .y ist the height.
  * The quadtree can get very large. Its origin (usually 0,0,0) and size are defined here.
- * Must be power of two. */
+ * Must be power of two. Trees of the quadtree forest take size and origin from their tile's .bb file,
+ * this is the fallback and the size the lod level settings are checked against. */
 const omath::uvec3 RASTER_MIN = { 0,0,0 };
 //const omath::uvec3 RASTER_MAX = { 16384,0,16384 };
 const omath::uvec3 RASTER_MAX = { 4096,0,4096 };
+/* Tiles of the quadtree forest are loaded when the camera is closer than the far plane and unloaded
+ * when it is further away than this factor times the far plane. Avoids load/unload cycles at the border. */
+const double TILE_UNLOAD_RANGE_FACTOR = 1.25;
+// Maximum number of tiles being read at the same time. Each tile load is a batch of block reads.
+const unsigned int MAX_TILE_LOADS_IN_FLIGHT = 2;
+/* No more tiles are loaded while heightmaps and quadtrees hold more than this, CPU and GPU memory
+ * together, as counted by the memory tracker. 0 for no limit. */
+const size_t TILE_MEMORY_BUDGET_MB = 0;
 /* Doesn't determine the absolute highst/lowest value from the heightmap for each node, but instead looks
- * up 4 cornerpoints and center height and builds bounding box from that. */
+ * up 4 cornerpoints and center height and builds bounding box from that.
+ * Only used if the heightmap has no min/max map for the node size. */
 const bool FAST_TREE_GENERATION = true;
+/* Calculate each node's geometric error (max height deviation from the surface drawn at its resolution)
+ * during quadtree creation. Needed by the screen space error selection metric. Costs a pass over the
+ * heightmap per lod level. */
+const bool COMPUTE_GEOMETRIC_ERROR = true;
+/* During quadtree creation, sub trees of nodes at least this large are created as jobs of the job system.
+ * Smaller ones are created by the job of their parent. */
+const unsigned int PARALLEL_TREE_NODE_SIZE = 256;
+// Rays per job of a batched quadtree raycast.
+const unsigned int RAYCAST_BATCH_GRAIN = 256;
+// Screen space error metric: nodes are refined if the geometric error around them projects to more pixels.
+const float PIXEL_ERROR_THRESHOLD = 1.0f;
 /* A multiplier to apply for the conversion between raster space and world space.
  * Can be seen as the distance between posts in m if height steps are 1m */
 const double RASTER_TO_WORLD_X = 90.0;
@@ -67,6 +94,8 @@ const unsigned int RENDER_GRID_RESULUTION_MULT = 1;
 const unsigned int GRIDMESH_DIMENSION = LEAF_NODE_SIZE * RENDER_GRID_RESULUTION_MULT;
 // The maximum depth of the quadtree.
 const unsigned int MAX_NUMBER_SELECTED_NODES = 1024;
+// Maximum number of views (selections) handled by one traversal of the quadtrees.
+const unsigned int MAX_SELECTION_VIEWS = 8;
 // TODO seperate view range for LOD and camera to be able to select shorter near/far planes
 // and still have LODding capabilities.
 /* The minimum view range that covers clean transitions. Can be situation dependent.
@@ -78,6 +107,28 @@ const double MAX_VIEW_RANGE = 100000.0;
  * number of triangles displayed on screen (in average) for all distances. Values above 2.0 will result in
  * more triangles on more distant areas, below 2.0 in less. */
 const double LOD_LEVEL_DISTANCE_RATIO = 2.0;
+/* Budget controller. Adjusts the distance ratio above at runtime within these limits to keep
+ * rendered triangles or frame time near the target. Hysteresis is the relative band around the target
+ * that is accepted, reaction frames the number of frames outside of it before the ratio changes. */
+const int LOD_BUDGET_TARGET_TRIANGLES = 1000000;
+const float LOD_BUDGET_TARGET_FRAME_MS = 16.0f;
+const double LOD_BUDGET_HYSTERESIS = 0.1;
+const unsigned int LOD_BUDGET_REACTION_FRAMES = 5;
+const double LOD_BUDGET_GAIN = 0.25;
+const double LOD_BUDGET_MIN_DISTANCE_RATIO = 1.5;
+const double LOD_BUDGET_MAX_DISTANCE_RATIO = 8.0;
+/* Horizon culling removes selected nodes hidden behind nearer terrain. Number of azimuth bins of the
+ * horizon buffer around the camera, more bins cull more at higher cost. */
+const bool HORIZON_CULLING = true;
+const unsigned int HORIZON_CULLING_BINS = 1024;
+/* Select the next frame on a worker thread while the current one is drawn. The selection is made
+ * for a camera pose extrapolated from the last two frames, with the field of view widened by the
+ * margin (degrees). If the camera ends up too far from the prediction, the frame is selected again. */
+const bool PIPELINED_SELECTION = true;
+const double PIPELINED_SELECTION_FOV_MARGIN = 10.0;
+/* Hierarchical z culling tests the selection against a depth pyramid of the last frame on the GPU.
+ * Reading back the results waits for the GPU, so it only pays off with many hidden nodes. */
+const bool HIZ_CULLING = false;
 /* The part of the distance over a level that is stable. 1-this is used for transitioning to the next level.
  * That is 0.66 means the first 0.66 are rendered with fixed resolution, 0.34 are used to linearly transition
  * to the next level. */
@@ -85,6 +136,12 @@ const double MORPH_START_RATIO = 0.66;
 /* Sort selection by camera distance. Can speed up rendering.
  * TODO: Sort by level first, then distance. */
 const bool SORT_SELECTION = true;
+/* Draw the sorted selection from near to far in one go instead of tile by tile and level by level.
+ * Keeps early z effective in hilly terrain, costs more heightmap and morph constant switches. */
+const bool FRONT_TO_BACK_DRAWING = false;
+/* Lay down depth with a position only vertex shader first, then shade each pixel once with depth
+ * writes off. Pays off when overdraw costs more than a second run of the vertex stage. */
+const bool DEPTH_PREPASS = false;
 // Not implemented yet
 const bool SHADOW_MAP_ENABLED = false;
 const unsigned int SHADOW_MAP_TEXTURE_RESOLUTION = 4096;	// 2048, 8192
@@ -36,6 +36,8 @@ uniform vec4 g_nodeScale;
 // distances for current lod level for begin and end of morphing
 // TODO: These are static in the application for now. Make them dynamic.
 uniform vec4 g_morphConsts;
+// Half edges bordering a coarser patch in bits 0-7, a finer one in bits 8-15, see lod_selection::edge_bits
+uniform uint g_edgeMorphs = 0u;
 uniform vec3 g_diffuseLightDir;
 layout( location = 5 ) uniform vec3 u_camera_position;
 layout( location = 15 ) uniform mat4 u_viewProjectionMatrix;
@@ -50,6 +52,9 @@ out VERTEX_OUTPUT {
 	float morphLerpK;
 } vertOut;
 
+// Same as in terrain_depth.vert.glsl, for testing against the prepass depth.
+invariant gl_Position;
+
 // Returns position relative to current tile fur texture lookup. Y value unsued.
 vec3 getTileVertexPos( vec3 inPosition ) {
 	vec3 returnValue = inPosition * g_nodeScale.xyz + g_nodeOffset;
@@ -72,6 +77,24 @@ vec2 morphVertex( vec3 inPosition, vec2 vertex, float morphLerpValue ) {
 	return vertex - decimals * morphLerpValue;
 }
 
+// Edges to a coarser patch are fully morphed, to a finer one not at all, so they match.
+float morphEdge( vec3 inPosition, float morphLerpValue ) {
+	uint edge = 0u;
+	if( inPosition.z == 0.0f )
+		edge = inPosition.x < 0.5f ? 1u : 2u;
+	else if( inPosition.z == 1.0f )
+		edge = inPosition.x < 0.5f ? 4u : 8u;
+	else if( inPosition.x == 0.0f )
+		edge = inPosition.z < 0.5f ? 16u : 32u;
+	else if( inPosition.x == 1.0f )
+		edge = inPosition.z < 0.5f ? 64u : 128u;
+	if( ( g_edgeMorphs & edge ) != 0u )
+		return 1.0f;
+	if( ( g_edgeMorphs & ( edge << 8 ) ) != 0u )
+		return 0.0f;
+	return morphLerpValue;
+}
+
 // Assumes linear filtering being enabled in sampler.
 // TODO 8 bit not yet supported !
 float sampleHeightmap( vec2 uv ) {
@@ -111,6 +134,7 @@ void main() {
 	float eyeDistance = distance( vertex, u_camera_position );
 
 	vertOut.morphLerpK = 1.0f - clamp( g_morphConsts.z - eyeDistance * g_morphConsts.w, 0.0f, 1.0f );
+	vertOut.morphLerpK = morphEdge( position, vertOut.morphLerpK );
 	vertex.xz = morphVertex( position, vertex.xz, vertOut.morphLerpK );
 
 	vertOut.heightmapUV = calculateUV( vertex.xz );
@@ -0,0 +1,81 @@
+
+/* Position only version of terrain.vert.glsl for the depth prepass. Samples the height twice for
+ * morphing and leaves out the normal. Position math must stay the same as there, gl_Position is
+ * invariant in both so the shading pass can test against the prepass depth. */
+
+#version 450 core
+
+layout( location = 0 ) in vec3 position;
+
+layout( binding = 0 ) uniform sampler2D g_tileHeightmap;
+
+uniform float u_height_factor = 1.0f;
+uniform vec2 u_raster_to_world = vec2(1.0f,1.0f);
+
+// See terrain.vert.glsl
+uniform vec3 g_tileOffset;
+uniform vec3 g_tileScale;
+uniform vec2 g_tileMax;
+uniform vec2 g_tileToTexture;
+uniform vec4 g_heightmapTextureInfo;
+uniform vec3 g_gridDim;
+uniform vec3 g_nodeOffset;
+uniform vec4 g_nodeScale;
+uniform vec4 g_morphConsts;
+uniform uint g_edgeMorphs = 0u;
+layout( location = 5 ) uniform vec3 u_camera_position;
+layout( location = 15 ) uniform mat4 u_viewProjectionMatrix;
+
+invariant gl_Position;
+
+vec3 getTileVertexPos( vec3 inPosition ) {
+	vec3 returnValue = inPosition * g_nodeScale.xyz + g_nodeOffset;
+	returnValue.xz = min( returnValue.xz, g_tileMax );
+	return returnValue;
+}
+
+vec2 calculateUV( vec2 vertex ) {
+	vec2 heightmapUV = ( vertex.xy - g_tileOffset.xz ) / g_tileScale.xz;
+	heightmapUV *= g_tileToTexture;
+	heightmapUV += g_heightmapTextureInfo.zw * 0.5f;
+	return heightmapUV;
+}
+
+vec2 morphVertex( vec3 inPosition, vec2 vertex, float morphLerpValue ) {
+	vec2 decimals = ( fract( inPosition.xz * vec2( g_gridDim.y, g_gridDim.y ) ) * 
+					vec2( g_gridDim.z, g_gridDim.z ) ) * g_nodeScale.xz;
+	return vertex - decimals * morphLerpValue;
+}
+
+float morphEdge( vec3 inPosition, float morphLerpValue ) {
+	uint edge = 0u;
+	if( inPosition.z == 0.0f )
+		edge = inPosition.x < 0.5f ? 1u : 2u;
+	else if( inPosition.z == 1.0f )
+		edge = inPosition.x < 0.5f ? 4u : 8u;
+	else if( inPosition.x == 0.0f )
+		edge = inPosition.z < 0.5f ? 16u : 32u;
+	else if( inPosition.x == 1.0f )
+		edge = inPosition.z < 0.5f ? 64u : 128u;
+	if( ( g_edgeMorphs & edge ) != 0u )
+		return 1.0f;
+	if( ( g_edgeMorphs & ( edge << 8 ) ) != 0u )
+		return 0.0f;
+	return morphLerpValue;
+}
+
+float sampleHeightmap( vec2 uv ) {
+	return texture( g_tileHeightmap, uv ).r * 65535.0f * u_height_factor;
+}
+
+void main() {
+	vec3 vertex = getTileVertexPos( position );
+	vec2 preUV = calculateUV( vertex.xz );
+	vertex.y = sampleHeightmap( preUV );
+	float eyeDistance = distance( vertex, u_camera_position );
+	float morphLerpK = morphEdge( position, 1.0f - clamp( g_morphConsts.z - eyeDistance * g_morphConsts.w, 0.0f, 1.0f ) );
+	vertex.xz = morphVertex( position, vertex.xz, morphLerpK );
+	vertex.y = sampleHeightmap( calculateUV( vertex.xz ) );
+	vec3 world_position = vertex * vec3(u_raster_to_world.x,1.0f,u_raster_to_world.y);
+	gl_Position = u_viewProjectionMatrix * vec4( world_position, 1.0f );
+}
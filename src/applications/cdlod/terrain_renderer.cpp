@@ -4,17 +4,28 @@
 #include "applications/camera/camera.h"
 #include "node.h"
 #include "quadtree.h"
+#include "quadtree_forest.h"
 #include "heightmap.h"
 #include "renderer/uniform.h"
 #include "scene/scene.h"
 #include "base/logbook.h"
+#include "base/async_reader.h"
+#include "base/frame_arena.h"
+#include "base/glfw_window.h"
 #include "omath/aabb.h"
 #include "omath/mat4.h"
+#include "renderer/gl_state.h"
+#include "renderer/profiler.h"
 #include "renderer/program.h"
 #include "renderer/uniform.h"
 #include "imgui/imgui.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <fstream>
+#include <initializer_list>
 #include <sstream>
+#include <utility>
 
 using namespace orf_n;
 
@@ -36,17 +47,13 @@ void terrain_renderer::setup() {
 	// Prepare gridmesh for drawing.
 	m_gridmesh = std::make_unique<gridmesh>( settings::GRIDMESH_DIMENSION );
 
-	// Load the heightmap and tile relative and world min/max coords for the bounding boxes
-	// TODO: check size and if it fits quadtree, do a proper datastructure and asynchronous load.
-	// TODO class terrain_tile
+	// Tiles of the forest. Only their bounding boxes are read here, data is loaded around the camera.
 	const std::vector<std::string> terrain_files {
 		//"/home/kemde/eclipse-workspace/cdlod_backup/resources/textures/terrain/n30e090/tiles_16k/tile_1638_4",
 		"resources/textures/terrain/n30e090/tiles_4k/tile_4096_4"
 	};
-	m_heightmap = std::make_unique<heightmap>( terrain_files[0], heightmap::B16 );
-	// Build the quadtree with nodes and their bounding boxes.
-	m_quadtree = std::make_unique<quadtree>( m_heightmap.get() );
-	m_quadtree->create();
+	m_reader = std::make_unique<async_reader>();
+	m_forest = std::make_unique<quadtree_forest>( terrain_files, m_reader.get() );
 
 	// Create terrain shaders
 	std::vector<std::shared_ptr<module>> modules;
@@ -57,10 +64,13 @@ void terrain_renderer::setup() {
 			std::make_shared<module>( GL_FRAGMENT_SHADER,"src/applications/cdlod/terrain.frag.glsl" )
 	);
 	m_shaderTerrain = std::make_unique<program>( modules );
+	m_shader_depth = std::make_unique<program>( std::vector<std::shared_ptr<module>>{
+			std::make_shared<module>( GL_VERTEX_SHADER, "src/applications/cdlod/terrain_depth.vert.glsl" )
+	} );
 
 	// Camera and selection object. Are connected because selection is based on view frustum and range.
 	// TODO parametrize or calculate initial position, direction and view range.
-	omath::daabb box; m_heightmap->get_world_aabb(box);
+	const omath::daabb &box{ m_forest->get_world_aabb() };
 	m_scene->get_camera()->set_position_and_target( box.m_max, box.m_min );
 	m_scene->get_camera()->set_near_plane( 1.0 );
 	m_scene->get_camera()->set_far_plane( box.get_diagonal_size() );
@@ -68,19 +78,19 @@ void terrain_renderer::setup() {
 
 	/* TODO Should be sorted by tile, level and distance to avoid too many heightmap switches
 	 * and shader uniform settings. */
-	m_selection = new lod_selection{ m_scene->get_camera(), settings::SORT_SELECTION };
+	const lod_selection::view_t view{ lod_selection::make_view( m_scene->get_camera() ) };
+	m_selection = new lod_selection{ view, settings::SORT_SELECTION };
+	m_next_selection = new lod_selection{ view, settings::SORT_SELECTION };
+	m_compare_selection = new lod_selection{ view, false };
+	m_last_camera_position = m_scene->get_camera()->get_position();
+	m_last_camera_front = m_predicted_front = m_scene->get_camera()->get_front();
+	// First frame should not be empty, wait for the tiles in range.
+	m_forest->update( m_scene->get_camera()->get_position(), m_scene->get_camera()->get_far_plane(), true );
 
 	// Set global shader uniforms valid for all tiles
 	m_shaderTerrain->use();
-	// Set default global shader uniforms belonging to this quadtree/heightmap
-	const float w = (float)m_heightmap->get_extent().x;
-	const float h = (float)m_heightmap->get_extent().y;
-	// Used to clamp edges to correct terrain size (only max-es needs clamping, min-s are clamped implicitly)
-	m_tileToTexture = omath::vec2{ ( w - 1.0f ) / w, ( h - 1.0f ) / h };
-	m_heightMapInfo = omath::vec4{ w, h, 1.0f / w, 1.0f / h };
+	// Tile specific uniforms are set in the render loop.
 	const GLuint p = m_shaderTerrain->get_program();
-	set_uniform( p, "g_tileToTexture", m_tileToTexture );
-	set_uniform( p, "g_heightmapTextureInfo", m_heightMapInfo );
 	set_uniform( p, "u_height_factor", (float)settings::HEIGHT_FACTOR );
 	// Set dimensions of the gridmesh used for rendering an individual node
 	set_uniform( p, "g_gridDim", omath::vec3{
@@ -97,21 +107,50 @@ void terrain_renderer::setup() {
 	set_uniform( p, "g_lightColorAmbient", lightColorAmbient );
 	set_uniform( p, "g_colorMult", colorMult );
 	set_uniform( p, "g_diffuseLightDir", -m_diffuseLightPos );
+	m_shader_depth->use();
+	const GLuint pd = m_shader_depth->get_program();
+	set_uniform( pd, "u_height_factor", (float)settings::HEIGHT_FACTOR );
+	set_uniform( pd, "g_gridDim", omath::vec3{
+		(float)settings::GRIDMESH_DIMENSION,
+		(float)settings::GRIDMESH_DIMENSION * 0.5f,
+		2.0f / (float)settings::GRIDMESH_DIMENSION
+	} );
 
 	// Setup debug drawing of AABBs.
 	m_draw_aabb.setup();
+	m_hiz_culling.setup();
 }
 
 void terrain_renderer::render(const double deltatime) {
-	glEnable( GL_DEPTH_TEST );
-	glEnable( GL_CULL_FACE );
+	gl_state::get_instance().enable( GL_DEPTH_TEST );
+	gl_state::get_instance().enable( GL_CULL_FACE );
 	const camera *const cam{ m_scene->get_camera() };
 	// Perform selection TODO parametrize sorting and concatenate lod selection.
 	// Reset selection, add nodes, sort selection, lod level and nearest to farest.
 	if( !m_single_step || (m_single_step && !m_stepped) ) {
-		m_selection->reset();
-		m_quadtree->lodSelect( m_selection );
-		m_selection->set_distances_and_sort();
+		const lod_selection::view_t view{ lod_selection::make_view( cam ) };
+		if( m_pipelined_selection && !m_single_step )
+			take_next_selection( view );
+		else {
+			// In case pipelining was just switched off
+			m_selection_jobs.wait();
+			m_next_pending = false;
+			m_forest->update( cam->get_position(), cam->get_far_plane() );
+			update_budget( deltatime );
+			set_metric( m_selection );
+			m_selection->set_view( view );
+			select( m_selection );
+		}
+		m_compare_selection->set_view( view );
+		if( m_multi_view_benchmark )
+			benchmark_multi_view();
+		if( m_use_hiz_culling ) {
+			PROFILE_CPU_SCOPE( "hi-z cull" );
+			PROFILE_GPU_SCOPE( "hi-z cull" );
+			m_hiz_culling.cull( m_selection, (unsigned int)m_gridmesh->get_number_indices() / 3 );
+		}
+		if( m_compare_metrics )
+			compare_metrics();
 		if( m_single_step && m_print_selection )
 			m_selection->print_selection();
 		if( !m_stepped ) {
@@ -122,161 +161,288 @@ void terrain_renderer::render(const double deltatime) {
 
 	// Debug: draw bounding boxes
 	bool refreshUniforms{ refreshUI() };
-	if( m_showTileBoxes || m_showLowestLevelBoxes || m_showSelectedBoxes )
+	if( m_showTileBoxes || m_showLowestLevelBoxes || m_showSelectedBoxes ) {
+		PROFILE_GPU_SCOPE( "aabb" );
 		debugDrawing();
+	}
 
 	// Bind meshes, shader, reset stats, prepare and set matrices and cam pos
-	if( !m_drawSelection )
+	if( !m_drawSelection ) {
+		m_hiz_culling.invalidate();
+		start_next_selection( deltatime );
 		return;
+	}
 	m_gridmesh->bind();
 	m_renderStats.reset();
+	const GLenum drawMode{ (GLenum)( cam->get_wireframe_mode() ? GL_LINES : GL_TRIANGLES ) };
+	// Lines would be hidden by the prepass triangles
+	const bool depth_prepass{ m_depth_prepass && GL_TRIANGLES == drawMode };
+	if( depth_prepass ) {
+		PROFILE_CPU_SCOPE( "depth prepass submit" );
+		PROFILE_GPU_SCOPE( "depth prepass" );
+		m_shader_depth->use();
+		setViewProjectionMatrix( cam->get_view_perspective_matrix() );
+		set_uniform( m_shader_depth->get_program(), "u_camera_position", omath::vec3(cam->get_position()) );
+		glColorMask( GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE );
+		draw_stats prepass_stats;
+		draw_selection( m_shader_depth->get_program(), drawMode, prepass_stats );
+		glColorMask( GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE );
+		gl_state::get_instance().depth_func( GL_LEQUAL );
+		gl_state::get_instance().depth_mask( GL_FALSE );
+	}
 	m_shaderTerrain->use();
 	const GLuint p = m_shaderTerrain->get_program();
-	if( refreshUniforms )
-		set_uniform( p, "g_diffuseLightDir", -m_diffuseLightPos );
-	setViewProjectionMatrix( cam->get_view_perspective_matrix() );
-	set_uniform( p, "debugColor", color::white );
-	set_uniform( p, "u_camera_position", omath::vec3(cam->get_position()) );
-	GLint drawMode = ( cam->get_wireframe_mode() ? GL_LINES : GL_TRIANGLES );
-	omath::daabb box; m_heightmap->get_world_aabb(box);
-	set_uniform( p, "g_tileMax", omath::vec2{ box.m_max.x, box.m_max.z } );
-	set_uniform( p, "g_tileScale", omath::vec3{ box.m_max - box.m_min } );
-	set_uniform( p, "g_tileOffset", omath::vec3{ box.m_min } );
-
-	omath::uvec2 renderStats{ 0, 0 };
-	m_heightmap->bind();
-	// Submeshes are evenly spaced in index buffer. Else calc offsets individually.
-	const unsigned int halfD{ m_gridmesh->getEndIndexTL() };
-	// Iterate through the lod selection's lod levels
-	for( unsigned int level = m_selection->m_min_selected_lod_level; level <= m_selection->m_max_selected_lod_level; ++level ) {
-		const unsigned int filterLODLevel = level;
-		unsigned int prevMorphConstLevelSet = UINT_MAX;
-		for( unsigned int i=0; i < m_selection->m_selection_count; ++i ) {
-			const lod_selection::selected_node &n = m_selection->m_selected_nodes[i];
-			// Only draw tiles of the currently bound heightmap; filter out nodes if not of the current level
-			if( filterLODLevel != n.lod_level )
-				continue;
-			// Set LOD level specific consts if they have changed from last lod level
-			if( prevMorphConstLevelSet == UINT_MAX || prevMorphConstLevelSet != n.lod_level ) {
-				prevMorphConstLevelSet = n.lod_level;
-				set_uniform(
-						p, "g_morphConsts", m_selection->get_morph_consts( prevMorphConstLevelSet )
-				);
-			}
-			bool drawFull{ n.has_tl && n.has_tr && n.has_bl && n.has_br };
-			omath::daabb box; n.p_node->get_world_aabb(box);
-			// .w holds the current lod level
-			omath::vec4 nodeScale{ (float)box.get_size().x, 0.0f, (float)box.get_size().z, float(n.lod_level) };
-			omath::vec3 nodeOffset{ (float)box.m_min.x, float(box.m_min.y+box.m_max.y) * 0.5f, (float)box.m_min.z };
-			set_uniform( p, "g_nodeScale", nodeScale );
-			set_uniform( p, "g_nodeOffset", nodeOffset );
-			const int numIndices{ m_gridmesh->get_number_indices() };
-			if( drawFull ) {
-				glDrawElements( drawMode, numIndices, GL_UNSIGNED_INT, (const void *)0 );
-				++renderStats.x;
-				renderStats.y += numIndices / 3;
-			} else {
-				// can be optimized by combining calls
-				if( n.has_tl ) {
-					glDrawElements( drawMode, halfD, GL_UNSIGNED_INT, (const void *)0 );
-					++renderStats.x;
-					renderStats.y += halfD / 3;
-				}
-				if( n.has_tr ) {
-					glDrawElements(
-							drawMode, halfD, GL_UNSIGNED_INT,(const void *)( m_gridmesh->getEndIndexTL() * sizeof( GL_UNSIGNED_INT ) )
-					);
-					++renderStats.x;
-					renderStats.y += halfD / 3;
-				}
-				if( n.has_bl ) {
-					glDrawElements(
-							drawMode, halfD, GL_UNSIGNED_INT,(const void *)( m_gridmesh->getEndIndexTR() * sizeof( GL_UNSIGNED_INT ) )
-					);
-					++renderStats.x;
-					renderStats.y += halfD / 3;
-				}
-				if( n.has_br ) {
-					glDrawElements(
-							drawMode, halfD, GL_UNSIGNED_INT,(const void *)( m_gridmesh->getEndIndexBL() * sizeof( GL_UNSIGNED_INT ) )
-					);
-					++renderStats.x;
-					renderStats.y += halfD / 3;
-				}
-			}
-		}
+	{
+		PROFILE_CPU_SCOPE( "uniform upload" );
+		if( refreshUniforms )
+			set_uniform( p, "g_diffuseLightDir", -m_diffuseLightPos );
+		setViewProjectionMatrix( cam->get_view_perspective_matrix() );
+		set_uniform( p, "debugColor", color::white );
+		set_uniform( p, "u_camera_position", omath::vec3(cam->get_position()) );
+	}
+	{
+		PROFILE_CPU_SCOPE( "draw submit" );
+		PROFILE_GPU_SCOPE( "terrain" );
+		draw_selection( p, drawMode, m_renderStats );
+	}
+	if( depth_prepass ) {
+		gl_state::get_instance().depth_func( GL_LESS );
+		gl_state::get_instance().depth_mask( GL_TRUE );
 	}
-	m_renderStats.totalRenderedNodes += renderStats.x;
-	m_renderStats.totalRenderedTriangles += renderStats.y;
+	orf_n::profiler::get_instance().set_counter( "selected nodes", (double)m_selection->m_selection_count );
+	orf_n::profiler::get_instance().set_counter( "drawn nodes", (double)m_renderStats.totalRenderedNodes );
+	orf_n::profiler::get_instance().set_counter( "triangles", (double)m_renderStats.totalRenderedTriangles );
+	orf_n::profiler::get_instance().set_counter( "draw calls", (double)m_renderStats.totalDrawCalls );
+	orf_n::profiler::get_instance().set_counter( "draw calls saved", (double)m_renderStats.savedDrawCalls );
+	// Depth pyramid for the next frame's culling
+	if( m_use_hiz_culling ) {
+		PROFILE_GPU_SCOPE( "hi-z build" );
+		m_hiz_culling.build( m_scene->get_render_width(), m_scene->get_render_height(),
+				omath::mat4( cam->get_view_perspective_matrix() ) );
+	} else
+		m_hiz_culling.invalidate();
+	start_next_selection( deltatime );
 }
 
 void terrain_renderer::cleanup() {
+	m_selection_jobs.wait();
+	delete m_next_selection;
+	delete m_compare_selection;
 	delete m_selection;
 	m_draw_aabb.cleanup();
+	m_hiz_culling.cleanup();
 }
 
-const heightmap *terrain_renderer::get_heightmap() const {
-	return m_heightmap.get();
+void terrain_renderer::select( lod_selection *selection, const bool horizon_culling ) {
+	PROFILE_CPU_SCOPE( "selection" );
+	selection->reset();
+	m_forest->lod_select( selection );
+	if( horizon_culling && m_use_horizon_culling )
+		m_horizon_culling.cull( selection, (unsigned int)m_gridmesh->get_number_indices() / 3, selection->m_view.position );
+	PROFILE_CPU_SCOPE( "sort" );
+	selection->set_distances_and_sort();
 }
 
-const terrain::quadtree *terrain_renderer::get_quadtree() const {
-	return m_quadtree.get();
+void terrain_renderer::take_next_selection( const lod_selection::view_t &view ) {
+	m_selection_jobs.wait();
+	if( m_next_pending ) {
+		m_next_pending = false;
+		std::swap( m_selection, m_next_selection );
+		/* Keep it if the camera stayed within a quarter of the finest morph range of the predicted
+		 * position, so selection and morphing match, and turned less than half the fov margin. */
+		const double max_offset{ 0.25 * ( m_selection->m_morph_end[0] - m_selection->m_morph_start[0] ) };
+		const double min_cos{ std::cos( omath::radians( 0.5 * settings::PIPELINED_SELECTION_FOV_MARGIN ) ) };
+		if( omath::magnitude( view.position - m_selection->m_view.position ) <= max_offset &&
+				omath::dot( m_scene->get_camera()->get_front(), m_predicted_front ) >= min_cos ) {
+			// With the camera's real position. Removing nodes keeps the selection sorted.
+			if( m_use_horizon_culling )
+				m_horizon_culling.cull( m_selection, (unsigned int)m_gridmesh->get_number_indices() / 3, view.position );
+			return;
+		}
+		++m_prediction_fallbacks;
+	}
+	set_metric( m_selection );
+	m_selection->set_view( view );
+	select( m_selection );
+}
+
+void terrain_renderer::start_next_selection( const double deltatime ) {
+	if( !m_pipelined_selection || m_single_step )
+		return;
+	const camera *const cam{ m_scene->get_camera() };
+	// No selection job runs here, the forest may change.
+	m_forest->update( cam->get_position(), cam->get_far_plane() );
+	update_budget( deltatime );
+	// Same velocity and turn rate as in the last frame
+	const omath::dvec3 position{ cam->get_position() * 2.0 - m_last_camera_position };
+	m_predicted_front = omath::normalize( cam->get_front() * 2.0 - m_last_camera_front );
+	m_last_camera_position = cam->get_position();
+	m_last_camera_front = cam->get_front();
+	lod_selection::view_t view{ lod_selection::make_view( cam ) };
+	view.position = position;
+	view.frustum.set_fov( std::min( cam->get_zoom() + settings::PIPELINED_SELECTION_FOV_MARGIN, 170.0 ),
+			cam->get_aspect_ratio(), cam->get_near_plane(), cam->get_far_plane() );
+	view.frustum.set_camera_vectors( position, position + m_predicted_front, cam->get_up() );
+	set_metric( m_next_selection );
+	m_next_selection->set_view( view );
+	m_next_pending = true;
+	lod_selection *const next{ m_next_selection };
+	m_selection_jobs.run( [this, next]{ select( next, false ); } );
+}
+
+void terrain_renderer::update_budget( const double deltatime ) {
+	if( !m_budget.update( m_renderStats.totalRenderedTriangles, deltatime, m_selection->m_selection_count ) )
+		return;
+	for( lod_selection *s : { m_selection, m_next_selection, m_compare_selection } ) {
+		s->m_distance_ratio = m_budget.get_distance_ratio();
+		s->calculate_ranges( false );
+	}
+}
+
+void terrain_renderer::set_metric( lod_selection *selection ) const {
+	float errors[settings::NUMBER_OF_LOD_LEVELS];
+	m_forest->get_max_geometric_errors( errors );
+	selection->set_metric( m_use_screen_space_error ? lod_selection::SCREEN_SPACE_ERROR : lod_selection::DISTANCE,
+			m_pixel_error_threshold, errors );
+}
+
+/* Triangle counts of both metrics at equal visual error: the screen space error selection gets the
+ * largest projected error of the distance selection as threshold. */
+void terrain_renderer::compare_metrics() {
+	const unsigned int triangles_per_node{ (unsigned int)m_gridmesh->get_number_indices() / 3 };
+	float errors[settings::NUMBER_OF_LOD_LEVELS];
+	m_forest->get_max_geometric_errors( errors );
+	m_compare_selection->reset();
+	m_compare_selection->set_metric( lod_selection::DISTANCE );
+	m_forest->lod_select( m_compare_selection );
+	m_metric_comparison.distance_triangles = m_compare_selection->get_triangle_count( triangles_per_node );
+	m_metric_comparison.distance_error = m_compare_selection->m_max_screen_space_error;
+	m_compare_selection->reset();
+	m_compare_selection->set_metric( lod_selection::SCREEN_SPACE_ERROR, (float)m_metric_comparison.distance_error, errors );
+	m_forest->lod_select( m_compare_selection );
+	m_metric_comparison.sse_triangles = m_compare_selection->get_triangle_count( triangles_per_node );
+	m_metric_comparison.sse_error = m_compare_selection->m_max_screen_space_error;
+}
+
+/* Splits the camera frustum into m_benchmark_views cascades between near and far plane
+ * and selects them one by one, then all in one traversal of the forest. */
+void terrain_renderer::benchmark_multi_view() {
+	const camera *const cam{ m_scene->get_camera() };
+	const unsigned int count{ (unsigned int)std::clamp( m_benchmark_views, 1, (int)settings::MAX_SELECTION_VIEWS ) };
+	const double near_plane{ cam->get_near_plane() };
+	const double far_plane{ cam->get_far_plane() };
+	lod_selection *selections[settings::MAX_SELECTION_VIEWS];
+	for( unsigned int i = 0; i < count; ++i ) {
+		// Logarithmic split like shadow cascades
+		const double n{ near_plane * std::pow( far_plane / near_plane, double(i) / double(count) ) };
+		const double f{ near_plane * std::pow( far_plane / near_plane, double(i+1) / double(count) ) };
+		lod_selection::view_t view{ lod_selection::make_view( cam ) };
+		view.frustum.set_fov( cam->get_zoom(), cam->get_aspect_ratio(), n, f );
+		view.frustum.set_camera_vectors( cam->get_position(), cam->get_position() + cam->get_front(), cam->get_up() );
+		if( m_benchmark_selections.size() <= i )
+			m_benchmark_selections.push_back( std::make_unique<lod_selection>( view, false ) );
+		else
+			m_benchmark_selections[i]->set_view( view );
+		m_benchmark_selections[i]->m_distance_ratio = m_selection->m_distance_ratio;
+		selections[i] = m_benchmark_selections[i].get();
+	}
+	const auto t0{ std::chrono::high_resolution_clock::now() };
+	for( unsigned int i = 0; i < count; ++i ) {
+		selections[i]->reset();
+		m_forest->lod_select( selections[i] );
+	}
+	const auto t1{ std::chrono::high_resolution_clock::now() };
+	for( unsigned int i = 0; i < count; ++i )
+		selections[i]->reset();
+	m_forest->lod_select( selections, count );
+	const auto t2{ std::chrono::high_resolution_clock::now() };
+	m_multi_view_timing.nodes = 0;
+	for( unsigned int i = 0; i < count; ++i )
+		m_multi_view_timing.nodes += selections[i]->m_selection_count;
+	const double separate_ms{ std::chrono::duration<double, std::milli>( t1 - t0 ).count() };
+	const double single_ms{ std::chrono::duration<double, std::milli>( t2 - t1 ).count() };
+	m_multi_view_timing.separate_ms += ( separate_ms - m_multi_view_timing.separate_ms ) * 0.05;
+	m_multi_view_timing.single_ms += ( single_ms - m_multi_view_timing.single_ms ) * 0.05;
+}
+
+const quadtree_forest *terrain_renderer::get_forest() const {
+	return m_forest.get();
+}
+
+void terrain_renderer::draw_selection( const GLuint p, const GLenum draw_mode, draw_stats &stats ) const {
+	const auto set_tile = [this, p]( const unsigned int tile_index ) {
+		const quadtree_forest::tile &t{ m_forest->get_tile( tile_index ) };
+		set_tile_uniforms( p, *t.p_heightmap, t.world_aabb );
+	};
+	terrain::draw_selection( p, draw_mode, *m_selection, *m_gridmesh, m_front_to_back, set_tile, stats );
 }
 
 // ******** Debug stuff
+// Boxes are collected and drawn in one instanced call, highlighted ones in a second with wider lines.
 void terrain_renderer::debugDrawing() {
 	// To keep the below less verbose
 	const program *p{ m_draw_aabb.getProgramPtr() };
 	p->use();
 	set_uniform( p->get_program(), "projViewMatrix", omath::mat4(m_scene->get_camera()->get_view_perspective_matrix()) );
 	omath::daabb box;
-	// TODO if( m_showTileBoxes ) m_draw_aabb.draw( *m_aabb, color::white );
+	if( m_showTileBoxes )
+		for( unsigned int i = 0; i < m_forest->get_number_of_tiles(); ++i ) {
+			const quadtree_forest::tile &t{ m_forest->get_tile( i ) };
+			m_draw_aabb.add( t.world_aabb, quadtree_forest::RESIDENT == t.state ? color::white : color::gray );
+		}
 	if( m_showLowestLevelBoxes )
 		debugDrawLowestLevelBoxes();
+	frame_vector<omath::daabb> highlighted;
 	if( m_showSelectedBoxes ) {
 		for( unsigned int i=0; i < m_selection->m_selection_count; ++i ) {
 			const lod_selection::selected_node &n = m_selection->m_selected_nodes[i];
 			bool drawFull = n.has_tl && n.has_tr && n.has_bl && n.has_br;
 			if( drawFull ) {
 				n.p_node->get_world_aabb(box);
-				m_draw_aabb.draw( box, color::rainbow[n.p_node->get_level()%6] );
+				m_draw_aabb.add( box, color::rainbow[n.p_node->get_level()%6] );
 			} else {
 				if( n.has_tl ) {
 					n.p_node->get_tl()->get_world_aabb(box);
-					m_draw_aabb.draw( box,color::rainbow[n.p_node->get_tl()->get_level()%6] );
+					m_draw_aabb.add( box,color::rainbow[n.p_node->get_tl()->get_level()%6] );
 				}
 				if( n.has_tr ) {
 					n.p_node->get_tr()->get_world_aabb(box);
-					m_draw_aabb.draw( box,color::rainbow[n.p_node->get_tr()->get_level()%6] );
+					m_draw_aabb.add( box,color::rainbow[n.p_node->get_tr()->get_level()%6] );
 				}
 				if( n.has_bl ) {
 					n.p_node->get_bl()->get_world_aabb(box);
-					m_draw_aabb.draw( box, color::rainbow[n.p_node->get_bl()->get_level()%6] );
+					m_draw_aabb.add( box, color::rainbow[n.p_node->get_bl()->get_level()%6] );
 				}
 				if( n.has_br ) {
 					n.p_node->get_br()->get_world_aabb(box);
-					m_draw_aabb.draw( box, color::rainbow[n.p_node->get_br()->get_level()%6] );
+					m_draw_aabb.add( box, color::rainbow[n.p_node->get_br()->get_level()%6] );
 				}
 			}
 			if( settings::DEBUG_HIGHLIGHT_SHORT_VISIBILITY_BOXES && n.is_vis_dist_too_small() ) {
-				glLineWidth(3.0f);
 				n.p_node->get_world_aabb(box);
-				m_draw_aabb.draw( box.expand( 0.003 ), color::red );
-				glLineWidth(1.0f);
+				highlighted.push_back( box.expand( 0.003 ) );
 			}
 		}
 	}
+	m_draw_aabb.flush();
+	if( !highlighted.empty() ) {
+		for( const omath::daabb &b : highlighted )
+			m_draw_aabb.add( b, color::red );
+		glLineWidth(3.0f);
+		m_draw_aabb.flush();
+		glLineWidth(1.0f);
+	}
 }
 
-// Draw all bounding boxes of heightmap
+// Queue the bounding boxes of the lowest level nodes in the view frustum of the visible tiles
 void terrain_renderer::debugDrawLowestLevelBoxes() const {
-	const node *const nodes{ m_quadtree->getNodes() };
-	for( unsigned int i=0; i < m_quadtree->getNodeCount(); ++i )
-		if( nodes[i].get_level() == settings::NUMBER_OF_LOD_LEVELS - 1 ) {
-			omath::daabb box; nodes[i].get_world_aabb(box);
-			if( m_scene->get_camera()->get_view_frustum().is_box_in_frustum( box ) != omath::OUTSIDE )
-				m_draw_aabb.draw( box, color::cornflowerBlue );
-		}
+	const omath::view_frustum &frustum{ m_scene->get_camera()->get_view_frustum() };
+	frame_vector<const node *> leaves;
+	for( const unsigned int tile_index : m_selection->m_visible_tiles )
+		m_forest->get_tile( tile_index ).p_quadtree->get_visible_leaves( frustum, leaves );
+	omath::daabb box;
+	for( const node *n : leaves )
+		m_draw_aabb.add( n->get_world_aabb(box), color::cornflowerBlue );
 }
 
 bool terrain_renderer::refreshUI() {
@@ -302,8 +468,55 @@ bool terrain_renderer::refreshUI() {
 	ImGui::Text( "# selected nodes %d", m_selection->m_selection_count );
 	ImGui::Text( "# rendered nodes %d", m_renderStats.totalRenderedNodes );
 	ImGui::Text( "# rendered triangles %d", m_renderStats.totalRenderedTriangles );
+	ImGui::Text( "# draw calls %d, saved by merging quadrants %d", m_renderStats.totalDrawCalls, m_renderStats.savedDrawCalls );
 	ImGui::Text( "min selected LOD level %d", m_selection->m_min_selected_lod_level );
 	ImGui::Text( "max selected LOD level %d", m_selection->m_max_selected_lod_level );
+	ImGui::Checkbox( "Horizon culling", &m_use_horizon_culling );
+	if( m_use_horizon_culling )
+		ImGui::Text( "# horizon culled nodes %d, triangles %d",
+				m_horizon_culling.get_culled_nodes(), m_horizon_culling.get_culled_triangles() );
+	ImGui::Checkbox( "Pipelined selection", &m_pipelined_selection );
+	if( m_pipelined_selection )
+		ImGui::Text( "# prediction fallbacks %d", m_prediction_fallbacks );
+	ImGui::Checkbox( "Front to back drawing", &m_front_to_back );
+	ImGui::Checkbox( "Depth prepass", &m_depth_prepass );
+	ImGui::Checkbox( "Hierarchical z culling", &m_use_hiz_culling );
+	if( m_use_hiz_culling )
+		ImGui::Text( "# hi-z culled nodes %d, triangles %d",
+				m_hiz_culling.get_culled_nodes(), m_hiz_culling.get_culled_triangles() );
+	ImGui::Text( "# tiles visible/resident/total %d/%d/%d", (int)m_selection->m_visible_tiles.size(),
+			m_forest->get_number_of_resident_tiles(), m_forest->get_number_of_tiles() );
+	ImGui::Separator();
+	ImGui::Text( "LOD budget" );
+	ImGui::RadioButton( "off", (int *)&m_budget.m_mode, lod_budget::OFF );
+	ImGui::SameLine();
+	ImGui::RadioButton( "triangles", (int *)&m_budget.m_mode, lod_budget::TRIANGLES );
+	ImGui::SameLine();
+	ImGui::RadioButton( "frame time", (int *)&m_budget.m_mode, lod_budget::FRAME_TIME );
+	if( lod_budget::TRIANGLES == m_budget.m_mode )
+		ImGui::SliderInt( "Target triangles", &m_budget.m_target_triangles, 10000, 10000000 );
+	if( lod_budget::FRAME_TIME == m_budget.m_mode )
+		ImGui::SliderFloat( "Target frame ms", &m_budget.m_target_frame_ms, 2.0f, 50.0f );
+	ImGui::Text( "distance ratio %.2f, measured %.1f", m_selection->m_distance_ratio, m_budget.get_measured() );
+	ImGui::Separator();
+	ImGui::Checkbox( "Screen space error LOD", &m_use_screen_space_error );
+	if( m_use_screen_space_error )
+		ImGui::SliderFloat( "Pixel error", &m_pixel_error_threshold, 0.25f, 16.0f );
+	ImGui::Text( "max pixel error of selection %.2f", m_selection->m_max_screen_space_error );
+	ImGui::Checkbox( "Compare metrics", &m_compare_metrics );
+	if( m_compare_metrics ) {
+		ImGui::Text( "distance: %d triangles, max error %.2fpx",
+				m_metric_comparison.distance_triangles, m_metric_comparison.distance_error );
+		ImGui::Text( "screen space: %d triangles (%.0f%%), max error %.2fpx",
+				m_metric_comparison.sse_triangles, 100.0 * m_metric_comparison.sse_triangles /
+				std::max( m_metric_comparison.distance_triangles, 1u ), m_metric_comparison.sse_error );
+	}
+	ImGui::Checkbox( "Multi view benchmark", &m_multi_view_benchmark );
+	if( m_multi_view_benchmark ) {
+		ImGui::SliderInt( "Cascades", &m_benchmark_views, 1, (int)settings::MAX_SELECTION_VIEWS );
+		ImGui::Text( "%d nodes: separate %.3fms, one traversal %.3fms", m_multi_view_timing.nodes,
+				m_multi_view_timing.separate_ms, m_multi_view_timing.single_ms );
+	}
 	ImGui::Separator();
 	float nearPlane{ m_scene->get_camera()->get_near_plane() };
 	float farPlane{ m_scene->get_camera()->get_far_plane() };
@@ -313,14 +526,12 @@ bool terrain_renderer::refreshUI() {
 	ImGui::SliderFloat( "Far plane", &farPlane, 200.0f, 10000.0f );
 	ImGui::SliderFloat( "Light Position x", &m_diffuseLightPos.x, -1.0f, 1.0f );
 	ImGui::End();
-	// Recalc camera fov and lod ranges on change
+	// Recalc camera fov on change, lod ranges follow with the next view
 	if( nearPlane != m_scene->get_camera()->get_near_plane() ) {
 		m_scene->get_camera()->set_near_plane( nearPlane );
-		m_selection->calculate_ranges();
 	}
 	if( farPlane != m_scene->get_camera()->get_far_plane()  ) {
 		m_scene->get_camera()->set_far_plane( farPlane );
-		m_selection->calculate_ranges();
 	}
 	if( oldDiffuseLightPos != m_diffuseLightPos )
 		retVal = true;
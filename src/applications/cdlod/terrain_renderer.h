@@ -3,12 +3,24 @@
 
 #include "gridmesh.h"
 #include "quadtree.h"
+#include "quadtree_forest.h"
 #include "settings.h"
+#include "base/job_system.h"
 #include "scene/renderable.h"
 #include "renderer/color.h"
 #include "renderer/program.h"
 #include <memory>
 #include "aabb_drawing.h"
+#include "hiz_culling.h"
+#include "horizon_culling.h"
+#include "lod_budget.h"
+#include "lod_selection.h"
+#include "selection_drawing.h"
+#include <vector>
+
+namespace orf_n {
+class async_reader;
+}
 
 namespace terrain {
 
@@ -27,8 +39,7 @@ public:
 	terrain_renderer( terrain_renderer &&other ) = default;
 	terrain_renderer &operator=( terrain_renderer &&other ) = default;
 
-	const heightmap *get_heightmap() const;
-	const quadtree *get_quadtree() const;
+	const quadtree_forest *get_forest() const;
 
 	virtual void setup() override final;
 	virtual void render(const double deltatime) override final;
@@ -39,25 +50,64 @@ private:
 	bool m_check_passed = true;
 	bool check_settings();
 
-	std::unique_ptr<heightmap> m_heightmap{nullptr};
-	std::unique_ptr<quadtree> m_quadtree{nullptr};
+	// Terrain data file reads go through this one.
+	std::unique_ptr<orf_n::async_reader> m_reader{nullptr};
+	// One quadtree and heightmap per tile, loaded around the camera.
+	std::unique_ptr<quadtree_forest> m_forest{nullptr};
 
-	struct renderStats_t {
-		int totalRenderedNodes{ 0 };
-		int totalRenderedTriangles{ 0 };
-		void reset() {
-			totalRenderedTriangles = totalRenderedNodes = 0;
-		}
-	} m_renderStats;
+	draw_stats m_renderStats;
 
 	std::unique_ptr<gridmesh> m_gridmesh{ nullptr };
 	std::unique_ptr<orf_n::program> m_shaderTerrain{ nullptr };
+	// Position only, for the depth prepass
+	std::unique_ptr<orf_n::program> m_shader_depth{ nullptr };
 	terrain::lod_selection *m_selection{ nullptr };
-	/* These figures are identical for all tiles of the same size. They hold the texture sizes
-	 * and their ratio tile to texture. This implies that all tiles must have equal size
-	 * and all textures equal resolution. Otherwise these values would have to be tile specific. */
-	omath::vec2 m_tileToTexture;
-	omath::vec4 m_heightMapInfo;
+	/* Pipelined selection: a job selects into this one for the next frame, then they are swapped.
+	 * Forest updates only happen while no selection job runs. */
+	terrain::lod_selection *m_next_selection{ nullptr };
+	orf_n::job_system::task_group m_selection_jobs{ orf_n::job_system::get_instance() };
+	bool m_next_pending{ false };
+	omath::dvec3 m_last_camera_position{ 0.0 };
+	omath::dvec3 m_last_camera_front{ 0.0, 0.0, -1.0 };
+	omath::dvec3 m_predicted_front{ 0.0, 0.0, -1.0 };
+	unsigned int m_prediction_fallbacks{ 0 };
+	/* Reset, select, cull on the CPU and sort. Runs as a job in pipelined mode, without horizon culling.
+	 * That isn't conservative for the predicted position and is done when the selection is taken. */
+	void select( lod_selection *selection, const bool horizon_culling = true );
+	// Waits for the selection job and uses its selection, or selects again if the camera is too far from the prediction.
+	void take_next_selection( const lod_selection::view_t &view );
+	// Updates the forest and starts the selection for the next frame. After drawing.
+	void start_next_selection( const double deltatime );
+	void update_budget( const double deltatime );
+	// Metric and threshold from the UI, with the level errors of the resident tiles.
+	void set_metric( lod_selection *selection ) const;
+	// Only used to count triangles of both selection metrics.
+	terrain::lod_selection *m_compare_selection{ nullptr };
+	struct metric_comparison_t {
+		unsigned int distance_triangles{ 0 };
+		unsigned int sse_triangles{ 0 };
+		double distance_error{ 0.0 };
+		double sse_error{ 0.0 };
+	} m_metric_comparison;
+	void compare_metrics();
+	/* Selections for split cascades of the camera frustum, made once with one traversal per view and
+	 * once with a single traversal for all views. Times are smoothed over frames. */
+	std::vector<std::unique_ptr<lod_selection>> m_benchmark_selections;
+	int m_benchmark_views{ 4 };
+	struct multi_view_timing_t {
+		double separate_ms{ 0.0 };
+		double single_ms{ 0.0 };
+		unsigned int nodes{ 0 };
+	} m_multi_view_timing;
+	void benchmark_multi_view();
+	// Adjusts the distance ratio from the last frame's stats.
+	lod_budget m_budget{ settings::LOD_LEVEL_DISTANCE_RATIO };
+	// Removes nodes behind the horizon from the selection.
+	horizon_culling m_horizon_culling;
+	// Removes nodes hidden in the last frame's depth from the selection.
+	hiz_culling m_hiz_culling;
+	// Draws the selection with the program in use, see selection_drawing.h.
+	void draw_selection( const GLuint p, const GLenum draw_mode, draw_stats &stats ) const;
 	// Lighting TODO, and it is the direction, not the position.
 	omath::vec3 m_diffuseLightPos{ -1.0f, 1.0f, 0.0f };
 	omath::mat4 m_modelMatrix{ 1.0f };
@@ -75,6 +125,15 @@ private:
 	bool m_single_step{false};
 	bool m_stepped{true};
 	bool m_print_selection{false};
+	bool m_use_screen_space_error{false};
+	float m_pixel_error_threshold{settings::PIXEL_ERROR_THRESHOLD};
+	bool m_compare_metrics{false};
+	bool m_multi_view_benchmark{false};
+	bool m_use_horizon_culling{settings::HORIZON_CULLING};
+	bool m_use_hiz_culling{settings::HIZ_CULLING};
+	bool m_pipelined_selection{settings::PIPELINED_SELECTION};
+	bool m_front_to_back{settings::FRONT_TO_BACK_DRAWING};
+	bool m_depth_prepass{settings::DEPTH_PREPASS};
 
 };
 
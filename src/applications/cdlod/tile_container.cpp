@@ -0,0 +1,197 @@
+
+#include "tile_container.h"
+#include "base/logbook.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace terrain {
+
+static const char TILE_CONTAINER_MAGIC[4]{ 'C', 'D', 'T', 'C' };
+static const uint32_t TILE_CONTAINER_VERSION{ 2 };
+// Largest extent a container may claim, one 65536 posts tile plus the shared edge.
+static const uint32_t TILE_CONTAINER_MAX_EXTENT{ 65537 };
+
+// How the heights are stored
+typedef enum : uint32_t {
+	HEIGHTS_RAW, HEIGHTS_PREDICTED
+} height_coding;
+
+// Median edge detector of LOCO-I. a is left, b upper, c upper left neighbour.
+static inline int32_t predict( const int32_t a, const int32_t b, const int32_t c ) {
+	if( c >= std::max( a, b ) )
+		return std::min( a, b );
+	if( c <= std::min( a, b ) )
+		return std::max( a, b );
+	return a + b - c;
+}
+
+static inline int32_t predict_at( const uint16_t *v, const unsigned int x, const unsigned int z, const unsigned int w ) {
+	if( 0 == z )
+		return x > 0 ? v[x-1] : 0;
+	if( 0 == x )
+		return v[( z - 1 ) * w];
+	const size_t i{ size_t( z ) * w + x };
+	return predict( v[i-1], v[i-w], v[i-w-1] );
+}
+
+// static
+void tile_container::compress_heights( const uint16_t *values, const omath::uvec2 &extent, std::vector<uint8_t> &out ) {
+	out.clear();
+	out.reserve( size_t( extent.x ) * extent.y );
+	for( unsigned int z = 0; z < extent.y; ++z )
+		for( unsigned int x = 0; x < extent.x; ++x ) {
+			const int32_t r{ int32_t( values[size_t( z ) * extent.x + x] ) - predict_at( values, x, z, extent.x ) };
+			// zigzag, then 7 bits per byte
+			uint32_t u{ ( uint32_t( r ) << 1 ) ^ uint32_t( r >> 31 ) };
+			while( u >= 0x80 ) {
+				out.push_back( uint8_t( u | 0x80 ) );
+				u >>= 7;
+			}
+			out.push_back( uint8_t( u ) );
+		}
+}
+
+// static
+bool tile_container::decompress_heights(
+		const uint8_t *data, const size_t size, const omath::uvec2 &extent, std::vector<uint16_t> &out ) {
+	out.resize( size_t( extent.x ) * extent.y );
+	size_t pos{ 0 };
+	for( unsigned int z = 0; z < extent.y; ++z )
+		for( unsigned int x = 0; x < extent.x; ++x ) {
+			uint32_t u{ 0 };
+			unsigned int shift{ 0 };
+			for( ;; ) {
+				if( pos >= size || shift > 28 )
+					return false;
+				const uint8_t b{ data[pos++] };
+				u |= uint32_t( b & 0x7f ) << shift;
+				if( !( b & 0x80 ) )
+					break;
+				shift += 7;
+			}
+			const int32_t r{ int32_t( u >> 1 ) ^ -int32_t( u & 1 ) };
+			out[size_t( z ) * extent.x + x] = uint16_t( predict_at( out.data(), x, z, extent.x ) + r );
+		}
+	return true;
+}
+
+void tile_container::encode( std::vector<uint8_t> &out ) const {
+	const size_t raw_size{ size_t( m_extent.x ) * m_extent.y * sizeof( uint16_t ) };
+	std::vector<uint8_t> compressed;
+	compress_heights( m_heights.data(), m_extent, compressed );
+	const height_coding coding{ compressed.size() < raw_size ? HEIGHTS_PREDICTED : HEIGHTS_RAW };
+	if( HEIGHTS_RAW == coding ) {
+		const uint8_t *raw{ reinterpret_cast<const uint8_t *>( m_heights.data() ) };
+		compressed.assign( raw, raw + raw_size );
+	}
+	const uint32_t header[]{ TILE_CONTAINER_VERSION, m_extent.x, m_extent.y, coding };
+	const float box[]{
+		m_raster_aabb.m_min.x, m_raster_aabb.m_min.y, m_raster_aabb.m_min.z,
+		m_raster_aabb.m_max.x, m_raster_aabb.m_max.y, m_raster_aabb.m_max.z
+	};
+	const uint64_t sizes[]{ compressed.size(), m_normals.size() };
+	std::ostringstream mm;
+	if( nullptr != m_min_max_map )
+		m_min_max_map->write( mm );
+	const std::string mm_data{ mm.str() };
+	out.clear();
+	out.reserve( sizeof( TILE_CONTAINER_MAGIC ) + sizeof( header ) + sizeof( box ) + sizeof( sizes ) +
+			compressed.size() + m_normals.size() + mm_data.size() );
+	const auto append = [&out]( const void *p, const size_t n ) {
+		const uint8_t *b{ static_cast<const uint8_t *>( p ) };
+		out.insert( out.end(), b, b + n );
+	};
+	append( TILE_CONTAINER_MAGIC, sizeof( TILE_CONTAINER_MAGIC ) );
+	append( header, sizeof( header ) );
+	append( box, sizeof( box ) );
+	append( sizes, sizeof( sizes ) );
+	append( compressed.data(), compressed.size() );
+	append( m_normals.data(), m_normals.size() );
+	append( mm_data.data(), mm_data.size() );
+}
+
+bool tile_container::save( const std::string &filename ) const {
+	std::vector<uint8_t> data;
+	encode( data );
+	std::ofstream f{ filename, std::ios::out | std::ios::binary | std::ios::trunc };
+	if( f.is_open() )
+		f.write( reinterpret_cast<const char *>( data.data() ), data.size() );
+	if( !f.good() ) {
+		orf_n::logbook::log_msg( orf_n::logbook::TERRAIN, orf_n::logbook::ERROR,
+				"Error writing tile container '" + filename + "'." );
+		return false;
+	}
+	return true;
+}
+
+// static
+std::unique_ptr<tile_container> tile_container::load( const std::string &filename ) {
+	std::ifstream f{ filename, std::ios::in | std::ios::binary | std::ios::ate };
+	if( !f.is_open() )
+		return nullptr;
+	std::vector<unsigned char> data( (size_t)f.tellg() );
+	f.seekg( 0 );
+	f.read( reinterpret_cast<char *>( data.data() ), data.size() );
+	if( !f.good() )
+		return nullptr;
+	return decode( data.data(), data.size() );
+}
+
+// static
+bool tile_container::is_container( const unsigned char *data, const size_t size ) {
+	return size >= sizeof( TILE_CONTAINER_MAGIC ) &&
+			0 == std::memcmp( data, TILE_CONTAINER_MAGIC, sizeof( TILE_CONTAINER_MAGIC ) );
+}
+
+// static
+std::unique_ptr<tile_container> tile_container::decode( const unsigned char *data, const size_t size ) {
+	uint32_t header[4];
+	float box[6];
+	uint64_t sizes[2];
+	const size_t fixed{ sizeof( TILE_CONTAINER_MAGIC ) + sizeof( header ) + sizeof( box ) + sizeof( sizes ) };
+	if( size < fixed || !is_container( data, size ) )
+		return nullptr;
+	size_t pos{ sizeof( TILE_CONTAINER_MAGIC ) };
+	std::memcpy( header, data + pos, sizeof( header ) );
+	pos += sizeof( header );
+	std::memcpy( box, data + pos, sizeof( box ) );
+	pos += sizeof( box );
+	std::memcpy( sizes, data + pos, sizeof( sizes ) );
+	pos += sizeof( sizes );
+	// Check sizes against the extent and the data before anything is allocated
+	const omath::uvec2 extent{ header[1], header[2] };
+	if( header[0] != TILE_CONTAINER_VERSION || extent.x < 2 || extent.y < 2 ||
+			extent.x > TILE_CONTAINER_MAX_EXTENT || extent.y > TILE_CONTAINER_MAX_EXTENT ||
+			sizes[0] > size - pos || sizes[1] > size - pos - sizes[0] )
+		return nullptr;
+	const size_t posts{ size_t( extent.x ) * extent.y };
+	// Predicted heights take at least a byte per post
+	if( ( HEIGHTS_RAW == header[3] && sizes[0] != posts * sizeof( uint16_t ) ) ||
+			( HEIGHTS_PREDICTED == header[3] && sizes[0] < posts ) ||
+			( HEIGHTS_RAW != header[3] && HEIGHTS_PREDICTED != header[3] ) ||
+			( 0 != sizes[1] && sizes[1] != posts * 2 ) )
+		return nullptr;
+	std::unique_ptr<tile_container> t{ std::make_unique<tile_container>() };
+	t->m_extent = extent;
+	t->m_raster_aabb = omath::aabb{ omath::vec3{ box[0], box[1], box[2] }, omath::vec3{ box[3], box[4], box[5] } };
+	if( HEIGHTS_RAW == header[3] ) {
+		t->m_heights.resize( posts );
+		std::memcpy( t->m_heights.data(), data + pos, sizes[0] );
+	} else if( !decompress_heights( data + pos, sizes[0], t->m_extent, t->m_heights ) )
+		return nullptr;
+	pos += sizes[0];
+	t->m_normals.assign( data + pos, data + pos + sizes[1] );
+	pos += sizes[1];
+	if( pos < size ) {
+		std::istringstream in{ std::string( reinterpret_cast<const char *>( data + pos ), size - pos ) };
+		t->m_min_max_map = min_max_map::read( in, t->m_extent );
+		if( nullptr == t->m_min_max_map )
+			orf_n::logbook::log_msg( orf_n::logbook::TERRAIN, orf_n::logbook::WARNING,
+					"Tile container has an invalid min/max map. Ignored." );
+	}
+	return t;
+}
+
+}
@@ -0,0 +1,48 @@
+/* Compressed container for one preprocessed terrain tile: raster bounds, 16 bit heights,
+ * the min/max pyramid and optionally a normal map. Heights are stored as residuals of a planar
+ * prediction from the left, upper and upper left neighbours, zigzag and varint coded.
+ * Terrain is smooth, so most residuals fit in a byte. If the coded heights would not be smaller
+ * than the raw ones, they are stored raw. The heightmap loads '<tile>.ctile' instead of the png
+ * if there is one. It ignores the normals, the terrain shader derives them from the heights. */
+
+#pragma once
+
+#include "min_max_map.h"
+#include "omath/aabb.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace terrain {
+
+class tile_container {
+public:
+	// Raster bounding box, heights in .y, origin and size in posts in .x/.z
+	omath::aabb m_raster_aabb;
+	omath::uvec2 m_extent;
+	std::vector<uint16_t> m_heights;
+	// Empty or two signed bytes per post, normal x and z. y is positive and derived from them.
+	std::vector<int8_t> m_normals;
+	std::unique_ptr<min_max_map> m_min_max_map{ nullptr };
+
+	tile_container() = default;
+	virtual ~tile_container() = default;
+
+	// Serializes the container into out. Compresses the heights.
+	void encode( std::vector<uint8_t> &out ) const;
+	bool save( const std::string &filename ) const;
+	static std::unique_ptr<tile_container> load( const std::string &filename );
+	// Also used to decode a container read into memory by the async reader.
+	static std::unique_ptr<tile_container> decode( const unsigned char *data, const size_t size );
+	// True if data starts like a container.
+	static bool is_container( const unsigned char *data, const size_t size );
+
+	static void compress_heights( const uint16_t *values, const omath::uvec2 &extent, std::vector<uint8_t> &out );
+	static bool decompress_heights(
+			const uint8_t *data, const size_t size, const omath::uvec2 &extent, std::vector<uint16_t> &out
+	);
+
+};
+
+}
@@ -1,4 +1,5 @@
 
+#include "renderer/gl_state.h"
 #include "renderer/uniform.h"
 #include "scene/scene.h"
 #include "sky_box.h"
@@ -65,6 +66,7 @@ void sky_box::create_texture() {
 			break;
 	}
 	glTextureStorage2D( m_texture, 1, internalFormat, width, height );
+	m_memory.set( m_memory.get() + memory_tracker::texture_bytes( internalFormat, width, height, 1, 6 ) );
 	// One mip level only
 	for( unsigned int face{ 0 }; face < 6; ++face ) {
 		data = stbi_load( m_faces[face].c_str(), &width, &height, &numChannels, 0 );
@@ -146,6 +148,7 @@ void sky_box::setup() {
 	glCreateVertexArrays( 1, &m_vao );
 	glCreateBuffers( 1, &m_vertex_buffer );
 	glNamedBufferData( m_vertex_buffer,vertices.size()*sizeof(omath::vec3),vertices.data(),GL_STATIC_DRAW );
+	m_memory.set( m_memory.get() + vertices.size()*sizeof(omath::vec3) );
 	// offset into buffer is 0 and stride is sizeof( vec3 )
 	glVertexArrayVertexBuffer(m_vao, SKYBOX_VERTEX_BUFFER_BINDING_INDEX, m_vertex_buffer, 0, sizeof(omath::vec3) );
 	glVertexArrayAttribBinding( m_vao, 0, SKYBOX_VERTEX_BUFFER_BINDING_INDEX );
@@ -156,27 +159,31 @@ void sky_box::setup() {
 
 void sky_box::render(const double delta_time) {
 	// draw sky_box at last !
-	glEnable( GL_DEPTH_TEST );
-	glDepthFunc( GL_LEQUAL );
-	// TODO try glBindTextureUnit and use a sampler ?
-	glBindTexture(GL_TEXTURE_CUBE_MAP, m_texture);
-	glBindVertexArray(m_vao);
-	glBindBuffer(GL_ARRAY_BUFFER,m_vertex_buffer);
-    glEnable( GL_TEXTURE_CUBE_MAP_SEAMLESS );
+	gl_state &state{ gl_state::get_instance() };
+	state.enable( GL_DEPTH_TEST );
+	state.depth_func( GL_LEQUAL );
+	// TODO use a sampler ?
+	state.bind_texture_unit( 0, m_texture );
+	state.bind_vertex_array( m_vao );
+	state.enable( GL_TEXTURE_CUBE_MAP_SEAMLESS );
 	m_program->use();
 	set_uniform(
 			m_program->get_program(), "projectionView", omath::mat4(m_scene->get_camera()->get_untranslated_view_perspective_matrix())
 	);
 	glDrawArrays( GL_TRIANGLES, 0, 36 );
-	glDepthFunc( GL_LESS );
+	state.depth_func( GL_LESS );
 }
 
 void sky_box::cleanup() {}
 
 sky_box::~sky_box() {
 	glDeleteVertexArrays( 1, &m_vao );
-	if(glIsTexture(m_texture))
+	gl_state::get_instance().deleted_vertex_array( m_vao );
+	glDeleteBuffers( 1, &m_vertex_buffer );
+	if(glIsTexture(m_texture)) {
 		glDeleteTextures(1, &m_texture);
+		gl_state::get_instance().deleted_texture( m_texture );
+	}
 	logbook::log_msg(
 			logbook::RENDERER, logbook::INFO,"Skybox texture #" + std::to_string(m_texture) + " destroyed."
 	);
@@ -15,6 +15,7 @@
 
 #include "renderer/program.h"
 #include "scene/renderable.h"
+#include "base/memory_tracker.h"
 #include "omath/vec3.h"
 #include <memory>
 #include <string>
@@ -44,6 +45,7 @@ private:
 	GLuint m_vao=0;
 	GLuint m_vertex_buffer=0;
 	std::vector<std::string> m_faces;
+	orf_n::memory_tracker::tracked_memory m_memory{ orf_n::memory_tracker::SKYBOX, orf_n::memory_tracker::GPU };
 
 	std::unique_ptr<orf_n::program> m_program{ nullptr };
 
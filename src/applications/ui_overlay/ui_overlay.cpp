@@ -3,14 +3,40 @@
 #include "base/logbook.h"
 #include "renderer/uniform.h"
 #include "base/glfw_window.h"
+#include "renderer/gl_state.h"
+#include "renderer/profiler.h"
 #include "renderer/program.h"
+#include "renderer/stream_buffer.h"
+#include "base/frame_arena.h"
 #include "scene/scene.h"
 #include "ui_overlay.h"
 #include "omath/mat4.h"
 #include "imgui/imgui.h"
+#include <cstdlib>
+#include <cstring>
 
 namespace orf_n {
 
+// ImGui's own allocations count for the UI. A header keeps the size for freeing.
+static const size_t IMGUI_ALLOCATION_HEADER{ alignof( std::max_align_t ) };
+
+static void *imgui_alloc( size_t size, void * ) {
+	unsigned char *p{ static_cast<unsigned char *>( std::malloc( size + IMGUI_ALLOCATION_HEADER ) ) };
+	if( nullptr == p )
+		return nullptr;
+	*reinterpret_cast<size_t *>( p ) = size;
+	memory_tracker::allocated( memory_tracker::UI, memory_tracker::CPU, size );
+	return p + IMGUI_ALLOCATION_HEADER;
+}
+
+static void imgui_free( void *ptr, void * ) {
+	if( nullptr == ptr )
+		return;
+	unsigned char *p{ static_cast<unsigned char *>( ptr ) - IMGUI_ALLOCATION_HEADER };
+	memory_tracker::freed( memory_tracker::UI, memory_tracker::CPU, *reinterpret_cast<size_t *>( p ) );
+	std::free( p );
+}
+
 // Low priority, rendered last
 ui_overlay::ui_overlay( glfw_window *win ) :
 		renderable{ "ui_overlay" }, event_handler{ win }, m_window{ win } {}
@@ -19,6 +45,7 @@ ui_overlay::~ui_overlay() {}
 
 void ui_overlay::setup() {
 	IMGUI_CHECKVERSION();
+	ImGui::SetAllocatorFunctions( imgui_alloc, imgui_free );
 	ImGui::CreateContext();
 	ImGuiIO& io = ImGui::GetIO();
 	// Setup style
@@ -77,12 +104,13 @@ void ui_overlay::setup() {
     glCreateTextures( GL_TEXTURE_2D, 1, &m_fontTexture);
     glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
     glTextureStorage2D( m_fontTexture, 1, GL_RGBA8, width, height );
+    m_gpu_memory.set( memory_tracker::texture_bytes( GL_RGBA8, width, height ) );
     glTextureSubImage2D( m_fontTexture, 0,		// texture and mip level
     					 0, 0, width, height,	// offset and size
 						 GL_RGBA, GL_UNSIGNED_BYTE, pixels );
     glTextureParameteri( m_fontTexture, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
     glTextureParameteri( m_fontTexture, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
-    glBindTextureUnit( FONT_TEXTURE_UNIT, m_fontTexture );
+    gl_state::get_instance().bind_texture_unit( FONT_TEXTURE_UNIT, m_fontTexture );
     // Store our identifier
     m_shader->use();
     set_uniform( m_shader->get_program(), "Texture", FONT_TEXTURE_UNIT );
@@ -90,8 +118,17 @@ void ui_overlay::setup() {
     io.Fonts->TexID = (void *)(intptr_t)m_fontTexture;
     if( !io.Fonts->IsBuilt() )
     	logbook::log_msg( logbook::RENDERER, logbook::ERROR,"The overlay font atlas was not built correctly." );
-    glGenBuffers( 1, &m_vboHandle );
-	glGenBuffers( 1, &m_elementsHandle );
+    // Buffer and offset are set per frame
+    glCreateVertexArrays( 1, &m_vertex_array );
+    const GLuint attributes[3]{ (GLuint)m_AttribLocationPosition, (GLuint)m_AttribLocationUV, (GLuint)m_AttribLocationColor };
+    for( const GLuint a : attributes ) {
+    	glEnableVertexArrayAttrib( m_vertex_array, a );
+    	glVertexArrayAttribBinding( m_vertex_array, a, 0 );
+    }
+    glVertexArrayAttribFormat( m_vertex_array, attributes[0], 2, GL_FLOAT, GL_FALSE, IM_OFFSETOF(ImDrawVert, pos) );
+    glVertexArrayAttribFormat( m_vertex_array, attributes[1], 2, GL_FLOAT, GL_FALSE, IM_OFFSETOF(ImDrawVert, uv) );
+    glVertexArrayAttribFormat( m_vertex_array, attributes[2], 4, GL_UNSIGNED_BYTE, GL_TRUE, IM_OFFSETOF(ImDrawVert, col) );
+    m_stream_buffer = new stream_buffer( memory_tracker::UI );
 
 	unsigned int cb = event_handler::KEY |
 					  event_handler::MOUSE_MOVE |
@@ -114,15 +151,18 @@ void ui_overlay::render(const double delta_time) {
 		ImGui::EndFrame();
 		return;
 	}
+	PROFILE_CPU_SCOPE( "UI" );
+	PROFILE_GPU_SCOPE( "UI" );
 	// Backup GL state
 	/* Setup render state: alpha-blending enabled, no face culling, no depth testing,
 	 * scissor enabled, polygon fill */
-	glEnable( GL_BLEND );
-	glBlendEquation( GL_FUNC_ADD );
-	glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
-	glDisable( GL_CULL_FACE );
-	glDisable( GL_DEPTH_TEST );
-	glEnable( GL_SCISSOR_TEST );
+	gl_state &state{ gl_state::get_instance() };
+	state.enable( GL_BLEND );
+	state.blend_equation( GL_FUNC_ADD );
+	state.blend_func( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+	state.disable( GL_CULL_FACE );
+	state.disable( GL_DEPTH_TEST );
+	state.enable( GL_SCISSOR_TEST );
 
 	ImGuiIO& io{ ImGui::GetIO() };
 	// get style for alpha blending
@@ -157,29 +197,13 @@ void ui_overlay::render(const double delta_time) {
 		m_window->set_v_sync( vsync );
 	ImGui::SameLine(); ImGui::Text( "   %.1lf fps", 1 / delta_time );
 	ImGui::SameLine();
-	ImGui::Text( "FB size %d/%d", m_scene->get_window()->get_width(), m_scene->get_window()->get_height() );
+	ImGui::Text( "FB size %u/%u", m_scene->get_render_width(), m_scene->get_render_height() );
 	ImGui::SliderFloat( "UI alpha", &style.Alpha, 0.3f, 1.0f );
 	ImGui::End();
+	profiler::get_instance().draw_ui();
+	draw_memory_window();
 	ImGui::Render();
 
-	/* Recreate the VAO every time
-	 * This is to easily allow multiple GL contexts. VAO are not shared among GL contexts,
-	 * and we don't track creation/deletion of windows so we don't have an obvious
-	 * key to use to cache them. */
-	GLuint vaoHandle = 0;
-	glGenVertexArrays(1, &vaoHandle );
-	glBindVertexArray( vaoHandle );
-	glBindBuffer( GL_ARRAY_BUFFER, m_vboHandle );
-	glEnableVertexAttribArray( m_AttribLocationPosition );
-	glEnableVertexAttribArray( m_AttribLocationUV );
-	glEnableVertexAttribArray( m_AttribLocationColor );
-	glVertexAttribPointer( m_AttribLocationPosition, 2, GL_FLOAT, GL_FALSE,
-			sizeof(ImDrawVert), (GLvoid*)IM_OFFSETOF(ImDrawVert, pos) );
-	glVertexAttribPointer( m_AttribLocationUV, 2, GL_FLOAT, GL_FALSE,
-			sizeof(ImDrawVert), (GLvoid*)IM_OFFSETOF(ImDrawVert, uv) );
-	glVertexAttribPointer( m_AttribLocationColor, 4, GL_UNSIGNED_BYTE, GL_TRUE,
-			sizeof(ImDrawVert), (GLvoid*)IM_OFFSETOF(ImDrawVert, col) );
-
 	/* TODO: Setup render state: alpha-blending enabled, no face culling, no depth testing,
 	 * scissor enabled. Setup viewport, orthographic projection matrix Setup shader:
 	 * vertex { float2 pos, float2 uv, u32 color }, fragment shader sample color from 1 texture,
@@ -189,59 +213,116 @@ void ui_overlay::render(const double delta_time) {
 	int fbWidth{ 0 };
 	int fbHeight{ 0 };
 	glfwGetFramebufferSize( m_window->get_window(), &fbWidth, &fbHeight );
+	// Vertices of all lists, then their indices
+	const GLsizeiptr vertex_bytes{ (GLsizeiptr)drawData->TotalVtxCount * (GLsizeiptr)sizeof(ImDrawVert) };
+	const GLsizeiptr index_start{ ( vertex_bytes + 3 ) & ~(GLsizeiptr)3 };
+	unsigned char *region{ m_stream_buffer->begin_frame(
+			index_start + (GLsizeiptr)drawData->TotalIdxCount * (GLsizeiptr)sizeof(ImDrawIdx) ) };
+	{
+		ImDrawVert *vertices{ reinterpret_cast<ImDrawVert *>( region ) };
+		ImDrawIdx *indices{ reinterpret_cast<ImDrawIdx *>( region + index_start ) };
+		for( int n = 0; n < drawData->CmdListsCount; n++ ) {
+			const ImDrawList* cmd_list = drawData->CmdLists[n];
+			std::memcpy( vertices, cmd_list->VtxBuffer.Data, (size_t)cmd_list->VtxBuffer.Size * sizeof(ImDrawVert) );
+			std::memcpy( indices, cmd_list->IdxBuffer.Data, (size_t)cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx) );
+			vertices += cmd_list->VtxBuffer.Size;
+			indices += cmd_list->IdxBuffer.Size;
+		}
+	}
+	const GLintptr region_offset{ m_stream_buffer->get_offset() };
+	glVertexArrayVertexBuffer( m_vertex_array, 0, m_stream_buffer->get_buffer(), region_offset, sizeof(ImDrawVert) );
+	glVertexArrayElementBuffer( m_vertex_array, m_stream_buffer->get_buffer() );
+	state.bind_vertex_array( m_vertex_array );
+
+	/* Commands with the same clip rect go into one multi draw, even across lists, each with the
+	 * base vertex of its list. The font texture stays bound to its unit. */
+	const GLenum index_type{ sizeof(ImDrawIdx) == 2 ? (GLenum)GL_UNSIGNED_SHORT : (GLenum)GL_UNSIGNED_INT };
+	frame_vector<GLsizei> counts;
+	frame_vector<const void *> offsets;
+	frame_vector<GLint> base_vertices;
+	unsigned int draw_calls{ 0 };
+	const auto flush = [&]() {
+		if( counts.empty() )
+			return;
+		if( 1 == counts.size() )
+			glDrawElementsBaseVertex( GL_TRIANGLES, counts[0], index_type, offsets[0], base_vertices[0] );
+		else
+			glMultiDrawElementsBaseVertex( GL_TRIANGLES, counts.data(), index_type, offsets.data(),
+					(GLsizei)counts.size(), base_vertices.data() );
+		++draw_calls;
+		counts.clear();
+		offsets.clear();
+		base_vertices.clear();
+	};
+	ImVec4 scissor_rect{ -1.0f, -1.0f, -1.0f, -1.0f };
+	GLint base_vertex{ 0 };
+	GLintptr index_offset{ region_offset + index_start };
 	for( int n = 0; n < drawData->CmdListsCount; n++ ) {
 		const ImDrawList* cmd_list = drawData->CmdLists[n];
-		const ImDrawIdx* idx_buffer_offset = 0;
-		glBindBuffer( GL_ARRAY_BUFFER, m_vboHandle );
-		glBufferData( GL_ARRAY_BUFFER,
-				(GLsizeiptr)cmd_list->VtxBuffer.Size * sizeof(ImDrawVert),
-				(const GLvoid*)cmd_list->VtxBuffer.Data,
-				GL_STREAM_DRAW );
-		glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, m_elementsHandle );
-		glBufferData( GL_ELEMENT_ARRAY_BUFFER,
-				(GLsizeiptr)cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx),
-				(const GLvoid*)cmd_list->IdxBuffer.Data,
-				GL_STREAM_DRAW );
 		for( int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; cmd_i++ ) {
-             const ImDrawCmd* pcmd = &cmd_list->CmdBuffer[cmd_i];
-             // User callback (registered via ImDrawList::AddCallback)
-             if( pcmd->UserCallback ) {
-            	 pcmd->UserCallback( cmd_list, pcmd );
-             } else {
-            	 ImVec4 clip_rect = ImVec4( pcmd->ClipRect.x - pos.x,
-            			 	 	 	 	 	pcmd->ClipRect.y - pos.y,
-											pcmd->ClipRect.z - pos.x,
-											pcmd->ClipRect.w - pos.y );
-            	 if( (int)clip_rect.x < fbWidth &&
-            		 (int)clip_rect.y < fbHeight &&
-					 clip_rect.z >= 0.0f &&
-					 clip_rect.w >= 0.0f ) {
-            		 // Apply scissor/clipping rectangle
-            		 glScissor( (int)clip_rect.x,
-            				 	fbHeight - (int)clip_rect.w,
-								(int)(clip_rect.z - clip_rect.x),
-								(int)(clip_rect.w - clip_rect.y) );
-            		 // Bind texture, Draw
-            		 //glBindTexture( GL_TEXTURE_2D, m_fontTexture );
-            		 glDrawElements( GL_TRIANGLES,
-            				 	 	 (GLsizei)pcmd->ElemCount,
-									 sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT,
-									 idx_buffer_offset );
-            	 }
-             }
-             idx_buffer_offset += pcmd->ElemCount;
+			const ImDrawCmd* pcmd = &cmd_list->CmdBuffer[cmd_i];
+			// User callback (registered via ImDrawList::AddCallback)
+			if( pcmd->UserCallback ) {
+				flush();
+				pcmd->UserCallback( cmd_list, pcmd );
+				scissor_rect = ImVec4( -1.0f, -1.0f, -1.0f, -1.0f );
+			} else {
+				ImVec4 clip_rect = ImVec4( pcmd->ClipRect.x - pos.x, pcmd->ClipRect.y - pos.y,
+						pcmd->ClipRect.z - pos.x, pcmd->ClipRect.w - pos.y );
+				if( (int)clip_rect.x < fbWidth && (int)clip_rect.y < fbHeight &&
+						clip_rect.z >= 0.0f && clip_rect.w >= 0.0f ) {
+					if( clip_rect.x != scissor_rect.x || clip_rect.y != scissor_rect.y ||
+							clip_rect.z != scissor_rect.z || clip_rect.w != scissor_rect.w ) {
+						flush();
+						// Apply scissor/clipping rectangle
+						glScissor( (int)clip_rect.x, fbHeight - (int)clip_rect.w,
+								(int)(clip_rect.z - clip_rect.x), (int)(clip_rect.w - clip_rect.y) );
+						scissor_rect = clip_rect;
+					}
+					counts.push_back( (GLsizei)pcmd->ElemCount );
+					offsets.push_back( (const void *)index_offset );
+					base_vertices.push_back( base_vertex );
+				}
+			}
+			index_offset += (GLintptr)pcmd->ElemCount * (GLintptr)sizeof(ImDrawIdx);
 		}
+		base_vertex += cmd_list->VtxBuffer.Size;
 	}
-	glDeleteVertexArrays(1, &vaoHandle);
+	flush();
+	m_stream_buffer->end_frame();
+	profiler::get_instance().set_counter( "ui draw calls", (double)draw_calls );
+	profiler::get_instance().set_counter( "ui buffer waits", (double)m_stream_buffer->get_waits() );
+
+	state.disable( GL_SCISSOR_TEST );
+}
 
-	glDisable( GL_SCISSOR_TEST );
+void ui_overlay::draw_memory_window() const {
+	ImGui::Begin( "Memory" );
+	ImGui::Text( "%-10s %10s %10s %10s %10s", "kB", "CPU", "CPU peak", "GPU", "GPU peak" );
+	for( unsigned int i = 0; i < memory_tracker::NUMBER_OF_SUBSYSTEMS; ++i ) {
+		const memory_tracker::subsystem s{ (memory_tracker::subsystem)i };
+		ImGui::Text( "%-10s %10zu %10zu %10zu %10zu", memory_tracker::get_name( s ),
+				memory_tracker::get_live_bytes( s, memory_tracker::CPU ) / 1024,
+				memory_tracker::get_peak_bytes( s, memory_tracker::CPU ) / 1024,
+				memory_tracker::get_live_bytes( s, memory_tracker::GPU ) / 1024,
+				memory_tracker::get_peak_bytes( s, memory_tracker::GPU ) / 1024 );
+	}
+	ImGui::Separator();
+	ImGui::Text( "%-10s %10zu %10zu %10zu %10zu", "total",
+			memory_tracker::get_total_live_bytes( memory_tracker::CPU ) / 1024,
+			memory_tracker::get_total_peak_bytes( memory_tracker::CPU ) / 1024,
+			memory_tracker::get_total_live_bytes( memory_tracker::GPU ) / 1024,
+			memory_tracker::get_total_peak_bytes( memory_tracker::GPU ) / 1024 );
+	ImGui::End();
 }
 
 void ui_overlay::cleanup() {
 	de_register_object( this );
-	glDeleteBuffers( 1, &m_vboHandle );
-	glDeleteBuffers( 1, &m_elementsHandle );
+	glDeleteVertexArrays( 1, &m_vertex_array );
+	gl_state::get_instance().deleted_vertex_array( m_vertex_array );
+	delete m_stream_buffer;
 	glDeleteTextures( 1, &m_fontTexture );
+	gl_state::get_instance().deleted_texture( m_fontTexture );
 	delete m_shader;
 	ImGui::DestroyContext();
 }
@@ -3,12 +3,14 @@
 
 #include "scene/renderable.h"
 #include "glad/glad.h"
+#include "base/memory_tracker.h"
 #include <imgui/imgui.h>
 
 namespace orf_n {
 
 class program;
 class glfw_window;
+class stream_buffer;
 
 class ui_overlay : public renderable, event_handler {
 public:
@@ -49,9 +51,16 @@ private:
 	int m_AttribLocationUV;
 	int m_AttribLocationColor;
 
-	GLuint m_vboHandle;
+	GLuint m_vertex_array{ 0 };
 
-	GLuint m_elementsHandle;
+	// Vertices and indices of all draw lists of a frame, in one region
+	stream_buffer *m_stream_buffer{ nullptr };
+
+	// Font texture
+	memory_tracker::tracked_memory m_gpu_memory{ memory_tracker::UI, memory_tracker::GPU };
+
+	// Live and peak bytes per subsystem
+	void draw_memory_window() const;
 
 	virtual bool on_mouse_move( float x, float y ) override;
 
@@ -0,0 +1,266 @@
+/* Benchmark of the asynchronous reader on many tile files, with a cold and a warm page cache.
+ * 	cold:     the files are evicted from the page cache with posix_fadvise( DONTNEED ) first
+ * 	warm:     the same reads right after, the files are cached
+ * 	blocking: whole files read one after another with pread() on this thread, like the old loader
+ * Files are read in blocks, the blocks of batch files go out as one submit and are waited for.
+ * Eviction is a hint. The share of the data that was still resident before a pass is printed,
+ * if it isn't near 0 the cold numbers are not cold; drop the caches as root then
+ * (echo 1 > /proc/sys/vm/drop_caches).
+ * Usage:
+ * 	async_reader_bench [files ...] [--synthetic n] [--size MB] [--block kB] [--batch n] [--depth n] [--threads n]
+ * Without files, --synthetic n files of --size MB are written to async_reader_bench_data/ and removed after.
+ * Results go to stdout, one line per pass. */
+
+#include "base/logbook.h"
+#include "base/async_reader.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace orf_n;
+
+namespace {
+
+typedef std::chrono::high_resolution_clock clock_type;
+
+double ms_since( const clock_type::time_point &start ) {
+	return std::chrono::duration<double, std::milli>( clock_type::now() - start ).count();
+}
+
+bool parse_uint( const char *s, unsigned int &value ) {
+	try {
+		value = (unsigned int)std::stoul( s );
+		return true;
+	} catch( const std::exception & ) {
+		return false;
+	}
+}
+
+uint64_t file_size( const std::string &filename ) {
+	struct stat st;
+	return 0 == ::stat( filename.c_str(), &st ) ? static_cast<uint64_t>( st.st_size ) : 0;
+}
+
+// Drops the file's clean pages from the page cache.
+void evict( const std::string &filename ) {
+	const int fd{ ::open( filename.c_str(), O_RDONLY | O_CLOEXEC ) };
+	if( fd < 0 )
+		return;
+	::posix_fadvise( fd, 0, 0, POSIX_FADV_DONTNEED );
+	::close( fd );
+}
+
+// Bytes of the file that are in the page cache.
+uint64_t resident_bytes( const std::string &filename ) {
+	const uint64_t size{ file_size( filename ) };
+	const int fd{ ::open( filename.c_str(), O_RDONLY | O_CLOEXEC ) };
+	if( fd < 0 || 0 == size ) {
+		if( fd >= 0 )
+			::close( fd );
+		return 0;
+	}
+	void *p{ ::mmap( nullptr, size, PROT_READ, MAP_SHARED, fd, 0 ) };
+	::close( fd );
+	if( MAP_FAILED == p )
+		return 0;
+	const uint64_t page{ static_cast<uint64_t>( ::sysconf( _SC_PAGESIZE ) ) };
+	std::vector<unsigned char> pages( ( size + page - 1 ) / page );
+	uint64_t resident{ 0 };
+	if( 0 == ::mincore( p, size, pages.data() ) )
+		for( size_t i = 0; i < pages.size(); ++i )
+			if( pages[i] & 1 )
+				resident += std::min( page, size - i * page );
+	::munmap( p, size );
+	return resident;
+}
+
+bool write_synthetic( const std::string &filename, const uint64_t size ) {
+	const int fd{ ::open( filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 ) };
+	if( fd < 0 )
+		return false;
+	std::vector<unsigned char> block( 1024 * 1024 );
+	for( size_t i = 0; i < block.size(); ++i )
+		block[i] = static_cast<unsigned char>( i * 31 + size );
+	bool ok{ true };
+	for( uint64_t done = 0; done < size && ok; ) {
+		const size_t n{ static_cast<size_t>( std::min<uint64_t>( block.size(), size - done ) ) };
+		ok = ::write( fd, block.data(), n ) == static_cast<ssize_t>( n );
+		done += n;
+	}
+	// Dirty pages can't be evicted
+	ok = ok && 0 == ::fsync( fd );
+	::close( fd );
+	return ok;
+}
+
+typedef struct {
+	double ms{ 0.0 };
+	uint64_t bytes{ 0 };
+	uint64_t resident_before{ 0 };
+	unsigned int errors{ 0 };
+} pass_result;
+
+// Reads all files in blocks through the reader, batch files per submit.
+pass_result read_async( async_reader &reader, const std::vector<std::string> &files, const size_t block_size,
+		const unsigned int batch ) {
+	pass_result r;
+	for( const std::string &f : files )
+		r.resident_before += resident_bytes( f );
+	std::vector<std::vector<unsigned char>> buffers( batch );
+	const clock_type::time_point start{ clock_type::now() };
+	for( size_t first = 0; first < files.size(); first += batch ) {
+		std::vector<int> fds;
+		std::vector<async_reader::read_request> requests;
+		for( size_t i = first; i < std::min( files.size(), first + batch ); ++i ) {
+			const int fd{ reader.open_file( files[i] ) };
+			if( fd < 0 ) {
+				++r.errors;
+				continue;
+			}
+			fds.push_back( fd );
+			const uint64_t size{ reader.get_file_size( fd ) };
+			std::vector<unsigned char> &buffer{ buffers[i - first] };
+			buffer.resize( size );
+			for( uint64_t offset = 0; offset < size; offset += block_size ) {
+				async_reader::read_request q;
+				q.fd = fd;
+				q.offset = offset;
+				q.size = static_cast<size_t>( std::min<uint64_t>( block_size, size - offset ) );
+				q.destination = buffer.data() + offset;
+				q.on_complete = [&r]( const async_reader::read_request &req, long result ) {
+					if( result != static_cast<long>( req.size ) )
+						++r.errors;
+					else
+						r.bytes += req.size;
+				};
+				requests.push_back( q );
+			}
+		}
+		reader.submit( requests );
+		reader.wait_all();
+		for( const int fd : fds )
+			reader.close_file( fd );
+	}
+	r.ms = ms_since( start );
+	return r;
+}
+
+// Whole files with blocking pread() on this thread.
+pass_result read_blocking( const std::vector<std::string> &files ) {
+	pass_result r;
+	for( const std::string &f : files )
+		r.resident_before += resident_bytes( f );
+	std::vector<unsigned char> buffer;
+	const clock_type::time_point start{ clock_type::now() };
+	for( const std::string &f : files ) {
+		const int fd{ ::open( f.c_str(), O_RDONLY | O_CLOEXEC ) };
+		if( fd < 0 ) {
+			++r.errors;
+			continue;
+		}
+		buffer.resize( file_size( f ) );
+		size_t done{ 0 };
+		while( done < buffer.size() ) {
+			const ssize_t n{ ::pread( fd, buffer.data() + done, buffer.size() - done, static_cast<off_t>( done ) ) };
+			if( n <= 0 )
+				break;
+			done += static_cast<size_t>( n );
+		}
+		if( done != buffer.size() )
+			++r.errors;
+		r.bytes += done;
+		::close( fd );
+	}
+	r.ms = ms_since( start );
+	return r;
+}
+
+void print_pass( const char *name, const char *backend, const size_t files, const uint64_t total, const pass_result &r ) {
+	const double mb{ double( r.bytes ) / ( 1024.0 * 1024.0 ) };
+	std::cout << std::left << std::setw( 8 ) << name << std::setw( 18 ) << backend << std::right << std::fixed <<
+			std::setprecision( 1 ) << files << " files, " << mb << " MB, " << r.ms << " ms, " <<
+			( r.ms > 0.0 ? mb / r.ms * 1000.0 : 0.0 ) << " MB/s, " << ( r.ms > 0.0 ? files / r.ms * 1000.0 : 0.0 ) <<
+			" files/s, resident before " << ( total > 0 ? 100.0 * double( r.resident_before ) / double( total ) : 0.0 ) <<
+			"%" << ( r.errors > 0 ? ", " + std::to_string( r.errors ) + " errors" : "" ) << std::endl;
+}
+
+}
+
+int main( int argc, char **argv ) {
+	std::vector<std::string> files;
+	unsigned int synthetic{ 64 };
+	unsigned int size_mb{ 16 };
+	unsigned int block_kb{ 1024 };
+	unsigned int batch{ 8 };
+	unsigned int depth{ 64 };
+	unsigned int threads{ 4 };
+	bool args_ok{ true };
+	for( int i = 1; i < argc && args_ok; ++i ) {
+		const std::string a{ argv[i] };
+		const bool has_value{ i + 1 < argc };
+		if( "--synthetic" == a && has_value )
+			args_ok = parse_uint( argv[++i], synthetic );
+		else if( "--size" == a && has_value )
+			args_ok = parse_uint( argv[++i], size_mb );
+		else if( "--block" == a && has_value )
+			args_ok = parse_uint( argv[++i], block_kb );
+		else if( "--batch" == a && has_value )
+			args_ok = parse_uint( argv[++i], batch );
+		else if( "--depth" == a && has_value )
+			args_ok = parse_uint( argv[++i], depth );
+		else if( "--threads" == a && has_value )
+			args_ok = parse_uint( argv[++i], threads );
+		else if( a.size() > 0 && a[0] != '-' )
+			files.push_back( a );
+		else
+			args_ok = false;
+	}
+	if( !args_ok || 0 == synthetic || 0 == size_mb || 0 == block_kb || 0 == batch || 0 == depth || 0 == threads ) {
+		std::cerr << "Usage: async_reader_bench [files ...] [--synthetic n] [--size MB] [--block kB] [--batch n]"
+				" [--depth n] [--threads n]" << std::endl;
+		return 1;
+	}
+	logbook::set_log_filename( "async_reader_bench.log" );
+	logbook::set_console_output( false );
+	const std::string data_dir{ "async_reader_bench_data" };
+	const bool own_files{ files.empty() };
+	if( own_files ) {
+		::mkdir( data_dir.c_str(), 0755 );
+		for( unsigned int i = 0; i < synthetic; ++i ) {
+			files.push_back( data_dir + "/tile_" + std::to_string( i ) );
+			if( !write_synthetic( files.back(), uint64_t( size_mb ) * 1024 * 1024 ) ) {
+				std::cerr << "Could not write '" << files.back() << "'." << std::endl;
+				return 1;
+			}
+		}
+	}
+	uint64_t total{ 0 };
+	for( const std::string &f : files )
+		total += file_size( f );
+
+	async_reader reader{ depth, threads };
+	const size_t block_size{ size_t( block_kb ) * 1024 };
+	for( const std::string &f : files )
+		evict( f );
+	print_pass( "cold", reader.get_backend_name(), files.size(), total, read_async( reader, files, block_size, batch ) );
+	print_pass( "warm", reader.get_backend_name(), files.size(), total, read_async( reader, files, block_size, batch ) );
+	for( const std::string &f : files )
+		evict( f );
+	print_pass( "cold", "blocking pread", files.size(), total, read_blocking( files ) );
+	print_pass( "warm", "blocking pread", files.size(), total, read_blocking( files ) );
+
+	if( own_files ) {
+		for( const std::string &f : files )
+			std::remove( f.c_str() );
+		::rmdir( data_dir.c_str() );
+	}
+	return 0;
+}
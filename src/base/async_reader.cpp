@@ -0,0 +1,271 @@
+
+#include "async_reader.h"
+#include "logbook.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+// io_uring is optional. Without liburing the thread pool is always used.
+#if __has_include(<liburing.h>)
+#include <liburing.h>
+#define ORF_HAVE_LIBURING 1
+#else
+#define ORF_HAVE_LIBURING 0
+#endif
+
+namespace orf_n {
+
+async_reader::async_reader( const unsigned int queue_depth, const unsigned int num_threads ) :
+		m_queue_depth{ queue_depth } {
+	if( init_uring() ) {
+		m_backend = IO_URING;
+	} else {
+		m_backend = THREAD_POOL;
+		const unsigned int n{ num_threads > 0 ? num_threads : 1 };
+		for( unsigned int i = 0; i < n; ++i )
+			m_threads.emplace_back( &async_reader::worker, this );
+	}
+	logbook::log_msg( logbook::RESOURCE, logbook::INFO,
+			std::string{ "Asynchronous reader created, backend " } + get_backend_name() + '.' );
+}
+
+async_reader::~async_reader() {
+	wait_all();
+	if( THREAD_POOL == m_backend ) {
+		{
+			std::lock_guard<std::mutex> lock{ m_queue_mutex };
+			m_shutdown = true;
+		}
+		m_queue_cv.notify_all();
+		for( std::thread &t : m_threads )
+			t.join();
+	}
+#if ORF_HAVE_LIBURING
+	if( nullptr != m_ring ) {
+		io_uring_queue_exit( m_ring );
+		delete m_ring;
+		m_ring = nullptr;
+	}
+#endif
+}
+
+bool async_reader::init_uring() {
+#if ORF_HAVE_LIBURING
+	m_ring = new io_uring;
+	const int ret{ io_uring_queue_init( m_queue_depth, m_ring, 0 ) };
+	if( ret < 0 ) {
+		// Old kernel, disabled by sysctl or seccomp. Fall back silently.
+		logbook::log_msg( logbook::RESOURCE, logbook::INFO,
+				std::string{ "io_uring not available (" } + std::strerror( -ret ) + "). Using thread pool." );
+		delete m_ring;
+		m_ring = nullptr;
+		return false;
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+int async_reader::open_file( const std::string &filename ) const {
+	const int fd{ ::open( filename.c_str(), O_RDONLY | O_CLOEXEC ) };
+	if( fd < 0 )
+		logbook::log_msg( logbook::RESOURCE, logbook::ERROR,
+				"Error opening file '" + filename + "': " + std::strerror( errno ) );
+	return fd;
+}
+
+void async_reader::close_file( const int fd ) const {
+	if( fd >= 0 )
+		::close( fd );
+}
+
+uint64_t async_reader::get_file_size( const int fd ) const {
+	struct stat st;
+	if( fstat( fd, &st ) != 0 )
+		return 0;
+	return static_cast<uint64_t>( st.st_size );
+}
+
+void async_reader::submit( const std::vector<read_request> &requests ) {
+	if( requests.empty() )
+		return;
+	m_pending += static_cast<unsigned int>( requests.size() );
+	if( IO_URING == m_backend ) {
+		for( const read_request &r : requests )
+			m_backlog.push_back( new in_flight{ r, 0, 0 } );
+		submit_uring_backlog();
+	} else {
+		{
+			std::lock_guard<std::mutex> lock{ m_queue_mutex };
+			for( const read_request &r : requests )
+				m_queue.push_back( new in_flight{ r, 0, 0 } );
+		}
+		m_queue_cv.notify_all();
+	}
+}
+
+unsigned int async_reader::poll() {
+	if( IO_URING == m_backend )
+		return reap_uring( false );
+	return dispatch_completed( false );
+}
+
+void async_reader::wait_all() {
+	while( m_pending > 0 ) {
+		if( IO_URING == m_backend )
+			reap_uring( true );
+		else
+			dispatch_completed( true );
+	}
+}
+
+async_reader::backend_type async_reader::get_backend() const {
+	return m_backend;
+}
+
+const char *async_reader::get_backend_name() const {
+	return IO_URING == m_backend ? "io_uring" : "thread pool/pread";
+}
+
+unsigned int async_reader::get_pending() const {
+	return m_pending;
+}
+
+/* Fills the submission queue from the backlog up to the queue depth and submits once. If the submit fails,
+ * the kernel has taken none of the entries. They are turned into no-ops, so that a later submit doesn't read
+ * into them, and the reads go back to the backlog. A full completion queue is retried on the next reap,
+ * other errors fail the reads there. */
+void async_reader::submit_uring_backlog() {
+#if ORF_HAVE_LIBURING
+	std::vector<std::pair<io_uring_sqe *, in_flight *>> queued;
+	while( !m_backlog.empty() && m_in_ring < m_queue_depth ) {
+		io_uring_sqe *sqe{ io_uring_get_sqe( m_ring ) };
+		if( nullptr == sqe )
+			break;
+		in_flight *f{ m_backlog.front() };
+		m_backlog.pop_front();
+		io_uring_prep_read( sqe, f->request.fd, static_cast<char *>( f->request.destination ) + f->done,
+				static_cast<unsigned int>( f->request.size - f->done ), f->request.offset + f->done );
+		io_uring_sqe_set_data( sqe, f );
+		++m_in_ring;
+		queued.emplace_back( sqe, f );
+	}
+	// Entries left over by a partial submit go out with this one.
+	if( queued.empty() && 0 == io_uring_sq_ready( m_ring ) )
+		return;
+	const int ret{ io_uring_submit( m_ring ) };
+	if( ret >= 0 )
+		return;
+	logbook::log_msg( logbook::RESOURCE, logbook::ERROR,
+			std::string{ "io_uring submit failed: " } + std::strerror( -ret ) );
+	for( auto q = queued.rbegin(); q != queued.rend(); ++q ) {
+		io_uring_prep_nop( q->first );
+		io_uring_sqe_set_data( q->first, nullptr );
+		m_backlog.push_front( q->second );
+	}
+	m_in_ring -= static_cast<unsigned int>( queued.size() );
+	if( -EAGAIN != ret && -EBUSY != ret && -EINTR != ret )
+		m_submit_error = ret;
+#endif
+}
+
+unsigned int async_reader::reap_uring( [[maybe_unused]] const bool wait ) {
+	unsigned int dispatched{ 0 };
+#if ORF_HAVE_LIBURING
+	io_uring_cqe *cqe{ nullptr };
+	int ret{ wait && m_in_ring > 0 ? io_uring_wait_cqe( m_ring, &cqe ) : io_uring_peek_cqe( m_ring, &cqe ) };
+	while( 0 == ret && nullptr != cqe ) {
+		in_flight *f{ static_cast<in_flight *>( io_uring_cqe_get_data( cqe ) ) };
+		const int res{ cqe->res };
+		io_uring_cqe_seen( m_ring, cqe );
+		ret = io_uring_peek_cqe( m_ring, &cqe );
+		// No-op of a failed submit
+		if( nullptr == f )
+			continue;
+		--m_in_ring;
+		if( res > 0 && f->done + res < f->request.size ) {
+			// Short read, queue the rest
+			f->done += res;
+			m_backlog.push_front( f );
+		} else {
+			f->result = res < 0 ? res : static_cast<long>( f->done + res );
+			if( f->request.on_complete )
+				f->request.on_complete( f->request, f->result );
+			delete f;
+			--m_pending;
+			++dispatched;
+		}
+	}
+	if( 0 != m_submit_error ) {
+		// The ring does not take submissions, fail what waits for it.
+		while( !m_backlog.empty() ) {
+			in_flight *f{ m_backlog.front() };
+			m_backlog.pop_front();
+			f->result = m_submit_error;
+			if( f->request.on_complete )
+				f->request.on_complete( f->request, f->result );
+			delete f;
+			--m_pending;
+			++dispatched;
+		}
+		m_submit_error = 0;
+	}
+	submit_uring_backlog();
+#endif
+	return dispatched;
+}
+
+void async_reader::worker() {
+	for( ;; ) {
+		in_flight *f{ nullptr };
+		{
+			std::unique_lock<std::mutex> lock{ m_queue_mutex };
+			m_queue_cv.wait( lock, [this]{ return m_shutdown || !m_queue.empty(); } );
+			if( m_queue.empty() )
+				return;
+			f = m_queue.front();
+			m_queue.pop_front();
+		}
+		char *dest{ static_cast<char *>( f->request.destination ) };
+		while( f->done < f->request.size ) {
+			const ssize_t r{ ::pread( f->request.fd, dest + f->done, f->request.size - f->done,
+					static_cast<off_t>( f->request.offset + f->done ) ) };
+			if( r < 0 && EINTR == errno )
+				continue;
+			if( r <= 0 ) {
+				f->result = r < 0 ? -errno : static_cast<long>( f->done );
+				break;
+			}
+			f->done += static_cast<size_t>( r );
+			f->result = static_cast<long>( f->done );
+		}
+		{
+			std::lock_guard<std::mutex> lock{ m_completed_mutex };
+			m_completed.push_back( f );
+		}
+		m_completed_cv.notify_one();
+	}
+}
+
+unsigned int async_reader::dispatch_completed( const bool wait ) {
+	std::deque<in_flight *> done;
+	{
+		std::unique_lock<std::mutex> lock{ m_completed_mutex };
+		if( wait )
+			m_completed_cv.wait( lock, [this]{ return !m_completed.empty(); } );
+		done.swap( m_completed );
+	}
+	for( in_flight *f : done ) {
+		if( f->request.on_complete )
+			f->request.on_complete( f->request, f->result );
+		delete f;
+		--m_pending;
+	}
+	return static_cast<unsigned int>( done.size() );
+}
+
+}
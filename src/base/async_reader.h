@@ -0,0 +1,101 @@
+/* Asynchronous block reads from terrain data files.
+ * Uses io_uring when compiled with liburing and the kernel supports it. Else falls back
+ * to a small pool of threads doing pread(). Reads are submitted in batches, completion
+ * callbacks are dispatched on the thread that calls poll() or wait_all(), usually the
+ * render thread, so they can safely create GL objects. */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct io_uring;
+
+namespace orf_n {
+
+class async_reader {
+public:
+	typedef enum {
+		IO_URING, THREAD_POOL
+	} backend_type;
+
+	typedef struct read_request {
+		int fd{ -1 };
+		uint64_t offset{ 0 };
+		size_t size{ 0 };
+		// Must stay valid until the completion callback has been called.
+		void *destination{ nullptr };
+		// Called with the number of bytes read or a negative errno.
+		std::function<void( const read_request &request, long result )> on_complete;
+	} read_request;
+
+	/* queue_depth is the maximum number of reads in flight with io_uring,
+	 * num_threads the number of threads of the fallback. */
+	async_reader( const unsigned int queue_depth = 64, const unsigned int num_threads = 4 );
+	virtual ~async_reader();
+	async_reader( const async_reader &other ) = delete;
+	async_reader &operator=( const async_reader &other ) = delete;
+
+	// Returns a file descriptor or -1 on error.
+	int open_file( const std::string &filename ) const;
+	void close_file( const int fd ) const;
+	uint64_t get_file_size( const int fd ) const;
+
+	// Queue a batch of reads. With io_uring the whole batch goes out with a single submit.
+	void submit( const std::vector<read_request> &requests );
+	// Calls the callbacks of finished reads without blocking. Returns the number of completions.
+	unsigned int poll();
+	// Blocks until all submitted reads have finished and their callbacks were called.
+	void wait_all();
+
+	backend_type get_backend() const;
+	const char *get_backend_name() const;
+	unsigned int get_pending() const;
+
+private:
+	typedef struct in_flight {
+		read_request request;
+		// Bytes already read. Short reads are resubmitted for the rest.
+		size_t done{ 0 };
+		long result{ 0 };
+	} in_flight;
+
+	backend_type m_backend{ THREAD_POOL };
+	unsigned int m_queue_depth{ 64 };
+	// Submitted, but not yet dispatched reads.
+	std::atomic<unsigned int> m_pending{ 0 };
+
+	// io_uring backend. Reads exceeding the queue depth wait in the backlog.
+	io_uring *m_ring{ nullptr };
+	unsigned int m_in_ring{ 0 };
+	std::deque<in_flight *> m_backlog;
+	// Negative errno of a failed submit, the backlog is failed with it on the next reap.
+	int m_submit_error{ 0 };
+	bool init_uring();
+	void submit_uring_backlog();
+	unsigned int reap_uring( const bool wait );
+
+	// Thread pool backend
+	std::vector<std::thread> m_threads;
+	std::deque<in_flight *> m_queue;
+	std::deque<in_flight *> m_completed;
+	std::mutex m_queue_mutex;
+	std::mutex m_completed_mutex;
+	std::condition_variable m_queue_cv;
+	std::condition_variable m_completed_cv;
+	bool m_shutdown{ false };
+	void worker();
+	unsigned int dispatch_completed( const bool wait );
+
+};
+
+}
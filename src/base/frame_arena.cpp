@@ -0,0 +1,70 @@
+
+#include "frame_arena.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace orf_n {
+
+// static
+frame_arena &frame_arena::get_instance() {
+	static frame_arena instance;
+	return instance;
+}
+
+frame_arena::frame_arena( const size_t block_size ) {
+	for( block &b : m_blocks ) {
+		b.size = std::max( block_size, ALIGNMENT );
+		b.memory.reset( new unsigned char[b.size] );
+	}
+}
+
+frame_arena::~frame_arena() {}
+
+void frame_arena::new_frame() {
+	const unsigned int current{ m_current.load( std::memory_order_relaxed ) };
+	const unsigned int heap_allocations{ m_heap_allocations.exchange( 0 ) };
+	m_frame_bytes = m_blocks[current].offset.load();
+	m_peak_bytes = std::max( m_peak_bytes, m_frame_bytes );
+	m_frame_heap_allocations = heap_allocations;
+	// Nobody uses the other block any more, reset it before it becomes current.
+	block &next{ m_blocks[1 - current] };
+	const size_t needed{ next.offset.load() };
+	if( needed > next.size ) {
+		size_t size{ next.size };
+		while( size < needed )
+			size *= 2;
+		next.memory.reset( new unsigned char[size] );
+		next.size = size;
+	}
+	next.overflow.clear();
+	next.offset.store( 0 );
+	m_current.store( 1 - current, std::memory_order_release );
+}
+
+void *frame_arena::allocate( const size_t size, const size_t alignment ) {
+	const size_t padded{ ( std::max( size, (size_t)1 ) + ALIGNMENT - 1 ) & ~( ALIGNMENT - 1 ) };
+	block &b{ m_blocks[m_current.load( std::memory_order_acquire )] };
+	const size_t offset{ b.offset.fetch_add( padded ) };
+	if( alignment <= ALIGNMENT && offset + padded <= b.size )
+		return b.memory.get() + offset;
+	m_heap_allocations.fetch_add( 1 );
+	const size_t align{ std::max( alignment, ALIGNMENT ) };
+	std::lock_guard<std::mutex> lock{ b.overflow_mutex };
+	b.overflow.emplace_back( new unsigned char[padded + align] );
+	const uintptr_t p{ reinterpret_cast<uintptr_t>( b.overflow.back().get() ) };
+	return reinterpret_cast<void *>( ( p + align - 1 ) & ~( align - 1 ) );
+}
+
+size_t frame_arena::get_frame_bytes() const {
+	return m_frame_bytes;
+}
+
+size_t frame_arena::get_peak_bytes() const {
+	return m_peak_bytes;
+}
+
+unsigned int frame_arena::get_frame_heap_allocations() const {
+	return m_frame_heap_allocations;
+}
+
+}
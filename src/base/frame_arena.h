@@ -0,0 +1,100 @@
+/* Linear allocator for transient data of a frame. Two blocks are used in turns: allocations bump an
+ * offset in the current block and are never freed one by one, new_frame() switches blocks and resets
+ * the other one. So memory stays valid until the end of the next frame, which covers jobs that run
+ * across a frame boundary like the pipelined selection. Allocations may come from any thread.
+ * When a block runs out, requests get their own heap chunk that lives as long as the block's contents,
+ * and the block grows to the needed size the next time it is reset, so a steady state doesn't touch
+ * the heap at all.
+ * frame_allocator adapts it for standard containers, e.g. frame_vector<int> v; v.reserve( n ); */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace orf_n {
+
+class frame_arena {
+public:
+	// Alignment of all allocations from the blocks, larger ones come from the heap
+	static constexpr size_t ALIGNMENT{ alignof( std::max_align_t ) };
+
+	// Shared instance for the application, created at first use.
+	static frame_arena &get_instance();
+
+	explicit frame_arena( const size_t block_size = 1024 * 1024 );
+	virtual ~frame_arena();
+	frame_arena( const frame_arena &other ) = delete;
+	frame_arena &operator=( const frame_arena &other ) = delete;
+
+	/* Main thread, at the start of a frame. Nothing allocated before the last call may be used
+	 * after this one. */
+	void new_frame();
+
+	void *allocate( const size_t size, const size_t alignment = ALIGNMENT );
+
+	// Bytes requested during the last frame, including heap fallbacks.
+	size_t get_frame_bytes() const;
+	size_t get_peak_bytes() const;
+	// Allocations of the last frame that went to the heap.
+	unsigned int get_frame_heap_allocations() const;
+
+private:
+	typedef struct block {
+		std::unique_ptr<unsigned char[]> memory;
+		size_t size{ 0 };
+		// May grow past size, then it is the size needed.
+		std::atomic<size_t> offset{ 0 };
+		// Heap chunks of requests that didn't fit
+		std::mutex overflow_mutex;
+		std::vector<std::unique_ptr<unsigned char[]>> overflow;
+	} block;
+
+	block m_blocks[2];
+	std::atomic<unsigned int> m_current{ 0 };
+	std::atomic<unsigned int> m_heap_allocations{ 0 };
+	size_t m_frame_bytes{ 0 };
+	size_t m_peak_bytes{ 0 };
+	unsigned int m_frame_heap_allocations{ 0 };
+
+};
+
+template<typename T>
+class frame_allocator {
+public:
+	typedef T value_type;
+
+	frame_allocator() noexcept {}
+
+	template<typename U>
+	frame_allocator( const frame_allocator<U> & ) noexcept {}
+
+	T *allocate( const size_t n ) {
+		return static_cast<T *>( frame_arena::get_instance().allocate( n * sizeof( T ), alignof( T ) ) );
+	}
+
+	// Freed all at once when the frame's block is reset.
+	void deallocate( T *, const size_t ) noexcept {}
+};
+
+template<typename T, typename U>
+bool operator==( const frame_allocator<T> &, const frame_allocator<U> & ) noexcept {
+	return true;
+}
+
+template<typename T, typename U>
+bool operator!=( const frame_allocator<T> &, const frame_allocator<U> & ) noexcept {
+	return false;
+}
+
+template<typename T>
+using frame_vector = std::vector<T, frame_allocator<T>>;
+typedef std::basic_string<char, std::char_traits<char>, frame_allocator<char>> frame_string;
+typedef std::basic_ostringstream<char, std::char_traits<char>, frame_allocator<char>> frame_ostringstream;
+
+}
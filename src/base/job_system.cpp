@@ -0,0 +1,223 @@
+
+#include "job_system.h"
+#include "logbook.h"
+#include <exception>
+
+namespace orf_n {
+
+// The job system a thread works for and its queue, only set in worker threads.
+static thread_local const job_system *t_owner{ nullptr };
+static thread_local unsigned int t_queue_index{ 0 };
+
+job_system::task_group::task_group( job_system &js ) : m_js{ js } {}
+
+job_system::task_group::~task_group() {
+	try {
+		wait();
+	} catch( ... ) {
+		// Already logged when the job threw
+	}
+}
+
+void job_system::task_group::run( job j ) {
+	m_pending.fetch_add( 1 );
+	m_js.push( task{ std::move( j ), this } );
+}
+
+void job_system::task_group::then( job continuation ) {
+	std::unique_lock<std::mutex> lock{ m_continuation_mutex };
+	if( 0 == m_pending.load() ) {
+		lock.unlock();
+		run( std::move( continuation ) );
+	} else
+		m_continuation = std::move( continuation );
+}
+
+void job_system::task_group::wait() {
+	while( 0 != m_pending.load() )
+		if( !m_js.run_one() )
+			std::this_thread::yield();
+	/* The last job counts down while it holds the mutex, so that then() can't miss it. Take the mutex once
+	 * more, then that job is done with the group and it may be destroyed. */
+	std::unique_lock<std::mutex> lock{ m_continuation_mutex };
+	if( nullptr != m_exception ) {
+		std::exception_ptr e{ m_exception };
+		m_exception = nullptr;
+		lock.unlock();
+		std::rethrow_exception( e );
+	}
+}
+
+bool job_system::task_group::is_done() const {
+	return 0 == m_pending.load();
+}
+
+void job_system::task_group::finish_one() {
+	std::unique_lock<std::mutex> lock{ m_continuation_mutex };
+	if( 1 == m_pending.load() && m_continuation ) {
+		// The continuation takes over the count of the last job.
+		job continuation{ std::move( m_continuation ) };
+		m_continuation = nullptr;
+		lock.unlock();
+		m_js.push( task{ std::move( continuation ), this } );
+		return;
+	}
+	m_pending.fetch_sub( 1 );
+}
+
+void job_system::task_group::set_exception( std::exception_ptr e ) {
+	std::lock_guard<std::mutex> lock{ m_continuation_mutex };
+	if( nullptr == m_exception )
+		m_exception = e;
+}
+
+// static
+job_system &job_system::get_instance() {
+	static job_system instance;
+	return instance;
+}
+
+job_system::job_system( unsigned int number_of_workers ) {
+	if( 0 == number_of_workers ) {
+		const unsigned int hw{ std::thread::hardware_concurrency() };
+		number_of_workers = hw > 1 ? hw - 1 : 0;
+	}
+	for( unsigned int i = 0; i <= number_of_workers; ++i )
+		m_queues.push_back( std::make_unique<task_queue>() );
+	for( unsigned int i = 0; i < number_of_workers; ++i )
+		m_workers.emplace_back( &job_system::worker_loop, this, i );
+	logbook::log_msg( logbook::SCHEDULER, logbook::INFO,
+			"Job system started with " + std::to_string( number_of_workers ) + " workers." );
+}
+
+job_system::~job_system() {
+	{
+		std::lock_guard<std::mutex> lock{ m_sleep_mutex };
+		m_quit = true;
+	}
+	m_sleep_cv.notify_all();
+	for( std::thread &t : m_workers )
+		t.join();
+	// Whatever is left runs here.
+	while( run_one() )
+		;
+}
+
+unsigned int job_system::get_number_of_workers() const {
+	return (unsigned int)m_workers.size();
+}
+
+void job_system::parallel_for( const size_t begin, const size_t end, const size_t grain,
+		const std::function<void( size_t, size_t )> &fn ) {
+	if( begin >= end )
+		return;
+	task_group group{ *this };
+	split( group, begin, end, grain > 0 ? grain : 1, fn );
+	group.wait();
+}
+
+// Halves are handed out as jobs, so thieves take large pieces and owners work through small ones.
+void job_system::split( task_group &group, const size_t begin, const size_t end, const size_t grain,
+		const std::function<void( size_t, size_t )> &fn ) {
+	size_t last{ end };
+	while( last - begin > grain ) {
+		const size_t middle{ begin + ( last - begin ) / 2 };
+		group.run( [this, &group, middle, last, grain, &fn]{ split( group, middle, last, grain, fn ); } );
+		last = middle;
+	}
+	fn( begin, last );
+}
+
+void job_system::run_on_main_thread( job j ) {
+	std::lock_guard<std::mutex> lock{ m_main_mutex };
+	m_main_jobs.push_back( std::move( j ) );
+}
+
+unsigned int job_system::run_main_thread_jobs() {
+	std::vector<job> jobs;
+	{
+		std::lock_guard<std::mutex> lock{ m_main_mutex };
+		jobs.swap( m_main_jobs );
+	}
+	for( job &j : jobs )
+		j();
+	return (unsigned int)jobs.size();
+}
+
+unsigned int job_system::get_queue_index() const {
+	return this == t_owner ? t_queue_index : (unsigned int)m_queues.size() - 1;
+}
+
+void job_system::push( task t ) {
+	task_queue &q{ *m_queues[get_queue_index()] };
+	{
+		std::lock_guard<std::mutex> lock{ q.mutex };
+		q.tasks.push_back( std::move( t ) );
+	}
+	m_queued.fetch_add( 1 );
+	// Workers only sleep after they have seen no jobs, with the sleep mutex held.
+	if( m_sleeping.load() > 0 ) {
+		std::lock_guard<std::mutex> lock{ m_sleep_mutex };
+		m_sleep_cv.notify_one();
+	}
+}
+
+bool job_system::run_one() {
+	if( 0 == m_queued.load() )
+		return false;
+	const unsigned int n{ (unsigned int)m_queues.size() };
+	const unsigned int self{ get_queue_index() };
+	task t;
+	bool found{ false };
+	{
+		task_queue &q{ *m_queues[self] };
+		std::lock_guard<std::mutex> lock{ q.mutex };
+		if( !q.tasks.empty() ) {
+			t = std::move( q.tasks.back() );
+			q.tasks.pop_back();
+			found = true;
+		}
+	}
+	for( unsigned int i = 1; i < n && !found; ++i ) {
+		task_queue &q{ *m_queues[( self + i ) % n] };
+		std::lock_guard<std::mutex> lock{ q.mutex };
+		if( !q.tasks.empty() ) {
+			t = std::move( q.tasks.front() );
+			q.tasks.pop_front();
+			found = true;
+		}
+	}
+	if( !found )
+		return false;
+	m_queued.fetch_sub( 1 );
+	// Kept for the group's wait(), nothing may escape a worker thread.
+	try {
+		t.fn();
+	} catch( const std::exception &e ) {
+		logbook::log_msg( logbook::SCHEDULER, logbook::ERROR, std::string{ "Job failed: " } + e.what() );
+		if( nullptr != t.group )
+			t.group->set_exception( std::current_exception() );
+	} catch( ... ) {
+		logbook::log_msg( logbook::SCHEDULER, logbook::ERROR, "Job failed with an unknown exception." );
+		if( nullptr != t.group )
+			t.group->set_exception( std::current_exception() );
+	}
+	if( nullptr != t.group )
+		t.group->finish_one();
+	return true;
+}
+
+void job_system::worker_loop( const unsigned int index ) {
+	t_owner = this;
+	t_queue_index = index;
+	while( !m_quit.load() ) {
+		if( run_one() )
+			continue;
+		std::unique_lock<std::mutex> lock{ m_sleep_mutex };
+		m_sleeping.fetch_add( 1 );
+		m_sleep_cv.wait( lock, [this]{ return m_quit.load() || m_queued.load() > 0; } );
+		m_sleeping.fetch_sub( 1 );
+	}
+}
+
+}
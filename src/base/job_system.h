@@ -0,0 +1,112 @@
+/* Work stealing job scheduler. Every worker thread has its own deque of jobs: it pushes and pops
+ * at the back (newest first, cache friendly), idle workers steal from the front of the others.
+ * Jobs pushed from threads that are not workers go to a shared queue that workers steal from, too.
+ * Jobs belong to a task_group; waiting for a group executes jobs on the waiting thread instead
+ * of blocking it. GL calls must stay on the main thread, so there is a separate queue for jobs
+ * that the main thread runs once per frame. Deques are guarded by a mutex each, contention is
+ * low because owners and thieves mostly work on different ends. */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace orf_n {
+
+class job_system {
+public:
+	typedef std::function<void()> job;
+
+	class task_group {
+	public:
+		explicit task_group( job_system &js );
+		// Waits for outstanding jobs. Exceptions of jobs are only logged.
+		virtual ~task_group();
+		task_group( const task_group &other ) = delete;
+		task_group &operator=( const task_group &other ) = delete;
+
+		void run( job j );
+		/* Runs as a job of the group when all other jobs of it have finished, at once if
+		 * there are none. Only one continuation at a time. */
+		void then( job continuation );
+		/* Blocks until all jobs and the continuation have finished, executes jobs meanwhile.
+		 * Rethrows the first exception a job of the group threw since the last wait(). */
+		void wait();
+		bool is_done() const;
+
+	private:
+		friend class job_system;
+		job_system &m_js;
+		std::atomic<unsigned int> m_pending{ 0 };
+		std::mutex m_continuation_mutex;
+		job m_continuation;
+		// First exception thrown by a job, guarded by the continuation mutex.
+		std::exception_ptr m_exception;
+
+		void finish_one();
+		void set_exception( std::exception_ptr e );
+	};
+
+	// Shared instance for the application, created at first use.
+	static job_system &get_instance();
+
+	// 0 workers means one less than the hardware threads. Without workers, waiting threads do all the work.
+	explicit job_system( unsigned int number_of_workers = 0 );
+	virtual ~job_system();
+	job_system( const job_system &other ) = delete;
+	job_system &operator=( const job_system &other ) = delete;
+
+	unsigned int get_number_of_workers() const;
+	/* Calls fn( first, last ) for subranges of [begin, end) of at most grain elements in parallel.
+	 * Returns when all have finished. */
+	void parallel_for( const size_t begin, const size_t end, const size_t grain,
+			const std::function<void( size_t, size_t )> &fn );
+
+	// Queue work for the main thread, e.g. GL uploads of data prepared by a job.
+	void run_on_main_thread( job j );
+	// Call from the main thread once per frame. Returns the number of jobs run.
+	unsigned int run_main_thread_jobs();
+
+private:
+	typedef struct task {
+		job fn;
+		task_group *group{ nullptr };
+	} task;
+
+	typedef struct task_queue {
+		std::mutex mutex;
+		std::deque<task> tasks;
+	} task_queue;
+
+	// One per worker, the last one for all other threads.
+	std::vector<std::unique_ptr<task_queue>> m_queues;
+	std::vector<std::thread> m_workers;
+	// Jobs in all queues. Workers sleep while there are none.
+	std::atomic<unsigned int> m_queued{ 0 };
+	std::atomic<unsigned int> m_sleeping{ 0 };
+	std::atomic<bool> m_quit{ false };
+	std::mutex m_sleep_mutex;
+	std::condition_variable m_sleep_cv;
+
+	std::mutex m_main_mutex;
+	std::vector<job> m_main_jobs;
+
+	void push( task t );
+	// Own queue first, then steal. Returns false if there was nothing to do.
+	bool run_one();
+	void worker_loop( const unsigned int index );
+	unsigned int get_queue_index() const;
+	void split( task_group &group, const size_t begin, const size_t end, const size_t grain,
+			const std::function<void( size_t, size_t )> &fn );
+
+};
+
+}
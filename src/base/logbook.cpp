@@ -1,58 +1,311 @@
 
 #include "logbook.h"
-#include <iostream>
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
 #include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
 #include <mutex>
+#include <stdexcept>
+#include <thread>
 
 namespace orf_n {
 
 namespace logbook {
 
-std::string log_filename{ "log.txt" };
+namespace {
 
-std::mutex logfile_mutex{};
+// Power of 2
+constexpr size_t RING_SIZE{ 4096 };
+constexpr unsigned int RATE_BUCKETS{ 1024 };
+constexpr unsigned int DEFAULT_FRAME_LIMIT{ 4 };
+// The background thread writes at least so often.
+constexpr std::chrono::milliseconds WRITE_INTERVAL{ 10 };
 
-std::ofstream log_handle{};
-
-void log_msg( const log_source type, const log_severity severity, const std::string &msg ) {
-	if( "" == log_filename ) {
-		std::string s{ "ERROR: Log filename not set !\n" };
-		std::cerr << s;
-		throw std::runtime_error( s );
-	}
-	std::cout << "logbook: " << msg << std::endl;
-	std::string lt, st;
+const char *source_name( const log_source type ) {
 	switch( type ) {
-		case ANY		: lt = "ANY"; break;
-		case SHADER		: lt = "SHADER"; break;
-		case RESOURCE	: lt = "RESOURCE"; break;
-		case SCENE		: lt = "SCENE"; break;
-		case SCHEDULER	: lt = "SCHEDULER"; break;
-		case RENDERER	: lt = "RENDERER"; break;
-		case WINDOW		: lt = "WINDOW"; break;
-		case TERRAIN	: lt = "TERRAIN"; break;
-		default			: lt = "UNKNOWN"; break;
+		case ANY		: return "ANY";
+		case SHADER		: return "SHADER";
+		case RESOURCE	: return "RESOURCE";
+		case SCENE		: return "SCENE";
+		case SCHEDULER	: return "SCHEDULER";
+		case RENDERER	: return "RENDERER";
+		case WINDOW		: return "WINDOW";
+		case TERRAIN	: return "TERRAIN";
+		default			: return "UNKNOWN";
 	};
+}
+
+const char *severity_name( const log_severity severity ) {
 	switch( severity ) {
-		case LOG		: st = "LOG"; break;
-		case INFO		: st = "INF"; break;
-		case WARNING	: st = "WRN"; break;
-		case ERROR		: st = "ERR"; break;
-		default			: st = "UNK"; break;
+		case LOG		: return "LOG";
+		case INFO		: return "INF";
+		case WARNING	: return "WRN";
+		case ERROR		: return "ERR";
+		default			: return "UNK";
 	};
-	using std::chrono::system_clock;
-	system_clock::time_point n = system_clock::now();
-	std::time_t t = system_clock::to_time_t( n );
-	std::string s = ctime( &t );
-	// delete trailing newline
-	s.at( s.size()-1 ) = ']';
-	std::lock_guard<std::mutex> lock{ logfile_mutex };
-	if( !log_handle.is_open() )
-		// If file exists, append to it.
-		log_handle.open( log_filename, std::ios::out | std::ios::app );
-	log_handle << '[' << s << " [" << st << "] " << lt <<  ": " << msg << std::endl;
-	log_handle.close();
+}
+
+typedef struct message {
+	log_source source{ ANY };
+	log_severity severity{ LOG };
+	std::time_t time{ 0 };
+	std::string text;
+} message;
+
+/* Bounded multi producer queue after D. Vyukov. A slot's sequence number says whose turn it is:
+ * equal to the position for the producer that claims it, position + 1 for the consumer. */
+typedef struct slot {
+	std::atomic<size_t> sequence{ 0 };
+	message msg;
+} slot;
+
+class async_log {
+public:
+	async_log() : m_ring{ new slot[RING_SIZE] } {
+		for( size_t i = 0; i < RING_SIZE; ++i )
+			m_ring[i].sequence.store( i, std::memory_order_relaxed );
+		for( std::atomic<uint64_t> &b : m_rate )
+			b.store( 0, std::memory_order_relaxed );
+		m_thread = std::thread{ &async_log::run, this };
+	}
+
+	~async_log() {
+		{
+			std::lock_guard<std::mutex> lock{ m_mutex };
+			m_quit = true;
+		}
+		m_wake.notify_one();
+		m_thread.join();
+	}
+
+	void push( const log_source type, const log_severity severity, const std::string &msg ) {
+		if( ERROR != severity && !within_frame_limit( msg ) )
+			return;
+		const std::time_t t{ std::chrono::system_clock::to_time_t( std::chrono::system_clock::now() ) };
+		// Warnings and errors wait for space, the rest is dropped and counted if the ring is full.
+		while( !try_push( type, severity, t, msg ) ) {
+			if( severity < WARNING ) {
+				m_dropped.fetch_add( 1, std::memory_order_relaxed );
+				return;
+			}
+			m_wake.notify_one();
+			std::this_thread::yield();
+		}
+		m_pushed.fetch_add( 1, std::memory_order_release );
+		if( ERROR == severity )
+			flush();
+	}
+
+	void flush() {
+		const uint64_t target{ m_pushed.load( std::memory_order_acquire ) };
+		std::unique_lock<std::mutex> lock{ m_mutex };
+		if( m_written >= target )
+			return;
+		m_flush_target = std::max( m_flush_target, target );
+		m_wake.notify_one();
+		m_written_cv.wait( lock, [this, target]{ return m_written >= target; } );
+	}
+
+	void set_filename( const std::string &filename ) {
+		flush();
+		std::lock_guard<std::mutex> lock{ m_mutex };
+		m_filename = filename;
+		if( m_file.is_open() )
+			m_file.close();
+		// If file exists, overwrite it. Stays open for the background thread.
+		m_file.open( m_filename, std::ios::out | std::ios::trunc );
+		if( !m_file.is_open() ) {
+			std::string s{ "ERROR: Log file could not be opened !\n" };
+			std::cerr << s;
+			throw std::runtime_error( s );
+		}
+	}
+
+	std::atomic<int> m_min_severity{ LOG };
+	std::atomic<uint32_t> m_frame{ 0 };
+	std::atomic<unsigned int> m_frame_limit{ DEFAULT_FRAME_LIMIT };
+	std::atomic<bool> m_console{ true };
+
+private:
+	std::unique_ptr<slot[]> m_ring;
+	alignas( 64 ) std::atomic<size_t> m_head{ 0 };
+	// Only touched by the background thread
+	alignas( 64 ) size_t m_tail{ 0 };
+	std::atomic<uint64_t> m_pushed{ 0 };
+	std::atomic<uint64_t> m_dropped{ 0 };
+	std::atomic<uint64_t> m_suppressed{ 0 };
+	// Frame number in the upper, count of that frame in the lower 32 bits, per message hash.
+	std::atomic<uint64_t> m_rate[RATE_BUCKETS];
+
+	// Guards the file and the members below
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_written_cv;
+	std::string m_filename{ "log.txt" };
+	std::ofstream m_file;
+	uint64_t m_written{ 0 };
+	uint64_t m_flush_target{ 0 };
+	bool m_quit{ false };
+
+	// Repeats in a row, background thread only
+	message m_last;
+	uint64_t m_repeats{ 0 };
+	std::time_t m_stamp_time{ -1 };
+	std::string m_stamp;
+
+	// Last, starts when the above are ready
+	std::thread m_thread;
+
+	bool within_frame_limit( const std::string &msg ) {
+		const uint32_t frame{ m_frame.load( std::memory_order_relaxed ) };
+		const unsigned int limit{ m_frame_limit.load( std::memory_order_relaxed ) };
+		if( 0 == frame || 0 == limit )
+			return true;
+		// Messages sharing a bucket share the limit.
+		std::atomic<uint64_t> &bucket{ m_rate[std::hash<std::string>{}( msg ) % RATE_BUCKETS] };
+		uint64_t v{ bucket.load( std::memory_order_relaxed ) };
+		while( true ) {
+			const uint64_t count{ ( v >> 32 ) == frame ? ( v & 0xffffffffu ) + 1 : 1 };
+			if( count > limit ) {
+				m_suppressed.fetch_add( 1, std::memory_order_relaxed );
+				return false;
+			}
+			if( bucket.compare_exchange_weak( v, ( (uint64_t)frame << 32 ) | count, std::memory_order_relaxed ) )
+				return true;
+		}
+	}
+
+	bool try_push( const log_source type, const log_severity severity, const std::time_t t, const std::string &msg ) {
+		size_t pos{ m_head.load( std::memory_order_relaxed ) };
+		while( true ) {
+			slot &s{ m_ring[pos & ( RING_SIZE - 1 )] };
+			const size_t seq{ s.sequence.load( std::memory_order_acquire ) };
+			const intptr_t diff{ (intptr_t)seq - (intptr_t)pos };
+			if( 0 == diff ) {
+				if( m_head.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) ) {
+					s.msg.source = type;
+					s.msg.severity = severity;
+					s.msg.time = t;
+					// Reuses the slot's capacity
+					s.msg.text.assign( msg );
+					s.sequence.store( pos + 1, std::memory_order_release );
+					return true;
+				}
+			} else if( diff < 0 )
+				return false;
+			else
+				pos = m_head.load( std::memory_order_relaxed );
+		}
+	}
+
+	bool pop( message &out ) {
+		slot &s{ m_ring[m_tail & ( RING_SIZE - 1 )] };
+		if( s.sequence.load( std::memory_order_acquire ) != m_tail + 1 )
+			return false;
+		out.source = s.msg.source;
+		out.severity = s.msg.severity;
+		out.time = s.msg.time;
+		std::swap( out.text, s.msg.text );
+		s.sequence.store( m_tail + RING_SIZE, std::memory_order_release );
+		++m_tail;
+		return true;
+	}
+
+	const std::string &stamp( const std::time_t t ) {
+		if( t != m_stamp_time ) {
+			m_stamp_time = t;
+			m_stamp = std::ctime( &t );
+			// delete trailing newline
+			m_stamp.back() = ']';
+		}
+		return m_stamp;
+	}
+
+	void append( std::string &file_out, std::string &console_out, const message &m ) {
+		console_out.append( "logbook: " ).append( m.text ).push_back( '\n' );
+		file_out.append( "[" ).append( stamp( m.time ) ).append( " [" ).append( severity_name( m.severity ) ).
+				append( "] " ).append( source_name( m.source ) ).append( ": " ).append( m.text ).push_back( '\n' );
+	}
+
+	void append_repeats( std::string &file_out, std::string &console_out ) {
+		if( 0 == m_repeats )
+			return;
+		message m{ m_last.source, m_last.severity, m_last.time,
+			"Last message repeated " + std::to_string( m_repeats ) + " times." };
+		append( file_out, console_out, m );
+		m_repeats = 0;
+	}
+
+	void append_counter( std::string &file_out, std::string &console_out, std::atomic<uint64_t> &counter,
+			const char *what ) {
+		const uint64_t n{ counter.exchange( 0, std::memory_order_relaxed ) };
+		if( 0 == n )
+			return;
+		message m{ ANY, WARNING, std::time( nullptr ), std::to_string( n ) + what };
+		append( file_out, console_out, m );
+	}
+
+	void run() {
+		message m;
+		std::string file_out, console_out;
+		std::unique_lock<std::mutex> lock{ m_mutex };
+		while( true ) {
+			m_wake.wait_for( lock, WRITE_INTERVAL, [this]{ return m_quit || m_written < m_flush_target; } );
+			uint64_t count{ 0 };
+			while( pop( m ) ) {
+				++count;
+				if( m.source == m_last.source && m.severity == m_last.severity && m.text == m_last.text ) {
+					++m_repeats;
+					m_last.time = m.time;
+					continue;
+				}
+				append_repeats( file_out, console_out );
+				append( file_out, console_out, m );
+				std::swap( m_last, m );
+			}
+			append_repeats( file_out, console_out );
+			append_counter( file_out, console_out, m_suppressed, " messages over the frame limit suppressed." );
+			append_counter( file_out, console_out, m_dropped, " messages dropped, log ring buffer full." );
+			if( !file_out.empty() ) {
+				if( m_console.load( std::memory_order_relaxed ) )
+					std::cout << console_out << std::flush;
+				if( !m_file.is_open() )
+					// If file exists, append to it.
+					m_file.open( m_filename, std::ios::out | std::ios::app );
+				m_file << file_out << std::flush;
+				file_out.clear();
+				console_out.clear();
+			}
+			if( count > 0 ) {
+				m_written += count;
+				m_written_cv.notify_all();
+			} else if( m_written < m_flush_target )
+				// A producer has claimed a slot but not filled it yet
+				std::this_thread::yield();
+			if( m_quit && m_written >= m_pushed.load( std::memory_order_acquire ) )
+				break;
+		}
+	}
+
+};
+
+async_log &get_log() {
+	static async_log log;
+	return log;
+}
+
+}
+
+void log_msg( const log_source type, const log_severity severity, const std::string &msg ) {
+	if( !is_enabled( severity ) )
+		return;
+	get_log().push( type, severity, msg );
 }
 
 void log_msg( const std::string &msg ) {
@@ -60,18 +313,37 @@ void log_msg( const std::string &msg ) {
 }
 
 void set_log_filename( const std::string &filename ) {
-	log_filename = filename;
-	if( log_handle.is_open() )
-		log_handle.close();
-	// If file exists, overwrite it.
-	log_handle.open( log_filename, std::ios::out );
-	if( !log_handle.is_open() ) {
-		std::string s{ "ERROR: Log file could not be opened !\n" };
+	if( "" == filename ) {
+		std::string s{ "ERROR: Log filename not set !\n" };
 		std::cerr << s;
 		throw std::runtime_error( s );
 	}
-	std::cout << "logbook: Log filename set to " + log_filename + '\n';
-	log_handle.close();
+	get_log().set_filename( filename );
+	std::cout << "logbook: Log filename set to " + filename + '\n';
+}
+
+void set_min_severity( const log_severity severity ) {
+	get_log().m_min_severity.store( severity, std::memory_order_relaxed );
+}
+
+bool is_enabled( const log_severity severity ) {
+	return (int)severity >= get_log().m_min_severity.load( std::memory_order_relaxed );
+}
+
+void new_frame() {
+	get_log().m_frame.fetch_add( 1, std::memory_order_relaxed );
+}
+
+void set_frame_limit( const unsigned int limit ) {
+	get_log().m_frame_limit.store( limit, std::memory_order_relaxed );
+}
+
+void set_console_output( const bool on ) {
+	get_log().m_console.store( on, std::memory_order_relaxed );
+}
+
+void flush() {
+	get_log().flush();
 }
 
 }
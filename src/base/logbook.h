@@ -1,8 +1,24 @@
+/* Messages are put into a lock free ring buffer by the calling threads and written to stdout and
+ * the log file by a background thread, in batches. Errors are written before log_msg() returns.
+ * Identical messages are rate limited per frame once new_frame() is called, repeats of the same
+ * message in a row are written once with a count. */
 
 #pragma once
 
 #include <string>
 
+// Severities below this are compiled out of LOGBOOK_MSG, e.g. -DLOGBOOK_MIN_SEVERITY=2 leaves warnings and errors.
+#ifndef LOGBOOK_MIN_SEVERITY
+#define LOGBOOK_MIN_SEVERITY 0
+#endif
+
+// For hot paths: msg is only evaluated if the severity is compiled in and enabled.
+#define LOGBOOK_MSG( source, severity, msg ) \
+	do { \
+		if( orf_n::logbook::is_compiled_in( severity ) && orf_n::logbook::is_enabled( severity ) ) \
+			orf_n::logbook::log_msg( source, severity, msg ); \
+	} while( false )
+
 namespace orf_n {
 
 namespace logbook {
@@ -21,6 +37,25 @@ void log_msg( const std::string &msg );
 
 void set_log_filename( const std::string &filename );
 
+constexpr bool is_compiled_in( const log_severity severity ) {
+	return (int)severity >= LOGBOOK_MIN_SEVERITY;
+}
+
+// Runtime threshold, messages below are dropped by log_msg(). Default LOG, everything.
+void set_min_severity( const log_severity severity );
+bool is_enabled( const log_severity severity );
+
+// Call once per frame. Until the first call, there is no rate limit.
+void new_frame();
+// Identical messages of one frame beyond this count are dropped and counted. 0 means no limit.
+void set_frame_limit( const unsigned int limit );
+
+// Echo messages to stdout, default on.
+void set_console_output( const bool on );
+
+// Blocks until all messages logged so far are written.
+void flush();
+
 }
 
 }
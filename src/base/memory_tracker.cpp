@@ -0,0 +1,109 @@
+
+#include "memory_tracker.h"
+#include <atomic>
+
+namespace orf_n {
+
+namespace memory_tracker {
+
+namespace {
+
+std::atomic<size_t> s_live[NUMBER_OF_SUBSYSTEMS][NUMBER_OF_KINDS]{};
+std::atomic<size_t> s_peak[NUMBER_OF_SUBSYSTEMS][NUMBER_OF_KINDS]{};
+std::atomic<size_t> s_total_live[NUMBER_OF_KINDS]{};
+std::atomic<size_t> s_total_peak[NUMBER_OF_KINDS]{};
+
+const char *SUBSYSTEM_NAMES[NUMBER_OF_SUBSYSTEMS]{
+	"heightmap", "quadtree", "gridmesh", "ui", "skybox", "renderer"
+};
+
+void raise_peak( std::atomic<size_t> &peak, const size_t value ) {
+	size_t p{ peak.load( std::memory_order_relaxed ) };
+	while( value > p && !peak.compare_exchange_weak( p, value, std::memory_order_relaxed ) );
+}
+
+size_t bytes_per_texel( const GLenum internal_format ) {
+	switch( internal_format ) {
+		case GL_R8: case GL_R8_SNORM: case GL_R8UI: case GL_R8I:
+			return 1;
+		case GL_R16: case GL_R16F: case GL_R16UI: case GL_R16I: case GL_RG8: case GL_DEPTH_COMPONENT16:
+			return 2;
+		case GL_RGB8: case GL_RGB8_SNORM: case GL_SRGB8: case GL_SRGB: case GL_DEPTH_COMPONENT24:
+			return 3;
+		case GL_RGBA16F: case GL_RG32F: case GL_RGBA16:
+			return 8;
+		case GL_RGB32F:
+			return 12;
+		case GL_RGBA32F:
+			return 16;
+		default:
+			// R32F, RG16F, RGBA8, SRGB8_ALPHA8, DEPTH_COMPONENT32F, DEPTH24_STENCIL8, ...
+			return 4;
+	}
+}
+
+}
+
+void allocated( const subsystem s, const memory_kind k, const size_t bytes ) {
+	raise_peak( s_peak[s][k], s_live[s][k].fetch_add( bytes, std::memory_order_relaxed ) + bytes );
+	raise_peak( s_total_peak[k], s_total_live[k].fetch_add( bytes, std::memory_order_relaxed ) + bytes );
+}
+
+void freed( const subsystem s, const memory_kind k, const size_t bytes ) {
+	s_live[s][k].fetch_sub( bytes, std::memory_order_relaxed );
+	s_total_live[k].fetch_sub( bytes, std::memory_order_relaxed );
+}
+
+size_t get_live_bytes( const subsystem s, const memory_kind k ) {
+	return s_live[s][k].load( std::memory_order_relaxed );
+}
+
+size_t get_peak_bytes( const subsystem s, const memory_kind k ) {
+	return s_peak[s][k].load( std::memory_order_relaxed );
+}
+
+size_t get_total_live_bytes( const memory_kind k ) {
+	return s_total_live[k].load( std::memory_order_relaxed );
+}
+
+size_t get_total_peak_bytes( const memory_kind k ) {
+	return s_total_peak[k].load( std::memory_order_relaxed );
+}
+
+const char *get_name( const subsystem s ) {
+	return s < NUMBER_OF_SUBSYSTEMS ? SUBSYSTEM_NAMES[s] : "unknown";
+}
+
+size_t texture_bytes( const GLenum internal_format, const unsigned int width, const unsigned int height,
+		const unsigned int levels, const unsigned int layers ) {
+	size_t texels{ 0 };
+	unsigned int w{ width }, h{ height };
+	for( unsigned int l = 0; l < levels; ++l ) {
+		texels += (size_t)w * h;
+		w = w > 1 ? w / 2 : 1;
+		h = h > 1 ? h / 2 : 1;
+	}
+	return texels * layers * bytes_per_texel( internal_format );
+}
+
+tracked_memory::tracked_memory( const subsystem s, const memory_kind k ) : m_subsystem{ s }, m_kind{ k } {}
+
+tracked_memory::~tracked_memory() {
+	set( 0 );
+}
+
+void tracked_memory::set( const size_t bytes ) {
+	if( bytes > m_bytes )
+		allocated( m_subsystem, m_kind, bytes - m_bytes );
+	else if( bytes < m_bytes )
+		freed( m_subsystem, m_kind, m_bytes - bytes );
+	m_bytes = bytes;
+}
+
+size_t tracked_memory::get() const {
+	return m_bytes;
+}
+
+}
+
+}
@@ -0,0 +1,62 @@
+/* Accounting of CPU and GPU memory per subsystem. Owners report what they hold, preferably through a
+ * tracked_memory member that is set to the current size and gives it back when destroyed. Live and
+ * peak bytes are atomics, any thread may report. GL objects count with the size of the storage they
+ * were created with; what the driver really uses (alignment, padding, compression) is unknown. */
+
+#pragma once
+
+#include "glad/glad.h"
+#include <cstddef>
+
+namespace orf_n {
+
+namespace memory_tracker {
+
+typedef enum : unsigned int {
+	HEIGHTMAP = 0, QUADTREE, GRIDMESH, UI, SKYBOX, RENDERER, NUMBER_OF_SUBSYSTEMS
+} subsystem;
+
+typedef enum : unsigned int {
+	CPU = 0, GPU, NUMBER_OF_KINDS
+} memory_kind;
+
+void allocated( const subsystem s, const memory_kind k, const size_t bytes );
+
+void freed( const subsystem s, const memory_kind k, const size_t bytes );
+
+size_t get_live_bytes( const subsystem s, const memory_kind k );
+
+size_t get_peak_bytes( const subsystem s, const memory_kind k );
+
+// Sums over all subsystems, the peak is the one of the sum.
+size_t get_total_live_bytes( const memory_kind k );
+
+size_t get_total_peak_bytes( const memory_kind k );
+
+const char *get_name( const subsystem s );
+
+// Bytes of a texture's or renderbuffer's storage. Unknown formats count 4 bytes per texel.
+size_t texture_bytes( const GLenum internal_format, const unsigned int width, const unsigned int height,
+		const unsigned int levels = 1, const unsigned int layers = 1 );
+
+class tracked_memory {
+public:
+	tracked_memory( const subsystem s, const memory_kind k );
+	virtual ~tracked_memory();
+	tracked_memory( const tracked_memory &other ) = delete;
+	tracked_memory &operator=( const tracked_memory &other ) = delete;
+
+	// Replaces the bytes reported for the owner.
+	void set( const size_t bytes );
+	size_t get() const;
+
+private:
+	const subsystem m_subsystem;
+	const memory_kind m_kind;
+	size_t m_bytes{ 0 };
+
+};
+
+}
+
+}
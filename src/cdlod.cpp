@@ -1,15 +1,58 @@
-
 #include "base/logbook.h"
 #include "renderer/renderer.h"
+#include "renderer/program_cache.h"
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
+#include <string>
 
-int main(void) {
+// cdlod [--record path] [--replay path [--stats file.csv] [--timestep seconds]] [--no-shader-cache] [--dynamic-resolution ms]
+int main( int argc, char **argv ) {
+	std::string record_path, replay_path, stats_path;
+	double timestep{ 1.0 / 60.0 };
+	bool shader_cache{ true };
+	double dynamic_resolution_ms{ 0.0 };
+	for( int i = 1; i < argc; ++i ) {
+		const std::string a{ argv[i] };
+		const bool has_value{ i + 1 < argc };
+		if( "--record" == a && has_value )
+			record_path = argv[++i];
+		else if( "--replay" == a && has_value )
+			replay_path = argv[++i];
+		else if( "--stats" == a && has_value )
+			stats_path = argv[++i];
+		else if( "--timestep" == a && has_value )
+			timestep = std::atof( argv[++i] );
+		else if( "--no-shader-cache" == a )
+			shader_cache = false;
+		else if( "--dynamic-resolution" == a && has_value )
+			dynamic_resolution_ms = std::atof( argv[++i] );
+		else {
+			std::cerr << "Usage: " << argv[0] <<
+					" [--record path] [--replay path [--stats file.csv] [--timestep seconds]] [--no-shader-cache] [--dynamic-resolution ms]" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
 	orf_n::logbook::set_log_filename( "orfnlog.log" );
 	orf_n::logbook::log_msg( "Program started." );
+	if( !shader_cache )
+		orf_n::program_cache::set_directory( "" );
 	try {
+		const auto start{ std::chrono::steady_clock::now() };
 		orf_n::renderer* r = new orf_n::renderer(true);
 		r->setupRenderer();
+		if( dynamic_resolution_ms > 0.0 )
+			r->set_dynamic_resolution( dynamic_resolution_ms );
 		r->setup();
+		const double startup_ms{ std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count() };
+		orf_n::logbook::log_msg( "Startup took " + std::to_string( startup_ms ) + " ms, " + ( shader_cache ?
+				std::to_string( orf_n::program_cache::get_hits() ) + " shader programs from cache, " +
+				std::to_string( orf_n::program_cache::get_misses() ) + " compiled." : "shader cache off." ) );
+		if( !replay_path.empty() ) {
+			if( !r->replay_camera( replay_path, stats_path, timestep ) )
+				std::cerr << "Could not replay camera path " << replay_path << std::endl;
+		} else if( !record_path.empty() )
+			r->record_camera( record_path );
 		r->render();
 		r->cleanup();
 		r->cleanupRenderer();
@@ -0,0 +1,146 @@
+/* Micro benchmarks of the job system.
+ * 	overhead: empty jobs spawned into one task group and waited for, time per job
+ * 	nested:   jobs spawning jobs from workers, time per job
+ * 	scaling:  parallel_for over a compute bound loop with 0 .. max workers, speedup over 0 workers
+ * Usage:
+ * 	job_system_bench [--jobs n] [--workers max] [--grain n]
+ * Results go to stdout, one line per measurement. */
+
+#include "base/logbook.h"
+#include "base/job_system.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace orf_n;
+
+namespace {
+
+typedef std::chrono::high_resolution_clock clock_type;
+
+double ms_since( const clock_type::time_point &start ) {
+	return std::chrono::duration<double, std::milli>( clock_type::now() - start ).count();
+}
+
+bool parse_uint( const char *s, unsigned int &value ) {
+	try {
+		value = (unsigned int)std::stoul( s );
+		return true;
+	} catch( const std::exception & ) {
+		return false;
+	}
+}
+
+// Best of a few runs against noise
+template<typename F>
+double best_ms( const unsigned int runs, F f ) {
+	double best{ 1e30 };
+	for( unsigned int i = 0; i < runs; ++i ) {
+		const clock_type::time_point start{ clock_type::now() };
+		f();
+		best = std::min( best, ms_since( start ) );
+	}
+	return best;
+}
+
+void bench_overhead( const unsigned int workers, const unsigned int jobs ) {
+	job_system js{ workers };
+	std::atomic<unsigned int> counter{ 0 };
+	const double ms{ best_ms( 5, [&]{
+		job_system::task_group group{ js };
+		for( unsigned int i = 0; i < jobs; ++i )
+			group.run( [&counter]{ counter.fetch_add( 1, std::memory_order_relaxed ); } );
+		group.wait();
+	} ) };
+	std::cout << "overhead workers " << std::setw( 2 ) << workers << ": " << std::fixed << std::setprecision( 1 ) <<
+			ms * 1.0e6 / jobs << " ns/job" << std::endl;
+}
+
+void bench_nested( const unsigned int workers, const unsigned int jobs ) {
+	job_system js{ workers };
+	const unsigned int fan_out{ 64 };
+	std::atomic<unsigned int> counter{ 0 };
+	const double ms{ best_ms( 5, [&]{
+		job_system::task_group group{ js };
+		for( unsigned int i = 0; i < jobs / fan_out; ++i )
+			group.run( [&group, &counter, fan_out]{
+				for( unsigned int j = 0; j < fan_out; ++j )
+					group.run( [&counter]{ counter.fetch_add( 1, std::memory_order_relaxed ); } );
+			} );
+		group.wait();
+	} ) };
+	std::cout << "nested   workers " << std::setw( 2 ) << workers << ": " << std::fixed << std::setprecision( 1 ) <<
+			ms * 1.0e6 / jobs << " ns/job" << std::endl;
+}
+
+double bench_scaling( const unsigned int workers, const unsigned int elements, const unsigned int grain ) {
+	job_system js{ workers };
+	std::vector<double> out( elements );
+	// 0 workers would mean hardware threads, so the single threaded case runs without the job system
+	const auto body = [&out]( size_t first, size_t last ) {
+		for( size_t i = first; i < last; ++i ) {
+			double v{ (double)i };
+			for( unsigned int k = 0; k < 200; ++k )
+				v = std::sin( v ) + std::sqrt( std::abs( v ) + 1.0 );
+			out[i] = v;
+		}
+	};
+	return best_ms( 3, [&]{
+		if( 0 == workers )
+			body( 0, elements );
+		else
+			js.parallel_for( 0, elements, grain, body );
+	} );
+}
+
+}
+
+int main( int argc, char **argv ) {
+	logbook::set_log_filename( "job_system_bench.log" );
+	unsigned int jobs{ 100000 };
+	unsigned int max_workers{ std::max( 1u, std::thread::hardware_concurrency() ) };
+	unsigned int grain{ 256 };
+	bool args_ok{ true };
+	for( int i = 1; i < argc && args_ok; ++i ) {
+		const std::string a{ argv[i] };
+		const bool has_value{ i + 1 < argc };
+		if( "--jobs" == a && has_value )
+			args_ok = parse_uint( argv[++i], jobs );
+		else if( "--workers" == a && has_value )
+			args_ok = parse_uint( argv[++i], max_workers );
+		else if( "--grain" == a && has_value )
+			args_ok = parse_uint( argv[++i], grain );
+		else
+			args_ok = false;
+	}
+	if( !args_ok || 0 == jobs ) {
+		std::cerr << "Usage: job_system_bench [--jobs n] [--workers max] [--grain n]" << std::endl;
+		return 1;
+	}
+	std::cout << "Hardware threads: " << std::thread::hardware_concurrency() << std::endl;
+	for( unsigned int w = 1; w <= max_workers; w *= 2 ) {
+		bench_overhead( w, jobs );
+		bench_nested( w, jobs );
+	}
+	// Workers plus the waiting thread do the work, so w workers use w + 1 threads.
+	const unsigned int elements{ 1u << 18 };
+	const double single{ bench_scaling( 0, elements, grain ) };
+	std::cout << "scaling  threads  1: " << std::fixed << std::setprecision( 2 ) << single << " ms" << std::endl;
+	std::vector<unsigned int> thread_counts;
+	for( unsigned int t = 2; t < max_workers; t *= 2 )
+		thread_counts.push_back( t );
+	if( max_workers > 1 )
+		thread_counts.push_back( max_workers );
+	for( const unsigned int t : thread_counts ) {
+		const double ms{ bench_scaling( t - 1, elements, grain ) };
+		std::cout << "scaling  threads " << std::setw( 2 ) << t << ": " << ms << " ms, speedup " <<
+				single / ms << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,114 @@
+/* Benchmarks of the logbook.
+ * 	throughput: threads log distinct messages as fast as they can, messages per second until all are written
+ * 	latency:    time spent in log_msg() on the calling thread, percentiles of single calls
+ * 	filtered:   time per LOGBOOK_MSG call below the runtime threshold
+ * Usage:
+ * 	logbook_bench [--messages n] [--threads n]
+ * Results go to stdout, the messages to logbook_bench.log. */
+
+#include "base/logbook.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace orf_n;
+
+namespace {
+
+typedef std::chrono::high_resolution_clock clock_type;
+
+double ns_since( const clock_type::time_point &start ) {
+	return std::chrono::duration<double, std::nano>( clock_type::now() - start ).count();
+}
+
+bool parse_uint( const char *s, unsigned int &value ) {
+	try {
+		value = (unsigned int)std::stoul( s );
+		return true;
+	} catch( const std::exception & ) {
+		return false;
+	}
+}
+
+void bench_throughput( const unsigned int threads, const unsigned int messages ) {
+	const clock_type::time_point start{ clock_type::now() };
+	std::vector<std::thread> workers;
+	for( unsigned int t = 0; t < threads; ++t )
+		workers.emplace_back( [t, messages]{
+			for( unsigned int i = 0; i < messages; ++i )
+				// Warnings wait for space in the ring instead of being dropped.
+				logbook::log_msg( logbook::ANY, logbook::WARNING,
+						"Thread " + std::to_string( t ) + " message " + std::to_string( i ) );
+		} );
+	for( std::thread &w : workers )
+		w.join();
+	logbook::flush();
+	const double seconds{ ns_since( start ) * 1.0e-9 };
+	std::cout << "throughput threads " << std::setw( 2 ) << threads << ": " << std::fixed << std::setprecision( 0 ) <<
+			threads * messages / seconds << " messages/s" << std::endl;
+}
+
+void bench_latency( const unsigned int messages ) {
+	std::vector<double> samples( messages );
+	const std::string text{ "Latency test message with a typical length for this application's log." };
+	for( unsigned int i = 0; i < messages; ++i ) {
+		const clock_type::time_point start{ clock_type::now() };
+		logbook::log_msg( logbook::ANY, logbook::INFO, text );
+		samples[i] = ns_since( start );
+		// Let the background thread keep up, this is about single calls.
+		if( 0 == i % 1024 )
+			logbook::flush();
+	}
+	logbook::flush();
+	std::sort( samples.begin(), samples.end() );
+	const auto percentile = [&samples]( const double p ) {
+		return samples[std::min( samples.size() - 1, (size_t)( p * (double)samples.size() ) )];
+	};
+	std::cout << "latency: " << std::fixed << std::setprecision( 0 ) << "p50 " << percentile( 0.5 ) <<
+			" ns, p99 " << percentile( 0.99 ) << " ns, max " << samples.back() << " ns" << std::endl;
+}
+
+void bench_filtered( const unsigned int messages ) {
+	logbook::set_min_severity( logbook::WARNING );
+	const clock_type::time_point start{ clock_type::now() };
+	for( unsigned int i = 0; i < messages; ++i )
+		LOGBOOK_MSG( logbook::ANY, logbook::INFO, "Filtered message " + std::to_string( i ) );
+	const double ns{ ns_since( start ) };
+	logbook::set_min_severity( logbook::LOG );
+	std::cout << "filtered: " << std::fixed << std::setprecision( 1 ) << ns / messages << " ns/call" << std::endl;
+}
+
+}
+
+int main( int argc, char **argv ) {
+	unsigned int messages{ 200000 };
+	unsigned int max_threads{ std::max( 1u, std::thread::hardware_concurrency() ) };
+	bool args_ok{ true };
+	for( int i = 1; i < argc && args_ok; ++i ) {
+		const std::string a{ argv[i] };
+		const bool has_value{ i + 1 < argc };
+		if( "--messages" == a && has_value )
+			args_ok = parse_uint( argv[++i], messages );
+		else if( "--threads" == a && has_value )
+			args_ok = parse_uint( argv[++i], max_threads );
+		else
+			args_ok = false;
+	}
+	if( !args_ok || 0 == messages || 0 == max_threads ) {
+		std::cerr << "Usage: logbook_bench [--messages n] [--threads n]" << std::endl;
+		return 1;
+	}
+	logbook::set_log_filename( "logbook_bench.log" );
+	logbook::set_console_output( false );
+	// Distinct messages, no rate limit
+	logbook::set_frame_limit( 0 );
+	for( unsigned int t = 1; t <= max_threads; t *= 2 )
+		bench_throughput( t, messages / t );
+	bench_latency( messages );
+	bench_filtered( messages );
+	return 0;
+}
@@ -0,0 +1,81 @@
+
+#include "dynamic_resolution.h"
+#include <algorithm>
+#include <cmath>
+
+namespace orf_n {
+
+dynamic_resolution::dynamic_resolution( const double target_ms, const float min_scale, const float max_scale ) :
+		m_target_ms{ target_ms }, m_min_scale{ min_scale }, m_max_scale{ max_scale }, m_scale{ max_scale } {
+	glCreateQueries( GL_TIMESTAMP, 2 * RING_SIZE, &m_queries[0][0] );
+}
+
+dynamic_resolution::~dynamic_resolution() {
+	glDeleteQueries( 2 * RING_SIZE, &m_queries[0][0] );
+}
+
+void dynamic_resolution::begin_frame() {
+	// If the oldest query isn't through after a full ring, this frame goes unmeasured.
+	if( !m_pending[m_slot] )
+		glQueryCounter( m_queries[m_slot][0], GL_TIMESTAMP );
+}
+
+void dynamic_resolution::end_frame() {
+	if( !m_pending[m_slot] ) {
+		glQueryCounter( m_queries[m_slot][1], GL_TIMESTAMP );
+		m_pending[m_slot] = true;
+	}
+	m_slot = ( m_slot + 1 ) % RING_SIZE;
+	for( unsigned int i = 0; i < RING_SIZE; ++i ) {
+		const unsigned int slot{ ( m_slot + i ) % RING_SIZE };
+		if( !m_pending[slot] )
+			continue;
+		GLint available{ GL_FALSE };
+		glGetQueryObjectiv( m_queries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available );
+		// Results come in order
+		if( GL_TRUE != available )
+			break;
+		GLuint64 start{ 0 }, end{ 0 };
+		glGetQueryObjectui64v( m_queries[slot][0], GL_QUERY_RESULT, &start );
+		glGetQueryObjectui64v( m_queries[slot][1], GL_QUERY_RESULT, &end );
+		m_pending[slot] = false;
+		const double ms{ (double)( end - start ) * 1.0e-6 };
+		m_gpu_ms = 0 == m_samples++ ? ms : m_gpu_ms + ( ms - m_gpu_ms ) * 0.1;
+		adjust();
+	}
+}
+
+void dynamic_resolution::adjust() {
+	m_frames_over = m_gpu_ms > m_target_ms * 1.05 ? m_frames_over + 1 : 0;
+	m_frames_under = m_gpu_ms < m_target_ms * 0.85 ? m_frames_under + 1 : 0;
+	if( m_frames_over < SETTLE_FRAMES && m_frames_under < SETTLE_FRAMES )
+		return;
+	const float wanted{ m_scale * (float)std::sqrt( m_target_ms / std::max( m_gpu_ms, 0.01 ) ) };
+	float scale{ std::round( wanted / SCALE_STEP ) * SCALE_STEP };
+	// At least one step towards the target
+	if( m_frames_over > 0 )
+		scale = std::min( scale, m_scale - SCALE_STEP );
+	else
+		scale = std::max( scale, m_scale + SCALE_STEP );
+	scale = std::clamp( scale, m_min_scale, m_max_scale );
+	if( scale != m_scale ) {
+		m_scale = scale;
+		// The smoothed time was measured at the old scale
+		m_samples = 0;
+	}
+	m_frames_over = m_frames_under = 0;
+}
+
+float dynamic_resolution::get_scale() const {
+	return m_scale;
+}
+
+double dynamic_resolution::get_gpu_ms() const {
+	return m_gpu_ms;
+}
+
+double dynamic_resolution::get_target_ms() const {
+	return m_target_ms;
+}
+
+}
@@ -0,0 +1,54 @@
+/* Scales the resolution the scene is rendered at so that its GPU time stays near a target.
+ * The time between begin_frame() and end_frame() is measured with timestamp queries from a small
+ * ring, which don't collide with the profiler's elapsed time queries and are read frames later
+ * when they are available, without waiting. Since the cost goes with the number of pixels, the
+ * scale follows the square root of target over measured time. It changes in steps of SCALE_STEP
+ * and only after some frames outside a band around the target, so targets aren't resized often. */
+
+#pragma once
+
+#include "glad/glad.h"
+
+namespace orf_n {
+
+class dynamic_resolution {
+public:
+	static constexpr float SCALE_STEP{ 0.05f };
+
+	dynamic_resolution( const double target_ms, const float min_scale = 0.5f, const float max_scale = 1.0f );
+	virtual ~dynamic_resolution();
+	dynamic_resolution( const dynamic_resolution &other ) = delete;
+	dynamic_resolution &operator=( const dynamic_resolution &other ) = delete;
+
+	void begin_frame();
+	// Reads finished queries and adjusts the scale.
+	void end_frame();
+
+	// Of width and height
+	float get_scale() const;
+	// Smoothed GPU time of the frames measured so far
+	double get_gpu_ms() const;
+	double get_target_ms() const;
+
+private:
+	static const unsigned int RING_SIZE{ 4 };
+	// Frames outside of the band before the scale changes
+	static const unsigned int SETTLE_FRAMES{ 10 };
+
+	GLuint m_queries[RING_SIZE][2];
+	bool m_pending[RING_SIZE]{ false };
+	unsigned int m_slot{ 0 };
+	double m_target_ms;
+	float m_min_scale;
+	float m_max_scale;
+	float m_scale;
+	double m_gpu_ms{ 0.0 };
+	unsigned int m_samples{ 0 };
+	unsigned int m_frames_over{ 0 };
+	unsigned int m_frames_under{ 0 };
+
+	void adjust();
+
+};
+
+}
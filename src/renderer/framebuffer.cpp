@@ -30,18 +30,22 @@ framebuffer::~framebuffer() {
 }
 
 void framebuffer::addColorAttachment( const GLenum colorFormat, GLenum attachmentPoint ) {
+	m_colorFormat = colorFormat;
 	glCreateRenderbuffers( 1, &m_colorAttachment );
 	if( GL_TRUE != glIsRenderbuffer( m_colorAttachment ) )
 		logbook::log_msg( logbook::RENDERER, logbook::ERROR, "Error creating color renderbuffer" );
 	glNamedRenderbufferStorage( m_colorAttachment, colorFormat, m_sizeX, m_sizeY );
+	m_color_memory.set( memory_tracker::texture_bytes( colorFormat, m_sizeX, m_sizeY ) );
 	glNamedFramebufferRenderbuffer( m_framebuffer, attachmentPoint, GL_RENDERBUFFER, m_colorAttachment );
 }
 
 void framebuffer::addDepthAttachment( const GLenum depthFormat ) {
+	m_depthFormat = depthFormat;
 	glCreateRenderbuffers( 1, &m_depthAttachment );
 	if( GL_TRUE != glIsRenderbuffer( m_depthAttachment ) )
 		logbook::log_msg( logbook::RENDERER, logbook::ERROR, "Error creating depth renderbuffer" );
 	glNamedRenderbufferStorage( m_depthAttachment, depthFormat, m_sizeX, m_sizeY );
+	m_depth_memory.set( memory_tracker::texture_bytes( depthFormat, m_sizeX, m_sizeY ) );
 	glNamedFramebufferRenderbuffer( m_framebuffer, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depthAttachment );
 	/*glTextureParameteri( m_depthAttachment, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
 	glTextureParameteri( m_depthAttachment, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
@@ -74,6 +78,14 @@ void framebuffer::resize( const unsigned int x, const unsigned int y ) {
 	}
 }
 
+unsigned int framebuffer::getSizeX() const {
+	return m_sizeX;
+}
+
+unsigned int framebuffer::getSizeY() const {
+	return m_sizeY;
+}
+
 void framebuffer::clear( const color_t &clearColor ) const {
 	glClearColor( clearColor.x, clearColor.y, clearColor.z, clearColor.w );
 	glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
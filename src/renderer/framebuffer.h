@@ -3,6 +3,7 @@
 
 #include "color.h"
 #include "glad/glad.h"
+#include "base/memory_tracker.h"
 
 namespace orf_n {
 
@@ -20,6 +21,10 @@ public:
 
 	void resize( const unsigned int x, const unsigned int y );
 
+	unsigned int getSizeX() const;
+
+	unsigned int getSizeY() const;
+
 	bool isComplete() const;
 
 	/**
@@ -44,6 +49,10 @@ private:
 
 	GLuint m_stencilAttachment{ 0 };
 
+	memory_tracker::tracked_memory m_color_memory{ memory_tracker::RENDERER, memory_tracker::GPU };
+
+	memory_tracker::tracked_memory m_depth_memory{ memory_tracker::RENDERER, memory_tracker::GPU };
+
 };
 
 }
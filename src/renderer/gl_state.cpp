@@ -0,0 +1,133 @@
+
+#include "gl_state.h"
+
+namespace orf_n {
+
+const GLenum gl_state::CAPABILITIES[NUMBER_OF_CAPABILITIES]{
+	GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND, GL_SCISSOR_TEST, GL_FRAMEBUFFER_SRGB, GL_TEXTURE_CUBE_MAP_SEAMLESS
+};
+
+// static
+gl_state &gl_state::get_instance() {
+	static gl_state instance;
+	return instance;
+}
+
+gl_state::gl_state() {
+	invalidate();
+}
+
+gl_state::~gl_state() {}
+
+bool gl_state::change( GLuint &shadow, const GLuint value ) {
+	if( shadow == value ) {
+		++m_avoided_calls;
+		return false;
+	}
+	shadow = value;
+	++m_calls;
+	return true;
+}
+
+void gl_state::use_program( const GLuint program ) {
+	if( change( m_program, program ) )
+		glUseProgram( program );
+}
+
+void gl_state::bind_vertex_array( const GLuint vertex_array ) {
+	if( change( m_vertex_array, vertex_array ) )
+		glBindVertexArray( vertex_array );
+}
+
+void gl_state::bind_texture_unit( const GLuint unit, const GLuint texture ) {
+	if( unit >= NUMBER_OF_TEXTURE_UNITS || change( m_textures[unit], texture ) )
+		glBindTextureUnit( unit, texture );
+}
+
+void gl_state::set_capability( const GLenum capability, const bool enabled ) {
+	for( unsigned int i = 0; i < NUMBER_OF_CAPABILITIES; ++i )
+		if( CAPABILITIES[i] == capability ) {
+			if( !change( m_capabilities[i], enabled ? 1 : 0 ) )
+				return;
+			break;
+		}
+	if( enabled )
+		glEnable( capability );
+	else
+		glDisable( capability );
+}
+
+void gl_state::enable( const GLenum capability ) {
+	set_capability( capability, true );
+}
+
+void gl_state::disable( const GLenum capability ) {
+	set_capability( capability, false );
+}
+
+void gl_state::depth_func( const GLenum func ) {
+	if( change( m_depth_func, func ) )
+		glDepthFunc( func );
+}
+
+void gl_state::depth_mask( const GLboolean mask ) {
+	if( change( m_depth_mask, mask ) )
+		glDepthMask( mask );
+}
+
+void gl_state::blend_equation( const GLenum mode ) {
+	if( change( m_blend_equation, mode ) )
+		glBlendEquation( mode );
+}
+
+void gl_state::blend_func( const GLenum source, const GLenum destination ) {
+	if( m_blend_source == source && m_blend_destination == destination ) {
+		++m_avoided_calls;
+		return;
+	}
+	m_blend_source = source;
+	m_blend_destination = destination;
+	++m_calls;
+	glBlendFunc( source, destination );
+}
+
+void gl_state::deleted_program( const GLuint program ) {
+	if( m_program == program )
+		m_program = UNKNOWN;
+}
+
+void gl_state::deleted_vertex_array( const GLuint vertex_array ) {
+	if( m_vertex_array == vertex_array )
+		m_vertex_array = UNKNOWN;
+}
+
+void gl_state::deleted_texture( const GLuint texture ) {
+	for( GLuint &t : m_textures )
+		if( t == texture )
+			t = UNKNOWN;
+}
+
+void gl_state::invalidate() {
+	m_program = m_vertex_array = UNKNOWN;
+	for( GLuint &t : m_textures )
+		t = UNKNOWN;
+	for( GLuint &c : m_capabilities )
+		c = UNKNOWN;
+	m_depth_func = m_depth_mask = m_blend_equation = m_blend_source = m_blend_destination = UNKNOWN;
+}
+
+void gl_state::new_frame() {
+	m_frame_calls = m_calls;
+	m_frame_avoided_calls = m_avoided_calls;
+	m_calls = m_avoided_calls = 0;
+}
+
+unsigned int gl_state::get_frame_calls() const {
+	return m_frame_calls;
+}
+
+unsigned int gl_state::get_frame_avoided_calls() const {
+	return m_frame_avoided_calls;
+}
+
+}
@@ -0,0 +1,73 @@
+/* Shadow of the GL state that is set over and over: the program in use, the vertex array, the
+ * texture of each unit, a few capabilities and depth and blend functions. A call that would set
+ * what is already set is not passed to GL, only counted. The shadow is only right if all changes
+ * of this state go through here; invalidate() forgets it after foreign code has touched it.
+ * GL unbinds deleted objects and hands out their names again, so deletions must be reported.
+ * Untracked capabilities and texture units are passed through. GL context thread only. */
+
+#pragma once
+
+#include "glad/glad.h"
+
+namespace orf_n {
+
+class gl_state {
+public:
+	static gl_state &get_instance();
+
+	void use_program( const GLuint program );
+	void bind_vertex_array( const GLuint vertex_array );
+	void bind_texture_unit( const GLuint unit, const GLuint texture );
+	void enable( const GLenum capability );
+	void disable( const GLenum capability );
+	void depth_func( const GLenum func );
+	void depth_mask( const GLboolean mask );
+	void blend_equation( const GLenum mode );
+	void blend_func( const GLenum source, const GLenum destination );
+
+	void deleted_program( const GLuint program );
+	void deleted_vertex_array( const GLuint vertex_array );
+	void deleted_texture( const GLuint texture );
+
+	// Everything is unknown, the next calls go to GL.
+	void invalidate();
+
+	// At the start of a frame. Makes the last frame's counts available.
+	void new_frame();
+	// Calls passed to GL and calls filtered out during the last frame.
+	unsigned int get_frame_calls() const;
+	unsigned int get_frame_avoided_calls() const;
+
+private:
+	static const GLuint UNKNOWN{ 0xffffffff };
+	static const unsigned int NUMBER_OF_TEXTURE_UNITS{ 32 };
+	static const unsigned int NUMBER_OF_CAPABILITIES{ 6 };
+	static const GLenum CAPABILITIES[NUMBER_OF_CAPABILITIES];
+
+	gl_state();
+	virtual ~gl_state();
+	gl_state( const gl_state &other ) = delete;
+	gl_state &operator=( const gl_state &other ) = delete;
+
+	GLuint m_program;
+	GLuint m_vertex_array;
+	GLuint m_textures[NUMBER_OF_TEXTURE_UNITS];
+	// 0 disabled, 1 enabled, else unknown
+	GLuint m_capabilities[NUMBER_OF_CAPABILITIES];
+	GLuint m_depth_func;
+	GLuint m_depth_mask;
+	GLuint m_blend_equation;
+	GLuint m_blend_source;
+	GLuint m_blend_destination;
+	unsigned int m_calls{ 0 };
+	unsigned int m_avoided_calls{ 0 };
+	unsigned int m_frame_calls{ 0 };
+	unsigned int m_frame_avoided_calls{ 0 };
+
+	// Counts and returns true if value is to be set.
+	bool change( GLuint &shadow, const GLuint value );
+	void set_capability( const GLenum capability, const bool enabled );
+
+};
+
+}
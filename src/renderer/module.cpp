@@ -9,24 +9,21 @@ namespace orf_n {
 
 module::module( const GLenum stage, const std::string &filename ) :
 		m_filename( filename ), m_stage( stage ), m_is_shader( false ) {
-	std::vector<GLchar> source=load_shader_source( m_filename );
-	if( !source.empty() ) {
-		m_shader = glCreateShader( stage );
-		const GLchar *x{ source.data() };
-		if( compile_shader( &x ) )
-			m_is_shader = true;
-	} else
+	m_source = load_shader_source( m_filename );
+	if( m_source.empty() ) {
 		logbook::log_msg(logbook::SHADER, logbook::ERROR, "Shader '"+m_filename+"' not loaded.");
+		m_compiled = true;
+	}
 }
 
 module::module( const GLenum stage, const char** shader_source ) : m_stage{stage} {
-	m_shader = glCreateShader( stage );
-	if( compile_shader( shader_source ) )
-		m_is_shader = true;
+	const std::string source{ shader_source[0] };
+	m_source.assign( source.begin(), source.end() );
+	m_source.push_back( '\0' );
 }
 
 module::module( const GLenum stage, const GLuint shader ) :
-		m_shader{shader}, m_stage{stage} {
+		m_shader{shader}, m_stage{stage}, m_compiled{true} {
 	m_is_shader = glIsShader( shader ) ? true : false;
 }
 
@@ -36,10 +33,12 @@ module::~module() {
 }
 
 GLuint module::get_shader() const {
+	compile();
 	return m_shader;
 }
 
 bool module::is_shader() const {
+	compile();
 	return m_is_shader;
 }
 
@@ -47,7 +46,24 @@ const std::string &module::get_filename() const {
 	return m_filename;
 }
 
-bool module::compile_shader( const char** shader_source ) {
+GLenum module::get_stage() const {
+	return m_stage;
+}
+
+const std::vector<GLchar> &module::get_source() const {
+	return m_source;
+}
+
+void module::compile() const {
+	if( m_compiled )
+		return;
+	m_compiled = true;
+	m_shader = glCreateShader( m_stage );
+	const GLchar *x{ m_source.data() };
+	m_is_shader = compile_shader( &x );
+}
+
+bool module::compile_shader( const char** shader_source ) const {
 	// Source assumed to be null-terminated
 	glShaderSource( m_shader, 1, shader_source, NULL );
 	glCompileShader( m_shader );
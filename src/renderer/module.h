@@ -12,7 +12,9 @@ public:
 	/* In the following order:
 	 * GL_VERTEX_SHADER, GL_TESS_CONTROL_SHADER, GL_TESS_EVALUATION_SHADER,
 	 * GL_GEOMETRY_SHADER, or GL_FRAGMENT_SHADER, GL_COMPUTE_SHADER
-	 * @param filename Pathname to shader. */
+	 * @param filename Pathname to shader.
+	 * Modules with a source are compiled when the shader is first asked for, so a program loaded
+	 * from the program cache doesn't compile them at all. */
 	module( const GLenum stage, const std::string &filename );
 
 	module( const GLenum stage, const char** shader_source );
@@ -21,20 +23,30 @@ public:
 
 	virtual ~module();
 
+	// Compiles the source at the first call.
 	GLuint get_shader() const;
 
 	bool is_shader() const;
 
 	const std::string &get_filename() const;
 
+	GLenum get_stage() const;
+
+	// Null terminated, empty for modules made from a shader object.
+	const std::vector<GLchar> &get_source() const;
+
 private:
-	GLuint m_shader;
+	mutable GLuint m_shader{ 0 };
 
 	std::string m_filename;
 
 	GLenum m_stage;
 
-	bool m_is_shader;
+	mutable bool m_is_shader{ false };
+
+	std::vector<GLchar> m_source;
+
+	mutable bool m_compiled{ false };
 
 	// Load a single standard glsl shader source file
 	static std::vector<GLchar> load_shader_source( const std::string& filename );
@@ -44,7 +56,9 @@ private:
 	// Do not set clear_code to false if you don't want the code of the last loaded file.
 	static std::vector<GLchar> parse_shader_source_file( const std::string& filename, bool clear_code = true );
 
-	bool compile_shader( const char** shader_source );
+	bool compile_shader( const char** shader_source ) const;
+
+	void compile() const;
 
 };
 
@@ -0,0 +1,285 @@
+
+#include "profiler.h"
+#include "base/logbook.h"
+#include "imgui/imgui.h"
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+
+namespace orf_n {
+
+// Small ids for the trace instead of std::thread::id
+static std::atomic<unsigned int> s_next_thread{ 0 };
+static thread_local const unsigned int t_thread{ s_next_thread.fetch_add( 1 ) };
+// Track of the GPU scopes in the trace
+static const unsigned int GPU_TRACK{ 1000 };
+static const unsigned int HISTOGRAM_BINS{ 16 };
+static const char *SECTION_TYPE_NAMES[]{ "CPU", "GPU", "CNT" };
+static const char *SECTION_KEY_PREFIXES[]{ "cpu:", "gpu:", "count:" };
+
+profiler::cpu_scope::cpu_scope( const char *name ) :
+		m_name{ name }, m_start{ profiler::get_instance().now_ns() } {}
+
+profiler::cpu_scope::~cpu_scope() {
+	profiler &p{ profiler::get_instance() };
+	p.record_cpu( m_name, m_start, p.now_ns() );
+}
+
+profiler::gpu_scope::gpu_scope( const char *name ) {
+	profiler &p{ profiler::get_instance() };
+	std::lock_guard<std::mutex> lock{ p.m_mutex };
+	if( p.m_gpu_scope_open )
+		return;
+	p.begin_gpu( name );
+	m_active = true;
+}
+
+profiler::gpu_scope::~gpu_scope() {
+	if( !m_active )
+		return;
+	profiler &p{ profiler::get_instance() };
+	std::lock_guard<std::mutex> lock{ p.m_mutex };
+	p.end_gpu();
+}
+
+// static
+profiler &profiler::get_instance() {
+	static profiler instance;
+	return instance;
+}
+
+profiler::profiler() {}
+
+profiler::~profiler() {}
+
+void profiler::begin_frame() {
+	std::lock_guard<std::mutex> lock{ m_mutex };
+	++m_frame;
+	m_frame_start = now_ns();
+	read_gpu_results( false );
+}
+
+void profiler::end_frame() {
+	const int64_t end{ now_ns() };
+	record_cpu( "frame", m_frame_start, end );
+	std::lock_guard<std::mutex> lock{ m_mutex };
+	for( section &s : m_sections )
+		if( GPU != s.type ) {
+			push_history( s, (float)s.frame_ms );
+			s.frame_ms = 0.0;
+		}
+	// The last captured frame's GPU results are surely in after a full ring.
+	if( m_capturing && m_frame >= m_capture_last + GPU_QUERY_RING ) {
+		read_gpu_results( true );
+		write_capture();
+		m_capturing = false;
+		m_events.clear();
+	}
+}
+
+void profiler::cleanup() {
+	std::lock_guard<std::mutex> lock{ m_mutex };
+	for( section &s : m_sections )
+		for( unsigned int i = 0; i < GPU_QUERY_RING; ++i ) {
+			if( 0 != s.queries[i] )
+				glDeleteQueries( 1, &s.queries[i] );
+			s.queries[i] = 0;
+			s.pending[i] = false;
+		}
+	m_gpu_scope_open = false;
+}
+
+void profiler::draw_ui() {
+	std::lock_guard<std::mutex> lock{ m_mutex };
+	ImGui::Begin( "Profiler" );
+	ImGui::Text( "Last %d frames, avg/min/max, times in ms", HISTORY );
+	for( size_t i = 0; i < m_sections.size(); ++i ) {
+		const section &s{ m_sections[i] };
+		float avg{ 0.0f }, min{ FLT_MAX }, max{ 0.0f };
+		for( unsigned int j = 0; j < s.history_count; ++j ) {
+			avg += s.history[j];
+			min = std::min( min, s.history[j] );
+			max = std::max( max, s.history[j] );
+		}
+		if( s.history_count > 0 )
+			avg /= (float)s.history_count;
+		else
+			min = 0.0f;
+		char label[128];
+		snprintf( label, sizeof( label ), "%s %-16s %7.3f %7.3f %7.3f", SECTION_TYPE_NAMES[s.type], s.name, avg, min, max );
+		if( ImGui::Selectable( label, (int)i == m_selected_section ) )
+			m_selected_section = (int)i;
+	}
+	if( m_selected_section < (int)m_sections.size() ) {
+		const section &s{ m_sections[m_selected_section] };
+		float min{ FLT_MAX }, max{ 0.0f };
+		for( unsigned int j = 0; j < s.history_count; ++j ) {
+			min = std::min( min, s.history[j] );
+			max = std::max( max, s.history[j] );
+		}
+		ImGui::PlotLines( COUNTER == s.type ? "" : "ms", s.history, HISTORY, (int)s.history_index, s.name, 0.0f, max * 1.1f, ImVec2{ 0.0f, 60.0f } );
+		// Distribution of the frames over min..max
+		float bins[HISTOGRAM_BINS]{};
+		const float range{ std::max( max - min, 1.0e-6f ) };
+		for( unsigned int j = 0; j < s.history_count; ++j )
+			bins[std::min( HISTOGRAM_BINS - 1, (unsigned int)( ( s.history[j] - min ) / range * HISTOGRAM_BINS ) )] += 1.0f;
+		ImGui::PlotHistogram( "frames", bins, HISTOGRAM_BINS, 0, nullptr, 0.0f, FLT_MAX, ImVec2{ 0.0f, 60.0f } );
+		if( s.history_count > 0 )
+			ImGui::Text( COUNTER == s.type ? "%.0f .. %.0f" : "%.3f .. %.3f ms", min, max );
+	}
+	ImGui::Separator();
+	ImGui::SliderInt( "Frames", &m_capture_frames, 1, 300 );
+	if( m_capturing )
+		ImGui::Text( "Capturing to %s", m_capture_filename.c_str() );
+	else if( ImGui::Button( "Capture trace" ) )
+		start_capture( "profile_" + std::to_string( m_frame ) + ".json", (unsigned int)m_capture_frames );
+	ImGui::End();
+}
+
+void profiler::capture( const std::string &filename, const unsigned int frames ) {
+	std::lock_guard<std::mutex> lock{ m_mutex };
+	if( m_capturing ) {
+		logbook::log_msg( logbook::RENDERER, logbook::WARNING, "Profiler already capturing." );
+		return;
+	}
+	start_capture( filename, frames );
+}
+
+bool profiler::is_capturing() const {
+	return m_capturing;
+}
+
+void profiler::set_counter( const char *name, const double value ) {
+	std::lock_guard<std::mutex> lock{ m_mutex };
+	get_section( name, COUNTER ).frame_ms = value;
+}
+
+void profiler::get_last_values( std::vector<std::pair<std::string, double>> &values ) {
+	std::lock_guard<std::mutex> lock{ m_mutex };
+	values.clear();
+	for( const section &s : m_sections )
+		if( s.history_count > 0 )
+			values.emplace_back( std::string{ SECTION_KEY_PREFIXES[s.type] } + s.name,
+					(double)s.history[( s.history_index + HISTORY - 1 ) % HISTORY] );
+}
+
+int64_t profiler::now_ns() const {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - m_epoch ).count();
+}
+
+profiler::section &profiler::get_section( const char *name, const section_type type ) {
+	const auto n{ m_name_index[type].find( name ) };
+	if( n != m_name_index[type].end() )
+		return m_sections[n->second];
+	// Equal names may come with different pointers
+	const std::string key{ std::string{ SECTION_KEY_PREFIXES[type] } + name };
+	const auto i{ m_section_index.find( key ) };
+	if( i != m_section_index.end() ) {
+		m_name_index[type][name] = i->second;
+		return m_sections[i->second];
+	}
+	m_name_index[type][name] = m_sections.size();
+	m_section_index[key] = m_sections.size();
+	m_sections.emplace_back();
+	m_sections.back().name = name;
+	m_sections.back().type = type;
+	return m_sections.back();
+}
+
+void profiler::start_capture( const std::string &filename, const unsigned int frames ) {
+	m_capture_filename = filename;
+	m_capture_first = m_frame + 1;
+	m_capture_last = m_frame + std::max( frames, 1u );
+	m_capturing = true;
+	m_events.clear();
+}
+
+bool profiler::in_capture( const uint64_t frame ) const {
+	return m_capturing && frame >= m_capture_first && frame <= m_capture_last;
+}
+
+void profiler::record_cpu( const char *name, const int64_t start, const int64_t end ) {
+	std::lock_guard<std::mutex> lock{ m_mutex };
+	get_section( name, CPU ).frame_ms += (double)( end - start ) * 1.0e-6;
+	if( in_capture( m_frame ) )
+		m_events.push_back( event{ name, false, t_thread, start, end - start } );
+}
+
+void profiler::begin_gpu( const char *name ) {
+	const unsigned int slot{ (unsigned int)( m_frame % GPU_QUERY_RING ) };
+	section &s{ get_section( name, GPU ) };
+	if( s.pending[slot] ) {
+		// Still not read after a full ring, or the pass ran twice this frame
+		GLuint64 ns{ 0 };
+		glGetQueryObjectui64v( s.queries[slot], GL_QUERY_RESULT, &ns );
+		push_history( s, (float)( (double)ns * 1.0e-6 ) );
+		s.pending[slot] = false;
+	}
+	if( 0 == s.queries[slot] )
+		glCreateQueries( GL_TIME_ELAPSED, 1, &s.queries[slot] );
+	glBeginQuery( GL_TIME_ELAPSED, s.queries[slot] );
+	s.pending[slot] = true;
+	s.query_frame[slot] = m_frame;
+	s.query_cpu_start[slot] = now_ns();
+	m_gpu_section = (size_t)( &s - m_sections.data() );
+	m_gpu_slot = slot;
+	m_gpu_scope_open = true;
+}
+
+void profiler::end_gpu() {
+	glEndQuery( GL_TIME_ELAPSED );
+	m_gpu_scope_open = false;
+}
+
+void profiler::read_gpu_results( const bool wait ) {
+	for( section &s : m_sections ) {
+		if( GPU != s.type )
+			continue;
+		for( unsigned int i = 0; i < GPU_QUERY_RING; ++i ) {
+			if( !s.pending[i] || ( m_gpu_scope_open && &s == &m_sections[m_gpu_section] && i == m_gpu_slot ) )
+				continue;
+			GLint available{ GL_TRUE };
+			if( !wait )
+				glGetQueryObjectiv( s.queries[i], GL_QUERY_RESULT_AVAILABLE, &available );
+			if( GL_TRUE != available )
+				continue;
+			GLuint64 ns{ 0 };
+			glGetQueryObjectui64v( s.queries[i], GL_QUERY_RESULT, &ns );
+			s.pending[i] = false;
+			push_history( s, (float)( (double)ns * 1.0e-6 ) );
+			if( in_capture( s.query_frame[i] ) )
+				m_events.push_back( event{ s.name, true, GPU_TRACK, s.query_cpu_start[i], (int64_t)ns } );
+		}
+	}
+}
+
+// static
+void profiler::push_history( section &s, const float ms ) {
+	s.history[s.history_index] = ms;
+	s.history_index = ( s.history_index + 1 ) % HISTORY;
+	s.history_count = std::min( s.history_count + 1, HISTORY );
+}
+
+void profiler::write_capture() {
+	std::ofstream out{ m_capture_filename };
+	if( !out.is_open() ) {
+		logbook::log_msg( logbook::RENDERER, logbook::ERROR, "Could not write profile capture " + m_capture_filename );
+		return;
+	}
+	// Chrome trace event format, complete events with microsecond times
+	out << std::fixed << std::setprecision( 3 );
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << GPU_TRACK << ",\"args\":{\"name\":\"GPU\"}}";
+	for( const event &e : m_events )
+		out << ",\n{\"name\":\"" << e.name << "\",\"cat\":\"" << ( e.gpu ? "gpu" : "cpu" ) <<
+				"\",\"ph\":\"X\",\"pid\":0,\"tid\":" << e.thread << ",\"ts\":" << (double)e.start_ns * 1.0e-3 <<
+				",\"dur\":" << (double)e.duration_ns * 1.0e-3 << '}';
+	out << "\n]}\n";
+	logbook::log_msg( logbook::RENDERER, logbook::INFO, "Profile of frames " + std::to_string( m_capture_first ) +
+			".." + std::to_string( m_capture_last ) + " written to " + m_capture_filename );
+}
+
+}
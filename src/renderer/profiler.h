@@ -0,0 +1,141 @@
+
+/* Frame profiler. CPU scopes may be timed on any thread, their times are summed per frame and name.
+ * GPU scopes time a pass with a GL_TIME_ELAPSED query from a small ring per pass, results are read
+ * a few frames later when they are available, without stalling. Only one GPU scope can be open at
+ * a time, nested ones are ignored. Statistics of the last frames are shown in an ImGui window.
+ * A capture writes the scopes of some frames in Chrome's trace event format (chrome://tracing,
+ * ui.perfetto.dev). GPU scopes appear there on their own track at the CPU time they were issued.
+ * Counters are per frame values like node counts, kept and shown like the timed sections. */
+
+#pragma once
+
+#include "glad/glad.h"
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Times the rest of the enclosing block.
+#define PROFILE_CPU_SCOPE( name ) orf_n::profiler::cpu_scope PROFILE_CONCAT( profile_cpu_, __LINE__ ){ name }
+#define PROFILE_GPU_SCOPE( name ) orf_n::profiler::gpu_scope PROFILE_CONCAT( profile_gpu_, __LINE__ ){ name }
+#define PROFILE_CONCAT( a, b ) PROFILE_CONCAT_INNER( a, b )
+#define PROFILE_CONCAT_INNER( a, b ) a##b
+
+namespace orf_n {
+
+class profiler {
+public:
+	// Frames kept for statistics
+	static constexpr unsigned int HISTORY{ 128 };
+	// Queries in flight per GPU pass
+	static constexpr unsigned int GPU_QUERY_RING{ 4 };
+
+	// Name must be a string literal or otherwise outlive the profiler.
+	class cpu_scope {
+	public:
+		explicit cpu_scope( const char *name );
+		~cpu_scope();
+	private:
+		const char *m_name;
+		int64_t m_start;
+	};
+
+	// Main thread with a current GL context only.
+	class gpu_scope {
+	public:
+		explicit gpu_scope( const char *name );
+		~gpu_scope();
+	private:
+		bool m_active{ false };
+	};
+
+	static profiler &get_instance();
+
+	virtual ~profiler();
+	profiler( const profiler &other ) = delete;
+	profiler &operator=( const profiler &other ) = delete;
+
+	// Call at the start and the end of every frame on the main thread.
+	void begin_frame();
+	void end_frame();
+	// Deletes the GL queries, call while the context is current.
+	void cleanup();
+	void draw_ui();
+	// Records the next frames and writes them to filename when their GPU results are in.
+	void capture( const std::string &filename, const unsigned int frames );
+	bool is_capturing() const;
+	// Value of the current frame, the last one set wins. Name as for scopes.
+	void set_counter( const char *name, const double value );
+	/* Latest value of every section, as "cpu:name", "gpu:name" or "count:name". Call after end_frame().
+	 * GPU values are those of the newest available query and lag a few frames behind. */
+	void get_last_values( std::vector<std::pair<std::string, double>> &values );
+
+private:
+	typedef enum {
+		CPU = 0, GPU, COUNTER
+	} section_type;
+
+	typedef struct section {
+		const char *name;
+		section_type type{ CPU };
+		// Sum of the current frame for CPU, the value for counters
+		double frame_ms{ 0.0 };
+		float history[HISTORY]{};
+		unsigned int history_index{ 0 };
+		unsigned int history_count{ 0 };
+		GLuint queries[GPU_QUERY_RING]{};
+		bool pending[GPU_QUERY_RING]{};
+		uint64_t query_frame[GPU_QUERY_RING]{};
+		int64_t query_cpu_start[GPU_QUERY_RING]{};
+	} section;
+
+	// Chrome trace "complete" event
+	typedef struct event {
+		const char *name;
+		bool gpu;
+		unsigned int thread;
+		int64_t start_ns;
+		int64_t duration_ns;
+	} event;
+
+	const std::chrono::steady_clock::time_point m_epoch{ std::chrono::steady_clock::now() };
+	std::mutex m_mutex;
+	std::vector<section> m_sections;
+	std::unordered_map<std::string, size_t> m_section_index;
+	// By name pointer per section type, so scopes don't build a key string each time
+	std::unordered_map<const char *, size_t> m_name_index[3];
+	uint64_t m_frame{ 0 };
+	int64_t m_frame_start{ 0 };
+	bool m_gpu_scope_open{ false };
+	unsigned int m_gpu_slot{ 0 };
+	size_t m_gpu_section{ 0 };
+
+	std::string m_capture_filename;
+	uint64_t m_capture_first{ 0 };
+	uint64_t m_capture_last{ 0 };
+	bool m_capturing{ false };
+	std::vector<event> m_events;
+
+	// UI
+	int m_selected_section{ 0 };
+	int m_capture_frames{ 10 };
+
+	profiler();
+	int64_t now_ns() const;
+	// m_mutex must be held
+	section &get_section( const char *name, const section_type type );
+	void start_capture( const std::string &filename, const unsigned int frames );
+	bool in_capture( const uint64_t frame ) const;
+	void record_cpu( const char *name, const int64_t start, const int64_t end );
+	void begin_gpu( const char *name );
+	void end_gpu();
+	void read_gpu_results( const bool wait );
+	static void push_history( section &s, const float ms );
+	void write_capture();
+
+};
+
+}
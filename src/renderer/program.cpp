@@ -1,6 +1,8 @@
 
 #include <base/logbook.h>
+#include <renderer/gl_state.h>
 #include <renderer/program.h>
+#include <renderer/program_cache.h>
 #include <fstream>
 #include <stdexcept>
 #include <sstream>
@@ -19,11 +21,27 @@ program::program( const std::vector<std::shared_ptr<module>> &modules ) {
     	logbook::log_msg( logbook::SHADER, logbook::ERROR, s );
     	throw std::runtime_error( s );
     }
+    // Stages and sources are the cache key. Modules made from shader objects can't be cached.
+    bool cached{ program_cache::is_enabled() };
+    std::string sources;
     for( const std::shared_ptr<module> &m : modules ) {
-        glAttachShader( m_program, m->get_shader() );
-        std::ostringstream s;
+        if( m->get_source().empty() )
+            cached = false;
+        sources += std::to_string( m->get_stage() ) + '\n';
+        sources.append( m->get_source().begin(), m->get_source().end() );
+    }
+    if( cached && program_cache::load( sources, m_program ) ) {
+        logbook::log_msg( logbook::SHADER, logbook::INFO,
+        		"Shader program #" + std::to_string( m_program ) + " loaded from cache. Ready for use." );
+        return;
     }
+    for( const std::shared_ptr<module> &m : modules )
+        glAttachShader( m_program, m->get_shader() );
+    if( cached )
+        glProgramParameteri( m_program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
     link();
+    if( cached )
+        program_cache::store( sources, m_program );
     std::ostringstream s;
     s << "Shader program #" << m_program << " linked. Ready for use.";
     logbook::log_msg( logbook::SHADER, logbook::INFO, s.str() );
@@ -31,6 +49,7 @@ program::program( const std::vector<std::shared_ptr<module>> &modules ) {
 
 program::~program() {
 	glDeleteProgram( m_program );
+	gl_state::get_instance().deleted_program( m_program );
 	logbook::log_msg(
 			logbook::SHADER, logbook::INFO,
 			"Shader program #" + std::to_string( m_program ) + " destroyed."
@@ -42,11 +61,11 @@ GLuint program::get_program() const {
 }
 
 void program::use() const {
-	glUseProgram( m_program );
+	gl_state::get_instance().use_program( m_program );
 }
 
 void program::un_use() const {
-	glUseProgram( 0 );
+	gl_state::get_instance().use_program( 0 );
 }
 
 void program::link() const {
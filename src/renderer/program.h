@@ -11,7 +11,8 @@ namespace orf_n {
 class program {
 public:
 	/* Create a new shaderprogram based on module objects.
-	 * A vector of shared pointers. It is kept as long as the program is alive. */
+	 * A vector of shared pointers. It is kept as long as the program is alive.
+	 * Loaded from the program cache if it has the binary, else linked and stored there. */
 	program( const std::vector<std::shared_ptr<module>> &modules );
 
 	virtual ~program();
@@ -0,0 +1,125 @@
+
+#include "program_cache.h"
+#include "base/logbook.h"
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+namespace orf_n {
+
+namespace program_cache {
+
+namespace {
+
+const uint32_t MAGIC{ 0x50465230 };	// "0RFP"
+
+std::string s_directory{ "shader_cache" };
+unsigned int s_hits{ 0 };
+unsigned int s_misses{ 0 };
+
+// FNV-1a
+uint64_t hash( const char *data, const size_t size, uint64_t h = 0xcbf29ce484222325ull ) {
+	for( size_t i = 0; i < size; ++i ) {
+		h ^= (unsigned char)data[i];
+		h *= 0x100000001b3ull;
+	}
+	return h;
+}
+
+uint64_t hash( const std::string &s, const uint64_t h = 0xcbf29ce484222325ull ) {
+	return hash( s.data(), s.size(), h );
+}
+
+uint64_t driver_hash() {
+	uint64_t h{ 0xcbf29ce484222325ull };
+	for( const GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION } ) {
+		const GLubyte *s{ glGetString( name ) };
+		if( nullptr != s )
+			h = hash( std::string{ (const char *)s } + '\n', h );
+	}
+	return h;
+}
+
+// File named after the hash of driver and sources. The file also holds a second hash of the sources.
+std::string filename( const uint64_t key ) {
+	char name[24];
+	std::snprintf( name, sizeof( name ), "%016llx.bin", (unsigned long long)key );
+	return s_directory + '/' + name;
+}
+
+}
+
+void set_directory( const std::string &directory ) {
+	s_directory = directory;
+}
+
+bool is_enabled() {
+	if( s_directory.empty() )
+		return false;
+	GLint formats{ 0 };
+	glGetIntegerv( GL_NUM_PROGRAM_BINARY_FORMATS, &formats );
+	return formats > 0;
+}
+
+bool load( const std::string &sources, const GLuint program ) {
+	const uint64_t driver{ driver_hash() };
+	std::ifstream file{ filename( hash( sources, driver ) ), std::ios::binary };
+	uint32_t magic{ 0 };
+	uint64_t check{ 0 };
+	GLenum format{ 0 };
+	GLint length{ 0 };
+	if( !file.read( (char *)&magic, sizeof( magic ) ) || !file.read( (char *)&check, sizeof( check ) ) ||
+			!file.read( (char *)&format, sizeof( format ) ) || !file.read( (char *)&length, sizeof( length ) ) ||
+			MAGIC != magic || hash( sources ) != check || length <= 0 ) {
+		++s_misses;
+		return false;
+	}
+	std::vector<char> binary( (size_t)length );
+	if( !file.read( binary.data(), length ) ) {
+		++s_misses;
+		return false;
+	}
+	glProgramBinary( program, format, binary.data(), length );
+	GLint linked{ GL_FALSE };
+	glGetProgramiv( program, GL_LINK_STATUS, &linked );
+	if( GL_TRUE != linked ) {
+		logbook::log_msg( logbook::SHADER, logbook::INFO, "Cached program binary rejected, compiling from source." );
+		++s_misses;
+		return false;
+	}
+	++s_hits;
+	return true;
+}
+
+void store( const std::string &sources, const GLuint program ) {
+	GLint length{ 0 };
+	glGetProgramiv( program, GL_PROGRAM_BINARY_LENGTH, &length );
+	if( length <= 0 )
+		return;
+	std::vector<char> binary( (size_t)length );
+	GLenum format{ 0 };
+	glGetProgramBinary( program, length, &length, &format, binary.data() );
+	std::error_code error;
+	std::filesystem::create_directories( s_directory, error );
+	const std::string name{ filename( hash( sources, driver_hash() ) ) };
+	std::ofstream file{ name, std::ios::binary | std::ios::trunc };
+	const uint64_t check{ hash( sources ) };
+	if( !file.write( (const char *)&MAGIC, sizeof( MAGIC ) ) || !file.write( (const char *)&check, sizeof( check ) ) ||
+			!file.write( (const char *)&format, sizeof( format ) ) || !file.write( (const char *)&length, sizeof( length ) ) ||
+			!file.write( binary.data(), length ) )
+		logbook::log_msg( logbook::SHADER, logbook::WARNING, "Could not write program binary '" + name + "'." );
+}
+
+unsigned int get_hits() {
+	return s_hits;
+}
+
+unsigned int get_misses() {
+	return s_misses;
+}
+
+}
+
+}
@@ -0,0 +1,35 @@
+/* On disk cache of linked program binaries (glGetProgramBinary/glProgramBinary). A program's key is
+ * a hash of its shader stages and sources as handed to the compiler, and of the GL vendor, renderer
+ * and version strings, so a driver update or an edited shader misses. A binary the driver rejects
+ * is counted as a miss and the program is compiled and linked from source as without a cache.
+ * GL context thread only. */
+
+#pragma once
+
+#include "glad/glad.h"
+#include <string>
+
+namespace orf_n {
+
+namespace program_cache {
+
+// Directory the binaries are kept in, created when the first one is stored. Empty disables the cache.
+void set_directory( const std::string &directory );
+
+// False when disabled or the driver has no binary formats.
+bool is_enabled();
+
+/* Loads the binary for sources into program. Returns false on a miss, then the program object
+ * may be linked as usual. */
+bool load( const std::string &sources, const GLuint program );
+
+// Stores the binary of a linked program, which should have been created retrievable.
+void store( const std::string &sources, const GLuint program );
+
+unsigned int get_hits();
+
+unsigned int get_misses();
+
+}
+
+}
@@ -1,13 +1,20 @@
 
 #include "applications/cdlod/terrain_renderer.h"
 #include "base/logbook.h"
+#include "base/frame_arena.h"
+#include "base/job_system.h"
 #include "base/glfw_window.h"
 #include "scene/scene.h"
+#include "dynamic_resolution.h"
 #include "framebuffer.h"
+#include "gl_state.h"
+#include "profiler.h"
 #include "applications/ui_overlay/ui_overlay.h"
 #include "renderer/renderer.h"
 #include "applications/camera/camera.h"
+#include "applications/camera/camera_recorder.h"
 #include "applications/sky_box/sky_box.h"
+#include <algorithm>
 
 namespace orf_n {
 
@@ -28,7 +35,30 @@ void renderer::setupRenderer() {
 	m_camera = new camera{ m_window, omath::dvec3{ 0.0, 0.0, 1.0 }, omath::dvec3{ 0.0, 0.0, 0.0 },
 		omath::vec3{ 0.0f, 1.0f, 0.0f }, 1.0f, 1000.0f, camera::FIRST_PERSON };
 	m_overlay = new ui_overlay( m_window );
+	m_recorder = new camera_recorder();
+	// Build the scene and set it up.
+	m_scene = new scene( m_window, m_camera, m_overlay );
+	m_scene->set_render_size( m_window->get_width(), m_window->get_height() );
+	m_scene->add_renderable( 1, std::make_shared<sky_box>() );
+	//m_scene->add_renderable( 1, std::make_shared<icosphere_ellipsoid>( Ellipsoid::WGS84_ELLIPSOID, 7 ) );
+	m_scene->add_renderable( 2, std::make_shared<terrain::terrain_renderer>());
+	//m_scene->add_renderable( 1, std::make_shared<shadow_map>() );
+}
+
+void renderer::record_camera( const std::string &filename ) {
+	m_recorder->start_recording( filename );
+}
+
+bool renderer::replay_camera( const std::string &filename, const std::string &stats_filename, const double timestep ) {
+	if( !m_recorder->start_replay( m_camera, filename, stats_filename, timestep ) )
+		return false;
+	m_window->set_v_sync( false );
+	return true;
+}
 
+void renderer::set_dynamic_resolution( const double target_ms ) {
+	if( nullptr != m_dynamic_resolution )
+		return;
 	m_framebuffer = new framebuffer( m_window->get_width(), m_window->get_height() );
 	m_framebuffer->addColorAttachment( GL_RGB8_SNORM, GL_COLOR_ATTACHMENT0 );
 	m_framebuffer->addDepthAttachment( GL_DEPTH_COMPONENT32F );
@@ -37,13 +67,9 @@ void renderer::setupRenderer() {
 		logbook::log_msg( logbook::RENDERER, logbook::ERROR, s );
 		throw std::runtime_error{ s };
 	} else
-		logbook::log_msg( logbook::RENDERER, logbook::ERROR, "Framebuffer/renderbuffer created." );
-	// Build the scene and set it up.
-	m_scene = new scene( m_window, m_camera, m_overlay );
-	m_scene->add_renderable( 1, std::make_shared<sky_box>() );
-	//m_scene->add_renderable( 1, std::make_shared<icosphere_ellipsoid>( Ellipsoid::WGS84_ELLIPSOID, 7 ) );
-	m_scene->add_renderable( 2, std::make_shared<terrain::terrain_renderer>());
-	//m_scene->add_renderable( 1, std::make_shared<shadow_map>() );
+		logbook::log_msg( logbook::RENDERER, logbook::INFO, "Framebuffer/renderbuffer created." );
+	m_dynamic_resolution = new dynamic_resolution( target_ms );
+	logbook::log_msg( logbook::RENDERER, logbook::INFO, "Dynamic resolution for " + std::to_string( target_ms ) + "ms GPU time." );
 }
 
 void renderer::setup() const {
@@ -59,49 +85,83 @@ void renderer::render() {
 	while( !glfwWindowShouldClose( m_window->get_window() ) ) {
 		double currentFrame { glfwGetTime() };
 		++frameCounter;
-		m_delta_time = currentFrame - lastFrame;
+		m_delta_time = m_recorder->get_delta_time( currentFrame - lastFrame );
 		lastFrame = currentFrame;
-
-		glEnable(GL_FRAMEBUFFER_SRGB);
-		// Render in the framebuffer first
-		m_framebuffer->bind( GL_DRAW_FRAMEBUFFER );
-		m_framebuffer->clear( omath::vec4{ 0.0f, 0.0f, 0.0f, 1.0f } );
+		profiler::get_instance().begin_frame();
+		logbook::new_frame();
+		frame_arena::get_instance().new_frame();
+		profiler::get_instance().set_counter( "frame arena kB", (double)frame_arena::get_instance().get_frame_bytes() / 1024.0 );
+		profiler::get_instance().set_counter( "frame arena heap", (double)frame_arena::get_instance().get_frame_heap_allocations() );
+		gl_state::get_instance().new_frame();
+		profiler::get_instance().set_counter( "gl state calls", (double)gl_state::get_instance().get_frame_calls() );
+		profiler::get_instance().set_counter( "gl state calls avoided", (double)gl_state::get_instance().get_frame_avoided_calls() );
+		// GL work that jobs have left for the main thread
+		job_system::get_instance().run_main_thread_jobs();
+
+		const unsigned int window_width{ (unsigned int)m_window->get_width() };
+		const unsigned int window_height{ (unsigned int)m_window->get_height() };
+		unsigned int width{ window_width }, height{ window_height };
+		if( nullptr != m_dynamic_resolution ) {
+			// Render in the scaled framebuffer first
+			const float scale{ m_dynamic_resolution->get_scale() };
+			width = std::max( 1u, (unsigned int)( (float)window_width * scale ) );
+			height = std::max( 1u, (unsigned int)( (float)window_height * scale ) );
+			if( width != m_framebuffer->getSizeX() || height != m_framebuffer->getSizeY() )
+				m_framebuffer->resize( width, height );
+			profiler::get_instance().set_counter( "render scale", (double)scale );
+			m_dynamic_resolution->begin_frame();
+			gl_state::get_instance().enable( GL_FRAMEBUFFER_SRGB );
+			m_framebuffer->bind( GL_DRAW_FRAMEBUFFER );
+		} else
+			glBindFramebuffer( GL_DRAW_FRAMEBUFFER, 0 );
+		glViewport( 0, 0, width, height );
+		m_scene->set_render_size( width, height );
+		glClearColor( 0.0f, 0.0f, 0.0f, 1.0f );
+		glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
 
 		m_scene->prepareFrame();
 		// Called after prepareFrame() because UIOverlay has to start a new frame.
-		m_scene->get_camera()->update_moving(m_delta_time);
+		m_recorder->update( m_scene->get_camera(), m_delta_time );
 
 		m_scene->render(m_delta_time);
+		if( nullptr != m_dynamic_resolution ) {
+			gl_state::get_instance().disable( GL_FRAMEBUFFER_SRGB );
+			// Upscale into the window
+			m_framebuffer->bind( GL_READ_FRAMEBUFFER );
+			glBindFramebuffer( GL_DRAW_FRAMEBUFFER, 0 );
+			glBlitFramebuffer( 0, 0, width, height, 0, 0, window_width, window_height, GL_COLOR_BUFFER_BIT,
+					width == window_width && height == window_height ? GL_NEAREST : GL_LINEAR );
+			glViewport( 0, 0, window_width, window_height );
+			m_dynamic_resolution->end_frame();
+		}
+		// UI at window resolution
+		m_scene->render_overlay( m_delta_time );
 		m_scene->endFrame();
-		glDisable(GL_FRAMEBUFFER_SRGB);
-
-		// Blit framebuffer to default window framebuffer
-		m_framebuffer->bind( GL_READ_FRAMEBUFFER );
-		glBindFramebuffer( GL_DRAW_FRAMEBUFFER, 0 );
-		// Clear to blue to distinguish between draw framebuffer; color::blue.
-		glClearColor( 0.0f, 0.0f, 1.0f, 1.0f );
-		glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
-		glBlitFramebuffer(
-				0, 0, m_window->get_width(), m_window->get_height(),
-				0, 0, m_window->get_width(), m_window->get_height(),
-				GL_COLOR_BUFFER_BIT, GL_NEAREST
-		);
 
 		glfwPollEvents();
 		glfwSwapBuffers( m_scene->get_window()->get_window() );
-
+		profiler::get_instance().end_frame();
+		m_recorder->end_frame();
+		if( m_recorder->is_finished() )
+			m_window->set_should_close();
 	}
+	m_recorder->stop( m_camera );
 	logbook::log_msg( orf_n::logbook::RENDERER, orf_n::logbook::INFO,"--- Leaving main loop ---" );
+	logbook::log_msg( logbook::RENDERER, logbook::INFO, "Frame arena peak " +
+			std::to_string( frame_arena::get_instance().get_peak_bytes() / 1024 ) + "kB per frame." );
 }
 
 void renderer::cleanup() const {
 	m_scene->cleanup();
+	profiler::get_instance().cleanup();
 }
 
 void renderer::cleanupRenderer() {
+	delete m_dynamic_resolution;
 	delete m_framebuffer;
 	delete m_scene;
 	delete m_overlay;
+	delete m_recorder;
 	delete m_camera;
 	delete m_window;
 }
@@ -1,8 +1,12 @@
 
 #pragma once
 
+#include <string>
+
 namespace orf_n {
 
+class camera_recorder;
+class dynamic_resolution;
 class framebuffer;
 class ui_overlay;
 class scene;
@@ -18,6 +22,18 @@ public:
 
 	void setup() const;
 
+	// Records the camera path of the session, written on exit. Between setupRenderer() and render().
+	void record_camera( const std::string &filename );
+
+	/* Replays a recorded camera path with a fixed timestep and vsync off, input is disabled and the
+	 * window closes at its end. Per frame stats go to stats_filename. Between setupRenderer() and render(). */
+	bool replay_camera( const std::string &filename, const std::string &stats_filename, const double timestep );
+
+	/* Renders the scene offscreen at a resolution scaled to keep its GPU time near target_ms and
+	 * upscales it into the window. Without, the scene is drawn into the window directly.
+	 * Between setupRenderer() and render(). */
+	void set_dynamic_resolution( const double target_ms );
+
 	void render();
 
 	void cleanup() const;
@@ -34,10 +50,15 @@ private:
 
 	camera *m_camera{ nullptr };
 
+	// Offscreen target of dynamic resolution
 	framebuffer *m_framebuffer{ nullptr };
 
+	dynamic_resolution *m_dynamic_resolution{ nullptr };
+
 	ui_overlay *m_overlay{ nullptr };
 
+	camera_recorder *m_recorder{ nullptr };
+
 	// A stub now. In future, suitability checks should be done here.
 	bool check_environment();
 
@@ -0,0 +1,94 @@
+
+#include "stream_buffer.h"
+#include "base/logbook.h"
+
+namespace orf_n {
+
+stream_buffer::stream_buffer( const memory_tracker::subsystem s, const GLsizeiptr region_size ) :
+		m_memory{ s, memory_tracker::GPU } {
+	create( region_size );
+}
+
+stream_buffer::~stream_buffer() {
+	destroy();
+}
+
+unsigned char *stream_buffer::begin_frame( const GLsizeiptr size ) {
+	if( size > m_region_size ) {
+		GLsizeiptr region_size{ m_region_size };
+		while( region_size < size )
+			region_size *= 2;
+		// Draws still reading the old buffer keep it alive
+		destroy();
+		create( region_size );
+		logbook::log_msg( logbook::RENDERER, logbook::INFO,
+				"Stream buffer regions grown to " + std::to_string( region_size ) + " bytes." );
+	}
+	m_region = ( m_region + 1 ) % REGIONS;
+	m_waits = 0;
+	GLsync &fence{ m_fences[m_region] };
+	if( nullptr != fence ) {
+		if( GL_TIMEOUT_EXPIRED == glClientWaitSync( fence, 0, 0 ) ) {
+			++m_waits;
+			// One second, then write anyway
+			if( GL_TIMEOUT_EXPIRED == glClientWaitSync( fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000 ) )
+				LOGBOOK_MSG( logbook::RENDERER, logbook::WARNING, "Timeout waiting for a stream buffer region." );
+		}
+		glDeleteSync( fence );
+		fence = nullptr;
+	}
+	return m_mapping + get_offset();
+}
+
+void stream_buffer::end_frame() {
+	GLsync &fence{ m_fences[m_region] };
+	if( nullptr != fence )
+		glDeleteSync( fence );
+	fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+}
+
+GLuint stream_buffer::get_buffer() const {
+	return m_buffer;
+}
+
+GLintptr stream_buffer::get_offset() const {
+	return (GLintptr)m_region * m_region_size;
+}
+
+GLsizeiptr stream_buffer::get_region_size() const {
+	return m_region_size;
+}
+
+unsigned int stream_buffer::get_waits() const {
+	return m_waits;
+}
+
+void stream_buffer::create( const GLsizeiptr region_size ) {
+	// Keeps regions aligned for any vertex or index type
+	m_region_size = ( region_size + 255 ) & ~(GLsizeiptr)255;
+	const GLbitfield flags{ GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT };
+	glCreateBuffers( 1, &m_buffer );
+	glNamedBufferStorage( m_buffer, m_region_size * REGIONS, nullptr, flags );
+	m_mapping = static_cast<unsigned char *>( glMapNamedBufferRange( m_buffer, 0, m_region_size * REGIONS, flags ) );
+	if( nullptr == m_mapping )
+		logbook::log_msg( logbook::RENDERER, logbook::ERROR, "Could not map stream buffer." );
+	m_memory.set( (size_t)( m_region_size * REGIONS ) );
+	m_region = 0;
+}
+
+void stream_buffer::destroy() {
+	for( GLsync &fence : m_fences ) {
+		if( nullptr != fence )
+			glDeleteSync( fence );
+		fence = nullptr;
+	}
+	if( 0 != m_buffer ) {
+		glUnmapNamedBuffer( m_buffer );
+		glDeleteBuffers( 1, &m_buffer );
+	}
+	m_buffer = 0;
+	m_mapping = nullptr;
+	m_memory.set( 0 );
+}
+
+}
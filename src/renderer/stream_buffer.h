@@ -0,0 +1,51 @@
+/* Ring of regions in one persistently mapped buffer, for data the CPU writes every frame and the GPU
+ * reads once, like the vertices and indices of the UI. Storage is allocated once and stays mapped,
+ * nothing is reallocated or orphaned per frame. Each frame writes the next region, which is fenced
+ * after the draws that read it were submitted. The fence is waited for when the region comes
+ * around again REGIONS frames later, normally the GPU is done by then. A frame that needs more
+ * than a region gets a larger buffer, the old one is released when the GPU no longer uses it. */
+
+#pragma once
+
+#include "glad/glad.h"
+#include "base/memory_tracker.h"
+
+namespace orf_n {
+
+class stream_buffer {
+public:
+	static const unsigned int REGIONS{ 3 };
+
+	stream_buffer( const memory_tracker::subsystem s, const GLsizeiptr region_size = 64 * 1024 );
+	virtual ~stream_buffer();
+	stream_buffer( const stream_buffer &other ) = delete;
+	stream_buffer &operator=( const stream_buffer &other ) = delete;
+
+	/* Makes the next region current for a frame that writes up to size bytes and returns where to
+	 * write. May replace the buffer, so get it after this call. */
+	unsigned char *begin_frame( const GLsizeiptr size );
+	// Fences the current region. After the draws reading it have been submitted.
+	void end_frame();
+
+	GLuint get_buffer() const;
+	// Of the current region in the buffer
+	GLintptr get_offset() const;
+	GLsizeiptr get_region_size() const;
+	// 1 if the current frame found its region still in use by the GPU, reset by begin_frame()
+	unsigned int get_waits() const;
+
+private:
+	memory_tracker::tracked_memory m_memory;
+	GLuint m_buffer{ 0 };
+	unsigned char *m_mapping{ nullptr };
+	GLsizeiptr m_region_size{ 0 };
+	GLsync m_fences[REGIONS]{};
+	unsigned int m_region{ 0 };
+	unsigned int m_waits{ 0 };
+
+	void create( const GLsizeiptr region_size );
+	void destroy();
+
+};
+
+}
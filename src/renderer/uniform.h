@@ -92,88 +92,89 @@ static inline void setDiffuseSpecularAmbientShininess( const omath::vec4 &dsas )
 	glUniform4fv( SUL_DIFFUSE_SPECULAR_AMBIENT_SHININESS, 1, &dsas[0] );
 }
 
-// Generic uniform setters for shader vars. Not the fastest ...
-static inline void set_uniform( const GLuint program, const std::string &name, bool value ) {
-	glUniform1i( glGetUniformLocation( program, name.c_str() ), (GLint)value );
+// Generic uniform setters for shader vars. Not the fastest, but names are C strings so a literal
+// doesn't build a std::string on every call.
+static inline void set_uniform( const GLuint program, const char *name, bool value ) {
+	glUniform1i( glGetUniformLocation( program, name ), (GLint)value );
 }
 
 /**
  * @brief This is the right overload for textures. Despite they being declared as GLuint
  * the api expects a GLint. So cast the texture before calling setUniform().
  */
-static inline void set_uniform( const GLuint program, const std::string &name, const GLint &value ) {
-	glUniform1i( glGetUniformLocation( program, name.c_str() ), value );
+static inline void set_uniform( const GLuint program, const char *name, const GLint &value ) {
+	glUniform1i( glGetUniformLocation( program, name ), value );
 }
 
-static inline void set_uniform( const GLuint program, const std::string &name, const GLuint &value ) {
-	glUniform1ui( glGetUniformLocation( program, name.c_str() ), value );
+static inline void set_uniform( const GLuint program, const char *name, const GLuint &value ) {
+	glUniform1ui( glGetUniformLocation( program, name ), value );
 }
 
-static inline void set_uniform( const GLuint program, const std::string &name, const GLfloat &value ) {
-	glUniform1f( glGetUniformLocation( program, name.c_str() ), value );
+static inline void set_uniform( const GLuint program, const char *name, const GLfloat &value ) {
+	glUniform1f( glGetUniformLocation( program, name ), value );
 }
 
-static inline void set_uniform( const GLuint program, const std::string &name, const GLdouble &value ) {
-	glUniform1d( glGetUniformLocation( program, name.c_str() ), value );
+static inline void set_uniform( const GLuint program, const char *name, const GLdouble &value ) {
+	glUniform1d( glGetUniformLocation( program, name ), value );
 }
 
-static inline void set_uniform( const GLuint program, const std::string &name, const omath::vec2 &value ) {
-	glUniform2fv( glGetUniformLocation( program, name.c_str() ), 1, &value[0] );
+static inline void set_uniform( const GLuint program, const char *name, const omath::vec2 &value ) {
+	glUniform2fv( glGetUniformLocation( program, name ), 1, &value[0] );
 }
 
-static inline void set_uniform( const GLuint program, const std::string &name, const omath::vec3 &value ) {
-	glUniform3fv( glGetUniformLocation( program, name.c_str() ), 1, &value[0] );
+static inline void set_uniform( const GLuint program, const char *name, const omath::vec3 &value ) {
+	glUniform3fv( glGetUniformLocation( program, name ), 1, &value[0] );
 }
 
-static inline void set_uniform( const GLuint program, const std::string &name, const omath::vec4 &value ) {
-	glUniform4fv(glGetUniformLocation( program, name.c_str() ), 1, &value[0] );
+static inline void set_uniform( const GLuint program, const char *name, const omath::vec4 &value ) {
+	glUniform4fv(glGetUniformLocation( program, name ), 1, &value[0] );
 }
 
-static inline void set_uniform( const GLuint program, const std::string &name, const omath::dvec2 &value ) {
-	glUniform2dv( glGetUniformLocation( program, name.c_str() ), 1, &value[0] );
+static inline void set_uniform( const GLuint program, const char *name, const omath::dvec2 &value ) {
+	glUniform2dv( glGetUniformLocation( program, name ), 1, &value[0] );
 }
 
-static inline void set_uniform( const GLuint program, const std::string &name, const omath::dvec3 &value ) {
-	glUniform3dv( glGetUniformLocation( program, name.c_str() ), 1, &value[0] );
+static inline void set_uniform( const GLuint program, const char *name, const omath::dvec3 &value ) {
+	glUniform3dv( glGetUniformLocation( program, name ), 1, &value[0] );
 }
 
-static inline void set_uniform( const GLuint program, const std::string &name, const omath::dvec4 &value ) {
-	glUniform4dv(glGetUniformLocation( program, name.c_str() ), 1, &value[0] );
+static inline void set_uniform( const GLuint program, const char *name, const omath::dvec4 &value ) {
+	glUniform4dv(glGetUniformLocation( program, name ), 1, &value[0] );
 }
 
 /**
  * @todo: Try omath::value_ptr(trans) as last argument.
  * omath stores matrices not in the way OpenGL expects them.
  */
-/*static inline void set_uniform( const GLuint program, const std::string &name, const omath::mat2 &mat ) {
-	glUniformMatrix2fv( glGetUniformLocation( program, name.c_str() ), 1, GL_FALSE, &mat[0][0] );
+/*static inline void set_uniform( const GLuint program, const char *name, const omath::mat2 &mat ) {
+	glUniformMatrix2fv( glGetUniformLocation( program, name ), 1, GL_FALSE, &mat[0][0] );
 }*/
 
-static inline void set_uniform( const GLuint program, const std::string &name, const omath::mat3 &mat ) {
-	glUniformMatrix3fv( glGetUniformLocation( program, name.c_str() ), 1, GL_FALSE, &mat[0][0] );
+static inline void set_uniform( const GLuint program, const char *name, const omath::mat3 &mat ) {
+	glUniformMatrix3fv( glGetUniformLocation( program, name ), 1, GL_FALSE, &mat[0][0] );
 }
 
-static inline void set_uniform( const GLuint program, const std::string &name, const omath::mat4 &mat ) {
-	glUniformMatrix4fv( glGetUniformLocation( program, name.c_str() ), 1, GL_FALSE, &mat[0][0] );
+static inline void set_uniform( const GLuint program, const char *name, const omath::mat4 &mat ) {
+	glUniformMatrix4fv( glGetUniformLocation( program, name ), 1, GL_FALSE, &mat[0][0] );
 }
 
-/*static inline void set_uniform( const GLuint program, const std::string &name, const omath::dmat2 &mat ) {
-	glUniformMatrix2dv( glGetUniformLocation( program, name.c_str() ), 1, GL_FALSE, &mat[0][0] );
+/*static inline void set_uniform( const GLuint program, const char *name, const omath::dmat2 &mat ) {
+	glUniformMatrix2dv( glGetUniformLocation( program, name ), 1, GL_FALSE, &mat[0][0] );
 }*/
 
-static inline void set_uniform( const GLuint program, const std::string &name, const omath::dmat3 &mat ) {
-	glUniformMatrix3dv( glGetUniformLocation( program, name.c_str() ), 1, GL_FALSE, &mat[0][0] );
+static inline void set_uniform( const GLuint program, const char *name, const omath::dmat3 &mat ) {
+	glUniformMatrix3dv( glGetUniformLocation( program, name ), 1, GL_FALSE, &mat[0][0] );
 }
 
-static inline void set_uniform( const GLuint program, const std::string &name, const omath::dmat4 &mat ) {
-	glUniformMatrix4dv( glGetUniformLocation( program, name.c_str() ), 1, GL_FALSE, &mat[0][0] );
+static inline void set_uniform( const GLuint program, const char *name, const omath::dmat4 &mat ) {
+	glUniformMatrix4dv( glGetUniformLocation( program, name ), 1, GL_FALSE, &mat[0][0] );
 }
 
 /**
  * @todo This might be 2x4 ...
  */
-/*static inline void setUniform( const GLuint program, const std::string &name, const omath::dmat4x2 &mat ) {
-	glUniformMatrix4x2dv( glGetUniformLocation( program, name.c_str() ), 1, GL_FALSE, &mat[0][0] );
+/*static inline void setUniform( const GLuint program, const char *name, const omath::dmat4x2 &mat ) {
+	glUniformMatrix4x2dv( glGetUniformLocation( program, name ), 1, GL_FALSE, &mat[0][0] );
 }*/
 
 }
@@ -29,7 +29,9 @@ void scene::prepareFrame() {
 void scene::render(const double delta_time) {
 	for( auto &e : m_ordered_renderables )
 		e.second->render(delta_time);
-	// Render overlay last
+}
+
+void scene::render_overlay( const double delta_time ) {
 	m_overlay->render(delta_time);
 }
 
@@ -65,6 +67,19 @@ camera *scene::get_camera() const {
 	return m_camera;
 }
 
+void scene::set_render_size( const unsigned int width, const unsigned int height ) {
+	m_render_width = width;
+	m_render_height = height;
+}
+
+unsigned int scene::get_render_width() const {
+	return m_render_width;
+}
+
+unsigned int scene::get_render_height() const {
+	return m_render_height;
+}
+
 scene::~scene() {
 	m_ordered_renderables.clear();
 	logbook::log_msg( logbook::SCENE, logbook::INFO, "Scene '" + get_name() + "' destroyed." );
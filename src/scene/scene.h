@@ -21,8 +21,11 @@ public:
 
 	virtual void prepareFrame() override;
 
+	// Renderables only, the overlay comes separately at window resolution.
 	virtual void render(const double delta_time) override;
 
+	void render_overlay( const double delta_time );
+
 	virtual void endFrame() override;
 
 	virtual void cleanup() override;
@@ -33,6 +36,13 @@ public:
 
 	camera *get_camera() const;
 
+	// Size of the target the renderables draw into. The window's, or smaller with dynamic resolution.
+	void set_render_size( const unsigned int width, const unsigned int height );
+
+	unsigned int get_render_width() const;
+
+	unsigned int get_render_height() const;
+
 private:
 	glfw_window *m_window{ nullptr };
 
@@ -40,6 +50,10 @@ private:
 
 	ui_overlay *m_overlay{ nullptr };
 
+	unsigned int m_render_width{ 0 };
+
+	unsigned int m_render_height{ 0 };
+
 	// Renderables in order for rendering.
 	std::map<unsigned int, std::shared_ptr<renderable>> m_ordered_renderables;
 
@@ -0,0 +1,714 @@
+/* Headless terrain benchmark, a regression gate for selection that runs without a window.
+ * Loads one heightmap tile without a GL texture, builds its quadtree and replays a camera path
+ * through lod_selection. Without a path file, a circle over the tile is flown.
+ * Reports load and tree build times, selection time percentiles and node and triangle counts,
+ * in total and per lod level, as JSON. The tile's files are evicted from the page cache with
+ * posix_fadvise() before the cold load. That is a hint, for a cold cache without doubt drop the caches
+ * as root first (echo 1 > /proc/sys/vm/drop_caches).
+ * With --render and EGL available at compile time (link with -lEGL), a pbuffer context is
+ * created, e.g. on llvmpipe, and the selection is also drawn with the terrain shaders into an
+ * offscreen framebuffer, timed with glFinish(). Draw calls are the terrain renderer's, from
+ * selection_drawing.h. The time to set that up includes creating the shader program, from the program
+ * cache unless --no-shader-cache. --front-to-back draws the sorted selection in its order instead of
+ * level by level, --depth-prepass lays down depth with the position only shader first,
+ * --hiz-culling removes nodes hidden in the depth of earlier frames, as the terrain renderer's options
+ * of the same names. --horizon-culling removes nodes behind the terrain's horizon from the selection,
+ * with or without --render.
+ * --rays n casts n random rays from above onto the tile through the quadtree, one after the other and
+ * batched on the job system, and reports rays per second. A part of them is checked against a walk
+ * over all cells of the heightmap. --height-queries n looks up bilinear heights and normals at n random
+ * positions, one by one and with the batched query, and reports queries per second and the largest
+ * difference between the two.
+ * Usage:
+ * 	terrain_bench <heightmap without .png> [--path file] [--frames n] [--width w --height h]
+ * 		[--fov degrees] [--sse] [--horizon-culling] [--render [--no-shader-cache] [--front-to-back]
+ * 		[--depth-prepass] [--hiz-culling]] [--rays n] [--height-queries n] [--out file.json]
+ * Run from the repository root, shader paths are relative to it. */
+
+#include "base/logbook.h"
+#include "base/memory_tracker.h"
+#include "applications/camera/camera_path.h"
+#include "applications/cdlod/settings.h"
+#include "applications/cdlod/heightmap.h"
+#include "applications/cdlod/horizon_culling.h"
+#include "applications/cdlod/lod_selection.h"
+#include "applications/cdlod/node.h"
+#include "applications/cdlod/quadtree.h"
+#include "omath/aabb.h"
+#include "omath/mat4.h"
+#include "omath/ray.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#if __has_include(<EGL/egl.h>)
+#include <EGL/egl.h>
+#include "applications/cdlod/gridmesh.h"
+#include "applications/cdlod/hiz_culling.h"
+#include "applications/cdlod/selection_drawing.h"
+#include "renderer/gl_state.h"
+#include "renderer/program.h"
+#include "renderer/program_cache.h"
+#include "renderer/uniform.h"
+#define TERRAIN_BENCH_HAVE_EGL 1
+#else
+#define TERRAIN_BENCH_HAVE_EGL 0
+#endif
+
+using namespace orf_n;
+using namespace terrain;
+
+namespace {
+
+typedef std::chrono::steady_clock clock_type;
+
+double ms_since( const clock_type::time_point &start ) {
+	return std::chrono::duration<double, std::milli>( clock_type::now() - start ).count();
+}
+
+// Drops the file's clean pages from the page cache.
+void evict( const std::string &filename ) {
+	const int fd{ ::open( filename.c_str(), O_RDONLY | O_CLOEXEC ) };
+	if( fd < 0 )
+		return;
+	::posix_fadvise( fd, 0, 0, POSIX_FADV_DONTNEED );
+	::close( fd );
+}
+
+typedef struct options {
+	std::string heightmap;
+	std::string path;
+	std::string out;
+	unsigned int frames{ 600 };
+	unsigned int width{ 1920 };
+	unsigned int height{ 1080 };
+	double fov{ 45.0 };
+	bool screen_space_error{ false };
+	bool render{ false };
+	bool shader_cache{ true };
+	bool front_to_back{ false };
+	bool depth_prepass{ false };
+	bool horizon_culling{ false };
+	bool hiz_culling{ false };
+	unsigned int rays{ 0 };
+	unsigned int height_queries{ 0 };
+} options;
+
+typedef struct frame_stats {
+	double select_ms{ 0.0 };
+	double render_ms{ 0.0 };
+	unsigned int nodes{ 0 };
+	unsigned int triangles{ 0 };
+	unsigned int level_nodes[settings::NUMBER_OF_LOD_LEVELS]{};
+	unsigned int level_triangles[settings::NUMBER_OF_LOD_LEVELS]{};
+} frame_stats;
+
+bool parse_options( int argc, char **argv, options &o ) {
+	if( argc < 2 )
+		return false;
+	o.heightmap = argv[1];
+	try {
+		for( int i = 2; i < argc; ++i ) {
+			const std::string a{ argv[i] };
+			const bool has_value{ i + 1 < argc };
+			if( "--path" == a && has_value )
+				o.path = argv[++i];
+			else if( "--out" == a && has_value )
+				o.out = argv[++i];
+			else if( "--frames" == a && has_value )
+				o.frames = (unsigned int)std::stoul( argv[++i] );
+			else if( "--width" == a && has_value )
+				o.width = (unsigned int)std::stoul( argv[++i] );
+			else if( "--height" == a && has_value )
+				o.height = (unsigned int)std::stoul( argv[++i] );
+			else if( "--fov" == a && has_value )
+				o.fov = std::stod( argv[++i] );
+			else if( "--sse" == a )
+				o.screen_space_error = true;
+			else if( "--render" == a )
+				o.render = true;
+			else if( "--no-shader-cache" == a )
+				o.shader_cache = false;
+			else if( "--front-to-back" == a )
+				o.front_to_back = true;
+			else if( "--depth-prepass" == a )
+				o.depth_prepass = true;
+			else if( "--horizon-culling" == a )
+				o.horizon_culling = true;
+			else if( "--hiz-culling" == a )
+				o.hiz_culling = true;
+			else if( "--rays" == a && has_value )
+				o.rays = (unsigned int)std::stoul( argv[++i] );
+			else if( "--height-queries" == a && has_value )
+				o.height_queries = (unsigned int)std::stoul( argv[++i] );
+			else
+				return false;
+		}
+	} catch( const std::exception & ) {
+		return false;
+	}
+	return o.frames > 0 && o.width > 0 && o.height > 0 && o.fov > 0.0 && o.fov < 180.0;
+}
+
+// One lap around the tile's center at 60 frames per second, looking ahead and down.
+camera_path make_circle_path( const omath::daabb &box, const unsigned int frames, const float fov ) {
+	camera_path path;
+	const omath::dvec3 center{ ( box.m_min + box.m_max ) * 0.5 };
+	const double radius{ 0.3 * std::min( box.m_max.x - box.m_min.x, box.m_max.z - box.m_min.z ) };
+	const double height{ box.m_max.y + 0.02 * box.get_diagonal_size() };
+	for( unsigned int i = 0; i < frames; ++i ) {
+		const double a{ omath::TWO_PI * (double)i / (double)frames };
+		camera_path::pose p;
+		p.time = (double)i / 60.0;
+		p.position = omath::dvec3{ center.x + radius * std::cos( a ), height, center.z + radius * std::sin( a ) };
+		p.front = omath::normalize( omath::vec3{ -(float)std::sin( a ), -0.3f, (float)std::cos( a ) } );
+		p.fov = fov;
+		path.add( p );
+	}
+	return path;
+}
+
+lod_selection::view_t make_view( const camera_path::pose &p, const options &o, const double far_plane ) {
+	lod_selection::view_t v;
+	v.position = p.position;
+	v.near_plane = 1.0;
+	v.far_plane = far_plane;
+	v.frustum.set_fov( p.fov, (double)o.width / (double)o.height, v.near_plane, v.far_plane );
+	v.frustum.set_camera_vectors( p.position, p.position + omath::dvec3{ p.front }, omath::dvec3{ p.up } );
+	// As camera::get_screen_space_factor()
+	v.screen_space_factor = (double)o.height * 0.5 / std::tan( omath::radians( (double)p.fov ) * 0.5 );
+	return v;
+}
+
+void count( const lod_selection &selection, const unsigned int triangles_per_node, frame_stats &s ) {
+	s.nodes = selection.m_selection_count;
+	for( unsigned int i = 0; i < selection.m_selection_count; ++i ) {
+		const lod_selection::selected_node &n{ selection.m_selected_nodes[i] };
+		const unsigned int level{ std::min( n.lod_level & 0x7FFFFFFF, settings::NUMBER_OF_LOD_LEVELS - 1 ) };
+		const unsigned int quadrants{ (unsigned int)n.has_tl + n.has_tr + n.has_bl + n.has_br };
+		const unsigned int triangles{ triangles_per_node / 4 * quadrants };
+		++s.level_nodes[level];
+		s.level_triangles[level] += triangles;
+		s.triangles += triangles;
+	}
+}
+
+typedef struct ray_stats {
+	double single_ms{ 0.0 };
+	double batched_ms{ 0.0 };
+	// Of the checked rays with the walk over the whole raster
+	double reference_ms{ 0.0 };
+	unsigned int hits{ 0 };
+	unsigned int checked{ 0 };
+	unsigned int mismatches{ 0 };
+} ray_stats;
+
+/* Rays from random points above the tile to random points on its floor, with a fixed seed. Most are
+ * grazing, as the tile is much wider than high. */
+std::vector<omath::ray_t<double>> make_rays( const omath::daabb &box, const unsigned int count ) {
+	uint64_t state{ 0x9E3779B97F4A7C15ull };
+	const auto random = [&state]() {
+		state = state * 6364136223846793005ull + 1442695040888963407ull;
+		return (double)( state >> 11 ) / (double)( 1ull << 53 );
+	};
+	const omath::dvec3 size{ box.m_max - box.m_min };
+	std::vector<omath::ray_t<double>> rays;
+	rays.reserve( count );
+	for( unsigned int i = 0; i < count; ++i ) {
+		const omath::dvec3 from{ box.m_min.x + random() * size.x, box.m_max.y + random() * size.y,
+			box.m_min.z + random() * size.z };
+		const omath::dvec3 to{ box.m_min.x + random() * size.x, box.m_min.y, box.m_min.z + random() * size.z };
+		rays.emplace_back( from, omath::normalize( to - from ) );
+	}
+	return rays;
+}
+
+// Casts the rays through the tree, then compares up to max_checked of them with a walk over the whole raster.
+ray_stats cast_rays( const quadtree &tree, const heightmap &hm, const std::vector<omath::ray_t<double>> &rays,
+		const unsigned int max_checked = 1000 ) {
+	ray_stats s;
+	std::vector<quadtree::raycast_hit> hits( rays.size() );
+	clock_type::time_point start{ clock_type::now() };
+	for( size_t i = 0; i < rays.size(); ++i )
+		if( tree.raycast( rays[i], hits[i] ) )
+			++s.hits;
+	s.single_ms = ms_since( start );
+	std::vector<quadtree::raycast_hit> batched( rays.size() );
+	start = clock_type::now();
+	tree.raycast( rays.data(), (unsigned int)rays.size(), batched.data() );
+	s.batched_ms = ms_since( start );
+	s.checked = std::min( max_checked, (unsigned int)rays.size() );
+	start = clock_type::now();
+	for( unsigned int i = 0; i < s.checked; ++i ) {
+		const omath::ray_t<double> &r{ rays[i] };
+		const omath::dvec3 origin{ r.m_origin.x / settings::RASTER_TO_WORLD_X, r.m_origin.y,
+			r.m_origin.z / settings::RASTER_TO_WORLD_Z };
+		const omath::dvec3 direction{ r.m_direction.x / settings::RASTER_TO_WORLD_X, r.m_direction.y,
+			r.m_direction.z / settings::RASTER_TO_WORLD_Z };
+		double t{ 0.0 };
+		const bool hit{ hm.raycast( origin, direction, 0, 0, hm.get_extent().x, hm.get_extent().y, 0.0, r.m_tmax, t ) };
+		const bool same{ hit == ( nullptr != hits[i].p_node ) && ( !hit || std::abs( t - hits[i].distance ) < 1e-6 * t ) &&
+			batched[i].p_node == hits[i].p_node && batched[i].distance == hits[i].distance };
+		if( !same )
+			++s.mismatches;
+	}
+	s.reference_ms = ms_since( start );
+	return s;
+}
+
+typedef struct height_query_stats {
+	double single_ms{ 0.0 };
+	double batched_ms{ 0.0 };
+	double single_normals_ms{ 0.0 };
+	double batched_normals_ms{ 0.0 };
+	double max_height_difference{ 0.0 };
+	double max_normal_difference{ 0.0 };
+} height_query_stats;
+
+// Random positions over the tile and a little beyond its borders, with a fixed seed.
+height_query_stats query_heights( const heightmap &hm, const omath::daabb &box, const unsigned int count ) {
+	uint64_t state{ 0x2545F4914F6CDD1Dull };
+	const auto random = [&state]() {
+		state = state * 6364136223846793005ull + 1442695040888963407ull;
+		return (double)( state >> 11 ) / (double)( 1ull << 53 );
+	};
+	std::vector<omath::dvec2> positions( count );
+	for( omath::dvec2 &p : positions )
+		p = omath::dvec2{ box.m_min.x + ( random() * 1.02 - 0.01 ) * ( box.m_max.x - box.m_min.x ),
+			box.m_min.z + ( random() * 1.02 - 0.01 ) * ( box.m_max.z - box.m_min.z ) };
+	std::vector<float> single( count ), batched( count );
+	std::vector<omath::vec3> single_normals( count ), batched_normals( count );
+	height_query_stats s;
+	clock_type::time_point start{ clock_type::now() };
+	for( unsigned int i = 0; i < count; ++i )
+		single[i] = hm.get_height( positions[i] );
+	s.single_ms = ms_since( start );
+	start = clock_type::now();
+	hm.get_heights( positions.data(), count, batched.data() );
+	s.batched_ms = ms_since( start );
+	for( unsigned int i = 0; i < count; ++i )
+		s.max_height_difference = std::max( s.max_height_difference, (double)std::abs( single[i] - batched[i] ) );
+	start = clock_type::now();
+	for( unsigned int i = 0; i < count; ++i )
+		single[i] = hm.get_height( positions[i], &single_normals[i] );
+	s.single_normals_ms = ms_since( start );
+	start = clock_type::now();
+	hm.get_heights( positions.data(), count, batched.data(), batched_normals.data() );
+	s.batched_normals_ms = ms_since( start );
+	for( unsigned int i = 0; i < count; ++i ) {
+		s.max_height_difference = std::max( s.max_height_difference, (double)std::abs( single[i] - batched[i] ) );
+		s.max_normal_difference = std::max( s.max_normal_difference,
+				(double)omath::magnitude( single_normals[i] - batched_normals[i] ) );
+	}
+	return s;
+}
+
+// JSON object with mean and percentiles of the values
+std::string summary( std::vector<double> values ) {
+	std::ostringstream s;
+	s << std::fixed << std::setprecision( 4 );
+	if( values.empty() ) {
+		s << "null";
+		return s.str();
+	}
+	std::sort( values.begin(), values.end() );
+	double sum{ 0.0 };
+	for( const double v : values )
+		sum += v;
+	const auto percentile = [&values]( const double p ) {
+		return values[std::min( values.size() - 1, (size_t)( p * (double)values.size() ) )];
+	};
+	s << "{\"mean\":" << sum / (double)values.size() << ",\"min\":" << values.front() <<
+			",\"p50\":" << percentile( 0.5 ) << ",\"p90\":" << percentile( 0.9 ) <<
+			",\"p99\":" << percentile( 0.99 ) << ",\"max\":" << values.back() << '}';
+	return s.str();
+}
+
+#if TERRAIN_BENCH_HAVE_EGL
+
+// Pbuffer GL 4.5 core context through EGL, no window system needed.
+class headless_context {
+public:
+	headless_context() {
+		m_display = eglGetDisplay( EGL_DEFAULT_DISPLAY );
+		if( EGL_NO_DISPLAY == m_display || !eglInitialize( m_display, nullptr, nullptr ) )
+			return;
+		const EGLint config_attribs[]{
+			EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_DEPTH_SIZE, 24, EGL_NONE
+		};
+		EGLConfig config;
+		EGLint number_of_configs{ 0 };
+		if( !eglChooseConfig( m_display, config_attribs, &config, 1, &number_of_configs ) || 0 == number_of_configs )
+			return;
+		const EGLint surface_attribs[]{ EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+		m_surface = eglCreatePbufferSurface( m_display, config, surface_attribs );
+		eglBindAPI( EGL_OPENGL_API );
+		const EGLint context_attribs[]{
+			EGL_CONTEXT_MAJOR_VERSION, 4, EGL_CONTEXT_MINOR_VERSION, 5,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE
+		};
+		m_context = eglCreateContext( m_display, config, EGL_NO_CONTEXT, context_attribs );
+		if( EGL_NO_CONTEXT == m_context || !eglMakeCurrent( m_display, m_surface, m_surface, m_context ) )
+			return;
+		m_valid = 0 != gladLoadGLLoader( (GLADloadproc)eglGetProcAddress );
+		if( m_valid )
+			logbook::log_msg( logbook::RENDERER, logbook::INFO, std::string{ "Headless GL context: " } +
+					(const char *)glGetString( GL_RENDERER ) + ", " + (const char *)glGetString( GL_VERSION ) );
+	}
+
+	~headless_context() {
+		if( EGL_NO_DISPLAY == m_display )
+			return;
+		eglMakeCurrent( m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT );
+		if( EGL_NO_CONTEXT != m_context )
+			eglDestroyContext( m_display, m_context );
+		if( EGL_NO_SURFACE != m_surface )
+			eglDestroySurface( m_display, m_surface );
+		eglTerminate( m_display );
+	}
+
+	bool is_valid() const {
+		return m_valid;
+	}
+
+	std::string get_renderer() const {
+		return m_valid ? (const char *)glGetString( GL_RENDERER ) : "";
+	}
+
+private:
+	EGLDisplay m_display{ EGL_NO_DISPLAY };
+	EGLSurface m_surface{ EGL_NO_SURFACE };
+	EGLContext m_context{ EGL_NO_CONTEXT };
+	bool m_valid{ false };
+
+};
+
+// Draws a selection of one tile with terrain_renderer's draw calls, into an offscreen framebuffer.
+class render_path {
+public:
+	render_path( const unsigned int width, const unsigned int height, const bool front_to_back, const bool depth_prepass,
+			const bool use_hiz_culling ) :
+			m_width{ width }, m_height{ height }, m_front_to_back{ front_to_back } {
+		m_gridmesh = std::make_unique<gridmesh>( settings::GRIDMESH_DIMENSION );
+		std::vector<std::shared_ptr<module>> modules;
+		modules.push_back( std::make_shared<module>( GL_VERTEX_SHADER, "src/applications/cdlod/terrain.vert.glsl" ) );
+		modules.push_back( std::make_shared<module>( GL_FRAGMENT_SHADER, "src/applications/cdlod/terrain.frag.glsl" ) );
+		m_program = std::make_unique<program>( modules );
+		if( depth_prepass )
+			m_depth_program = std::make_unique<program>( std::vector<std::shared_ptr<module>>{
+					std::make_shared<module>( GL_VERTEX_SHADER, "src/applications/cdlod/terrain_depth.vert.glsl" )
+			} );
+		if( use_hiz_culling ) {
+			m_hiz_culling = std::make_unique<hiz_culling>();
+			m_hiz_culling->setup();
+		}
+		glCreateFramebuffers( 1, &m_framebuffer );
+		glCreateRenderbuffers( 2, m_renderbuffers );
+		glNamedRenderbufferStorage( m_renderbuffers[0], GL_RGBA8, width, height );
+		glNamedRenderbufferStorage( m_renderbuffers[1], GL_DEPTH_COMPONENT32F, width, height );
+		glNamedFramebufferRenderbuffer( m_framebuffer, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_renderbuffers[0] );
+		glNamedFramebufferRenderbuffer( m_framebuffer, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_renderbuffers[1] );
+		if( GL_FRAMEBUFFER_COMPLETE != glCheckNamedFramebufferStatus( m_framebuffer, GL_DRAW_FRAMEBUFFER ) )
+			logbook::log_msg( logbook::RENDERER, logbook::ERROR, "Benchmark framebuffer incomplete." );
+		// Uniforms of terrain_renderer::setup()
+		m_program->use();
+		const GLuint p{ m_program->get_program() };
+		set_uniform( p, "u_height_factor", (float)settings::HEIGHT_FACTOR );
+		set_uniform( p, "g_gridDim", omath::vec3{
+			(float)settings::GRIDMESH_DIMENSION,
+			(float)settings::GRIDMESH_DIMENSION * 0.5f,
+			2.0f / (float)settings::GRIDMESH_DIMENSION
+		} );
+		set_uniform( p, "g_lightColorDiffuse", omath::vec4{ 0.65f, 0.65f, 0.65f, 1.0f } );
+		set_uniform( p, "g_lightColorAmbient", omath::vec4{ 0.35f, 0.35f, 0.35f, 1.0f } );
+		set_uniform( p, "g_colorMult", omath::vec4{ 1.0f, 1.0f, 1.0f, 1.0f } );
+		set_uniform( p, "g_diffuseLightDir", omath::vec3{ 1.0f, -1.0f, 0.0f } );
+		set_uniform( p, "debugColor", omath::vec3{ 1.0f, 1.0f, 1.0f } );
+		m_program->un_use();
+		if( m_depth_program ) {
+			m_depth_program->use();
+			const GLuint pd{ m_depth_program->get_program() };
+			set_uniform( pd, "u_height_factor", (float)settings::HEIGHT_FACTOR );
+			set_uniform( pd, "g_gridDim", omath::vec3{
+				(float)settings::GRIDMESH_DIMENSION,
+				(float)settings::GRIDMESH_DIMENSION * 0.5f,
+				2.0f / (float)settings::GRIDMESH_DIMENSION
+			} );
+			m_depth_program->un_use();
+		}
+	}
+
+	~render_path() {
+		if( m_hiz_culling )
+			m_hiz_culling->cleanup();
+		glDeleteRenderbuffers( 2, m_renderbuffers );
+		glDeleteFramebuffers( 1, &m_framebuffer );
+	}
+
+	/* Culls with the depth of earlier frames if enabled, draws, and builds the depth pyramid for the next
+	 * frames. Returns the time until the GPU has finished. */
+	double draw( lod_selection &selection, const heightmap &hm, const camera_path::pose &pose ) {
+		const clock_type::time_point start{ clock_type::now() };
+		gl_state &state{ gl_state::get_instance() };
+		glBindFramebuffer( GL_DRAW_FRAMEBUFFER, m_framebuffer );
+		glViewport( 0, 0, m_width, m_height );
+		if( m_hiz_culling )
+			m_hiz_culling->cull( &selection, (unsigned int)m_gridmesh->get_number_indices() / 3 );
+		state.enable( GL_DEPTH_TEST );
+		state.enable( GL_CULL_FACE );
+		const GLfloat clear_color[]{ 0.0f, 0.0f, 0.0f, 1.0f };
+		const GLfloat clear_depth{ 1.0f };
+		glClearNamedFramebufferfv( m_framebuffer, GL_COLOR, 0, clear_color );
+		glClearNamedFramebufferfv( m_framebuffer, GL_DEPTH, 0, &clear_depth );
+		m_gridmesh->bind();
+		const omath::dvec3 front{ pose.front };
+		const omath::dmat4 view_projection{
+			omath::perspective( omath::radians( (double)pose.fov ), (double)m_width / (double)m_height,
+					selection.m_view.near_plane, selection.m_view.far_plane ) *
+			omath::lookAt( pose.position, pose.position + front, omath::dvec3{ pose.up } )
+		};
+		omath::daabb box;
+		hm.get_world_aabb( box );
+		draw_stats stats;
+		if( m_depth_program ) {
+			m_depth_program->use();
+			const GLuint p{ m_depth_program->get_program() };
+			set_camera_uniforms( p, pose, view_projection );
+			glColorMask( GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE );
+			draw_selection( p, GL_TRIANGLES, selection, *m_gridmesh, m_front_to_back,
+					[p, &hm, &box]( const unsigned int ) { set_tile_uniforms( p, hm, box ); }, stats );
+			glColorMask( GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE );
+			state.depth_func( GL_LEQUAL );
+			state.depth_mask( GL_FALSE );
+		}
+		m_program->use();
+		const GLuint p{ m_program->get_program() };
+		set_camera_uniforms( p, pose, view_projection );
+		draw_selection( p, GL_TRIANGLES, selection, *m_gridmesh, m_front_to_back,
+				[p, &hm, &box]( const unsigned int ) { set_tile_uniforms( p, hm, box ); }, stats );
+		state.depth_func( GL_LESS );
+		state.depth_mask( GL_TRUE );
+		m_program->un_use();
+		if( m_hiz_culling )
+			m_hiz_culling->build( m_width, m_height, omath::mat4{ view_projection } );
+		glFinish();
+		return ms_since( start );
+	}
+
+private:
+	unsigned int m_width;
+	unsigned int m_height;
+	bool m_front_to_back;
+	std::unique_ptr<gridmesh> m_gridmesh;
+	std::unique_ptr<program> m_program;
+	std::unique_ptr<program> m_depth_program;
+	std::unique_ptr<hiz_culling> m_hiz_culling;
+	GLuint m_framebuffer{ 0 };
+	GLuint m_renderbuffers[2]{ 0, 0 };
+
+	// With the program in use
+	static void set_camera_uniforms( const GLuint p, const camera_path::pose &pose, const omath::dmat4 &view_projection ) {
+		setViewProjectionMatrix( omath::mat4{ view_projection } );
+		set_uniform( p, "u_camera_position", omath::vec3{ pose.position } );
+	}
+
+};
+
+#endif
+
+}
+
+int main( int argc, char **argv ) {
+	options o;
+	if( !parse_options( argc, argv, o ) ) {
+		std::cerr << "Usage: terrain_bench <heightmap without .png> [--path file] [--frames n] [--width w --height h]\n"
+				"\t[--fov degrees] [--sse] [--horizon-culling] [--render [--no-shader-cache] [--front-to-back] [--depth-prepass]\n"
+				"\t[--hiz-culling]] [--rays n] [--height-queries n] [--out file.json]" << std::endl;
+		return 1;
+	}
+	logbook::set_log_filename( "terrain_bench.log" );
+	logbook::set_console_output( false );
+	bool render{ false };
+	std::string gl_renderer;
+#if TERRAIN_BENCH_HAVE_EGL
+	std::unique_ptr<headless_context> context;
+	if( o.render ) {
+		context = std::make_unique<headless_context>();
+		render = context->is_valid();
+		gl_renderer = context->get_renderer();
+		if( !render )
+			std::cerr << "No headless GL context, selection only." << std::endl;
+	}
+#else
+	if( o.render )
+		std::cerr << "Built without EGL, selection only." << std::endl;
+#endif
+
+	// Cold is the first load after evicting the tile's files, warm the second with them in the page cache.
+	for( const std::string &f : { heightmap::get_data_filename( o.heightmap ), o.heightmap + ".bb", o.heightmap + ".mm" } )
+		evict( f );
+	clock_type::time_point start{ clock_type::now() };
+	std::unique_ptr<heightmap> hm{ std::make_unique<heightmap>( o.heightmap, heightmap::B16, nullptr, render ) };
+	const double cold_load_ms{ ms_since( start ) };
+	if( 0 == hm->get_extent().x || 0 == hm->get_extent().y ) {
+		std::cerr << "Could not load heightmap '" << heightmap::get_data_filename( o.heightmap ) << "'." << std::endl;
+		return 1;
+	}
+	hm.reset();
+	start = clock_type::now();
+	hm = std::make_unique<heightmap>( o.heightmap, heightmap::B16, nullptr, render );
+	const double warm_load_ms{ ms_since( start ) };
+	quadtree tree{ hm.get() };
+	start = clock_type::now();
+	tree.create();
+	const double tree_build_ms{ ms_since( start ) };
+
+	omath::daabb box;
+	hm->get_world_aabb( box );
+	camera_path path;
+	if( !o.path.empty() && !path.load( o.path ) ) {
+		std::cerr << "Could not load camera path '" << o.path << "'." << std::endl;
+		return 1;
+	}
+	if( o.path.empty() )
+		path = make_circle_path( box, o.frames, (float)o.fov );
+	const std::vector<camera_path::pose> &poses{ path.get_poses() };
+	const double far_plane{ box.get_diagonal_size() };
+	lod_selection selection{ make_view( poses.front(), o, far_plane ), settings::SORT_SELECTION };
+	// One tree, so there are no neighbouring tiles' errors
+	selection.set_metric( o.screen_space_error ? lod_selection::SCREEN_SPACE_ERROR : lod_selection::DISTANCE );
+	const unsigned int triangles_per_node{ settings::GRIDMESH_DIMENSION * settings::GRIDMESH_DIMENSION * 2 };
+	if( !o.shader_cache )
+		program_cache::set_directory( "" );
+	start = clock_type::now();
+#if TERRAIN_BENCH_HAVE_EGL
+	std::unique_ptr<render_path> renderer{ render ?
+			std::make_unique<render_path>( o.width, o.height, o.front_to_back, o.depth_prepass, o.hiz_culling ) : nullptr };
+#endif
+	const double render_setup_ms{ ms_since( start ) };
+
+	horizon_culling horizon;
+	std::vector<frame_stats> frames( poses.size() );
+	for( size_t f = 0; f < poses.size(); ++f ) {
+		frame_stats &s{ frames[f] };
+		selection.set_view( make_view( poses[f], o, far_plane ) );
+		start = clock_type::now();
+		selection.reset();
+		tree.lodSelect( &selection );
+		// As quadtree_forest::lod_select() with one tile
+		selection.m_visible_tiles.push_back( 0 );
+		selection.calculate_edge_morphs();
+		if( o.horizon_culling )
+			horizon.cull( &selection, triangles_per_node, poses[f].position );
+		selection.set_distances_and_sort();
+		s.select_ms = ms_since( start );
+#if TERRAIN_BENCH_HAVE_EGL
+		// Hierarchical z culling changes the selection
+		if( render )
+			s.render_ms = renderer->draw( selection, *hm, poses[f] );
+#endif
+		count( selection, triangles_per_node, s );
+	}
+
+	ray_stats rays;
+	if( o.rays > 0 )
+		rays = cast_rays( tree, *hm, make_rays( box, o.rays ) );
+	height_query_stats heights;
+	if( o.height_queries > 0 )
+		heights = query_heights( *hm, box, o.height_queries );
+
+	std::vector<double> select_ms, render_ms, nodes, triangles;
+	std::vector<double> level_nodes[settings::NUMBER_OF_LOD_LEVELS], level_triangles[settings::NUMBER_OF_LOD_LEVELS];
+	for( const frame_stats &s : frames ) {
+		select_ms.push_back( s.select_ms );
+		if( render )
+			render_ms.push_back( s.render_ms );
+		nodes.push_back( s.nodes );
+		triangles.push_back( s.triangles );
+		for( unsigned int l = 0; l < settings::NUMBER_OF_LOD_LEVELS; ++l ) {
+			level_nodes[l].push_back( s.level_nodes[l] );
+			level_triangles[l].push_back( s.level_triangles[l] );
+		}
+	}
+	std::ostringstream json;
+	json << std::fixed << std::setprecision( 4 );
+	json << "{\n\t\"heightmap\": \"" << o.heightmap << "\",\n\t\"extent\": [" << hm->get_extent().x << ", " <<
+			hm->get_extent().y << "],\n\t\"path\": \"" << ( o.path.empty() ? "circle" : o.path ) << "\",\n\t\"frames\": " <<
+			frames.size() << ",\n\t\"metric\": \"" << ( o.screen_space_error ? "screen_space_error" : "distance" ) <<
+			"\",\n\t\"horizon_culling\": " << ( o.horizon_culling ? "true" : "false" ) <<
+			",\n\t\"viewport\": [" << o.width << ", " << o.height << "],\n\t\"cold_load_ms\": " << cold_load_ms <<
+			",\n\t\"warm_load_ms\": " << warm_load_ms << ",\n\t\"tree_build_ms\": " << tree_build_ms <<
+			",\n\t\"tree_nodes\": " << tree.getNodeCount() << ",\n\t\"selection_ms\": " << summary( select_ms ) <<
+			",\n\t\"nodes\": " << summary( nodes ) << ",\n\t\"triangles\": " << summary( triangles ) <<
+			",\n\t\"levels\": [";
+	for( unsigned int l = 0; l < settings::NUMBER_OF_LOD_LEVELS; ++l )
+		json << ( l > 0 ? "," : "" ) << "\n\t\t{\"level\": " << l << ", \"nodes\": " << summary( level_nodes[l] ) <<
+				", \"triangles\": " << summary( level_triangles[l] ) << '}';
+	// Live kB at the end of the run and peak kB per subsystem
+	json << "\n\t],\n\t\"memory_kb\": {";
+	for( unsigned int i = 0; i < memory_tracker::NUMBER_OF_SUBSYSTEMS; ++i ) {
+		const memory_tracker::subsystem m{ (memory_tracker::subsystem)i };
+		json << ( i > 0 ? "," : "" ) << "\n\t\t\"" << memory_tracker::get_name( m ) << "\": {\"cpu\": " <<
+				memory_tracker::get_live_bytes( m, memory_tracker::CPU ) / 1024 << ", \"cpu_peak\": " <<
+				memory_tracker::get_peak_bytes( m, memory_tracker::CPU ) / 1024 << ", \"gpu\": " <<
+				memory_tracker::get_live_bytes( m, memory_tracker::GPU ) / 1024 << ", \"gpu_peak\": " <<
+				memory_tracker::get_peak_bytes( m, memory_tracker::GPU ) / 1024 << '}';
+	}
+	json << ",\n\t\t\"total\": {\"cpu\": " << memory_tracker::get_total_live_bytes( memory_tracker::CPU ) / 1024 <<
+			", \"cpu_peak\": " << memory_tracker::get_total_peak_bytes( memory_tracker::CPU ) / 1024 <<
+			", \"gpu\": " << memory_tracker::get_total_live_bytes( memory_tracker::GPU ) / 1024 <<
+			", \"gpu_peak\": " << memory_tracker::get_total_peak_bytes( memory_tracker::GPU ) / 1024 << "}\n\t},";
+	json << "\n\t\"render\": ";
+	if( render )
+		json << "{\"renderer\": \"" << gl_renderer << "\", \"front_to_back\": " <<
+				( o.front_to_back ? "true" : "false" ) << ", \"depth_prepass\": " << ( o.depth_prepass ? "true" : "false" ) <<
+				", \"hiz_culling\": " << ( o.hiz_culling ? "true" : "false" ) << ", \"setup_ms\": " << render_setup_ms <<
+				", \"cached_programs\": " << program_cache::get_hits() << ", \"ms\": " << summary( render_ms ) << '}';
+	else
+		json << "null";
+	json << ",\n\t\"raycast\": ";
+	if( o.rays > 0 )
+		json << "{\"rays\": " << o.rays << ", \"hits\": " << rays.hits << ", \"single_ms\": " << rays.single_ms <<
+				", \"single_rays_per_s\": " << o.rays / rays.single_ms * 1000.0 << ", \"batched_ms\": " << rays.batched_ms <<
+				", \"batched_rays_per_s\": " << o.rays / rays.batched_ms * 1000.0 << ", \"workers\": " <<
+				job_system::get_instance().get_number_of_workers() << ", \"checked\": " << rays.checked <<
+				", \"reference_rays_per_s\": " << rays.checked / rays.reference_ms * 1000.0 <<
+				", \"mismatches\": " << rays.mismatches << '}';
+	else
+		json << "null";
+	json << ",\n\t\"height_queries\": ";
+	if( o.height_queries > 0 ) {
+		const auto per_s = [&o]( const double ms ) {
+			return o.height_queries / ms * 1000.0;
+		};
+		json << "{\"queries\": " << o.height_queries << ", \"single_per_s\": " << per_s( heights.single_ms ) <<
+				", \"batched_per_s\": " << per_s( heights.batched_ms ) << ", \"single_normals_per_s\": " <<
+				per_s( heights.single_normals_ms ) << ", \"batched_normals_per_s\": " << per_s( heights.batched_normals_ms ) <<
+				", \"max_height_difference\": " << heights.max_height_difference <<
+				", \"max_normal_difference\": " << heights.max_normal_difference << '}';
+	} else
+		json << "null";
+	json << "\n}\n";
+	if( o.out.empty() )
+		std::cout << json.str();
+	else {
+		std::ofstream f{ o.out };
+		f << json.str();
+		if( !f.good() ) {
+			std::cerr << "Could not write '" << o.out << "'." << std::endl;
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,705 @@
+
+/* Offline terrain preprocessor.
+ * Splits a large 16 bit heightmap into tiles of tile size + 1 posts (neighbouring tiles share
+ * their edge posts) and writes per tile what the terrain renderer loads:
+ * 	<out>/tile_<size>_<index>.png	16 bit heights
+ * 	<out>/tile_<size>_<index>.bb	raster bounding box
+ * 	<out>/tile_<size>_<index>.mm	min/max pyramid for the quadtree
+ * 	<out>/tile_<size>_<index>.ctile	compressed container with heights and the pyramid, with --normals
+ * 									also a normal map. The renderer loads it instead of the png.
+ * Pipeline of a reader thread, a number of worker threads and a writer thread, connected by
+ * bounded queues. At most queue capacity tiles are in flight per stage. Tiles are read with a one
+ * post border, so normals at tile edges see the neighbouring tiles' posts.
+ * Raw input is read per tile, so memory does not depend on the input size. Png input is inflated
+ * row by row with zlib and a band of one tile row of source rows is kept, memory grows with the
+ * width only. Only non-interlaced grey pngs with 8 or 16 bits are supported.
+ * Usage:
+ * 	terrain_preprocessor <input.raw|input.png> <output dir> [--width w --height h] [--tile 4096]
+ * 		[--threads n] [--queue n] [--normals]
+ * Raw input is little endian uint16, row major, width and height in posts must be given. */
+
+#include "base/logbook.h"
+#include "base/async_reader.h"
+#include "applications/cdlod/settings.h"
+#include "applications/cdlod/min_max_map.h"
+#include "applications/cdlod/tile_container.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+
+using namespace orf_n;
+
+namespace {
+
+// Blocking queue with a maximum size. pop() returns false when closed and empty.
+template<typename T>
+class bounded_queue {
+public:
+	explicit bounded_queue( const size_t capacity ) : m_capacity{ capacity > 0 ? capacity : 1 } {}
+
+	void push( T &&item ) {
+		std::unique_lock<std::mutex> lock{ m_mutex };
+		m_not_full.wait( lock, [this]{ return m_items.size() < m_capacity; } );
+		m_items.push_back( std::move( item ) );
+		m_not_empty.notify_one();
+	}
+
+	bool pop( T &item ) {
+		std::unique_lock<std::mutex> lock{ m_mutex };
+		m_not_empty.wait( lock, [this]{ return m_closed || !m_items.empty(); } );
+		if( m_items.empty() )
+			return false;
+		item = std::move( m_items.front() );
+		m_items.pop_front();
+		m_not_full.notify_one();
+		return true;
+	}
+
+	void close() {
+		std::lock_guard<std::mutex> lock{ m_mutex };
+		m_closed = true;
+		m_not_empty.notify_all();
+	}
+
+private:
+	const size_t m_capacity;
+	std::deque<T> m_items;
+	std::mutex m_mutex;
+	std::condition_variable m_not_empty;
+	std::condition_variable m_not_full;
+	bool m_closed{ false };
+};
+
+typedef struct {
+	unsigned int index{ 0 };
+	omath::uvec2 origin;
+	// ( tile size + 3 )^2 posts, the tile and a one post border
+	std::vector<uint16_t> heights;
+} raw_tile;
+
+typedef struct {
+	unsigned int index{ 0 };
+	std::vector<uint8_t> png;
+	std::string bb;
+	std::string mm;
+	std::vector<uint8_t> container;
+} encoded_tile;
+
+// Busy time and bytes processed of a pipeline stage. Time is summed over the stage's threads.
+typedef struct {
+	std::atomic<uint64_t> bytes_in{ 0 };
+	std::atomic<uint64_t> bytes_out{ 0 };
+	std::atomic<uint64_t> nanoseconds{ 0 };
+	std::atomic<unsigned int> tiles{ 0 };
+} stage_stats;
+
+class stage_timer {
+public:
+	explicit stage_timer( stage_stats &s ) : m_stats{ s }, m_start{ std::chrono::steady_clock::now() } {}
+	~stage_timer() {
+		m_stats.nanoseconds += static_cast<uint64_t>( std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - m_start ).count() );
+	}
+private:
+	stage_stats &m_stats;
+	const std::chrono::steady_clock::time_point m_start;
+};
+
+// Source raster. Tiles are read with clamped edges, so the first/last row/column is replicated.
+class height_source {
+public:
+	virtual ~height_source() = default;
+	// Square of posts * posts from x0/z0, which may be outside the source by the border.
+	virtual bool read_tile( const int x0, const int z0, const unsigned int posts, std::vector<uint16_t> &out ) = 0;
+	omath::uvec2 m_extent{ 0, 0 };
+
+protected:
+	// Part of the tile that is inside the source, in source coordinates, [x0,x1)*[z0,z1)
+	void get_inside( const int x0, const int z0, const unsigned int posts,
+			unsigned int &sx0, unsigned int &sz0, unsigned int &sx1, unsigned int &sz1 ) const {
+		sx0 = unsigned( std::max( x0, 0 ) );
+		sz0 = unsigned( std::max( z0, 0 ) );
+		sx1 = unsigned( std::min<int64_t>( int64_t( x0 ) + posts, m_extent.x ) );
+		sz1 = unsigned( std::min<int64_t>( int64_t( z0 ) + posts, m_extent.y ) );
+	}
+
+	// The w * h posts at x/z of the tile are filled, copies their edges outwards.
+	static void replicate_edges( std::vector<uint16_t> &out, const unsigned int posts,
+			const unsigned int x, const unsigned int z, const unsigned int w, const unsigned int h ) {
+		for( unsigned int r = z; r < z + h; ++r ) {
+			uint16_t *row{ &out[size_t( r ) * posts] };
+			std::fill( row, row + x, row[x] );
+			std::fill( row + x + w, row + posts, row[x + w - 1] );
+		}
+		for( unsigned int r = 0; r < z; ++r )
+			std::copy( &out[size_t( z ) * posts], &out[size_t( z + 1 ) * posts], &out[size_t( r ) * posts] );
+		for( unsigned int r = z + h; r < posts; ++r )
+			std::copy( &out[size_t( z + h - 1 ) * posts], &out[size_t( z + h ) * posts], &out[size_t( r ) * posts] );
+	}
+};
+
+// Streams raw little endian uint16 files row by row through the async reader.
+class raw_source : public height_source {
+public:
+	raw_source( const std::string &filename, const omath::uvec2 &extent ) {
+		m_extent = extent;
+		m_fd = m_reader.open_file( filename );
+		if( m_fd >= 0 && m_reader.get_file_size( m_fd ) < uint64_t( extent.x ) * extent.y * sizeof( uint16_t ) ) {
+			logbook::log_msg( logbook::RESOURCE, logbook::ERROR, "'" + filename + "' is smaller than width * height * 2." );
+			m_reader.close_file( m_fd );
+			m_fd = -1;
+		}
+	}
+
+	virtual ~raw_source() {
+		m_reader.close_file( m_fd );
+	}
+
+	bool is_open() const {
+		return m_fd >= 0;
+	}
+
+	bool read_tile( const int x0, const int z0, const unsigned int posts, std::vector<uint16_t> &out ) override {
+		out.resize( size_t( posts ) * posts );
+		unsigned int sx0, sz0, sx1, sz1;
+		get_inside( x0, z0, posts, sx0, sz0, sx1, sz1 );
+		bool ok{ true };
+		std::vector<async_reader::read_request> requests( sz1 - sz0 );
+		for( unsigned int z = sz0; z < sz1; ++z ) {
+			async_reader::read_request &r{ requests[z - sz0] };
+			r.fd = m_fd;
+			r.offset = ( uint64_t( z ) * m_extent.x + sx0 ) * sizeof( uint16_t );
+			r.size = ( sx1 - sx0 ) * sizeof( uint16_t );
+			r.destination = &out[size_t( int( z ) - z0 ) * posts + ( int( sx0 ) - x0 )];
+			r.on_complete = [&ok]( const async_reader::read_request &req, long result ) {
+				if( result != static_cast<long>( req.size ) )
+					ok = false;
+			};
+		}
+		m_reader.submit( requests );
+		m_reader.wait_all();
+		replicate_edges( out, posts, int( sx0 ) - x0, int( sz0 ) - z0, sx1 - sx0, sz1 - sz0 );
+		return ok;
+	}
+
+private:
+	async_reader m_reader;
+	int m_fd{ -1 };
+};
+
+/* Inflates the png's image data with zlib as rows are needed and keeps a band of decoded rows.
+ * Rows are decoded once, so tiles must be read in row order. Rows above the requested ones are
+ * dropped from the band. */
+class png_source : public height_source {
+public:
+	png_source( const std::string &filename ) : m_filename{ filename } {
+		m_file.open( filename, std::ios::in | std::ios::binary );
+		static const uint8_t signature[]{ 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+		uint8_t head[8 + 8 + 13];
+		m_file.read( reinterpret_cast<char *>( head ), sizeof( head ) );
+		if( !m_file.good() || !std::equal( signature, signature + 8, head ) || 0 != std::memcmp( head + 12, "IHDR", 4 ) ) {
+			logbook::log_msg( logbook::RESOURCE, logbook::ERROR, "'" + filename + "' is not a png." );
+			return;
+		}
+		const uint8_t *ihdr{ head + 16 };
+		const uint8_t depth{ ihdr[8] }, colour_type{ ihdr[9] }, interlace{ ihdr[12] };
+		m_extent = omath::uvec2{ get_u32( ihdr ), get_u32( ihdr + 4 ) };
+		if( 0 != colour_type || ( 8 != depth && 16 != depth ) || 0 != interlace || 0 == m_extent.x || 0 == m_extent.y ) {
+			logbook::log_msg( logbook::RESOURCE, logbook::ERROR, "'" + filename +
+					"' is not a non-interlaced 8 or 16 bit grey png. Convert it to raw." );
+			return;
+		}
+		// Skip the IHDR crc
+		m_file.seekg( 4, std::ios::cur );
+		m_bytes_per_post = depth / 8;
+		m_previous.assign( size_t( m_extent.x ) * m_bytes_per_post, 0 );
+		m_current.resize( m_previous.size() );
+		m_input.resize( 64 * 1024 );
+		m_is_open = Z_OK == inflateInit( &m_stream );
+	}
+
+	virtual ~png_source() {
+		if( m_is_open )
+			inflateEnd( &m_stream );
+	}
+
+	bool is_open() const {
+		return m_is_open;
+	}
+
+	bool read_tile( const int x0, const int z0, const unsigned int posts, std::vector<uint16_t> &out ) override {
+		out.resize( size_t( posts ) * posts );
+		unsigned int sx0, sz0, sx1, sz1;
+		get_inside( x0, z0, posts, sx0, sz0, sx1, sz1 );
+		if( !decode_rows( sz0, sz1 ) )
+			return false;
+		for( unsigned int z = sz0; z < sz1; ++z ) {
+			const uint16_t *row{ &m_band[size_t( z - m_band_first ) * m_extent.x] };
+			std::copy( row + sx0, row + sx1, &out[size_t( int( z ) - z0 ) * posts + ( int( sx0 ) - x0 )] );
+		}
+		replicate_edges( out, posts, int( sx0 ) - x0, int( sz0 ) - z0, sx1 - sx0, sz1 - sz0 );
+		return true;
+	}
+
+private:
+	std::string m_filename;
+	std::ifstream m_file;
+	z_stream m_stream{};
+	bool m_is_open{ false };
+	unsigned int m_bytes_per_post{ 2 };
+	// Bytes left of the current IDAT chunk, and whether the reader is inside one.
+	uint32_t m_chunk_left{ 0 };
+	bool m_in_idat{ false };
+	std::vector<uint8_t> m_input;
+	// Unfiltered previous and current row
+	std::vector<uint8_t> m_previous;
+	std::vector<uint8_t> m_current;
+	// Decoded rows m_band_first.. and the next row to decode
+	std::vector<uint16_t> m_band;
+	unsigned int m_band_first{ 0 };
+	unsigned int m_next_row{ 0 };
+
+	static uint32_t get_u32( const uint8_t *p ) {
+		return uint32_t( p[0] ) << 24 | uint32_t( p[1] ) << 16 | uint32_t( p[2] ) << 8 | p[3];
+	}
+
+	// Band holds rows [first,last) afterwards.
+	bool decode_rows( const unsigned int first, const unsigned int last ) {
+		if( first < m_band_first ) {
+			logbook::log_msg( logbook::RESOURCE, logbook::ERROR, "Png rows of '" + m_filename + "' requested out of order." );
+			return false;
+		}
+		const unsigned int drop{ std::min( first, m_next_row ) - m_band_first };
+		m_band.erase( m_band.begin(), m_band.begin() + size_t( drop ) * m_extent.x );
+		m_band_first += drop;
+		std::vector<uint16_t> skipped( m_extent.x );
+		while( m_next_row < last ) {
+			uint16_t *row{ skipped.data() };
+			if( m_next_row >= first ) {
+				m_band.resize( m_band.size() + m_extent.x );
+				row = &m_band[m_band.size() - m_extent.x];
+			} else
+				++m_band_first;
+			if( !decode_row( row ) ) {
+				logbook::log_msg( logbook::RESOURCE, logbook::ERROR, "Error decoding '" + m_filename + "'." );
+				return false;
+			}
+			++m_next_row;
+		}
+		return true;
+	}
+
+	bool decode_row( uint16_t *out ) {
+		uint8_t filter;
+		if( !inflate_bytes( &filter, 1 ) || !inflate_bytes( m_current.data(), m_current.size() ) )
+			return false;
+		const size_t bpp{ m_bytes_per_post };
+		for( size_t i = 0; i < m_current.size(); ++i ) {
+			const int a{ i >= bpp ? m_current[i - bpp] : 0 };
+			const int b{ m_previous[i] };
+			const int c{ i >= bpp ? m_previous[i - bpp] : 0 };
+			switch( filter ) {
+				case 0: break;
+				case 1: m_current[i] = uint8_t( m_current[i] + a ); break;
+				case 2: m_current[i] = uint8_t( m_current[i] + b ); break;
+				case 3: m_current[i] = uint8_t( m_current[i] + ( a + b ) / 2 ); break;
+				case 4: {
+					// Paeth
+					const int p{ a + b - c }, pa{ std::abs( p - a ) }, pb{ std::abs( p - b ) }, pc{ std::abs( p - c ) };
+					m_current[i] = uint8_t( m_current[i] + ( pa <= pb && pa <= pc ? a : pb <= pc ? b : c ) );
+					break;
+				}
+				default: return false;
+			}
+		}
+		// Big endian samples, 8 bit ones scaled to 16 like stb does
+		for( unsigned int x = 0; x < m_extent.x; ++x )
+			out[x] = 2 == bpp ? uint16_t( m_current[x * 2] << 8 | m_current[x * 2 + 1] ) : uint16_t( m_current[x] * 257 );
+		std::swap( m_previous, m_current );
+		return true;
+	}
+
+	bool inflate_bytes( uint8_t *out, const size_t size ) {
+		m_stream.next_out = out;
+		m_stream.avail_out = static_cast<uInt>( size );
+		while( m_stream.avail_out > 0 ) {
+			if( 0 == m_stream.avail_in && !next_input() )
+				return false;
+			const int result{ inflate( &m_stream, Z_NO_FLUSH ) };
+			if( Z_STREAM_END == result )
+				return 0 == m_stream.avail_out;
+			if( Z_OK != result && Z_BUF_ERROR != result )
+				return false;
+		}
+		return true;
+	}
+
+	// Reads the next piece of image data, IDAT chunks may be split anywhere.
+	bool next_input() {
+		while( 0 == m_chunk_left ) {
+			if( m_in_idat )
+				m_file.seekg( 4, std::ios::cur );
+			uint8_t chunk[8];
+			m_file.read( reinterpret_cast<char *>( chunk ), sizeof( chunk ) );
+			if( !m_file.good() || 0 == std::memcmp( chunk + 4, "IEND", 4 ) )
+				return false;
+			m_in_idat = 0 == std::memcmp( chunk + 4, "IDAT", 4 );
+			if( m_in_idat )
+				m_chunk_left = get_u32( chunk );
+			else
+				m_file.seekg( std::streamoff( get_u32( chunk ) ) + 4, std::ios::cur );
+		}
+		const uint32_t n{ std::min<uint32_t>( m_chunk_left, static_cast<uint32_t>( m_input.size() ) ) };
+		m_file.read( reinterpret_cast<char *>( m_input.data() ), n );
+		m_chunk_left -= n;
+		m_stream.next_in = m_input.data();
+		m_stream.avail_in = n;
+		return m_file.good();
+	}
+};
+
+// Minimal 16 bit grey png writer. stb_image_write has no 16 bit support.
+// Uses stored (uncompressed) deflate blocks, the .ctile container is the compressed format.
+class png16_writer {
+public:
+	static void encode( const uint16_t *values, const omath::uvec2 &extent, std::vector<uint8_t> &out ) {
+		// Filter byte + big endian samples per row
+		std::vector<uint8_t> raw( size_t( extent.y ) * ( 1 + extent.x * 2 ) );
+		uint8_t *p{ raw.data() };
+		for( unsigned int z = 0; z < extent.y; ++z ) {
+			*p++ = 0;
+			for( unsigned int x = 0; x < extent.x; ++x ) {
+				const uint16_t v{ values[size_t( z ) * extent.x + x] };
+				*p++ = uint8_t( v >> 8 );
+				*p++ = uint8_t( v & 0xff );
+			}
+		}
+		std::vector<uint8_t> zlib;
+		zlib.reserve( raw.size() + raw.size() / 65535 * 5 + 16 );
+		zlib.push_back( 0x78 );
+		zlib.push_back( 0x01 );
+		for( size_t pos = 0; pos < raw.size(); ) {
+			const uint16_t n{ uint16_t( std::min<size_t>( 65535, raw.size() - pos ) ) };
+			zlib.push_back( pos + n >= raw.size() ? 1 : 0 );
+			zlib.push_back( uint8_t( n & 0xff ) );
+			zlib.push_back( uint8_t( n >> 8 ) );
+			zlib.push_back( uint8_t( ~n & 0xff ) );
+			zlib.push_back( uint8_t( uint16_t( ~n ) >> 8 ) );
+			zlib.insert( zlib.end(), raw.begin() + pos, raw.begin() + pos + n );
+			pos += n;
+		}
+		put_u32( zlib, adler32( raw.data(), raw.size() ) );
+
+		static const uint8_t signature[]{ 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+		out.assign( signature, signature + sizeof( signature ) );
+		std::vector<uint8_t> ihdr;
+		put_u32( ihdr, extent.x );
+		put_u32( ihdr, extent.y );
+		// bit depth 16, grey, deflate, adaptive filtering, no interlace
+		ihdr.insert( ihdr.end(), { 16, 0, 0, 0, 0 } );
+		put_chunk( out, "IHDR", ihdr );
+		put_chunk( out, "IDAT", zlib );
+		put_chunk( out, "IEND", std::vector<uint8_t>{} );
+	}
+
+private:
+	static void put_u32( std::vector<uint8_t> &out, const uint32_t v ) {
+		out.insert( out.end(), { uint8_t( v >> 24 ), uint8_t( v >> 16 ), uint8_t( v >> 8 ), uint8_t( v ) } );
+	}
+
+	static void put_chunk( std::vector<uint8_t> &out, const char *type, const std::vector<uint8_t> &data ) {
+		put_u32( out, static_cast<uint32_t>( data.size() ) );
+		const size_t start{ out.size() };
+		out.insert( out.end(), type, type + 4 );
+		out.insert( out.end(), data.begin(), data.end() );
+		put_u32( out, crc32( &out[start], out.size() - start ) );
+	}
+
+	static uint32_t crc32( const uint8_t *data, const size_t size ) {
+		static const std::vector<uint32_t> table{ []{
+			std::vector<uint32_t> t( 256 );
+			for( uint32_t n = 0; n < 256; ++n ) {
+				uint32_t c{ n };
+				for( int k = 0; k < 8; ++k )
+					c = c & 1 ? 0xedb88320u ^ ( c >> 1 ) : c >> 1;
+				t[n] = c;
+			}
+			return t;
+		}() };
+		uint32_t c{ 0xffffffffu };
+		for( size_t i = 0; i < size; ++i )
+			c = table[( c ^ data[i] ) & 0xff] ^ ( c >> 8 );
+		return c ^ 0xffffffffu;
+	}
+
+	static uint32_t adler32( const uint8_t *data, const size_t size ) {
+		uint32_t a{ 1 }, b{ 0 };
+		size_t i{ 0 };
+		while( i < size ) {
+			// 5552 is the largest n that can't overflow before the modulo
+			const size_t end{ std::min( size, i + 5552 ) };
+			for( ; i < end; ++i ) {
+				a += data[i];
+				b += a;
+			}
+			a %= 65521;
+			b %= 65521;
+		}
+		return ( b << 16 ) | a;
+	}
+};
+
+/* Normals by central differences in world units, two signed bytes (x, z) per post. The heights have a
+ * one post border around the extent, so edge posts use the same neighbours as in the adjacent tile. */
+void compute_normals( const uint16_t *h, const omath::uvec2 &extent, std::vector<int8_t> &out ) {
+	out.resize( size_t( extent.x ) * extent.y * 2 );
+	const size_t stride{ extent.x + 2 };
+	const double sx{ double( terrain::settings::HEIGHT_FACTOR ) / ( 2.0 * terrain::settings::RASTER_TO_WORLD_X ) };
+	const double sz{ double( terrain::settings::HEIGHT_FACTOR ) / ( 2.0 * terrain::settings::RASTER_TO_WORLD_Z ) };
+	for( unsigned int z = 0; z < extent.y; ++z )
+		for( unsigned int x = 0; x < extent.x; ++x ) {
+			const size_t i{ ( z + 1 ) * stride + x + 1 };
+			const double dx{ ( double( h[i + 1] ) - h[i - 1] ) * sx };
+			const double dz{ ( double( h[i + stride] ) - h[i - stride] ) * sz };
+			const double len{ std::sqrt( dx * dx + 1.0 + dz * dz ) };
+			out[( size_t( z ) * extent.x + x ) * 2] = int8_t( std::lround( -dx / len * 127.0 ) );
+			out[( size_t( z ) * extent.x + x ) * 2 + 1] = int8_t( std::lround( -dz / len * 127.0 ) );
+		}
+}
+
+// t.heights has a one post border around the tile's posts.
+encoded_tile process_tile( raw_tile &t, const unsigned int posts, const unsigned int tile_size, const bool normals ) {
+	encoded_tile e;
+	e.index = t.index;
+	const omath::uvec2 extent{ posts, posts };
+	terrain::tile_container c;
+	c.m_extent = extent;
+	c.m_heights.resize( size_t( posts ) * posts );
+	for( unsigned int z = 0; z < posts; ++z ) {
+		const uint16_t *row{ &t.heights[size_t( z + 1 ) * ( posts + 2 ) + 1] };
+		std::copy( row, row + posts, &c.m_heights[size_t( z ) * posts] );
+	}
+	const auto mm{ std::minmax_element( c.m_heights.begin(), c.m_heights.end() ) };
+	// Raster bounds from the tile origin to origin + tile size, the shared edge belongs to the next tile.
+	c.m_raster_aabb = omath::aabb{
+		omath::vec3{ float( t.origin.x ), float( *mm.first ), float( t.origin.y ) },
+		omath::vec3{ float( t.origin.x + tile_size ), float( *mm.second ), float( t.origin.y + tile_size ) }
+	};
+	std::ostringstream bb;
+	bb << c.m_raster_aabb.m_min.x << ' ' << c.m_raster_aabb.m_min.y << ' ' << c.m_raster_aabb.m_min.z << ' ' <<
+			c.m_raster_aabb.m_max.x << ' ' << c.m_raster_aabb.m_max.y << ' ' << c.m_raster_aabb.m_max.z << '\n';
+	e.bb = bb.str();
+	c.m_min_max_map = std::make_unique<terrain::min_max_map>(
+			c.m_heights.data(), extent, terrain::settings::LEAF_NODE_SIZE, terrain::settings::NUMBER_OF_LOD_LEVELS
+	);
+	std::ostringstream mmf;
+	c.m_min_max_map->write( mmf );
+	e.mm = mmf.str();
+	if( normals )
+		compute_normals( t.heights.data(), extent, c.m_normals );
+	png16_writer::encode( c.m_heights.data(), extent, e.png );
+	c.encode( e.container );
+	return e;
+}
+
+bool write_file( const std::string &filename, const void *data, const size_t size ) {
+	std::ofstream f{ filename, std::ios::out | std::ios::binary | std::ios::trunc };
+	if( f.is_open() )
+		f.write( static_cast<const char *>( data ), size );
+	if( !f.good() ) {
+		logbook::log_msg( logbook::RESOURCE, logbook::ERROR, "Error writing '" + filename + "'." );
+		return false;
+	}
+	return true;
+}
+
+void print_stage( const char *name, const stage_stats &s, const unsigned int threads ) {
+	const double busy{ double( s.nanoseconds ) * 1e-9 / threads };
+	std::ostringstream o;
+	o << std::fixed << std::setprecision( 1 ) << std::left << std::setw( 8 ) << name <<
+			s.tiles << " tiles, in " << double( s.bytes_in ) / 1048576.0 << " MB, out " <<
+			double( s.bytes_out ) / 1048576.0 << " MB, " << busy << " s busy, " <<
+			( busy > 0.0 ? double( s.bytes_in ) / 1048576.0 / busy : 0.0 ) << " MB/s, " <<
+			( busy > 0.0 ? s.tiles / busy : 0.0 ) << " tiles/s";
+	std::cout << o.str() << std::endl;
+	logbook::log_msg( o.str() );
+}
+
+bool parse_uint( const char *s, unsigned int &out ) {
+	char *end{ nullptr };
+	const unsigned long v{ std::strtoul( s, &end, 10 ) };
+	if( end == s || *end != '\0' || v == 0 )
+		return false;
+	out = static_cast<unsigned int>( v );
+	return true;
+}
+
+}
+
+int main( int argc, char **argv ) {
+	logbook::set_log_filename( "terrain_preprocessor.log" );
+	// Progress goes to stdout, details and errors to the log file
+	logbook::set_console_output( false );
+	std::string input, output;
+	omath::uvec2 raw_extent{ 0, 0 };
+	unsigned int tile_size{ 4096 };
+	unsigned int threads{ std::max( 1u, std::thread::hardware_concurrency() ) };
+	unsigned int queue_size{ 0 };
+	bool normals{ false };
+	bool args_ok{ true };
+	for( int i = 1; i < argc && args_ok; ++i ) {
+		const std::string a{ argv[i] };
+		const bool has_value{ i + 1 < argc };
+		if( "--width" == a && has_value )
+			args_ok = parse_uint( argv[++i], raw_extent.x );
+		else if( "--height" == a && has_value )
+			args_ok = parse_uint( argv[++i], raw_extent.y );
+		else if( "--tile" == a && has_value )
+			args_ok = parse_uint( argv[++i], tile_size );
+		else if( "--threads" == a && has_value )
+			args_ok = parse_uint( argv[++i], threads );
+		else if( "--queue" == a && has_value )
+			args_ok = parse_uint( argv[++i], queue_size );
+		else if( "--normals" == a )
+			normals = true;
+		else if( a.size() > 0 && a[0] != '-' && input.empty() )
+			input = a;
+		else if( a.size() > 0 && a[0] != '-' && output.empty() )
+			output = a;
+		else
+			args_ok = false;
+	}
+	const bool is_png{ input.size() > 4 && input.substr( input.size() - 4 ) == ".png" };
+	if( !args_ok || input.empty() || output.empty() || ( !is_png && ( 0 == raw_extent.x || 0 == raw_extent.y ) ) ||
+			tile_size % terrain::settings::LEAF_NODE_SIZE != 0 ) {
+		std::cerr << "Usage: " << argv[0] << " <input.raw|input.png> <output dir> [--width w --height h]"
+				" [--tile size] [--threads n] [--queue n] [--normals]\n"
+				"Raw input is little endian uint16 and needs width and height. Tile size must be a multiple of " <<
+				terrain::settings::LEAF_NODE_SIZE << "." << std::endl;
+		return EXIT_FAILURE;
+	}
+	if( 0 == queue_size )
+		queue_size = threads;
+
+	std::unique_ptr<height_source> source;
+	if( is_png ) {
+		std::unique_ptr<png_source> p{ std::make_unique<png_source>( input ) };
+		if( p->is_open() )
+			source = std::move( p );
+	} else {
+		std::unique_ptr<raw_source> r{ std::make_unique<raw_source>( input, raw_extent ) };
+		if( r->is_open() )
+			source = std::move( r );
+	}
+	if( nullptr == source ) {
+		std::cerr << "Could not open '" << input << "'. See the log file." << std::endl;
+		return EXIT_FAILURE;
+	}
+	const omath::uvec2 extent{ source->m_extent };
+	const unsigned int posts{ tile_size + 1 };
+	const omath::uvec2 tiles{
+		std::max( 1u, ( extent.x - 1 + tile_size - 1 ) / tile_size ),
+		std::max( 1u, ( extent.y - 1 + tile_size - 1 ) / tile_size )
+	};
+	{
+		std::ostringstream s;
+		s << "Preprocessing '" << input << "', " << extent.x << '*' << extent.y << " posts into " << tiles.x << '*' <<
+				tiles.y << " tiles of " << tile_size << ", " << threads << " worker threads, queue size " << queue_size << '.';
+		std::cout << s.str() << std::endl;
+		logbook::log_msg( s.str() );
+	}
+
+	bounded_queue<raw_tile> raw_queue{ queue_size };
+	bounded_queue<encoded_tile> encoded_queue{ queue_size };
+	stage_stats read_stats, process_stats, write_stats;
+	std::atomic<bool> failed{ false };
+	const auto start{ std::chrono::steady_clock::now() };
+
+	std::thread reader{ [&]{
+		for( unsigned int tz = 0; tz < tiles.y && !failed; ++tz )
+			for( unsigned int tx = 0; tx < tiles.x && !failed; ++tx ) {
+				raw_tile t;
+				t.index = tz * tiles.x + tx;
+				t.origin = omath::uvec2{ tx * tile_size, tz * tile_size };
+				{
+					stage_timer timer{ read_stats };
+					if( !source->read_tile( int( t.origin.x ) - 1, int( t.origin.y ) - 1, posts + 2, t.heights ) ) {
+						logbook::log_msg( logbook::RESOURCE, logbook::ERROR, "Error reading tile " + std::to_string( t.index ) );
+						failed = true;
+						break;
+					}
+				}
+				read_stats.bytes_out += t.heights.size() * sizeof( uint16_t );
+				read_stats.bytes_in += t.heights.size() * sizeof( uint16_t );
+				++read_stats.tiles;
+				raw_queue.push( std::move( t ) );
+			}
+		raw_queue.close();
+	} };
+
+	std::vector<std::thread> workers;
+	for( unsigned int i = 0; i < threads; ++i )
+		workers.emplace_back( [&]{
+			raw_tile t;
+			while( raw_queue.pop( t ) ) {
+				const size_t in{ t.heights.size() * sizeof( uint16_t ) };
+				encoded_tile e;
+				{
+					stage_timer timer{ process_stats };
+					e = process_tile( t, posts, tile_size, normals );
+				}
+				process_stats.bytes_in += in;
+				process_stats.bytes_out += e.png.size() + e.bb.size() + e.mm.size() + e.container.size();
+				++process_stats.tiles;
+				encoded_queue.push( std::move( e ) );
+			}
+		} );
+
+	std::thread writer{ [&]{
+		encoded_tile e;
+		while( encoded_queue.pop( e ) ) {
+			stage_timer timer{ write_stats };
+			const std::string base{ output + "/tile_" + std::to_string( tile_size ) + '_' + std::to_string( e.index ) };
+			bool ok{ write_file( base + ".png", e.png.data(), e.png.size() ) };
+			ok = ok && write_file( base + ".bb", e.bb.data(), e.bb.size() );
+			ok = ok && write_file( base + ".mm", e.mm.data(), e.mm.size() );
+			ok = ok && write_file( base + ".ctile", e.container.data(), e.container.size() );
+			if( !ok )
+				failed = true;
+			const size_t n{ e.png.size() + e.bb.size() + e.mm.size() + e.container.size() };
+			write_stats.bytes_in += n;
+			write_stats.bytes_out += n;
+			++write_stats.tiles;
+		}
+	} };
+
+	reader.join();
+	for( std::thread &w : workers )
+		w.join();
+	encoded_queue.close();
+	writer.join();
+
+	const double seconds{ std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count() };
+	print_stage( "read", read_stats, 1 );
+	print_stage( "process", process_stats, threads );
+	print_stage( "write", write_stats, 1 );
+	std::ostringstream s;
+	s << std::fixed << std::setprecision( 1 ) << "Total " << write_stats.tiles << " tiles in " << seconds << " s, " <<
+			double( extent.x ) * extent.y * sizeof( uint16_t ) / 1048576.0 / seconds << " MB/s of source data." <<
+			( failed ? " There were errors, see the log file." : "" );
+	std::cout << s.str() << std::endl;
+	logbook::log_msg( s.str() );
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}